@@ -0,0 +1,27 @@
+#!/bin/bash
+# Arithmetic benchmark: a loop counter updated in the shell with $(( ))
+# and (( )), against one expr process per update (the only way before).
+# Usage: bench/bench_arith.sh [iterations] [shell]
+
+ITERATIONS=${1:-100000}
+SHELL_BIN=${2:-./myshell}
+FORKS=$(( ITERATIONS / 100 ))
+
+ns() {
+    date +%s%N
+}
+
+start=$(ns)
+"$SHELL_BIN" -c "i=0; while test \$i -lt $ITERATIONS; do i=\$((i + 1)); done"
+end=$(ns)
+echo "i=\$((i + 1)):          $(( (end - start) / ITERATIONS )) ns per iteration"
+
+start=$(ns)
+"$SHELL_BIN" -c "i=0; while (( i < $ITERATIONS )); do (( i++ )); done"
+end=$(ns)
+echo "(( i < n )); (( i++ )): $(( (end - start) / ITERATIONS )) ns per iteration"
+
+start=$(ns)
+"$SHELL_BIN" -c "i=0; while test \$i -lt $FORKS; do expr \$i + 1 >/dev/null; i=\$((i + 1)); done"
+end=$(ns)
+echo "expr \$i + 1:           $(( (end - start) / FORKS )) ns per iteration"
@@ -0,0 +1,114 @@
+/**
+ * Command completion benchmark for myshell
+ * Puts a directory of generated executables (10k by default) on PATH in
+ * front of the system directories and times complete_commands(): the
+ * first call (full scan), warm lookups, and the call after one PATH
+ * directory changes. A rescan of every PATH directory, which is what an
+ * unindexed completer does per Tab, is timed for comparison.
+ *
+ * Usage: bench_complete [executables]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "complete.h"
+
+static const char *prefixes[] = {"g", "gi", "tool_01", "tool_01234", "ls", "zz", "py", "x"};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * The unindexed way: readdir + stat every PATH directory
+ */
+static int scan_path(const char *prefix) {
+    char *path = strdup(getenv("PATH"));
+    size_t prefix_len = strlen(prefix);
+    int count = 0;
+
+    for (char *dir = strtok(path, ":"); dir; dir = strtok(NULL, ":")) {
+        DIR *d = opendir(dir);
+        if (!d) continue;
+        struct dirent *ent;
+        while ((ent = readdir(d)) != NULL) {
+            struct stat st;
+            if (strncmp(ent->d_name, prefix, prefix_len) == 0 &&
+                fstatat(dirfd(d), ent->d_name, &st, 0) == 0 && S_ISREG(st.st_mode) && (st.st_mode & 0111)) {
+                count++;
+            }
+        }
+        closedir(d);
+    }
+    free(path);
+    return count;
+}
+
+int main(int argc, char **argv) {
+    int executables = (argc > 1) ? atoi(argv[1]) : 10000;
+    size_t nprefixes = sizeof(prefixes) / sizeof(prefixes[0]);
+    char dir[] = "/tmp/bench_complete_XXXXXX";
+    char file[512];
+    const char *const *names;
+
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    for (int i = 0; i < executables; i++) {
+        snprintf(file, sizeof(file), "%s/tool_%05d", dir, i);
+        int fd = open(file, O_CREAT | O_WRONLY, 0755);
+        if (fd >= 0) close(fd);
+    }
+    char path[4096];
+    snprintf(path, sizeof(path), "%s:/usr/local/bin:/usr/bin:/bin", dir);
+    setenv("PATH", path, 1);
+
+    double start = now();
+    int total = complete_commands("", &names);
+    printf("first call (scan + sort): %.2f ms, %d commands indexed\n", (now() - start) * 1e3, total);
+
+    int rounds = 10000;
+    for (size_t p = 0; p < nprefixes; p++) {
+        int count = 0;
+        start = now();
+        for (int r = 0; r < rounds; r++) {
+            count = complete_commands(prefixes[p], &names);
+        }
+        double indexed = (now() - start) / rounds;
+
+        start = now();
+        int scan_count = scan_path(prefixes[p]);
+        double scanned = now() - start;
+        printf("%-12s %5d matches: indexed %7.2f us | rescan %8.2f ms (%d)\n",
+               prefixes[p], count, indexed * 1e6, scanned * 1e3, scan_count);
+    }
+
+    // A new executable changes the directory's mtime: only it is rescanned
+    snprintf(file, sizeof(file), "%s/zz_new_tool", dir);
+    int fd = open(file, O_CREAT | O_WRONLY, 0755);
+    if (fd >= 0) close(fd);
+    start = now();
+    int found = complete_commands("zz_new", &names);
+    printf("after adding a file: %.2f ms (%d match)\n", (now() - start) * 1e3, found);
+
+    // Clean up
+    for (int i = 0; i < executables; i++) {
+        snprintf(file, sizeof(file), "%s/tool_%05d", dir, i);
+        unlink(file);
+    }
+    snprintf(file, sizeof(file), "%s/zz_new_tool", dir);
+    unlink(file);
+    rmdir(dir);
+    complete_free();
+    return 0;
+}
@@ -0,0 +1,104 @@
+/**
+ * Filename completion benchmark for myshell's directory cache
+ * Fills a directory with generated files (200k by default) and times
+ * dircache_match() for a prefix: how long until the first names arrive
+ * and until the scan is done, then a lookup from the cache. A plain
+ * readdir pass, which is what every Tab cost before, is timed for
+ * comparison.
+ *
+ * Usage: bench_dircache [files]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+#include "dircache.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void count_match(const char *name, void *arg) {
+    (void)name;  // Unused parameter
+    (*(int *)arg)++;
+}
+
+/**
+ * The uncached way: one readdir pass per Tab
+ */
+static int scan_dir(const char *dir, const char *prefix) {
+    size_t prefix_len = strlen(prefix);
+    int count = 0;
+    DIR *d = opendir(dir);
+    if (d == NULL) return 0;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (strncmp(ent->d_name, prefix, prefix_len) == 0) count++;
+    }
+    closedir(d);
+    return count;
+}
+
+int main(int argc, char **argv) {
+    int files = (argc > 1) ? atoi(argv[1]) : 200000;
+    char dir[] = "/tmp/bench_dircache_XXXXXX";
+    char file[512];
+    const char *prefix = "file_01";
+
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    for (int i = 0; i < files; i++) {
+        snprintf(file, sizeof(file), "%s/file_%06d", dir, i);
+        int fd = open(file, O_CREAT | O_WRONLY, 0644);
+        if (fd >= 0) close(fd);
+    }
+
+    double start = now();
+    int sync_count = scan_dir(dir, prefix);
+    printf("readdir pass:       %8.2f ms (%d matches)\n", (now() - start) * 1e3, sync_count);
+
+    size_t seen = 0;
+    int count = 0;
+    double first = 0;
+    start = now();
+    int state = dircache_match(dir, prefix, &seen, count_match, &count);
+    double returned = now() - start;
+    while (state == DIRCACHE_SCANNING) {
+        struct pollfd pfd = {dircache_fd(), POLLIN, 0};
+        poll(&pfd, 1, -1);
+        state = dircache_match(dir, prefix, &seen, count_match, &count);
+        if (first == 0 && seen > 0) first = now() - start;
+    }
+    double done = now() - start;
+    printf("first call returns: %8.2f ms\n", returned * 1e3);
+    printf("first names after:  %8.2f ms\n", first * 1e3);
+    printf("scan done after:    %8.2f ms (%d matches)\n", done * 1e3, count);
+
+    int rounds = 1000;
+    start = now();
+    for (int r = 0; r < rounds; r++) {
+        seen = 0;
+        count = 0;
+        dircache_match(dir, prefix, &seen, count_match, &count);
+    }
+    printf("cached lookup:      %8.2f us (%d matches)\n", (now() - start) / rounds * 1e6, count);
+
+    // Clean up
+    dircache_free();
+    for (int i = 0; i < files; i++) {
+        snprintf(file, sizeof(file), "%s/file_%06d", dir, i);
+        unlink(file);
+    }
+    rmdir(dir);
+    return 0;
+}
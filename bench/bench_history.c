@@ -0,0 +1,81 @@
+/**
+ * History insertion benchmark for myshell
+ * Appends generated command lines to a full history of HISTSIZE entries
+ * and reports ns/insert and peak RSS, next to the old fixed array that
+ * strdup'd every line and shifted the whole array once full.
+ *
+ * Usage: bench_history [histsize] [inserts]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "history.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long max_rss_kb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void make_line(char *buf, size_t size, long i) {
+    snprintf(buf, size, "grep -n pattern_%ld src/file_%ld.c | sort | head -n %ld",
+             i, i % 97, i % 13);
+}
+
+int main(int argc, char **argv) {
+    int histsize = (argc > 1) ? atoi(argv[1]) : 100000;
+    long inserts = (argc > 2) ? atol(argv[2]) : 1000000;
+    char line[256];
+
+    char env[32];
+    snprintf(env, sizeof(env), "%d", histsize);
+    setenv("HISTSIZE", env, 1);
+    setenv("HISTFILE", "", 1);
+    init_history();
+
+    double start = now();
+    for (long i = 0; i < inserts; i++) {
+        make_line(line, sizeof(line), i);
+        add_history(line);
+    }
+    double elapsed = now() - start;
+    printf("ring:  %ld inserts into HISTSIZE=%d: %.1f ns/insert, %d held, max RSS %ld KB\n",
+           inserts, histsize, elapsed * 1e9 / inserts, history_length(), max_rss_kb());
+    free_history();
+
+    // Old scheme: strdup per line, shift the array down when full. It is
+    // O(HISTSIZE) per insert, so only time a slice of the inserts.
+    long shift_inserts = inserts / 20 > histsize ? inserts / 20 : histsize + histsize / 10;
+    char **old = calloc(histsize, sizeof(char *));
+    int old_count = 0;
+    start = now();
+    for (long i = 0; i < shift_inserts; i++) {
+        make_line(line, sizeof(line), i);
+        if (old_count >= histsize) {
+            free(old[0]);
+            for (int j = 1; j < histsize; j++) {
+                old[j - 1] = old[j];
+            }
+            old_count--;
+        }
+        old[old_count++] = strdup(line);
+    }
+    elapsed = now() - start;
+    printf("shift: %ld inserts into HISTSIZE=%d: %.1f ns/insert\n",
+           shift_inserts, histsize, elapsed * 1e9 / shift_inserts);
+    for (int i = 0; i < old_count; i++) {
+        free(old[i]);
+    }
+    free(old);
+    return 0;
+}
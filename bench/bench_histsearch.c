@@ -0,0 +1,118 @@
+/**
+ * Ctrl-R search latency benchmark for myshell
+ * Fills the history with generated command lines, then "types" a few
+ * queries one character at a time, timing history_search() for every
+ * keystroke. A plain newest-first strstr scan over the same history is
+ * timed for comparison.
+ *
+ * Usage: bench_histsearch [entries]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "history.h"
+#include "histsearch.h"
+
+static const char *queries[] = {
+    "git commit",
+    "make -j",
+    "grep -rn handler_77",
+    "ssh build-host-1234",
+    "docker run --rm img",
+    "zzz no such command",
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned int rng = 12345;
+
+static unsigned int next_rand(void) {
+    rng = rng * 1103515245u + 12345u;
+    return (rng >> 8) & 0xffffff;
+}
+
+static void make_line(char *buf, size_t size) {
+    unsigned int r = next_rand();
+    switch (r % 8) {
+    case 0: snprintf(buf, size, "git commit -m 'fix bug %u'", next_rand() % 5000); break;
+    case 1: snprintf(buf, size, "make -j%u target_%u", 1 + r % 16, next_rand() % 300); break;
+    case 2: snprintf(buf, size, "grep -rn handler_%u src/module_%u", next_rand() % 1000, r % 50); break;
+    case 3: snprintf(buf, size, "ssh build-host-%u uptime", next_rand() % 10000); break;
+    case 4: snprintf(buf, size, "docker run --rm img_%u sh -c 'echo %u'", r % 200, next_rand()); break;
+    case 5: snprintf(buf, size, "cd /srv/project_%u/src", next_rand() % 3000); break;
+    case 6: snprintf(buf, size, "vim notes_%u.md", next_rand() % 800); break;
+    default: snprintf(buf, size, "ls -la /var/log/app_%u", next_rand() % 400); break;
+    }
+}
+
+/**
+ * The unindexed way: newest first, strstr every line until enough matches
+ */
+static int linear_search(const char *query, int *matches, int max) {
+    int n = 0;
+    for (int i = history_length() - 1; i >= 0 && n < max; i--) {
+        if (strstr(history_get(i), query)) {
+            matches[n++] = i;
+        }
+    }
+    return n;
+}
+
+static void type_query(const char *query, int (*search)(const char *, int *, int),
+                       double *total, double *worst, int *keys) {
+    char typed[128];
+    int matches[HISTSEARCH_MAX_MATCHES];
+    size_t len = strlen(query);
+
+    for (size_t i = 1; i <= len && i < sizeof(typed); i++) {
+        memcpy(typed, query, i);
+        typed[i] = '\0';
+        double start = now();
+        search(typed, matches, HISTSEARCH_MAX_MATCHES);
+        double elapsed = now() - start;
+        *total += elapsed;
+        if (elapsed > *worst) *worst = elapsed;
+        (*keys)++;
+    }
+}
+
+int main(int argc, char **argv) {
+    int entries = (argc > 1) ? atoi(argv[1]) : 1000000;
+    char env[32], line[256];
+    size_t nqueries = sizeof(queries) / sizeof(queries[0]);
+
+    snprintf(env, sizeof(env), "%d", entries);
+    setenv("HISTSIZE", env, 1);
+    setenv("HISTFILE", "", 1);
+    init_history();
+
+    double start = now();
+    for (int i = 0; i < entries; i++) {
+        make_line(line, sizeof(line));
+        add_history(line);
+    }
+    double fill = now() - start;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("filled %d entries in %.2f s, max RSS %ld KB\n", history_length(), fill, usage.ru_maxrss);
+
+    for (size_t q = 0; q < nqueries; q++) {
+        double total = 0, worst = 0, lin_total = 0, lin_worst = 0;
+        int keys = 0, lin_keys = 0;
+        type_query(queries[q], history_search, &total, &worst, &keys);
+        type_query(queries[q], linear_search, &lin_total, &lin_worst, &lin_keys);
+        printf("%-22s indexed: mean %7.1f us, worst %8.1f us | scan: mean %8.1f us, worst %8.1f us\n",
+               queries[q], total * 1e6 / keys, worst * 1e6, lin_total * 1e6 / lin_keys, lin_worst * 1e6);
+    }
+
+    free_history();
+    return 0;
+}
@@ -0,0 +1,123 @@
+/**
+ * Keystroke-to-echo latency benchmark for myshell's line editor
+ * Runs the shell on a pseudo-terminal, types characters one at a time
+ * and times how long each takes to come back, along with how many
+ * read(2) calls (roughly, terminal writes) the echo arrived in.
+ *
+ * Usage: bench_keylatency [keystrokes] [shell]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <pty.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Read from the terminal until `expect` shows up (or 2s pass)
+ * @return: Number of reads it took, or -1 on timeout
+ */
+static int wait_for(int fd, const char *expect) {
+    char buf[4096];
+    char seen[8192];
+    size_t seen_len = 0;
+    int reads = 0;
+
+    while (1) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, 2000) <= 0) {
+            return -1;
+        }
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) {
+            return -1;
+        }
+        reads++;
+        if (seen_len + n >= sizeof(seen)) {
+            seen_len = 0;
+        }
+        memcpy(seen + seen_len, buf, n);
+        seen_len += n;
+        seen[seen_len] = '\0';
+        if (strstr(seen, expect)) {
+            return reads;
+        }
+    }
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv) {
+    int keystrokes = (argc > 1) ? atoi(argv[1]) : 2000;
+    const char *shell = (argc > 2) ? argv[2] : "./myshell";
+    struct winsize ws = {24, 200, 0, 0};
+    int fd;
+
+    pid_t pid = forkpty(&fd, NULL, NULL, &ws);
+    if (pid < 0) {
+        perror("forkpty");
+        return 1;
+    }
+    if (pid == 0) {
+        setenv("HISTFILE", "", 1);
+        setenv("TERM", "xterm", 1);
+        execl(shell, shell, (char *)NULL);
+        _exit(127);
+    }
+
+    if (wait_for(fd, "myshell> ") < 0) {
+        fprintf(stderr, "no prompt from %s\n", shell);
+        return 1;
+    }
+
+    double *latency = malloc(sizeof(double) * keystrokes);
+    long total_reads = 0;
+    int measured = 0;
+    for (int i = 0; i < keystrokes; i++) {
+        // Start a fresh line now and then so it never scrolls
+        if (i % 100 == 99) {
+            if (write(fd, "\x15", 1) != 1 || wait_for(fd, "\x1b[K") < 0) break;
+            continue;
+        }
+        char c = 'a' + i % 26;
+        char expect[2] = {c, '\0'};
+        double start = now();
+        if (write(fd, &c, 1) != 1) break;
+        int reads = wait_for(fd, expect);
+        if (reads < 0) break;
+        latency[measured++] = now() - start;
+        total_reads += reads;
+    }
+
+    if (write(fd, "\x15" "exit\r", 6) != 6 || wait_for(fd, "Goodbye") < 0) {
+        kill(pid, SIGTERM);
+    }
+    waitpid(pid, NULL, 0);
+
+    if (measured == 0) {
+        fprintf(stderr, "no echoes measured\n");
+        return 1;
+    }
+    qsort(latency, measured, sizeof(double), compare_doubles);
+    double sum = 0;
+    for (int i = 0; i < measured; i++) sum += latency[i];
+    printf("%d keystrokes: mean %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us, %.2f reads/key\n",
+           measured, sum / measured * 1e6, latency[measured / 2] * 1e6,
+           latency[(int)(measured * 0.99)] * 1e6, latency[measured - 1] * 1e6,
+           (double)total_reads / measured);
+    free(latency);
+    return 0;
+}
@@ -0,0 +1,64 @@
+/**
+ * Launch microbenchmark for myshell
+ * Compares the old fork()+execvp path with the posix_spawn launch engine,
+ * optionally after inflating the parent's RSS (fork cost grows with it).
+ *
+ * Usage: bench_launch [launches] [ballast_mb]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "launch.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run_fork(char **argv) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    waitpid(pid, NULL, 0);
+}
+
+static void run_spawn(char **argv) {
+    pid_t pid = launch_process(argv, NULL);
+    if (pid > 0) {
+        waitpid(pid, NULL, 0);
+    }
+}
+
+static void report(const char *name, void (*fn)(char **), char **argv, int n) {
+    double start = now();
+    for (int i = 0; i < n; i++) {
+        fn(argv);
+    }
+    double elapsed = now() - start;
+    printf("  %-18s %8.0f launches/sec\n", name, n / elapsed);
+}
+
+int main(int argc, char **argv) {
+    int n = (argc > 1) ? atoi(argv[1]) : 2000;
+    size_t ballast_mb = (argc > 2) ? (size_t)atoi(argv[2]) : 0;
+    char *cmd[] = {"true", NULL};
+
+    if (ballast_mb > 0) {
+        // Touch every page so it is really part of the RSS
+        char *ballast = malloc(ballast_mb << 20);
+        if (ballast) memset(ballast, 1, ballast_mb << 20);
+    }
+
+    printf("%d launches of 'true', %zu MB ballast\n", n, ballast_mb);
+    report("fork+execvp", run_fork, cmd, n);
+    report("launch_process", run_spawn, cmd, n);
+    return 0;
+}
@@ -0,0 +1,96 @@
+/**
+ * Lexer throughput benchmark for myshell
+ * Lexes a generated multi-megabyte script line by line and reports
+ * MB/s and tokens/s, next to a plain strtok split of the same text.
+ *
+ * Usage: bench_lexer [megabytes]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arena.h"
+#include "lexer.h"
+#include "expand.h"
+
+static const char *samples[] = {
+    "echo line with some plain words here",
+    "cat <input.txt|sort|uniq -c >>out_$HOME.txt",
+    "grep -v 'quoted pattern' file 2>/dev/null | head -n 10 | wc -l",
+    "ls -la \"${HOME}/dir with spaces\" /tmp &",
+    "printf '%s\\n' a\\ b \"c $USER d\"",
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    size_t target = (size_t)((argc > 1) ? atoi(argv[1]) : 8) << 20;
+    size_t nsamples = sizeof(samples) / sizeof(samples[0]);
+    char *script = malloc(target + 256);
+    size_t size = 0, lines = 0;
+
+    while (size < target) {
+        const char *s = samples[lines++ % nsamples];
+        size_t n = strlen(s);
+        memcpy(script + size, s, n);
+        script[size + n] = '\n';
+        size += n + 1;
+    }
+    script[size] = '\0';
+
+    char *work = malloc(size + 1);
+    arena_t arena;
+    arena_init(&arena);
+    long tokens = 0;
+    double start, elapsed;
+
+    // Lexer + expansion of every word
+    memcpy(work, script, size + 1);
+    start = now();
+    for (char *line = work, *next; line && *line; line = next) {
+        next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+        token_t *toks;
+        int n = lex_line(&arena, line, &toks);
+        for (int i = 0; i < n; i++) {
+            if (toks[i].type == TOK_WORD) expand_word(&arena, &toks[i]);
+        }
+        tokens += n;
+        arena_reset(&arena);
+    }
+    elapsed = now() - start;
+    printf("%zu lines, %.1f MB\n", lines, size / 1048576.0);
+    printf("  %-22s %8.1f MB/s %10.0f tokens/s\n", "lex_line+expand_word",
+           size / 1048576.0 / elapsed, tokens / elapsed);
+
+    // Reference: the old model, strtok on whitespace plus a 4096-byte
+    // expansion buffer per token (no quoting, no operators)
+    memcpy(work, script, size + 1);
+    tokens = 0;
+    start = now();
+    for (char *line = work, *next; line && *line; line = next) {
+        next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+        char *save;
+        for (char *t = strtok_r(line, " \t", &save); t; t = strtok_r(NULL, " \t", &save)) {
+            char *copy = malloc(4096);
+            strcpy(copy, t);
+            free(copy);
+            tokens++;
+        }
+    }
+    elapsed = now() - start;
+    printf("  %-22s %8.1f MB/s %10.0f tokens/s\n", "strtok+malloc (old)",
+           size / 1048576.0 / elapsed, tokens / elapsed);
+
+    arena_free(&arena);
+    free(work);
+    free(script);
+    return 0;
+}
@@ -0,0 +1,46 @@
+#!/bin/bash
+# Command-list benchmark: chained steps in one shell against one shell
+# per step, and { } groups (run in the shell) against ( ) subshells
+# (one fork each).
+# Usage: bench/bench_list.sh [iterations] [shell]
+
+ITERATIONS=${1:-500}
+SHELL_BIN=${2:-./myshell}
+SCRIPT=$(mktemp)
+
+ns() {
+    date +%s%N
+}
+
+start=$(ns)
+for ((i = 0; i < ITERATIONS; i++)); do
+    "$SHELL_BIN" -c 'cd /tmp' && "$SHELL_BIN" -c 'true' && "$SHELL_BIN" -c 'echo done >/dev/null'
+done
+end=$(ns)
+echo "3 steps, one shell each:        $(( (end - start) / ITERATIONS / 1000 )) us"
+
+start=$(ns)
+for ((i = 0; i < ITERATIONS; i++)); do
+    "$SHELL_BIN" -c 'cd /tmp && true && echo done >/dev/null'
+done
+end=$(ns)
+echo "3 steps, one shell with &&:     $(( (end - start) / ITERATIONS / 1000 )) us"
+
+LINES=$(( ITERATIONS * 20 ))
+for ((i = 0; i < LINES; i++)); do
+    echo "{ true; echo line $i; } >/dev/null"
+done > "$SCRIPT"
+start=$(ns)
+"$SHELL_BIN" "$SCRIPT"
+end=$(ns)
+echo "{ group; } per line:            $(( (end - start) / LINES / 1000 )) us"
+
+for ((i = 0; i < LINES; i++)); do
+    echo "( true; echo line $i ) >/dev/null"
+done > "$SCRIPT"
+start=$(ns)
+"$SHELL_BIN" "$SCRIPT"
+end=$(ns)
+echo "( subshell ) per line:          $(( (end - start) / LINES / 1000 )) us"
+
+rm -f "$SCRIPT"
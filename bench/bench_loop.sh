@@ -0,0 +1,61 @@
+#!/bin/bash
+# Control-flow benchmark: a `for` loop compiled once and run by the VM
+# (with an empty body, then a builtin-only one) against the same commands
+# written out one line per item (each line parsed and evaluated on its
+# own), plus a function called in a loop. Each case is timed net of a
+# zero-iteration run of the same script, so shell startup and reading the
+# item list are not counted.
+# Usage: bench/bench_loop.sh [items] [shell]
+
+ITEMS=${1:-100000}
+SHELL_BIN=${2:-./myshell}
+SCRIPT=$(mktemp)
+
+ns() {
+    date +%s%N
+}
+
+# Run $SCRIPT; prints the elapsed ns
+run_script() {
+    local start end
+    start=$(ns)
+    "$SHELL_BIN" "$SCRIPT"
+    end=$(ns)
+    echo $(( end - start ))
+}
+
+# Print one result line from the full and zero-iteration times
+report() {
+    local label=$1 full=$2 empty=$3
+    local net=$(( full - empty ))
+    (( net > 0 )) || net=1
+    printf '%-22s %6d ns per iteration, %9d iterations/s\n' \
+        "$label:" $(( net / ITEMS )) $(( ITEMS * 1000000000 / net ))
+}
+
+LIST=$(seq 1 "$ITEMS" | tr '\n' ' ')
+
+# Loop over $L, then the same script with nothing to loop over
+time_loop() {
+    local label=$1 prelude=$2 body=$3 full empty
+    printf 'L="%s"\n%s\nfor i in $L; do %s; done\n' "$LIST" "$prelude" "$body" > "$SCRIPT"
+    full=$(run_script)
+    printf 'L="%s"\n%s\nfor i in $NONE; do %s; done\n' "$LIST" "$prelude" "$body" > "$SCRIPT"
+    empty=$(run_script)
+    report "$label" "$full" "$empty"
+}
+
+time_loop "empty loop" "" ":"
+time_loop "builtin body" "" 'if test $i = 0; then echo zero; fi'
+
+for ((i = 1; i <= ITEMS; i++)); do
+    echo "if test $i = 0; then echo zero; fi"
+done > "$SCRIPT"
+full=$(run_script)
+: > "$SCRIPT"
+empty=$(run_script)
+report "one line per item" "$full" "$empty"
+
+time_loop "function call in loop" 'check() { if test "$1" = 0; then echo zero; fi; }' 'check $i'
+
+rm -f "$SCRIPT"
@@ -0,0 +1,48 @@
+#!/bin/bash
+# Parse benchmark: allocations per line and parse throughput
+# Runs `myshell -n` (parse only) over a generated script.
+# Usage: bench/bench_parse.sh [lines] [shell]
+
+LINES=${1:-200000}
+SHELL_BIN=${2:-./myshell}
+SCRIPT=$(mktemp)
+EMPTY=$(mktemp)
+
+for ((i = 0; i < LINES; i++)); do
+    case $((i % 4)) in
+        0) echo "echo line $i with some words here" ;;
+        1) echo "cat < input_$i.txt | sort | uniq -c > out_\$HOME.txt" ;;
+        2) echo "grep -v pattern file_$i | head -n 10 | wc -l" ;;
+        3) echo "ls -la \${HOME}/dir_$i /tmp &" ;;
+    esac
+done > "$SCRIPT"
+
+# Allocations: subtract the cost of running an empty script
+base=$(LD_PRELOAD=bench/preload_malloc_count.so "$SHELL_BIN" -n "$EMPTY" 2>&1 | sed -n 's/.*total=//p')
+total=$(LD_PRELOAD=bench/preload_malloc_count.so "$SHELL_BIN" -n "$SCRIPT" 2>&1 | sed -n 's/.*total=//p')
+echo "$LINES lines, $(wc -c < "$SCRIPT") bytes"
+awk -v t="$total" -v b="$base" -v n="$LINES" 'BEGIN { printf "  allocations/line:  %.3f\n", (t - b) / n }'
+
+start=$(date +%s%N)
+"$SHELL_BIN" -n "$SCRIPT"
+end=$(date +%s%N)
+echo "  parse throughput:  $(( LINES * 1000000000 / (end - start) )) lines/sec"
+
+# Repeated lines (history re-runs, generated loops): served by the parse cache
+for ((i = 0; i < LINES; i++)); do
+    echo "grep -v pattern file_$((i % 100)) | head -n 10 | wc -l > out_\$HOME.txt"
+done > "$SCRIPT"
+
+start=$(date +%s%N)
+"$SHELL_BIN" -n "$SCRIPT"
+end=$(date +%s%N)
+echo "$LINES lines, 100 distinct"
+echo "  parse throughput:  $(( LINES * 1000000000 / (end - start) )) lines/sec"
+# Hit rate, measured with cheap builtin lines
+for ((i = 0; i < 1000; i++)); do
+    echo "rehash file_$((i % 100))"
+done > "$SCRIPT"
+echo "parsecache" >> "$SCRIPT"
+"$SHELL_BIN" "$SCRIPT" | grep -E "hits|misses|hit rate" | sed 's/^/  /'
+
+rm -f "$SCRIPT" "$EMPTY"
@@ -0,0 +1,31 @@
+#!/bin/bash
+# rc load benchmark: time to start a shell that sources a 200-line ~/.myshellrc
+# made of echo/printf/test/pwd lines (all builtins, so no process should be spawned)
+# Usage: bench/bench_rc.sh [count] [shell]
+
+COUNT=${1:-200}
+SHELL_BIN=$(realpath "${2:-./myshell}")
+LINES=200
+
+HOME_DIR=$(mktemp -d)
+trap 'rm -rf "$HOME_DIR"' EXIT
+
+for ((i = 0; i < LINES; i++)); do
+    case $((i % 5)) in
+        0) echo "echo line $i > /dev/null" ;;
+        1) echo "printf '%s %d\\n' item $i > /dev/null" ;;
+        2) echo "test -d /tmp" ;;
+        3) echo "[ $i -gt 10 ]" ;;
+        4) echo "pwd > /dev/null" ;;
+    esac
+done > "$HOME_DIR/.myshellrc"
+
+start=$(date +%s%N)
+for ((i = 0; i < COUNT; i++)); do
+    HOME="$HOME_DIR" "$SHELL_BIN" --rc -c true
+done
+end=$(date +%s%N)
+
+echo "$COUNT startups with a $LINES-line rc"
+echo "  $(( (end - start) / COUNT / 1000 )) us per startup"
+echo "  $(( COUNT * 1000000000 / (end - start) )) startups/sec"
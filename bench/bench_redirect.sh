@@ -0,0 +1,33 @@
+#!/bin/bash
+# Redirection benchmark: logging from a script, reopening the log on every
+# line (echo ... >>log) against a descriptor opened once (exec 3>>log,
+# then echo ... >&3).
+# Usage: bench/bench_redirect.sh [lines] [shell]
+
+LINES=${1:-100000}
+SHELL_BIN=${2:-./myshell}
+SCRIPT=$(mktemp)
+LOG=$(mktemp)
+
+run() {
+    : > "$LOG"
+    start=$(date +%s%N)
+    "$SHELL_BIN" "$SCRIPT"
+    end=$(date +%s%N)
+    echo "  $1 $(( (end - start) / LINES )) ns/line ($(wc -l < "$LOG") lines logged)"
+}
+
+echo "$LINES log lines"
+
+for ((i = 0; i < LINES; i++)); do
+    echo "echo line $i >>$LOG"
+done > "$SCRIPT"
+run "reopen (>>log):      "
+
+echo "exec 3>>$LOG" > "$SCRIPT"
+for ((i = 0; i < LINES; i++)); do
+    echo "echo line $i >&3"
+done >> "$SCRIPT"
+run "exec 3>>log, >&3:    "
+
+rm -f "$SCRIPT" "$LOG"
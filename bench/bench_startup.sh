@@ -0,0 +1,21 @@
+#!/bin/bash
+# Startup benchmark: invocations/sec of `myshell -c true`
+# Usage: bench/bench_startup.sh [count] [shell]
+
+COUNT=${1:-2000}
+SHELL_BIN=${2:-./myshell}
+
+run() {
+    local start end
+    start=$(date +%s%N)
+    for ((i = 0; i < COUNT; i++)); do
+        "$@"
+    done
+    end=$(date +%s%N)
+    echo "$(( COUNT * 1000000000 / (end - start) )) invocations/sec"
+}
+
+echo "$COUNT invocations"
+printf "  %-24s " "$SHELL_BIN -c true"; run "$SHELL_BIN" -c true
+printf "  %-24s " "(spawn, no tail exec)";  run "$SHELL_BIN" -c $'true\ncd .'
+printf "  %-24s " "/bin/true (floor)";  run /bin/true
@@ -0,0 +1,28 @@
+#!/bin/bash
+# Command substitution benchmark: $(echo x) runs a pure builtin in the
+# shell with no process at all, $(basename /a/b) spawns the command
+# directly, and $(f) (a function) forks a subshell.
+# Usage: bench/bench_subst.sh [iterations] [shell]
+
+ITERATIONS=${1:-20000}
+SHELL_BIN=${2:-./myshell}
+SPAWNS=$(( ITERATIONS / 10 ))
+
+ns() {
+    date +%s%N
+}
+
+start=$(ns)
+"$SHELL_BIN" -c "i=0; while test \$i -lt $ITERATIONS; do x=\$(echo x); i=\$((i + 1)); done"
+end=$(ns)
+echo "x=\$(echo x):         $(( (end - start) / ITERATIONS )) ns per iteration"
+
+start=$(ns)
+"$SHELL_BIN" -c "i=0; while test \$i -lt $SPAWNS; do x=\$(basename /a/b); i=\$((i + 1)); done"
+end=$(ns)
+echo "x=\$(basename /a/b):  $(( (end - start) / SPAWNS )) ns per iteration"
+
+start=$(ns)
+"$SHELL_BIN" -c "f() { echo x; }; i=0; while test \$i -lt $SPAWNS; do x=\$(f); i=\$((i + 1)); done"
+end=$(ns)
+echo "x=\$(f):              $(( (end - start) / SPAWNS )) ns per iteration"
@@ -0,0 +1,69 @@
+/**
+ * Variable lookup and environment benchmark for myshell
+ * Puts a number of variables (200 by default) in the environment and
+ * times vars_get() against getenv() (a linear scan of environ), then
+ * vars_environ() when nothing changed against a rebuild after every
+ * assignment to an exported variable.
+ *
+ * Usage: bench_vars [variables]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vars.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    int variables = (argc > 1) ? atoi(argv[1]) : 200;
+    char name[64], value[64];
+    int rounds = 1000000;
+    volatile size_t sink = 0;
+
+    for (int i = 0; i < variables; i++) {
+        snprintf(name, sizeof(name), "BENCH_VAR_%d", i);
+        snprintf(value, sizeof(value), "value_%d", i);
+        setenv(name, value, 1);
+    }
+    snprintf(name, sizeof(name), "BENCH_VAR_%d", variables - 1);
+
+    double start = now();
+    for (int r = 0; r < rounds; r++) {
+        sink += (size_t)getenv(name);
+    }
+    double scan = (now() - start) / rounds;
+
+    start = now();
+    for (int r = 0; r < rounds; r++) {
+        sink += (size_t)vars_get(name);
+    }
+    double hashed = (now() - start) / rounds;
+    printf("lookup of the last of %d variables: getenv %.1f ns | vars_get %.1f ns\n",
+           variables, scan * 1e9, hashed * 1e9);
+
+    rounds = 100000;
+    start = now();
+    for (int r = 0; r < rounds; r++) {
+        sink += (size_t)vars_environ();
+    }
+    double cached = (now() - start) / rounds;
+
+    start = now();
+    for (int r = 0; r < rounds; r++) {
+        vars_set("BENCH_CHANGED", "x", VAR_EXPORT);
+        sink += (size_t)vars_environ();
+    }
+    double rebuilt = (now() - start) / rounds;
+    printf("envp per spawn: cached %.1f ns | rebuilt after an export %.1f ns\n",
+           cached * 1e9, rebuilt * 1e9);
+
+    vars_free();
+    return sink == 0;
+}
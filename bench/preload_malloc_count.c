@@ -0,0 +1,61 @@
+/**
+ * LD_PRELOAD shim that counts malloc/calloc/realloc calls
+ * Prints the totals to stderr when the process exits.
+ *
+ * Usage: LD_PRELOAD=bench/preload_malloc_count.so ./myshell ...
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <dlfcn.h>
+
+static unsigned long mallocs, callocs, reallocs;
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+
+// dlsym itself may calloc before real_calloc is known
+static char bootstrap[4096];
+static size_t bootstrap_used;
+
+void *malloc(size_t size) {
+    if (!real_malloc) real_malloc = dlsym(RTLD_NEXT, "malloc");
+    mallocs++;
+    return real_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    if (!real_calloc) {
+        static int resolving;
+        if (resolving) {
+            void *p = bootstrap + bootstrap_used;
+            bootstrap_used += (n * size + 15) & ~(size_t)15;
+            return p;
+        }
+        resolving = 1;
+        real_calloc = dlsym(RTLD_NEXT, "calloc");
+        resolving = 0;
+    }
+    callocs++;
+    return real_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    if (!real_realloc) real_realloc = dlsym(RTLD_NEXT, "realloc");
+    reallocs++;
+    return real_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    static void (*real_free)(void *);
+    char *p = ptr;
+    if (p >= bootstrap && p < bootstrap + sizeof(bootstrap)) return;
+    if (!real_free) real_free = dlsym(RTLD_NEXT, "free");
+    real_free(ptr);
+}
+
+__attribute__((destructor))
+static void report(void) {
+    fprintf(stderr, "malloc=%lu calloc=%lu realloc=%lu total=%lu\n",
+            mallocs, callocs, reallocs, mallocs + callocs + reallocs);
+}
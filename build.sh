@@ -22,9 +22,51 @@ gcc -Wall -Wextra -Iinclude -c src/readline.c -o obj/readline.o || exit 1
 echo "Compiling jobs.c..."
 gcc -Wall -Wextra -Iinclude -c src/jobs.c -o obj/jobs.o || exit 1
 
+echo "Compiling launch.c..."
+gcc -Wall -Wextra -Iinclude -c src/launch.c -o obj/launch.o || exit 1
+
+echo "Compiling cmdhash.c..."
+gcc -Wall -Wextra -Iinclude -c src/cmdhash.c -o obj/cmdhash.o || exit 1
+
+echo "Compiling arena.c..."
+gcc -Wall -Wextra -Iinclude -c src/arena.c -o obj/arena.o || exit 1
+
+echo "Compiling lexer.c..."
+gcc -Wall -Wextra -Iinclude -c src/lexer.c -o obj/lexer.o || exit 1
+
+echo "Compiling expand.c..."
+gcc -Wall -Wextra -Iinclude -c src/expand.c -o obj/expand.o || exit 1
+
+echo "Compiling parser.c..."
+gcc -Wall -Wextra -Iinclude -c src/parser.c -o obj/parser.o || exit 1
+
+echo "Compiling parsecache.c..."
+gcc -Wall -Wextra -Iinclude -c src/parsecache.c -o obj/parsecache.o || exit 1
+
+echo "Compiling history.c..."
+gcc -Wall -Wextra -Iinclude -c src/history.c -o obj/history.o || exit 1
+
+echo "Compiling histsearch.c..."
+gcc -Wall -Wextra -Iinclude -c src/histsearch.c -o obj/histsearch.o || exit 1
+
+echo "Compiling complete.c..."
+gcc -Wall -Wextra -Iinclude -c src/complete.c -o obj/complete.o || exit 1
+
+echo "Compiling dircache.c..."
+gcc -Wall -Wextra -Iinclude -c src/dircache.c -o obj/dircache.o || exit 1
+
+echo "Compiling vars.c..."
+gcc -Wall -Wextra -Iinclude -c src/vars.c -o obj/vars.o || exit 1
+
+echo "Compiling vm.c..."
+gcc -Wall -Wextra -Iinclude -c src/vm.c -o obj/vm.o || exit 1
+
+echo "Compiling arith.c..."
+gcc -Wall -Wextra -Iinclude -c src/arith.c -o obj/arith.o || exit 1
+
 # Link
 echo "Linking..."
-gcc obj/main.o obj/builtins.o obj/error.o obj/readline.o obj/jobs.o -o myshell || exit 1
+gcc obj/main.o obj/builtins.o obj/error.o obj/readline.o obj/jobs.o obj/launch.o obj/cmdhash.o obj/arena.o obj/lexer.o obj/expand.o obj/parser.o obj/parsecache.o obj/history.o obj/histsearch.o obj/complete.o obj/dircache.o obj/vars.o obj/vm.o obj/arith.o -o myshell -lpthread || exit 1
 
 echo "✓ Build successful! Run with: ./myshell"
 
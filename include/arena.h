@@ -0,0 +1,103 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/**
+ * Bump allocator for short-lived shell data
+ * Everything allocated while evaluating one command line comes from an
+ * arena and is released in one shot with arena_reset(); the first block
+ * is kept, so steady-state evaluation does no heap traffic at all.
+ */
+
+typedef struct arena_block {
+    struct arena_block *next;   // Older block
+    size_t size;                // Usable bytes in data[]
+    size_t used;                // Bytes handed out
+    char data[];
+} arena_block_t;
+
+typedef struct arena {
+    arena_block_t *head;        // Current (newest) block
+    void *last;                 // Most recent allocation (can grow in place)
+    arena_block_t *spare;       // Last block given back, reused before malloc
+    size_t block_size;          // Minimum size of new blocks
+    size_t block_mallocs;       // Blocks obtained from malloc (lifetime)
+} arena_t;
+
+/**
+ * Position in an arena to roll back to (see arena_mark)
+ */
+typedef struct arena_mark {
+    arena_block_t *block;       // Newest block at the time, or NULL
+    size_t used;                // Its fill level
+} arena_mark_t;
+
+/**
+ * Initialize an empty arena
+ * @param arena: Arena to initialize
+ */
+void arena_init(arena_t *arena);
+
+/**
+ * Initialize an empty arena with a custom block size
+ * Useful for many small long-lived arenas (e.g. cached parses).
+ * @param arena: Arena to initialize
+ * @param block_size: Minimum size of each block
+ */
+void arena_init_size(arena_t *arena, size_t block_size);
+
+/**
+ * Allocate memory from an arena (aligned for any type)
+ * Exits the shell on allocation failure, like the rest of the parser.
+ * @param arena: Arena
+ * @param size: Number of bytes
+ * @return: Pointer valid until the next arena_reset/arena_free
+ */
+void *arena_alloc(arena_t *arena, size_t size);
+
+/**
+ * Resize an allocation; grows in place when it is the newest one
+ * @param arena: Arena
+ * @param ptr: Previous allocation (or NULL)
+ * @param old_size: Its size
+ * @param new_size: Requested size
+ * @return: Pointer to the (possibly moved) allocation
+ */
+void *arena_realloc(arena_t *arena, void *ptr, size_t old_size, size_t new_size);
+
+/**
+ * Copy a string (or its first n bytes) into an arena
+ */
+char *arena_strdup(arena_t *arena, const char *s);
+char *arena_strndup(arena_t *arena, const char *s, size_t n);
+
+/**
+ * Remember the current fill level of an arena
+ * Allocations are released last-in first-out by rewinding to a mark,
+ * so a loop can drop each iteration's data without a full reset.
+ * @param arena: Arena
+ * @return: Mark for arena_rewind()
+ */
+arena_mark_t arena_mark(const arena_t *arena);
+
+/**
+ * Release everything allocated since a mark
+ * @param arena: Arena
+ * @param mark: Mark taken on this arena, not older than the last reset
+ */
+void arena_rewind(arena_t *arena, arena_mark_t mark);
+
+/**
+ * Release every allocation, keeping the first block for reuse
+ * @param arena: Arena
+ */
+void arena_reset(arena_t *arena);
+
+/**
+ * Release all memory owned by an arena
+ * @param arena: Arena
+ */
+void arena_free(arena_t *arena);
+
+#endif // ARENA_H
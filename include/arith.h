@@ -0,0 +1,30 @@
+#ifndef ARITH_H
+#define ARITH_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/**
+ * Shell arithmetic for myshell: $(( )), let and (( ))
+ * 64-bit signed integers with the C operators and their precedence,
+ * plus ** (power), and the assignment operators =, +=, -=, *=, /=, %=,
+ * <<=, >>=, &=, ^=, |= and ++/--. Variables are referenced by name; a
+ * value that is not a plain number is itself evaluated as an expression.
+ * Everything runs in the shell: no expr process per counter update.
+ */
+
+// Deepest nesting of variables whose values are expressions (a=b, b=a)
+#define ARITH_MAX_DEPTH 1024
+
+/**
+ * Evaluate an arithmetic expression
+ * Overflow wraps around. An empty expression is 0.
+ * @param expr: Expression text ($ expansions already done)
+ * @param result: Output value (unchanged on error)
+ * @param err: Stream for error messages
+ * @return: 0, or -1 on an error (message printed; assignments made
+ *          before the error stay)
+ */
+int arith_eval(const char *expr, int64_t *result, FILE *err);
+
+#endif // ARITH_H
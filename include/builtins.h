@@ -1,6 +1,26 @@
 #ifndef BUILTINS_H
 #define BUILTINS_H
 
+#include <stdio.h>
+
+/**
+ * Streams a builtin reads and writes
+ * Builtins never touch stdin/stdout/stderr directly, so the same code can
+ * run as the last stage in the shell, on a thread writing into a pipe, or
+ * in a forked child.
+ */
+typedef struct builtin_io {
+    FILE *in;    // Input stream
+    FILE *out;   // Output stream
+    FILE *err;   // Diagnostics stream
+} builtin_io_t;
+
+/**
+ * Point a builtin_io at the shell's stdin/stdout/stderr
+ * @param io: Streams to initialize
+ */
+void builtin_io_init(builtin_io_t *io);
+
 /**
  * Check if a command is a built-in
  * @param cmd: Command name to check
@@ -8,46 +28,214 @@
  */
 int is_builtin(char *cmd);
 
+/**
+ * Names of all built-ins (used by completion)
+ */
+extern char *builtin_names[];
+
+/**
+ * Number of entries in builtin_names
+ * @return: Count of built-ins
+ */
+int num_builtins(void);
+
+/**
+ * Check if a built-in only reads shell state and writes to its streams
+ * Such builtins may run on a thread as a non-final pipeline stage; the
+ * others (cd, exit, jobs, hash, ...) touch shell state and are forked.
+ * @param cmd: Command name to check
+ * @return: 1 if the built-in is safe to run concurrently, 0 otherwise
+ */
+int is_builtin_pure(char *cmd);
+
 /**
  * Execute a built-in command
  * @param argv: Command arguments (NULL-terminated)
+ * @param io: Streams to use
  * @return: 0 on success, 1 on failure, -1 to exit shell
  */
-int execute_builtin(char **argv);
+int execute_builtin(char **argv, builtin_io_t *io);
 
 /**
  * Built-in: cd - Change directory
  * @param argv: Command arguments
+ * @param io: Streams for the stage
  * @return: 0 on success, 1 on failure
  */
-int builtin_cd(char **argv);
+int builtin_cd(char **argv, builtin_io_t *io);
 
 /**
  * Built-in: exit - Exit the shell
  * @param argv: Command arguments
+ * @param io: Streams for the stage
  * @return: -1 to signal shell exit
  */
-int builtin_exit(char **argv);
+int builtin_exit(char **argv, builtin_io_t *io);
 
 /**
- * Built-in: jobs - List all jobs
+ * Built-in: jobs - List all jobs (-l adds per-process state and CPU time)
  * @param argv: Command arguments
+ * @param io: Streams for the stage
  * @return: 0 on success
  */
-int builtin_jobs(char **argv);
+int builtin_jobs(char **argv, builtin_io_t *io);
 
 /**
  * Built-in: fg - Bring job to foreground
  * @param argv: Command arguments
+ * @param io: Streams for the stage
  * @return: 0 on success, 1 on failure
  */
-int builtin_fg(char **argv);
+int builtin_fg(char **argv, builtin_io_t *io);
 
 /**
  * Built-in: bg - Continue job in background
  * @param argv: Command arguments
+ * @param io: Streams for the stage
+ * @return: 0 on success, 1 on failure
+ */
+int builtin_bg(char **argv, builtin_io_t *io);
+
+/**
+ * Built-in: hash - List cached command locations, or manage the cache
+ * (hash -r clears it, hash name... resolves and caches names)
+ * @param argv: Command arguments
+ * @param io: Streams for the stage
+ * @return: 0 on success, 1 if a name was not found
+ */
+int builtin_hash(char **argv, builtin_io_t *io);
+
+/**
+ * Built-in: rehash - Clear the command location cache
+ * @param argv: Command arguments
+ * @param io: Streams for the stage
+ * @return: 0
+ */
+int builtin_rehash(char **argv, builtin_io_t *io);
+
+/**
+ * Built-in: parsecache - Print parsed-line cache hit/miss counters
+ * (parsecache -r clears the cache and counters)
+ * @param argv: Command arguments
+ * @param io: Streams for the stage
+ * @return: 0 on success, 1 on usage error
+ */
+int builtin_parsecache(char **argv, builtin_io_t *io);
+
+/**
+ * Built-in: history - Print the command history with line numbers
+ * (history n prints the last n lines, history -c clears it)
+ * @param argv: Command arguments
+ * @param io: Streams for the stage
+ * @return: 0 on success, 2 on usage error
+ */
+int builtin_history(char **argv, builtin_io_t *io);
+
+/**
+ * Built-in: echo - Print arguments separated by spaces
+ * Supports -n (no trailing newline) and -e/-E (backslash escapes on/off)
+ * @param argv: Command arguments
+ * @param io: Streams for the stage
+ * @return: 0
+ */
+int builtin_echo(char **argv, builtin_io_t *io);
+
+/**
+ * Built-in: printf - Formatted output (%s %b %c %d %i %o %u %x %X %f %e %g)
+ * The format is reused while arguments remain
+ * @param argv: Command arguments
+ * @param io: Streams for the stage
+ * @return: 0 on success, 1 on a bad number or conversion, 2 on usage error
+ */
+int builtin_printf(char **argv, builtin_io_t *io);
+
+/**
+ * Built-in: pwd - Print the current working directory
+ * @param argv: Command arguments
+ * @param io: Streams for the stage
  * @return: 0 on success, 1 on failure
  */
-int builtin_bg(char **argv);
+int builtin_pwd(char **argv, builtin_io_t *io);
+
+/**
+ * Built-in: test / [ - Evaluate a conditional expression
+ * File tests, string and integer comparisons, !, -a, -o and parentheses
+ * @param argv: Command arguments
+ * @param io: Streams for the stage
+ * @return: 0 if true, 1 if false, 2 on error
+ */
+int builtin_test(char **argv, builtin_io_t *io);
+
+/**
+ * Built-in: set - Set shell options (set -o pipefail, set +o pipefail, set -n)
+ * With no arguments (or just -o / +o) lists the options and their state
+ * @param argv: Command arguments
+ * @param io: Streams for the stage
+ * @return: 0 on success, 2 on an invalid option
+ */
+int builtin_set(char **argv, builtin_io_t *io);
+
+/**
+ * Built-in: export - Export variables (export name[=value] ..., export -n
+ * name to stop exporting); with no names (or -p) lists the exported ones
+ * @param argv: Command arguments
+ * @param io: Streams for the stage
+ * @return: 0 on success, 1 on an invalid name, 2 on usage error
+ */
+int builtin_export(char **argv, builtin_io_t *io);
+
+/**
+ * Built-in: unset - Remove shell variables (unset -f: functions)
+ * @param argv: Command arguments
+ * @param io: Streams for the stage
+ * @return: 0 on success, 1 on an invalid name, 2 on usage error
+ */
+int builtin_unset(char **argv, builtin_io_t *io);
+
+/**
+ * Built-in: exec - Replace the shell with a command
+ * Without a command only the redirections matter; the caller keeps them
+ * as the shell's own (exec 3>log).
+ * @param argv: Command arguments
+ * @param io: Streams for the stage
+ * @return: 0 without a command; otherwise only returns on failure (127 or 126)
+ */
+int builtin_exec(char **argv, builtin_io_t *io);
+
+/**
+ * Built-in: break - Leave the innermost loop, or the N innermost (break N)
+ * The loop ends once the builtin returns (see vm_control).
+ * @param argv: Command arguments
+ * @param io: Streams for the stage
+ * @return: 0, or 1 on a bad count
+ */
+int builtin_break(char **argv, builtin_io_t *io);
+
+/**
+ * Built-in: continue - Go on with the next iteration of the innermost
+ * loop, or of the Nth one (continue N)
+ * @param argv: Command arguments
+ * @param io: Streams for the stage
+ * @return: 0, or 1 on a bad count
+ */
+int builtin_continue(char **argv, builtin_io_t *io);
+
+/**
+ * Built-in: return - Leave the running function with a status
+ * @param argv: Command arguments
+ * @param io: Streams for the stage
+ * @return: The given status (default $?), 1 outside a function, 2 on a
+ *          bad number
+ */
+int builtin_return(char **argv, builtin_io_t *io);
+
+/**
+ * Built-in: let - Evaluate each argument as an arithmetic expression
+ * (( expression )) runs as `let "expression"`.
+ * @param argv: Command arguments
+ * @param io: Streams for the stage
+ * @return: 0 if the last value is non-zero, 1 if it is zero or on an error
+ */
+int builtin_let(char **argv, builtin_io_t *io);
 
 #endif // BUILTINS_H
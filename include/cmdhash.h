@@ -0,0 +1,46 @@
+#ifndef CMDHASH_H
+#define CMDHASH_H
+
+#include <stdio.h>
+
+/**
+ * Command location cache for myshell
+ * Maps command names to the absolute path found on PATH so each command
+ * walks PATH once, not on every launch. Misses are cached too, so a
+ * repeated typo does not rescan PATH: it only stats the PATH directories,
+ * and is searched again once one of them has changed (a command was
+ * installed). The whole table is dropped when PATH changes or on
+ * `hash -r` / `rehash`.
+ */
+
+/**
+ * Resolve a command name to an executable path
+ * Names containing '/' are returned unchanged and never cached.
+ * @param name: Command name
+ * @return: Path to execute (owned by the cache) or NULL if not found
+ */
+const char *cmdhash_lookup(const char *name);
+
+/**
+ * Drop a single entry (e.g. the cached file vanished)
+ * @param name: Command name
+ */
+void cmdhash_forget(const char *name);
+
+/**
+ * Drop every entry (hash -r, rehash)
+ */
+void cmdhash_clear(void);
+
+/**
+ * Print the cached commands with their hit counts (hash)
+ * @param out: Stream to print to
+ */
+void cmdhash_list(FILE *out);
+
+/**
+ * Free all cache memory
+ */
+void cmdhash_free(void);
+
+#endif // CMDHASH_H
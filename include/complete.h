@@ -0,0 +1,27 @@
+#ifndef COMPLETE_H
+#define COMPLETE_H
+
+/**
+ * Command name completion for myshell
+ * Keeps every executable found on PATH, plus the built-ins, in one
+ * sorted array, so the names starting with a prefix are a contiguous
+ * run found by binary search. Each PATH directory is rescanned only when
+ * its mtime changes, and the whole index is rebuilt when PATH itself
+ * changes; otherwise a lookup costs one stat() per PATH directory.
+ */
+
+/**
+ * Find the commands starting with a prefix
+ * @param prefix: Start of the command name
+ * @param names: Receives the first match; matches are sorted, unique and
+ *               contiguous, and stay valid until the next call
+ * @return: Number of matches
+ */
+int complete_commands(const char *prefix, const char *const **names);
+
+/**
+ * Free the command index
+ */
+void complete_free(void);
+
+#endif // COMPLETE_H
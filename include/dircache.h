@@ -0,0 +1,49 @@
+#ifndef DIRCACHE_H
+#define DIRCACHE_H
+
+#include <stddef.h>
+
+/**
+ * Directory listings for filename completion (POSIX only)
+ * A background thread reads directories and keeps each listing, keyed
+ * by device and inode, until the directory's mtime changes, so Tab in a
+ * directory with hundreds of thousands of entries neither freezes the
+ * prompt nor rescans it every time. While a scan runs, names are
+ * published in batches and dircache_fd() becomes readable after each.
+ */
+
+#define DIRCACHE_ERROR -1     // Not a readable directory
+#define DIRCACHE_SCANNING 0   // More names may follow
+#define DIRCACHE_DONE 1       // Every name has been visited
+
+/**
+ * Called for each matching name; directories end in '/'
+ */
+typedef void (*dircache_fn)(const char *name, void *arg);
+
+/**
+ * Visit the names in a directory that start with a prefix
+ * With *seen == 0 the directory is looked up (and scanned in the
+ * background if it is new or has changed); a non-zero *seen continues
+ * the previous lookup with the names published since.
+ * @param dir: Directory path ("" for the current directory)
+ * @param prefix: Start of the names wanted
+ * @param seen: Cursor, 0 for a new lookup; updated on return
+ * @param fn: Called for each new matching name (sorted once scanned)
+ * @param arg: Passed to fn
+ * @return: DIRCACHE_DONE, DIRCACHE_SCANNING or DIRCACHE_ERROR
+ */
+int dircache_match(const char *dir, const char *prefix, size_t *seen, dircache_fn fn, void *arg);
+
+/**
+ * File descriptor that becomes readable when a scan publishes names
+ * @return: The descriptor, or -1 before the first scan
+ */
+int dircache_fd(void);
+
+/**
+ * Stop the scanner thread and free every listing
+ */
+void dircache_free(void);
+
+#endif // DIRCACHE_H
@@ -0,0 +1,75 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include "arena.h"
+#include "lexer.h"
+
+/**
+ * Word expansion for myshell
+ * Turns a lexed word into its final text: quote removal, backslash
+ * escapes, $VAR / ${VAR} / special parameter expansion, $(( ))
+ * arithmetic and $( ) / `` command substitution, in one pass.
+ */
+
+/**
+ * Look up a variable for expansion
+ * Special parameters ($?, $#, $$, $0-$9) and PIPESTATUS / PIPESTATUS[n]
+ * come from the shell state, everything else from the shell variables.
+ * @param name: Variable name
+ * @return: Value or NULL if unset
+ */
+const char *lookup_variable(const char *name);
+
+/**
+ * Expand a word token
+ * Plain words (no quotes, no $) are returned as-is without copying.
+ * @param arena: Arena for the result
+ * @param word: TOK_WORD token
+ * @return: NUL-terminated expanded text
+ */
+char *expand_word(arena_t *arena, const token_t *word);
+
+/**
+ * Expand a NAME=value assignment word (the name is never quoted)
+ * @param arena: Arena for the result
+ * @param word: TOK_WORD token starting with NAME=
+ * @return: NUL-terminated "NAME=value" with the value expanded
+ */
+char *expand_assignment(arena_t *arena, const token_t *word);
+
+/**
+ * Expand a word list into fields
+ * "$@" gives one field per positional parameter. With split, an unquoted
+ * expansion is also split at blanks, so a variable holding a list gives
+ * one field per item (the word list of a `for` loop); command words are
+ * not split. Any other word is a single field.
+ * @param arena: Arena for the fields
+ * @param words: Word tokens
+ * @param count: Number of words
+ * @param split: 1 to split unquoted expansions at blanks
+ * @param num_fields: Output number of fields
+ * @return: NULL-terminated array of fields
+ */
+char **expand_fields(arena_t *arena, const token_t *words, int count, int split, int *num_fields);
+
+/**
+ * Check whether an expansion failed (a bad $(( )) expression, message
+ * already printed) since the last call, and clear the flag
+ * The command whose words failed to expand should not run.
+ * @return: 1 if one failed, 0 otherwise
+ */
+int expand_failed(void);
+
+// Provided by the evaluator (main.c)
+
+/**
+ * Run the command of a $( ... ) or `...` substitution and capture its
+ * standard output
+ * $? becomes the command's exit status.
+ * @param arena: Arena for the output
+ * @param command: Command text
+ * @return: Its output without trailing newlines (in the arena)
+ */
+char *eval_substitution(arena_t *arena, const char *command);
+
+#endif // EXPAND_H
@@ -0,0 +1,196 @@
+#ifndef HASHTABLE_H
+#define HASHTABLE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+
+/**
+ * Open-addressing hash table for myshell (variables, jobs, history index)
+ * Linear probing over a power-of-two array of caller-defined slots:
+ * Fibonacci hashing picks a key's home slot, the table doubles before it
+ * is 3/4 full, and deletion shifts later entries back instead of leaving
+ * tombstones, so probe chains stay short. Each table describes its slot
+ * type with a hashtable_type_t; everything here is static inline so the
+ * type's callbacks compile down to plain field reads in each user.
+ */
+
+/**
+ * Layout of one kind of slot
+ * A zero-filled slot must be empty, and an occupied one never is.
+ */
+typedef struct hashtable_type {
+    size_t slot_size;
+    size_t initial_capacity;               // Power of two
+    const char *what;                      // Named in allocation errors
+    int (*is_empty)(const void *slot);
+    uint64_t (*hash)(const void *slot);    // Key hash of an occupied slot
+} hashtable_type_t;
+
+typedef struct hashtable {
+    void *slots;
+    size_t capacity;      // Power of two; 0 until the first insert
+    size_t count;
+} hashtable_t;
+
+/**
+ * FNV-1a hash of a string of known length
+ */
+static inline uint32_t hash_fnv1a(const char *s, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)s[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * FNV-1a hash of a NUL-terminated string
+ */
+static inline uint32_t hash_fnv1a_str(const char *s) {
+    uint32_t hash = 2166136261u;
+    while (*s) {
+        hash ^= (unsigned char)*s++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * 64-bit FNV-1a hash of a NUL-terminated string, for keys known by their
+ * hash alone
+ */
+static inline uint64_t hash_fnv1a64(const char *s) {
+    uint64_t hash = 14695981039346656037ull;
+    while (*s) {
+        hash = (hash ^ (unsigned char)*s++) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * Home slot of a hash
+ * Fibonacci hashing spreads sequential ids and similar names across the table.
+ */
+static inline size_t hashtable_home(uint64_t hash, size_t capacity) {
+    return (size_t)((hash * 11400714819323198485ull) >> 32) & (capacity - 1);
+}
+
+/**
+ * Slot number i
+ */
+static inline void *hashtable_at(const hashtable_t *table, const hashtable_type_t *type, size_t i) {
+    return (char *)table->slots + i * type->slot_size;
+}
+
+/**
+ * Look a key up
+ * @param hash: Hash of the key
+ * @param match: Tells whether an occupied slot holds the key
+ * @param key: Passed to match
+ * @return: The slot holding the key, or the empty slot where it would
+ *          go; NULL while the table has no slots
+ */
+static inline void *hashtable_find(const hashtable_t *table, const hashtable_type_t *type, uint64_t hash,
+                                   int (*match)(const void *slot, const void *key), const void *key) {
+    if (table->capacity == 0) {
+        return NULL;
+    }
+    size_t mask = table->capacity - 1;
+    for (size_t i = hashtable_home(hash, table->capacity); ; i = (i + 1) & mask) {
+        void *slot = hashtable_at(table, type, i);
+        if (type->is_empty(slot) || match(slot, key)) {
+            return slot;
+        }
+    }
+}
+
+/**
+ * Make room for one more entry
+ * The table doubles when it would pass 3/4 full; slots then move, so
+ * pointers into the table are stale afterwards.
+ */
+static inline void hashtable_reserve(hashtable_t *table, const hashtable_type_t *type) {
+    if ((table->count + 1) * 4 <= table->capacity * 3) {
+        return;
+    }
+    hashtable_t old = *table;
+
+    table->capacity = old.capacity ? old.capacity * 2 : type->initial_capacity;
+    table->slots = calloc(table->capacity, type->slot_size);
+    if (table->slots == NULL) {
+        error_allocation(type->what);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t mask = table->capacity - 1;
+    for (size_t i = 0; i < old.capacity; i++) {
+        void *slot = hashtable_at(&old, type, i);
+        if (!type->is_empty(slot)) {
+            size_t j = hashtable_home(type->hash(slot), table->capacity);
+            while (!type->is_empty(hashtable_at(table, type, j))) {
+                j = (j + 1) & mask;
+            }
+            memcpy(hashtable_at(table, type, j), slot, type->slot_size);
+        }
+    }
+    free(old.slots);
+}
+
+/**
+ * Find a key's slot, taking an empty one for it when it is absent
+ * A new slot is counted as used: the caller must fill in its key.
+ * @param created: Output, 1 if the slot is new (may be NULL)
+ * @return: The slot
+ */
+static inline void *hashtable_put(hashtable_t *table, const hashtable_type_t *type, uint64_t hash,
+                                  int (*match)(const void *slot, const void *key), const void *key,
+                                  int *created) {
+    hashtable_reserve(table, type);
+    void *slot = hashtable_find(table, type, hash, match, key);
+    int is_new = type->is_empty(slot);
+    if (is_new) {
+        table->count++;
+    }
+    if (created) {
+        *created = is_new;
+    }
+    return slot;
+}
+
+/**
+ * Empty an occupied slot
+ * Later entries of its probe chain move back, so other slot pointers are
+ * stale afterwards.
+ */
+static inline void hashtable_remove(hashtable_t *table, const hashtable_type_t *type, void *slot) {
+    size_t mask = table->capacity - 1;
+    size_t hole = (size_t)((char *)slot - (char *)table->slots) / type->slot_size;
+
+    // Backward-shift deletion: no tombstones, probe chains stay short
+    for (size_t j = (hole + 1) & mask; !type->is_empty(hashtable_at(table, type, j)); j = (j + 1) & mask) {
+        size_t home = hashtable_home(type->hash(hashtable_at(table, type, j)), table->capacity);
+        // Move j into the hole unless its home lies cyclically in (hole, j]
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            memcpy(hashtable_at(table, type, hole), hashtable_at(table, type, j), type->slot_size);
+            hole = j;
+        }
+    }
+    memset(hashtable_at(table, type, hole), 0, type->slot_size);
+    table->count--;
+}
+
+/**
+ * Free the slots (not what they point to)
+ */
+static inline void hashtable_free(hashtable_t *table) {
+    free(table->slots);
+    table->slots = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
+
+#endif // HASHTABLE_H
@@ -0,0 +1,105 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <time.h>
+
+/**
+ * Command history for myshell
+ * Entries live in a ring buffer of HISTSIZE slots (grown on demand), so
+ * appending and evicting the oldest line are both O(1). The text of each
+ * line is packed into large chunks rather than one malloc per line; a
+ * chunk is released as soon as the last line stored in it is evicted, so
+ * memory tracks the text actually retained.
+ *
+ * Interactive shells also log every line to $HISTFILE (default
+ * ~/.myshell_history) as ": <time>:<status>;<command>", one O_APPEND
+ * write per line so concurrent shells can share the file without
+ * locking; a command typed over several lines is one entry, its
+ * newlines stored as \036. The file is mmap'd at startup but only parsed
+ * the first time the history is looked at.
+ */
+
+typedef struct history_entry {
+    const char *text;       // Command line
+    time_t when;            // When it was entered (0 if unknown)
+    int status;             // Exit status (-1 if unknown)
+} history_entry_t;
+
+#define HISTSIZE_DEFAULT 1000
+
+/**
+ * Initialize the history buffer and open $HISTFILE
+ * The capacity comes from $HISTSIZE (HISTSIZE_DEFAULT if unset/invalid);
+ * an empty HISTFILE keeps history in memory only.
+ */
+void init_history(void);
+
+/**
+ * Add a line to the command history
+ * Empty lines and repeats of the previous line are not recorded.
+ * @param line: The command to add; one typed over several lines comes
+ *              whole, its lines joined by newlines
+ */
+void add_history(const char *line);
+
+/**
+ * Set the exit status of the line just added and log it to $HISTFILE
+ * Does nothing if the last add_history() call did not record a line.
+ * @param status: Exit status of the command
+ */
+void history_record_status(int status);
+
+/**
+ * Number of lines currently held
+ */
+int history_length(void);
+
+/**
+ * History number of the oldest line held (numbers keep counting up as
+ * old lines are evicted, like bash's `history` output)
+ */
+int history_base(void);
+
+/**
+ * Get a line by position
+ * @param index: 0 for the oldest line held, history_length() - 1 for the newest
+ * @return: The line (owned by the history) or NULL if out of range
+ */
+const char *history_get(int index);
+
+/**
+ * Get a line with its time and exit status
+ * @param index: As for history_get()
+ * @return: The entry (owned by the history) or NULL if out of range
+ */
+const history_entry_t *history_entry(int index);
+
+/**
+ * Change the capacity, evicting the oldest lines if it shrinks
+ * @param size: Maximum number of lines to keep (0 disables history)
+ */
+void history_set_size(int size);
+
+/**
+ * Re-read $HISTSIZE (called whenever it is assigned or unset)
+ */
+void history_update_size(void);
+
+/**
+ * Current capacity
+ */
+int history_size(void);
+
+/**
+ * Drop every line (history -c), keeping the capacity
+ * Lines already written to $HISTFILE stay there.
+ */
+void clear_history(void);
+
+/**
+ * Free history memory and close $HISTFILE
+ */
+void free_history(void);
+
+#endif // HISTORY_H
@@ -0,0 +1,49 @@
+#ifndef HISTSEARCH_H
+#define HISTSEARCH_H
+
+/**
+ * History search index for myshell (Ctrl-R)
+ * Every history line is indexed by its trigrams (3-byte substrings). Each
+ * trigram maps to the history numbers containing it in ascending order,
+ * so adding a line appends to its lists and evicting the oldest line pops
+ * from their fronts. A query is answered from the shortest list among its
+ * trigrams, newest first, checking each candidate with strstr.
+ *
+ * The history module keeps the index in step; the editor only calls
+ * history_search().
+ */
+
+// Distinct matches collected and ranked per query
+#define HISTSEARCH_MAX_MATCHES 64
+
+/**
+ * Index a line just added to the history
+ * @param id: Its history number
+ * @param text: The line
+ */
+void histsearch_add(int id, const char *text);
+
+/**
+ * Drop a line being evicted (always the oldest indexed line)
+ * @param id: Its history number
+ * @param text: The line
+ */
+void histsearch_remove(int id, const char *text);
+
+/**
+ * Drop the whole index
+ */
+void histsearch_clear(void);
+
+/**
+ * Find history lines containing a substring, best first
+ * Repeated lines are reported once. Matches are ranked by how often the
+ * line was run, weighted by how recently; ties go to the newer line.
+ * @param query: Substring to look for
+ * @param matches: Receives history indexes (for history_get())
+ * @param max: Size of matches
+ * @return: Number of matches stored
+ */
+int history_search(const char *query, int *matches, int max);
+
+#endif // HISTSEARCH_H
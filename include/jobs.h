@@ -1,7 +1,11 @@
 #ifndef JOBS_H
 #define JOBS_H
 
+#include <stdio.h>
 #include <sys/types.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
 
 // Job states
 typedef enum {
@@ -10,13 +14,29 @@ typedef enum {
     JOB_DONE
 } job_state_t;
 
+// One process of a pipeline job
+typedef struct job_stage {
+    pid_t pid;               // Process ID
+    int running;             // 1 until the process has been reaped
+    int status;              // Raw wait status once reaped
+    #ifndef _WIN32
+    struct rusage usage;     // Resources used, once reaped (from wait4)
+    #endif
+} job_stage_t;
+
 // Job structure
 typedef struct job {
     int job_id;              // Job number (1, 2, 3, ...)
-    pid_t pid;               // Process ID
+    pid_t pid;               // Process ID of the last stage
+    pid_t pgid;              // Process group (0 without job control)
+    job_stage_t *stages;     // Every process of the pipeline
+    int num_stages;
+    int num_running;         // Stages not yet reaped
     char *command;           // Command string
     job_state_t state;       // Current state
     int background;          // 1 if started in background
+    struct job *prev;        // Job list, oldest to newest
+    struct job *next;
 } job_t;
 
 /**
@@ -24,14 +44,41 @@ typedef struct job {
  */
 void init_jobs(void);
 
+/**
+ * Enable job control for an interactive shell on a terminal
+ * Puts the shell in its own process group, takes the terminal, and
+ * ignores the terminal stop signals. Without it pipelines stay in the
+ * shell's group and jobs are signalled process by process.
+ */
+void init_job_control(void);
+
+/**
+ * Check whether job control is active
+ * @return: 1 if pipelines get their own process group, 0 otherwise
+ */
+int job_control_enabled(void);
+
+/**
+ * Make a process group the terminal's foreground group (no-op without job control)
+ * @param pgid: Process group to give the terminal to
+ */
+void give_terminal(pid_t pgid);
+
+/**
+ * Take the terminal back for the shell (no-op without job control)
+ */
+void reclaim_terminal(void);
+
 /**
  * Add a new job to the job list
- * @param pid: Process ID
+ * @param pgid: Process group of the pipeline (0 without job control)
+ * @param pids: Process IDs of the stages; entries <= 0 are skipped
+ * @param num_pids: Number of entries in pids
  * @param command: Command string
  * @param background: 1 if background job
- * @return: Job ID or -1 on error
+ * @return: Job ID or -1 on error (or if no stage has a process)
  */
-int add_job(pid_t pid, const char *command, int background);
+int add_job(pid_t pgid, const pid_t *pids, int num_pids, const char *command, int background);
 
 /**
  * Remove a job from the job list
@@ -41,7 +88,7 @@ void remove_job(int job_id);
 
 /**
  * Get job by job ID
- * @param job_id: Job ID
+ * @param job_id: Job ID (0 for the current job, %+)
  * @return: Pointer to job or NULL if not found
  */
 job_t *get_job(int job_id);
@@ -53,6 +100,14 @@ job_t *get_job(int job_id);
  */
 job_t *get_job_by_pid(pid_t pid);
 
+/**
+ * Resolve a job specification: %n or n, %+ / %% / %, %-, or %name
+ * (newest job whose command starts with name)
+ * @param spec: Job specification
+ * @return: Job ID, or -1 if no job matches
+ */
+int find_job_spec(const char *spec);
+
 /**
  * Update job state
  * @param job_id: Job ID
@@ -62,27 +117,50 @@ void update_job_state(int job_id, job_state_t state);
 
 /**
  * List all jobs (jobs command)
+ * @param out: Stream to print to
+ * @param verbose: 1 to also list every stage with its PID, state and
+ *                 CPU time (jobs -l); CPU is known once a stage is reaped
  */
-void list_jobs(void);
+void list_jobs(FILE *out, int verbose);
 
 /**
  * Bring job to foreground (fg command)
- * @param job_id: Job ID (0 for most recent)
- * @return: 0 on success, -1 on error
+ * The terminal goes to the job's group and every stage is waited for.
+ * @param job_id: Job ID (0 for the current job)
+ * @return: Exit status of the job's last stage, or -1 on error
  */
 int fg_job(int job_id);
 
 /**
  * Continue job in background (bg command)
- * @param job_id: Job ID (0 for most recent)
+ * @param job_id: Job ID (0 for the current job)
  * @return: 0 on success, -1 on error
  */
 int bg_job(int job_id);
 
 /**
- * Check for completed jobs and update states
+ * Reap children that changed state and report finished/stopped jobs
+ * Cheap when nothing happened: SIGCHLD only sets a flag and writes to a
+ * self-pipe, and all reaping is one waitpid(-1, WNOHANG) loop here.
+ * Reports are printed only by an interactive shell. Must not run while
+ * a foreground pipeline has children not yet waited for.
+ * @return: Number of job state changes reported
+ */
+int check_jobs(void);
+
+/**
+ * File descriptor that becomes readable when a child changes state
+ * Poll it alongside input to notice job changes while idle.
+ * @return: Read end of the SIGCHLD self-pipe, or -1 if unsupported
+ */
+int jobs_event_fd(void);
+
+/**
+ * Reset job state in a forked subshell: ( list ) or a backgrounded list
+ * Forgets the parent's jobs and turns job control off, so the
+ * subshell's pipelines stay in the process group they were started in.
  */
-void check_jobs(void);
+void jobs_enter_subshell(void);
 
 /**
  * Free all job resources
@@ -0,0 +1,137 @@
+#ifndef LAUNCH_H
+#define LAUNCH_H
+
+#include <sys/types.h>
+
+/**
+ * Process launch engine for myshell (POSIX)
+ * Starts external commands with posix_spawn so the shell never copies its
+ * own address space; all fd plumbing is expressed as spawn file actions.
+ */
+
+// Descriptors commands can redirect; the shell keeps its own fds above
+#define LAUNCH_USER_FDS 10
+
+/**
+ * Redirection operations
+ */
+typedef enum {
+    REDIR_INPUT,        // n<file
+    REDIR_OUTPUT,       // n>file
+    REDIR_APPEND,       // n>>file
+    REDIR_READWRITE,    // n<>file
+    REDIR_DUP,          // n>&m, n<&m
+    REDIR_CLOSE         // n>&-, n<&-
+} redir_op_t;
+
+/**
+ * One redirection, applied in command-line order
+ */
+typedef struct redirection {
+    redir_op_t op;
+    int fd;                   // Descriptor being redirected (0-9)
+    int source;               // REDIR_DUP: descriptor copied onto fd, or -1 if invalid
+    const char *path;         // File target; for REDIR_DUP the word, for messages
+} redirection_t;
+
+/**
+ * Per-process launch options
+ */
+typedef struct launch_opts {
+    int in_fd;                // fd that becomes stdin, or -1 to inherit
+    int out_fd;               // fd that becomes stdout, or -1 to inherit
+    const redirection_t *redirs;  // Redirections, applied after the pipes
+    int num_redirs;           // Number of redirections
+    char **envp;              // Environment, or NULL for the exported shell variables
+    pid_t pgid;               // Process group: -1 keep the shell's, 0 new, >0 join
+    int foreground;           // 1 to give the terminal to the new group
+} launch_opts_t;
+
+/**
+ * Initialize launch options to "inherit everything"
+ * @param opts: Options to initialize
+ */
+void launch_opts_init(launch_opts_t *opts);
+
+/**
+ * Create a pipe whose both ends are close-on-exec
+ * Children only ever see the ends that are dup2'ed onto 0/1.
+ * @param fds: Output array (read end, write end)
+ * @return: 0 on success, -1 on failure
+ */
+int launch_pipe(int fds[2]);
+
+/**
+ * Move a descriptor the shell keeps for itself above the user fds
+ * @param fd: Open descriptor (closed if it is moved)
+ * @return: The descriptor to use from now on, close-on-exec
+ */
+int launch_private_fd(int fd);
+
+/**
+ * Create a pipe for the shell's own use, placed above the user fds
+ * Keeps wakeup pipes out of reach of `exec 3>file` and n>&m.
+ * @param fds: Output array (read end, write end), both close-on-exec
+ * @param flags: Extra pipe2() flags, e.g. O_NONBLOCK
+ * @return: 0 on success, -1 on failure
+ */
+int launch_private_pipe(int fds[2], int flags);
+
+/**
+ * Launch an external command
+ * Redirection files are opened by the shell (close-on-exec) and handed to
+ * the child as dup2 file actions in command-line order, so errors are
+ * reported precisely and the parent's own fds are never touched.
+ * @param argv: Command arguments (NULL-terminated)
+ * @param opts: Launch options (NULL for defaults)
+ * @return: PID of the new process, or on error (message already printed)
+ *          the negated exit status: -127 not found, -126 not executable,
+ *          -1 a redirection failed
+ */
+pid_t launch_process(char **argv, const launch_opts_t *opts);
+
+/**
+ * Replace the shell with an external command (tail exec)
+ * Redirections are applied to the shell's own fds and signal dispositions
+ * are reset, so the result is indistinguishable from a spawned child.
+ * @param argv: Command arguments (NULL-terminated)
+ * @param opts: Launch options (NULL for defaults)
+ * @return: Only returns on failure: 127 if not found, 126 otherwise
+ */
+int launch_exec(char **argv, const launch_opts_t *opts);
+
+/**
+ * Fork a child that runs shell code (a builtin pipeline stage)
+ * Only for work that must see a private copy of the shell's state; plain
+ * commands go through launch_process(). The child gets the options'
+ * pipes and redirections and default signal dispositions.
+ * @param opts: Launch options (NULL for defaults)
+ * @return: 0 in the child, child PID in the parent, -1 on error
+ */
+pid_t launch_fork(const launch_opts_t *opts);
+
+/**
+ * Apply redirections to the shell's own descriptors
+ * Used to run builtins in-process: the originals are parked on
+ * close-on-exec fds >= 10 and put back by launch_restore(). Without a
+ * saved array the redirections are permanent (`exec 3>log`).
+ * @param opts: Launch options (in_fd/out_fd and redirections)
+ * @param saved: Output, the parked fds to hand to launch_restore(), or NULL
+ * @return: 0 on success, -1 on error (nothing left redirected if saved)
+ */
+int launch_redirect(const launch_opts_t *opts, int saved[LAUNCH_USER_FDS]);
+
+/**
+ * Undo launch_redirect()
+ * @param saved: Parked fds from launch_redirect()
+ */
+void launch_restore(int saved[LAUNCH_USER_FDS]);
+
+/**
+ * Convert a wait() status into a shell exit status
+ * @param status: Status from wait/waitpid
+ * @return: Exit code, or 128 + signal number
+ */
+int launch_exit_status(int status);
+
+#endif // LAUNCH_H
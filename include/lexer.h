@@ -0,0 +1,82 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include "arena.h"
+
+/**
+ * Single-pass lexer for myshell command lines
+ * Produces a token stream whose words are spans into the original line.
+ * Quotes, backslashes and operators are recognized in the same pass, so
+ * operators need no surrounding spaces (a|b, cmd>out, x&&y, (cd d;make)).
+ * Newlines are tokens, so one input can hold several lines of commands.
+ * $( ... ), `...` and $(( ... )) stay inside their word whatever they
+ * contain.
+ * `{`, `}` and if/then/while/do/... are reserved words, not operators:
+ * the parser recognizes them as plain words in command position.
+ */
+
+// Token types
+typedef enum {
+    TOK_WORD,       // Word (span may still contain quotes and $)
+    TOK_PIPE,       // |
+    TOK_LESS,       // <
+    TOK_GREAT,      // >
+    TOK_DGREAT,     // >>
+    TOK_LESSGREAT,  // <>
+    TOK_LESSAND,    // <&
+    TOK_GREATAND,   // >&
+    TOK_AMPGREAT,   // &>
+    TOK_AMPDGREAT,  // &>>
+    TOK_AMP,        // &
+    TOK_SEMI,       // ;
+    TOK_AND_IF,     // &&
+    TOK_OR_IF,      // ||
+    TOK_LPAREN,     // (
+    TOK_RPAREN,     // )
+    TOK_DSEMI,      // ;;
+    TOK_ARITH,      // (( expression )), the whole span
+    TOK_NEWLINE,    // End of a line (not the last)
+    TOK_EOF         // End of input
+} token_type_t;
+
+// Word flags (also set on TOK_ARITH for its expression)
+#define WORD_QUOTED 1   // Contains quotes or backslashes to remove
+#define WORD_DOLLAR 2   // Contains a $ or ` that is subject to expansion
+
+// One token
+typedef struct token {
+    token_type_t type;
+    int flags;               // WORD_* flags (words only)
+    int io_number;           // Redirections: explicit fd 0-9 (2>), or -1
+    char *start;             // Span into the line
+    int len;                 // Span length
+} token_t;
+
+// Is a token type a redirection operator?
+#define TOK_IS_REDIRECT(type) ((type) >= TOK_LESS && (type) <= TOK_AMPDGREAT)
+
+// Result codes for lex_line
+#define LEX_OK          0
+#define LEX_ERROR      -1   // Syntax error (message already printed)
+#define LEX_INCOMPLETE -2   // Input ends inside quotes, a substitution or after a backslash
+
+/**
+ * Split a command line into tokens
+ * Words without quotes or $ are NUL-terminated in place and used as-is
+ * (zero-copy); the line must stay alive as long as the tokens.
+ * @param arena: Arena for the token array
+ * @param line: Command line (modified in place)
+ * @param tokens: Output token array, terminated by a TOK_EOF token
+ * @return: Number of tokens before TOK_EOF, or LEX_INCOMPLETE (nothing
+ *          printed: the caller may read another line and try again)
+ */
+int lex_line(arena_t *arena, char *line, token_t **tokens);
+
+/**
+ * Printable form of an operator token, for error messages
+ * @param type: Token type
+ * @return: Operator text
+ */
+const char *token_name(token_type_t type);
+
+#endif // LEXER_H
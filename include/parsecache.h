@@ -0,0 +1,56 @@
+#ifndef PARSECACHE_H
+#define PARSECACHE_H
+
+#include <stdio.h>
+#include "parser.h"
+
+/**
+ * Parsed-line cache for myshell
+ * A bounded LRU map from exact command-line text to its parsed
+ * (pre-expansion) command list, compiled to bytecode. A hit skips
+ * lexing, parsing and compiling entirely; only expansion runs again.
+ * Lines with syntax errors are never cached.
+ */
+
+typedef struct parsecache_entry parsecache_entry_t;
+
+/**
+ * Find or parse and compile a command line
+ * The entry is pinned (never evicted) until parsecache_release.
+ * @param line: Command line text, possibly several lines (not modified)
+ * @param code: Output compiled list, NULL for an empty line
+ * @param entry: Output entry to release afterwards
+ * @return: 0 on success, -1 on a syntax error, or PARSE_INCOMPLETE if
+ *          the command goes on past the end of the text
+ */
+int parsecache_acquire(const char *line, const struct code **code, parsecache_entry_t **entry);
+
+/**
+ * Pin an entry once more (a function defined by it stays usable)
+ * @param entry: Entry (NULL is ignored)
+ */
+void parsecache_retain(parsecache_entry_t *entry);
+
+/**
+ * Unpin an entry returned by parsecache_acquire
+ * @param entry: Entry (NULL is ignored)
+ */
+void parsecache_release(parsecache_entry_t *entry);
+
+/**
+ * Print cache statistics (parsecache builtin)
+ * @param out: Stream to print to
+ */
+void parsecache_stats(FILE *out);
+
+/**
+ * Drop every unpinned entry and reset the counters
+ */
+void parsecache_clear(void);
+
+/**
+ * Free all cache memory
+ */
+void parsecache_free(void);
+
+#endif // PARSECACHE_H
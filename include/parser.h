@@ -0,0 +1,123 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include "arena.h"
+#include "lexer.h"
+
+/**
+ * Parser for myshell command lines
+ * Builds pre-expansion structures: words stay as lexer tokens and are
+ * expanded only when the command runs, so a parsed line can be reused.
+ */
+
+/**
+ * A parsed redirection
+ */
+struct parsed_redirect {
+    token_type_t type;       // Operator (TOK_LESS ... TOK_AMPDGREAT)
+    int fd;                  // Explicit fd (2>), or -1 for the operator's default
+    token_t *target;         // File name or fd word, pre-expansion
+};
+
+// Kinds of pipeline stage
+#define CMD_SIMPLE   0       // words, assignments and redirections
+#define CMD_GROUP    1       // Compound command run by the shell itself:
+                             // { list; }, if, while, until, for or case
+#define CMD_SUBSHELL 2       // ( list ) run in a forked copy of the shell
+
+// Result of parse_line when the input stops in the middle of a command
+#define PARSE_INCOMPLETE -2
+
+struct node;
+struct code;                 // Compiled form of a list (vm.h)
+
+/**
+ * A parsed command (one pipeline stage)
+ */
+struct parsed_command {
+    int kind;                // CMD_SIMPLE, CMD_GROUP or CMD_SUBSHELL
+    token_t *words;          // Argument words, pre-expansion
+    int num_words;           // Number of words
+    token_t *assigns;        // Leading NAME=value words, pre-expansion
+    int num_assigns;         // Number of assignments
+    struct parsed_redirect *redirs;  // Redirections in command-line order
+    int num_redirs;          // Number of redirections
+    struct node *body;       // Groups: the list or if/while/...; subshells: the list
+    const char *text;        // Groups and subshells: source text, for job listings
+    const struct code *code; // Groups and subshells: compiled body (vm_compile)
+};
+
+/**
+ * A parsed pipeline (cmd1 | cmd2 | ...)
+ */
+struct pipeline {
+    struct parsed_command *commands;
+    int num_cmds;            // 0 for a bare `time`
+    int timed;               // 1 if prefixed by the `time` reserved word
+    int negated;             // 1 if prefixed by `!`
+};
+
+// AST node types
+typedef enum {
+    NODE_PIPELINE,           // A pipeline
+    NODE_AND,                // left && right
+    NODE_OR,                 // left || right
+    NODE_SEQ,                // left ; right
+    NODE_ASYNC,              // left & (left is an and-or list)
+    NODE_IF,                 // if left; then right; else alt; fi
+    NODE_WHILE,              // while left; do right; done
+    NODE_UNTIL,              // until left; do right; done
+    NODE_FOR,                // for name in words; do right; done
+    NODE_CASE,               // case words[0] in items... esac
+    NODE_FUNCTION            // name() body, defined when the node runs
+} node_type_t;
+
+/**
+ * One `pattern | pattern) list ;;` arm of a case command
+ */
+struct case_item {
+    token_t *patterns;       // Patterns, pre-expansion
+    int num_patterns;
+    struct node *body;       // List to run, NULL for an empty arm
+};
+
+/**
+ * A node of the command-list AST
+ * A line is a list of and-or lists separated by ;, & or newlines, each
+ * a chain of pipelines joined by && and ||. Sequences nest to the right
+ * and and-or chains to the left, so `a && b || c; d` is
+ * SEQ(OR(AND(a, b), c), d). if/while/until/for/case are pipeline stages
+ * (CMD_GROUP) whose body is one of the control-flow nodes.
+ */
+struct node {
+    node_type_t type;
+    struct pipeline *pipeline;   // NODE_PIPELINE; NODE_FUNCTION: the body, one stage
+    struct node *left;           // Operators: first operand; NODE_ASYNC: the job;
+                                 // NODE_IF/WHILE/UNTIL: the condition
+    struct node *right;          // Binary operators: second operand; loops and
+                                 // NODE_IF: the body
+    struct node *alt;            // NODE_IF: else part (elif is a nested NODE_IF), or NULL
+    token_t *name;               // NODE_FOR: loop variable; NODE_FUNCTION: its name
+    token_t *words;              // NODE_FOR: word list; NODE_CASE: the subject word
+    int num_words;               // NODE_FOR: -1 without `in` (loop over "$@")
+    struct case_item *items;     // NODE_CASE: arms in order
+    int num_items;
+    const char *text;            // NODE_ASYNC: source text, for job listings
+    const struct code *code;     // NODE_ASYNC: compiled job, run by the subshell
+};
+
+/**
+ * Parse command lines into a command list
+ * Tokens point into the line, which must outlive the tree.
+ * @param arena: Arena for all parser output
+ * @param line: One or more lines of commands, separated by newlines
+ *              (modified in place)
+ * @param tree: Output root, NULL for empty or comment-only input
+ * @return: 0 on success, -1 on a syntax error (message already printed),
+ *          or PARSE_INCOMPLETE if the input ends inside a command
+ *          (`if` without `fi`, a trailing `|` or `&&`, an open quote);
+ *          nothing is printed then, so the caller can append a line
+ */
+int parse_line(arena_t *arena, char *line, struct node **tree);
+
+#endif // PARSER_H
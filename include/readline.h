@@ -1,17 +1,6 @@
 #ifndef READLINE_H
 #define READLINE_H
 
-/**
- * Initialize the history buffer
- */
-void init_history(void);
-
-/**
- * Add a line to the command history
- * @param line: The command line to add
- */
-void add_history(const char *line);
-
 /**
  * Read a line of input with support for history navigation (Up/Down arrows)
  * @param prompt: The prompt to display
@@ -20,9 +9,13 @@ void add_history(const char *line);
 char *read_line(const char *prompt);
 
 /**
- * Free history memory
+ * Watch an extra fd while read_line() waits for input
+ * When it becomes readable the callback runs; if it returns > 0 (it
+ * printed something) the prompt is shown again.
+ * @param fd: File descriptor to poll, or -1 for none
+ * @param callback: Function to run when fd is readable
  */
-void free_history(void);
+void set_read_line_event(int fd, int (*callback)(void));
 
 /**
  * Attempt to complete the current input
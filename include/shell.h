@@ -0,0 +1,21 @@
+#ifndef SHELL_H
+#define SHELL_H
+
+/**
+ * Shell-wide state shared between the evaluator, built-ins and job control
+ */
+typedef struct shell_state {
+    int interactive;         // 1 when reading commands from a terminal
+    int last_status;         // Exit status of the last pipeline ($?)
+    int noexec;              // -n: parse commands but do not run them
+    char *name;              // Script or shell name ($0)
+    int argc;                // Number of positional parameters ($#)
+    char **argv;             // Positional parameters ($1, $2, ...)
+    int pipefail;            // set -o pipefail: a pipeline fails if any stage does
+    int *pipestatus;         // Exit status of each stage of the last pipeline
+    int num_pipestatus;      // Number of entries in pipestatus (PIPESTATUS)
+} shell_state_t;
+
+extern shell_state_t shell;
+
+#endif // SHELL_H
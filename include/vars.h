@@ -0,0 +1,112 @@
+#ifndef VARS_H
+#define VARS_H
+
+#include <stdio.h>
+#include "arena.h"
+
+/**
+ * Shell variables for myshell
+ * One open-addressing hash table holds every variable, local or
+ * exported, imported from the environment on first use. Each variable is
+ * stored as a single "NAME=value" string, so the envp handed to spawned
+ * commands is just an array of pointers into the table; it is rebuilt
+ * only after an exported variable changes and reused for every spawn
+ * in between.
+ */
+
+// Variable flags
+#define VAR_EXPORT 1    // Passed to commands in their environment
+
+/**
+ * Saved state of variables overridden for one command
+ */
+typedef struct vars_saved vars_saved_t;
+
+/**
+ * Check a variable name: a letter or '_', then letters, digits and '_'
+ * @param name: Name to check (need not be NUL-terminated)
+ * @param len: Length of the name
+ * @return: 1 if valid, 0 otherwise
+ */
+int vars_valid_name(const char *name, size_t len);
+
+/**
+ * Look up a variable
+ * @param name: Variable name
+ * @return: Value (valid until the variable changes), or NULL if unset
+ */
+const char *vars_get(const char *name);
+
+/**
+ * Set a variable
+ * An exported variable stays exported; flags can only add VAR_EXPORT.
+ * @param name: Variable name
+ * @param value: New value, or NULL to declare the name without a value
+ * @param flags: VAR_* flags to add
+ * @return: 0 on success, -1 if the name is not valid
+ */
+int vars_set(const char *name, const char *value, int flags);
+
+/**
+ * Set a variable from a NAME=value string
+ * @param assignment: Text of the assignment
+ * @param flags: VAR_* flags to add
+ * @return: 0 on success, -1 if there is no '=' or the name is not valid
+ */
+int vars_assign(const char *assignment, int flags);
+
+/**
+ * Remove a variable
+ * @param name: Variable name
+ */
+void vars_unset(const char *name);
+
+/**
+ * Mark a variable for export, or stop exporting it (export -n)
+ * @param name: Variable name; created without a value if unset
+ * @param exported: 1 to export, 0 to unexport
+ * @return: 0 on success, -1 if the name is not valid
+ */
+int vars_export(const char *name, int exported);
+
+/**
+ * Print the exported variables as `export NAME='value'`, sorted by name
+ * @param out: Stream to print to
+ */
+void vars_list_exported(FILE *out);
+
+/**
+ * Environment for spawned commands
+ * @return: NULL-terminated NAME=value array, owned by the table and valid
+ *          until the next change to an exported variable
+ */
+char **vars_environ(void);
+
+/**
+ * Environment for one command with prefix assignments (VAR=x cmd)
+ * @param arena: Arena for the array
+ * @param assigns: NULL-terminated NAME=value strings that override the
+ *                 exported variables
+ * @return: NULL-terminated NAME=value array
+ */
+char **vars_environ_with(arena_t *arena, char *const *assigns);
+
+/**
+ * Apply prefix assignments for the duration of a builtin
+ * @param assigns: NULL-terminated NAME=value strings, set as exported
+ * @return: Record of what they replaced, for vars_restore()
+ */
+vars_saved_t *vars_save(char *const *assigns);
+
+/**
+ * Undo vars_save(), putting back the previous values and flags
+ * @param saved: Record from vars_save() (freed here)
+ */
+void vars_restore(vars_saved_t *saved);
+
+/**
+ * Free every variable
+ */
+void vars_free(void);
+
+#endif // VARS_H
@@ -0,0 +1,127 @@
+#ifndef VM_H
+#define VM_H
+
+#include "arena.h"
+#include "parser.h"
+#include "parsecache.h"
+
+/**
+ * Bytecode compiler and virtual machine for myshell command lists
+ * A parsed line is compiled once, when it enters the parse cache, into a
+ * flat array of instructions: pipelines become RUN instructions and
+ * &&, ||, if, while, until, for and case become conditional jumps. A loop
+ * iteration is then a few array reads and the expansion of the commands
+ * it runs, with no tree walk and no re-parse. Compound commands that run
+ * on their own (redirected, in a pipeline, in the background) and
+ * function bodies get separate code, run by a nested vm_run().
+ */
+
+// Flags for vm_run and the evaluator hooks
+#define EVAL_TAIL_EXEC 1   // Last command of `-c`: exec it in place of the shell
+#define EVAL_HISTORY 2     // eval_line: add the command to history once it is complete
+
+// Control transfers requested by the break, continue and return builtins
+#define VM_BREAK    1
+#define VM_CONTINUE 2
+#define VM_RETURN   3
+
+// Deepest function recursion before calls fail (each level uses C stack)
+#define VM_MAX_FUNCTION_DEPTH 1000
+
+/**
+ * Compile a command list, and every compound command inside it
+ * Separate code for groups, subshells and background jobs is stored in
+ * their parsed_command->code and node->code.
+ * @param arena: Arena holding the tree; the code is allocated there too
+ * @param tree: Parsed list (not NULL)
+ * @param owner: Cache entry owning the arena, kept alive while a function
+ *               defined by this code exists (NULL if not cached)
+ * @return: Compiled code
+ */
+const struct code *vm_compile(arena_t *arena, struct node *tree, parsecache_entry_t *owner);
+
+/**
+ * Run compiled code
+ * @param code: Code from vm_compile (or a parsed_command's code)
+ * @param arena: Arena for expansions; loops give back what each iteration
+ *               allocated
+ * @param flags: EVAL_* flags, passed on to a pipeline in tail position
+ * @return: Status of the last command run, or -1 if the shell should exit
+ */
+int vm_run(const struct code *code, arena_t *arena, int flags);
+
+/**
+ * The pipeline of code that is nothing but one pipeline (not a; b, an
+ * if, a loop, a negated or background pipeline, ...)
+ * Lets a caller choose how to run a lone command.
+ * @param code: Compiled code
+ * @return: The pipeline, or NULL
+ */
+const struct pipeline *vm_single_pipeline(const struct code *code);
+
+/**
+ * Look up a shell function
+ * @param name: Command name (NULL is allowed)
+ * @return: Function body (one compound stage with its redirections), or NULL
+ */
+const struct parsed_command *vm_function(const char *name);
+
+/**
+ * Remove a shell function (unset -f)
+ * @param name: Function name
+ */
+void vm_unset_function(const char *name);
+
+/**
+ * Start a function call
+ * @return: 0, or -1 (message printed) if calls are nested too deep
+ */
+int vm_function_begin(void);
+
+/**
+ * Finish a function call; a `return` inside it stops here
+ */
+void vm_function_end(void);
+
+/**
+ * Number of loops currently running (for break and continue)
+ */
+int vm_loop_depth(void);
+
+/**
+ * Number of function calls currently running (for return)
+ */
+int vm_function_depth(void);
+
+/**
+ * Ask the running code to break, continue or return once the current
+ * command finishes
+ * @param what: VM_BREAK, VM_CONTINUE or VM_RETURN
+ * @param count: Number of enclosing loops for break and continue
+ */
+void vm_control(int what, int count);
+
+/**
+ * Free every function definition
+ */
+void vm_free(void);
+
+// Provided by the evaluator (main.c)
+
+/**
+ * Expand and run one pipeline
+ * @param pipeline: Parsed pipeline
+ * @param flags: EVAL_* flags
+ * @param background: 1 to run it as a background job (&)
+ * @return: Exit status, or -1 if the shell should exit
+ */
+int eval_pipeline(const struct pipeline *pipeline, int flags, int background);
+
+/**
+ * Start an and-or list in the background (list &)
+ * @param node: NODE_ASYNC node
+ * @return: 0, 1 if it could not be started, or -1 if the shell should exit
+ */
+int eval_async(const struct node *node);
+
+#endif // VM_H
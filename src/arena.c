@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "error.h"
+
+#define ARENA_BLOCK_SIZE (16 * 1024)
+#define ARENA_ALIGN (sizeof(void *) * 2)
+
+void arena_init(arena_t *arena) {
+    arena_init_size(arena, ARENA_BLOCK_SIZE);
+}
+
+void arena_init_size(arena_t *arena, size_t block_size) {
+    arena->head = NULL;
+    arena->last = NULL;
+    arena->spare = NULL;
+    arena->block_size = block_size;
+    arena->block_mallocs = 0;
+}
+
+/**
+ * Push a new block able to hold at least `size` bytes
+ */
+static arena_block_t *new_block(arena_t *arena, size_t size) {
+    // A zero-initialized arena uses the default block size
+    size_t min_size = arena->block_size ? arena->block_size : ARENA_BLOCK_SIZE;
+    size_t block_size = (size > min_size) ? size : min_size;
+    arena_block_t *block = arena->spare;
+
+    if (block != NULL && block->size >= block_size) {
+        arena->spare = NULL;
+    } else {
+        block = malloc(sizeof(arena_block_t) + block_size);
+        if (!block) {
+            error_allocation("arena");
+            exit(EXIT_FAILURE);
+        }
+        block->size = block_size;
+        arena->block_mallocs++;
+    }
+    block->next = arena->head;
+    block->used = 0;
+    arena->head = block;
+    return block;
+}
+
+/**
+ * Give back a block; one is kept, so a loop whose every iteration spills
+ * into a new block and then rewinds does not malloc and free each time
+ */
+static void release_block(arena_t *arena, arena_block_t *block) {
+    if (arena->spare == NULL) {
+        arena->spare = block;
+    } else {
+        free(block);
+    }
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    arena_block_t *block = arena->head;
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    if (block == NULL || block->size - block->used < size) {
+        block = new_block(arena, size);
+    }
+    void *ptr = block->data + block->used;
+    block->used += size;
+    arena->last = ptr;
+    return ptr;
+}
+
+void *arena_realloc(arena_t *arena, void *ptr, size_t old_size, size_t new_size) {
+    if (ptr == NULL) {
+        return arena_alloc(arena, new_size);
+    }
+
+    // Newest allocation: just move the bump pointer
+    arena_block_t *block = arena->head;
+    if (ptr == arena->last) {
+        size_t offset = (char *)ptr - block->data;
+        size_t aligned = (new_size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+        if (offset + aligned <= block->size) {
+            block->used = offset + aligned;
+            return ptr;
+        }
+    }
+
+    void *moved = arena_alloc(arena, new_size);
+    memcpy(moved, ptr, old_size < new_size ? old_size : new_size);
+    return moved;
+}
+
+char *arena_strndup(arena_t *arena, const char *s, size_t n) {
+    char *copy = arena_alloc(arena, n + 1);
+    memcpy(copy, s, n);
+    copy[n] = '\0';
+    return copy;
+}
+
+char *arena_strdup(arena_t *arena, const char *s) {
+    return arena_strndup(arena, s, strlen(s));
+}
+
+arena_mark_t arena_mark(const arena_t *arena) {
+    arena_mark_t mark;
+    mark.block = arena->head;
+    mark.used = arena->head ? arena->head->used : 0;
+    return mark;
+}
+
+void arena_rewind(arena_t *arena, arena_mark_t mark) {
+    arena_block_t *block = arena->head;
+    if (block == NULL) {
+        return;
+    }
+
+    // Blocks opened since the mark go; an empty mark keeps the oldest one
+    while (block != mark.block && block->next) {
+        arena_block_t *next = block->next;
+        release_block(arena, block);
+        block = next;
+    }
+    block->used = (block == mark.block) ? mark.used : 0;
+    arena->head = block;
+    arena->last = NULL;
+}
+
+void arena_reset(arena_t *arena) {
+    arena_block_t *block = arena->head;
+    if (block == NULL) {
+        return;
+    }
+
+    // Keep the oldest block (normally the only one) for the next line
+    while (block->next) {
+        arena_block_t *next = block->next;
+        release_block(arena, block);
+        block = next;
+    }
+    block->used = 0;
+    arena->head = block;
+    arena->last = NULL;
+}
+
+void arena_free(arena_t *arena) {
+    arena_block_t *block = arena->head;
+    while (block) {
+        arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena->spare);
+    arena->head = NULL;
+    arena->last = NULL;
+    arena->spare = NULL;
+}
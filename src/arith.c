@@ -0,0 +1,559 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+
+#include "arith.h"
+#include "vars.h"
+
+// Longest variable name an expression can use
+#define ARITH_NAME_MAX 256
+
+// Arithmetic on the unsigned type, so overflow wraps instead of being undefined
+#define WRAP(op, x, y) ((int64_t)((uint64_t)(x) op (uint64_t)(y)))
+
+/**
+ * Parser state for one expression
+ * Parsing and evaluation are one pass; an operand that must not be
+ * evaluated (the right side of 0 && x++, the other arm of ?:) is still
+ * parsed, with noeval set so it has no side effects and raises no errors.
+ */
+typedef struct arith {
+    const char *expr;      // Whole expression, for messages
+    const char *p;         // Next unread character
+    int noeval;            // > 0 inside an operand that is skipped
+    int depth;             // Nesting of variable values being evaluated
+    int failed;            // An error has been reported
+    FILE *err;             // Stream for error messages
+} arith_t;
+
+// Binary operators (and the operation of compound assignments)
+enum {
+    BIN_NONE, BIN_SET,
+    BIN_MUL, BIN_DIV, BIN_MOD, BIN_ADD, BIN_SUB, BIN_SHL, BIN_SHR,
+    BIN_LT, BIN_LE, BIN_GT, BIN_GE, BIN_EQ, BIN_NE,
+    BIN_AND, BIN_XOR, BIN_OR, BIN_LAND, BIN_LOR
+};
+
+/**
+ * Binary operators with their C precedence (higher binds tighter)
+ * Longer spellings come first so `<<` is not read as `<`.
+ */
+static const struct binop {
+    const char *text;
+    int len;
+    int prec;
+    int op;
+} binops[] = {
+    {"||", 2, 1, BIN_LOR}, {"&&", 2, 2, BIN_LAND},
+    {"==", 2, 6, BIN_EQ}, {"!=", 2, 6, BIN_NE},
+    {"<=", 2, 7, BIN_LE}, {">=", 2, 7, BIN_GE},
+    {"<<", 2, 8, BIN_SHL}, {">>", 2, 8, BIN_SHR},
+    {"|", 1, 3, BIN_OR}, {"^", 1, 4, BIN_XOR}, {"&", 1, 5, BIN_AND},
+    {"<", 1, 7, BIN_LT}, {">", 1, 7, BIN_GT},
+    {"+", 1, 9, BIN_ADD}, {"-", 1, 9, BIN_SUB},
+    {"*", 1, 10, BIN_MUL}, {"/", 1, 10, BIN_DIV}, {"%", 1, 10, BIN_MOD},
+    {NULL, 0, 0, BIN_NONE}
+};
+
+/**
+ * Assignment operators; `=` just stores
+ */
+static const struct assignop {
+    const char *text;
+    int op;
+} assignops[] = {
+    {"<<=", BIN_SHL}, {">>=", BIN_SHR},
+    {"*=", BIN_MUL}, {"/=", BIN_DIV}, {"%=", BIN_MOD}, {"+=", BIN_ADD}, {"-=", BIN_SUB},
+    {"&=", BIN_AND}, {"^=", BIN_XOR}, {"|=", BIN_OR},
+    {"=", BIN_SET},
+    {NULL, BIN_NONE}
+};
+
+static int64_t parse_comma(arith_t *a);
+static int64_t parse_assign(arith_t *a);
+static int64_t evaluate(arith_t *a);
+
+/**
+ * Report an error (only the first one) and stop parsing
+ */
+static void arith_error(arith_t *a, const char *message) {
+    if (!a->failed) {
+        if (*a->p != '\0') {
+            fprintf(a->err, "myshell: %s: %s (error token is \"%s\")\n", a->expr, message, a->p);
+        } else {
+            fprintf(a->err, "myshell: %s: %s\n", a->expr, message);
+        }
+        a->failed = 1;
+    }
+    // Every rule sees the end of the input from now on
+    a->p = "";
+}
+
+static void skip_blanks(arith_t *a) {
+    while (isspace((unsigned char)*a->p)) {
+        a->p++;
+    }
+}
+
+/**
+ * Length of the variable name at p, 0 if there is none
+ */
+static size_t name_length(const char *p) {
+    size_t len = 0;
+    if (!isalpha((unsigned char)p[0]) && p[0] != '_') {
+        return 0;
+    }
+    while (isalnum((unsigned char)p[len]) || p[len] == '_') {
+        len++;
+    }
+    return len;
+}
+
+/**
+ * Copy a name out of the expression so it is NUL-terminated
+ * @return: 0, or -1 if it is too long (error reported)
+ */
+static int copy_name(arith_t *a, const char *name, size_t len, char *buf) {
+    if (len >= ARITH_NAME_MAX) {
+        arith_error(a, "variable name too long");
+        return -1;
+    }
+    memcpy(buf, name, len);
+    buf[len] = '\0';
+    return 0;
+}
+
+/**
+ * Value of a variable: unset or empty is 0, a number is used as-is, and
+ * anything else is evaluated as an expression
+ */
+static int64_t variable_value(arith_t *a, const char *name, size_t len) {
+    char buf[ARITH_NAME_MAX];
+
+    if (a->noeval || copy_name(a, name, len, buf) < 0) {
+        return 0;
+    }
+    const char *value = vars_get(buf);
+    if (value == NULL || *value == '\0') {
+        return 0;
+    }
+
+    // Plain decimal numbers, the usual case, skip the parser
+    const char *s = value;
+    int negative = (*s == '-');
+    if (*s == '-' || *s == '+') {
+        s++;
+    }
+    if (isdigit((unsigned char)s[0]) && (s[0] != '0' || s[1] == '\0')) {
+        uint64_t n = 0;
+        while (isdigit((unsigned char)*s)) {
+            n = n * 10 + (uint64_t)(*s++ - '0');
+        }
+        if (*s == '\0') {
+            return (int64_t)(negative ? 0 - n : n);
+        }
+    }
+
+    if (a->depth >= ARITH_MAX_DEPTH) {
+        arith_error(a, "expression recursion level exceeded");
+        return 0;
+    }
+    arith_t sub = {value, value, 0, a->depth + 1, 0, a->err};
+    int64_t result = evaluate(&sub);
+    if (sub.failed) {
+        // Reported against the variable's value; just stop here
+        a->failed = 1;
+        a->p = "";
+        return 0;
+    }
+    return result;
+}
+
+/**
+ * Assign a variable (not while skipping an operand)
+ */
+static void store(arith_t *a, const char *name, size_t len, int64_t value) {
+    char buf[ARITH_NAME_MAX];
+    char text[24];
+
+    if (a->noeval || copy_name(a, name, len, buf) < 0) {
+        return;
+    }
+    snprintf(text, sizeof(text), "%" PRId64, value);
+    vars_set(buf, text, 0);
+}
+
+/**
+ * Apply a binary operator (not && or ||, which short-circuit)
+ */
+static int64_t apply(arith_t *a, int op, int64_t x, int64_t y) {
+    switch (op) {
+        case BIN_MUL: return WRAP(*, x, y);
+        case BIN_DIV:
+        case BIN_MOD:
+            if (y == 0) {
+                if (!a->noeval) {
+                    arith_error(a, "division by 0");
+                }
+                return 0;
+            }
+            if (x == INT64_MIN && y == -1) {
+                // The one quotient that does not fit
+                return (op == BIN_DIV) ? INT64_MIN : 0;
+            }
+            return (op == BIN_DIV) ? x / y : x % y;
+        case BIN_ADD: return WRAP(+, x, y);
+        case BIN_SUB: return WRAP(-, x, y);
+        case BIN_SHL: return (int64_t)((uint64_t)x << (y & 63));
+        case BIN_SHR: return x >> (y & 63);
+        case BIN_LT:  return x < y;
+        case BIN_LE:  return x <= y;
+        case BIN_GT:  return x > y;
+        case BIN_GE:  return x >= y;
+        case BIN_EQ:  return x == y;
+        case BIN_NE:  return x != y;
+        case BIN_AND: return x & y;
+        case BIN_XOR: return x ^ y;
+        case BIN_OR:  return x | y;
+        default:      return y;
+    }
+}
+
+/**
+ * Assignment operator at p
+ * @param len: Output length of the operator, 0 if there is none
+ * @return: BIN_SET for `=`, the operation of a compound assignment, or
+ *          BIN_NONE
+ */
+static int assignment_op(const char *p, int *len) {
+    for (int i = 0; assignops[i].text != NULL; i++) {
+        size_t n = strlen(assignops[i].text);
+        if (strncmp(p, assignops[i].text, n) == 0) {
+            if (assignops[i].op == BIN_SET && p[1] == '=') {
+                break;   // ==
+            }
+            *len = (int)n;
+            return assignops[i].op;
+        }
+    }
+    *len = 0;
+    return BIN_NONE;
+}
+
+/**
+ * Binary operator at p, or NULL (also for the start of an assignment,
+ * so a += 1 is not read as a + (= 1))
+ */
+static const struct binop *binary_op(const char *p) {
+    for (int i = 0; binops[i].text != NULL; i++) {
+        const struct binop *b = &binops[i];
+        if (strncmp(p, b->text, b->len) == 0) {
+            int compares = (b->op == BIN_EQ || b->op == BIN_NE || b->op == BIN_LE || b->op == BIN_GE);
+            if (!compares && p[b->len] == '=') {
+                return NULL;
+            }
+            return b;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Number: decimal, 0x hex, 0 octal, or base#digits (base 2 to 64)
+ */
+static int64_t parse_number(arith_t *a) {
+    const char *p = a->p;
+    int base = 10;
+    uint64_t n = 0;
+
+    if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        base = 16;
+        p += 2;
+    } else if (p[0] == '0') {
+        base = 8;
+    } else {
+        const char *q = p;
+        int b = 0;
+        while (isdigit((unsigned char)*q)) {
+            b = (b > 64) ? b : b * 10 + (*q - '0');
+            q++;
+        }
+        if (*q == '#') {
+            if (b < 2 || b > 64) {
+                arith_error(a, "invalid arithmetic base");
+                return 0;
+            }
+            base = b;
+            p = q + 1;
+        }
+    }
+
+    const char *digits = p;
+    while (isalnum((unsigned char)*p) || *p == '@' || *p == '_') {
+        int d;
+        if (isdigit((unsigned char)*p)) {
+            d = *p - '0';
+        } else if (islower((unsigned char)*p)) {
+            d = *p - 'a' + 10;
+        } else if (isupper((unsigned char)*p)) {
+            // Up to base 36 letters are case-insensitive
+            d = *p - 'A' + ((base <= 36) ? 10 : 36);
+        } else {
+            d = (*p == '@') ? 62 : 63;
+        }
+        if (d >= base) {
+            arith_error(a, "value too great for base");
+            return 0;
+        }
+        n = n * (uint64_t)base + (uint64_t)d;
+        p++;
+    }
+    if (p == digits) {
+        arith_error(a, "invalid number");
+        return 0;
+    }
+    a->p = p;
+    return (int64_t)n;
+}
+
+/**
+ * Primary: (expr), a number, or a variable with an optional ++ or --
+ */
+static int64_t parse_primary(arith_t *a) {
+    skip_blanks(a);
+    const char *p = a->p;
+
+    if (*p == '(') {
+        a->p++;
+        int64_t value = parse_comma(a);
+        skip_blanks(a);
+        if (*a->p != ')') {
+            arith_error(a, "missing `)'");
+            return 0;
+        }
+        a->p++;
+        return value;
+    }
+    if (isdigit((unsigned char)*p)) {
+        return parse_number(a);
+    }
+
+    size_t len = name_length(p);
+    if (len == 0) {
+        arith_error(a, "syntax error: operand expected");
+        return 0;
+    }
+    a->p += len;
+
+    // name++ and name-- yield the old value
+    const char *q = a->p;
+    while (isspace((unsigned char)*q)) {
+        q++;
+    }
+    int64_t value = variable_value(a, p, len);
+    if ((q[0] == '+' || q[0] == '-') && q[1] == q[0]) {
+        a->p = q + 2;
+        store(a, p, len, WRAP(+, value, (q[0] == '+') ? 1 : -1));
+    }
+    return value;
+}
+
+/**
+ * Unary operators: + - ! ~, and ++name / --name
+ */
+static int64_t parse_unary(arith_t *a) {
+    skip_blanks(a);
+    char c = *a->p;
+
+    if ((c == '+' || c == '-') && a->p[1] == c) {
+        const char *name = a->p + 2;
+        while (isspace((unsigned char)*name)) {
+            name++;
+        }
+        size_t len = name_length(name);
+        if (len > 0) {
+            a->p = name + len;
+            int64_t value = WRAP(+, variable_value(a, name, len), (c == '+') ? 1 : -1);
+            store(a, name, len, value);
+            return value;
+        }
+        // Not a variable: two signs (--5 is 5)
+    }
+    if (c == '+' || c == '-' || c == '!' || c == '~') {
+        a->p++;
+        int64_t value = parse_unary(a);
+        switch (c) {
+            case '-': return WRAP(-, 0, value);
+            case '!': return !value;
+            case '~': return ~value;
+            default:  return value;
+        }
+    }
+    return parse_primary(a);
+}
+
+/**
+ * Power: unary ** power (right associative, binds tighter than *)
+ */
+static int64_t parse_power(arith_t *a) {
+    int64_t base = parse_unary(a);
+
+    skip_blanks(a);
+    if (a->p[0] != '*' || a->p[1] != '*') {
+        return base;
+    }
+    a->p += 2;
+    int64_t exponent = parse_power(a);
+    if (exponent < 0) {
+        if (!a->noeval) {
+            arith_error(a, "exponent less than 0");
+        }
+        return 0;
+    }
+
+    uint64_t result = 1, factor = (uint64_t)base;
+    while (exponent > 0) {
+        if (exponent & 1) {
+            result *= factor;
+        }
+        factor *= factor;
+        exponent >>= 1;
+    }
+    return (int64_t)result;
+}
+
+/**
+ * Binary operators from || down to * / %, by precedence climbing
+ * @param min_prec: Lowest precedence this call may consume
+ */
+static int64_t parse_binary(arith_t *a, int min_prec) {
+    int64_t left = parse_power(a);
+
+    while (1) {
+        skip_blanks(a);
+        const struct binop *b = binary_op(a->p);
+        if (b == NULL || b->prec < min_prec) {
+            return left;
+        }
+        a->p += b->len;
+
+        if (b->op == BIN_LAND || b->op == BIN_LOR) {
+            // Once the left side decides, the right one is only parsed
+            int decided = (b->op == BIN_LAND) ? (left == 0) : (left != 0);
+            a->noeval += decided;
+            int64_t right = parse_binary(a, b->prec + 1);
+            a->noeval -= decided;
+            left = decided ? (b->op == BIN_LOR) : (right != 0);
+        } else {
+            int64_t right = parse_binary(a, b->prec + 1);
+            left = apply(a, b->op, left, right);
+        }
+    }
+}
+
+/**
+ * Conditional: binary [? comma : assign]
+ */
+static int64_t parse_ternary(arith_t *a) {
+    int64_t cond = parse_binary(a, 1);
+
+    skip_blanks(a);
+    if (*a->p != '?') {
+        return cond;
+    }
+    a->p++;
+    a->noeval += (cond == 0);
+    int64_t yes = parse_comma(a);
+    a->noeval -= (cond == 0);
+
+    skip_blanks(a);
+    if (*a->p != ':') {
+        arith_error(a, "`:' expected for conditional expression");
+        return 0;
+    }
+    a->p++;
+    a->noeval += (cond != 0);
+    int64_t no = parse_assign(a);
+    a->noeval -= (cond != 0);
+    return cond ? yes : no;
+}
+
+/**
+ * Assignment: name op= assign, or a conditional
+ */
+static int64_t parse_assign(arith_t *a) {
+    skip_blanks(a);
+    const char *name = a->p;
+    size_t len = name_length(name);
+
+    if (len > 0) {
+        const char *q = name + len;
+        int op_len;
+        while (isspace((unsigned char)*q)) {
+            q++;
+        }
+        int op = assignment_op(q, &op_len);
+        if (op != BIN_NONE) {
+            a->p = q + op_len;
+            int64_t value = parse_assign(a);
+            if (op != BIN_SET) {
+                value = apply(a, op, variable_value(a, name, len), value);
+            }
+            if (!a->failed) {
+                store(a, name, len, value);
+            }
+            return value;
+        }
+    }
+    return parse_ternary(a);
+}
+
+/**
+ * Comma: assign (, assign)*; the value is the last one
+ */
+static int64_t parse_comma(arith_t *a) {
+    int64_t value = parse_assign(a);
+
+    skip_blanks(a);
+    while (*a->p == ',') {
+        a->p++;
+        value = parse_assign(a);
+        skip_blanks(a);
+    }
+    return value;
+}
+
+/**
+ * Whole expression: nothing may be left over
+ */
+static int64_t evaluate(arith_t *a) {
+    skip_blanks(a);
+    if (*a->p == '\0') {
+        return 0;
+    }
+
+    int64_t value = parse_comma(a);
+    skip_blanks(a);
+    if (*a->p != '\0') {
+        int len;
+        if (assignment_op(a->p, &len) != BIN_NONE) {
+            arith_error(a, "attempted assignment to non-variable");
+        } else {
+            arith_error(a, "syntax error in expression");
+        }
+    }
+    return value;
+}
+
+int arith_eval(const char *expr, int64_t *result, FILE *err) {
+    arith_t a = {expr, expr, 0, 0, 0, err};
+    int64_t value = evaluate(&a);
+
+    if (a.failed) {
+        return -1;
+    }
+    *result = value;
+    return 0;
+}
@@ -1,10 +1,29 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <sys/stat.h>
+#ifdef _WIN32
 #include <direct.h>
+#include <io.h>
+#include <process.h>
+#define getcwd _getcwd
+#else
+#include <unistd.h>
+#define _chdir chdir
+#endif
 #include "builtins.h"
 #include "error.h"
 #include "jobs.h"
+#include "cmdhash.h"
+#include "shell.h"
+#include "parsecache.h"
+#include "history.h"
+#include "vars.h"
+#include "launch.h"
+#include "vm.h"
+#include "arith.h"
 
 
 // List of built-in command names
@@ -13,11 +32,31 @@ char *builtin_names[] = {
     "exit",
     "jobs",
     "fg",
-    "bg"
+    "bg",
+    "hash",
+    "rehash",
+    "parsecache",
+    "history",
+    "echo",
+    "printf",
+    "pwd",
+    "true",
+    "false",
+    ":",
+    "test",
+    "[",
+    "set",
+    "export",
+    "unset",
+    "exec",
+    "break",
+    "continue",
+    "return",
+    "let"
 };
 
 // Number of built-ins
-int num_builtins() {
+int num_builtins(void) {
     return sizeof(builtin_names) / sizeof(char *);
 }
 
@@ -37,24 +76,87 @@ int is_builtin(char *cmd) {
     return 0;
 }
 
+/**
+ * Check if a built-in only writes to its streams
+ */
+int is_builtin_pure(char *cmd) {
+    static const char *pure[] = {"echo", "printf", "pwd", "true", "false", ":", "test", "[", NULL};
+    
+    if (cmd == NULL) {
+        return 0;
+    }
+    
+    for (int i = 0; pure[i] != NULL; i++) {
+        if (strcmp(cmd, pure[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Point a builtin_io at the shell's standard streams
+ */
+void builtin_io_init(builtin_io_t *io) {
+    io->in = stdin;
+    io->out = stdout;
+    io->err = stderr;
+}
+
 /**
  * Execute a built-in command
  */
-int execute_builtin(char **argv) {
+int execute_builtin(char **argv, builtin_io_t *io) {
     if (argv == NULL || argv[0] == NULL) {
         return 1;
     }
     
     if (strcmp(argv[0], "cd") == 0) {
-        return builtin_cd(argv);
+        return builtin_cd(argv, io);
     } else if (strcmp(argv[0], "exit") == 0) {
-        return builtin_exit(argv);
+        return builtin_exit(argv, io);
     } else if (strcmp(argv[0], "jobs") == 0) {
-        return builtin_jobs(argv);
+        return builtin_jobs(argv, io);
     } else if (strcmp(argv[0], "fg") == 0) {
-        return builtin_fg(argv);
+        return builtin_fg(argv, io);
     } else if (strcmp(argv[0], "bg") == 0) {
-        return builtin_bg(argv);
+        return builtin_bg(argv, io);
+    } else if (strcmp(argv[0], "hash") == 0) {
+        return builtin_hash(argv, io);
+    } else if (strcmp(argv[0], "rehash") == 0) {
+        return builtin_rehash(argv, io);
+    } else if (strcmp(argv[0], "parsecache") == 0) {
+        return builtin_parsecache(argv, io);
+    } else if (strcmp(argv[0], "history") == 0) {
+        return builtin_history(argv, io);
+    } else if (strcmp(argv[0], "echo") == 0) {
+        return builtin_echo(argv, io);
+    } else if (strcmp(argv[0], "printf") == 0) {
+        return builtin_printf(argv, io);
+    } else if (strcmp(argv[0], "pwd") == 0) {
+        return builtin_pwd(argv, io);
+    } else if (strcmp(argv[0], "true") == 0 || strcmp(argv[0], ":") == 0) {
+        return 0;
+    } else if (strcmp(argv[0], "false") == 0) {
+        return 1;
+    } else if (strcmp(argv[0], "test") == 0 || strcmp(argv[0], "[") == 0) {
+        return builtin_test(argv, io);
+    } else if (strcmp(argv[0], "set") == 0) {
+        return builtin_set(argv, io);
+    } else if (strcmp(argv[0], "export") == 0) {
+        return builtin_export(argv, io);
+    } else if (strcmp(argv[0], "unset") == 0) {
+        return builtin_unset(argv, io);
+    } else if (strcmp(argv[0], "exec") == 0) {
+        return builtin_exec(argv, io);
+    } else if (strcmp(argv[0], "break") == 0) {
+        return builtin_break(argv, io);
+    } else if (strcmp(argv[0], "continue") == 0) {
+        return builtin_continue(argv, io);
+    } else if (strcmp(argv[0], "return") == 0) {
+        return builtin_return(argv, io);
+    } else if (strcmp(argv[0], "let") == 0) {
+        return builtin_let(argv, io);
     }
     
     return 1; // Unknown built-in
@@ -63,13 +165,14 @@ int execute_builtin(char **argv) {
 /**
  * Built-in: cd - Change directory
  */
-int builtin_cd(char **argv) {
+int builtin_cd(char **argv, builtin_io_t *io) {
+    (void)io; // Unused parameter
     if (argv[1] == NULL) {
         // No argument: go to HOME
-        char *home = getenv("HOME");
+        const char *home = vars_get("HOME");
         if (home == NULL) {
             // Try USERPROFILE on Windows
-            home = getenv("USERPROFILE");
+            home = vars_get("USERPROFILE");
         }
         if (home == NULL) {
             error_syntax("cd: HOME environment variable not set");
@@ -92,59 +195,934 @@ int builtin_cd(char **argv) {
 /**
  * Built-in: exit - Exit the shell
  */
-int builtin_exit(char **argv) {
-    // Optional: support exit code argument
+int builtin_exit(char **argv, builtin_io_t *io) {
+    // Optional: support exit code argument. The shell unwinds and exits
+    // with it; exit() here would also run a forked subshell's stdio
+    // cleanup, rewinding a script the parent is still reading.
     if (argv[1] != NULL) {
         int exit_code = atoi(argv[1]);
-        printf("Goodbye! (exit code: %d)\n", exit_code);
-        exit(exit_code);
+        if (shell.interactive) {
+            fprintf(io->out, "Goodbye! (exit code: %d)\n", exit_code);
+        }
+        shell.last_status = exit_code & 0xff;
+        return -1;
     }
     
-    printf("Goodbye!\n");
+    if (shell.interactive) {
+        fprintf(io->out, "Goodbye!\n");
+    }
     return -1; // Signal to exit shell
 }
 
 /**
  * Built-in: jobs - List all jobs
  */
-int builtin_jobs(char **argv) {
-    (void)argv; // Unused parameter
-    list_jobs();
+int builtin_jobs(char **argv, builtin_io_t *io) {
+    int verbose = 0;
+    
+    if (argv[1] != NULL) {
+        if (strcmp(argv[1], "-l") != 0) {
+            fprintf(io->err, "myshell: jobs: usage: jobs [-l]\n");
+            return 2;
+        }
+        verbose = 1;
+    }
+    
+    list_jobs(io->out, verbose);
     return 0;
 }
 
 /**
  * Built-in: fg - Bring job to foreground
  */
-int builtin_fg(char **argv) {
+int builtin_fg(char **argv, builtin_io_t *io) {
     int job_id = 0;
     
-    // Parse job ID if provided
+    // Parse job spec if provided (%n, n, %+, %-, %name)
     if (argv[1] != NULL) {
-        if (argv[1][0] == '%') {
-            job_id = atoi(argv[1] + 1);
-        } else {
-            job_id = atoi(argv[1]);
+        job_id = find_job_spec(argv[1]);
+        if (job_id < 0) {
+            fprintf(io->err, "myshell: fg: %s: no such job\n", argv[1]);
+            return 1;
         }
     }
     
-    return fg_job(job_id);
+    // fg_job reports its own errors; -1 must not exit the shell
+    int status = fg_job(job_id);
+    return status < 0 ? 1 : status;
 }
 
 /**
  * Built-in: bg - Continue job in background
  */
-int builtin_bg(char **argv) {
+int builtin_bg(char **argv, builtin_io_t *io) {
     int job_id = 0;
     
-    // Parse job ID if provided
+    // Parse job spec if provided (%n, n, %+, %-, %name)
+    if (argv[1] != NULL) {
+        job_id = find_job_spec(argv[1]);
+        if (job_id < 0) {
+            fprintf(io->err, "myshell: bg: %s: no such job\n", argv[1]);
+            return 1;
+        }
+    }
+    
+    // bg_job reports its own errors; -1 must not exit the shell
+    return bg_job(job_id) < 0 ? 1 : 0;
+}
+
+/**
+ * Built-in: hash - Show or manage the command location cache
+ */
+int builtin_hash(char **argv, builtin_io_t *io) {
+    int status = 0;
+    
+    if (argv[1] == NULL) {
+        cmdhash_list(io->out);
+        return 0;
+    }
+    
+    if (strcmp(argv[1], "-r") == 0) {
+        cmdhash_clear();
+        return 0;
+    }
+    
+    // hash name...: resolve and remember each name now
+    for (int i = 1; argv[i] != NULL; i++) {
+        if (cmdhash_lookup(argv[i]) == NULL) {
+            fprintf(io->err, "myshell: hash: %s: not found\n", argv[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+/**
+ * Built-in: rehash - Forget all cached command locations
+ */
+int builtin_rehash(char **argv, builtin_io_t *io) {
+    (void)argv; // Unused parameter
+    (void)io; // Unused parameter
+    cmdhash_clear();
+    return 0;
+}
+
+/**
+ * Built-in: parsecache - Show or clear the parsed-line cache
+ */
+int builtin_parsecache(char **argv, builtin_io_t *io) {
+    if (argv[1] == NULL) {
+        parsecache_stats(io->out);
+        return 0;
+    }
+    
+    if (strcmp(argv[1], "-r") == 0) {
+        parsecache_clear();
+        return 0;
+    }
+    
+    fprintf(io->err, "myshell: parsecache: usage: parsecache [-r]\n");
+    return 1;
+}
+
+/**
+ * Built-in: history - List, or clear, the command history
+ */
+int builtin_history(char **argv, builtin_io_t *io) {
+    int length = history_length();
+    int first = 0;
+    
+    if (argv[1] != NULL && strcmp(argv[1], "-c") == 0 && argv[2] == NULL) {
+        clear_history();
+        return 0;
+    }
+    
+    if (argv[1] != NULL) {
+        char *end;
+        long n = strtol(argv[1], &end, 10);
+        if (*argv[1] == '\0' || *end != '\0' || n < 0 || argv[2] != NULL) {
+            fprintf(io->err, "myshell: history: usage: history [-c] [n]\n");
+            return 2;
+        }
+        if (n < length) {
+            first = length - (int)n;
+        }
+    }
+    
+    for (int i = first; i < length; i++) {
+        fprintf(io->out, "%5d  %s\n", history_base() + i, history_get(i));
+    }
+    return 0;
+}
+
+/**
+ * Print one backslash escape starting at p (p[0] == '\\')
+ * @param p: Escape sequence
+ * @param octal_needs_zero: 1 for echo/%b style (\0NNN), 0 for printf (\NNN)
+ * @param stop: Set to 1 when \c ends all output
+ * @param out: Stream to print to
+ * @return: Pointer to the last character consumed
+ */
+static const char *print_escape(const char *p, int octal_needs_zero, int *stop, FILE *out) {
+    char c = p[1];
+    
+    switch (c) {
+        case 'a':  fputc('\a', out); return p + 1;
+        case 'b':  fputc('\b', out); return p + 1;
+        case 'e':  fputc('\033', out); return p + 1;
+        case 'f':  fputc('\f', out); return p + 1;
+        case 'n':  fputc('\n', out); return p + 1;
+        case 'r':  fputc('\r', out); return p + 1;
+        case 't':  fputc('\t', out); return p + 1;
+        case 'v':  fputc('\v', out); return p + 1;
+        case '\\': fputc('\\', out); return p + 1;
+        case 'c':  *stop = 1; return p + 1;
+        case '\0': fputc('\\', out); return p;
+        default:
+            break;
+    }
+    
+    // Octal escape
+    if ((octal_needs_zero && c == '0') || (!octal_needs_zero && c >= '0' && c <= '7')) {
+        const char *q = p + (octal_needs_zero ? 2 : 1);
+        int value = 0;
+        for (int n = 0; n < 3 && *q >= '0' && *q <= '7'; n++, q++) {
+            value = value * 8 + (*q - '0');
+        }
+        fputc(value, out);
+        return q - 1;
+    }
+    
+    // Unknown escape: print it unchanged
+    fputc('\\', out);
+    fputc(c, out);
+    return p + 1;
+}
+
+/**
+ * Print a string, interpreting backslash escapes (echo -e, printf %b)
+ * @return: 1 if \c was seen (stop all output), 0 otherwise
+ */
+static int print_escaped(const char *s, FILE *out) {
+    int stop = 0;
+    for (const char *p = s; *p && !stop; p++) {
+        if (*p == '\\') {
+            p = print_escape(p, 1, &stop, out);
+        } else {
+            fputc(*p, out);
+        }
+    }
+    return stop;
+}
+
+/**
+ * Built-in: echo - Print arguments
+ */
+int builtin_echo(char **argv, builtin_io_t *io) {
+    int newline = 1;
+    int escapes = 0;
+    int i = 1;
+    
+    // Options: -n (no newline), -e (escapes), -E (no escapes), combinable
+    for (; argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        const char *opt = argv[i] + 1;
+        if (strspn(opt, "neE") != strlen(opt)) {
+            break;  // Not an option: print it
+        }
+        for (; *opt; opt++) {
+            if (*opt == 'n') newline = 0;
+            else if (*opt == 'e') escapes = 1;
+            else escapes = 0;
+        }
+    }
+    
+    for (int first = i; argv[i] != NULL; i++) {
+        if (i > first) {
+            fputc(' ', io->out);
+        }
+        if (escapes) {
+            if (print_escaped(argv[i], io->out)) {
+                return 0;
+            }
+        } else {
+            fputs(argv[i], io->out);
+        }
+    }
+    
+    if (newline) {
+        fputc('\n', io->out);
+    }
+    return 0;
+}
+
+/**
+ * Convert a printf argument to a number ('c gives the character code)
+ */
+static int printf_number(const char *arg, long long *signed_value,
+                         unsigned long long *unsigned_value, double *float_value,
+                         FILE *err) {
+    char *end;
+    
+    if (arg == NULL || *arg == '\0') {
+        *signed_value = 0;
+        *unsigned_value = 0;
+        *float_value = 0;
+        return 0;
+    }
+    if (arg[0] == '\'' || arg[0] == '"') {
+        *signed_value = (unsigned char)arg[1];
+        *unsigned_value = (unsigned char)arg[1];
+        *float_value = (unsigned char)arg[1];
+        return 0;
+    }
+    
+    errno = 0;
+    *float_value = strtod(arg, &end);
+    if (strpbrk(arg, ".eE") == NULL || strncmp(arg, "0x", 2) == 0) {
+        *signed_value = strtoll(arg, &end, 0);
+        *unsigned_value = (arg[0] == '-') ? (unsigned long long)*signed_value
+                                          : strtoull(arg, &end, 0);
+    } else {
+        *signed_value = (long long)*float_value;
+        *unsigned_value = (unsigned long long)*signed_value;
+    }
+    if (*end != '\0' || errno) {
+        fprintf(err, "myshell: printf: %s: invalid number\n", arg);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Built-in: printf - Formatted output
+ */
+int builtin_printf(char **argv, builtin_io_t *io) {
+    const char *format = argv[1];
+    char **args;
+    int status = 0;
+    int stop = 0;
+    
+    if (format == NULL) {
+        fprintf(io->err, "myshell: printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+    args = argv + 2;
+    
+    // The format is reused as long as it consumes arguments
+    do {
+        char **pass_start = args;
+        
+        for (const char *p = format; *p && !stop; p++) {
+            if (*p == '\\') {
+                p = print_escape(p, 0, &stop, io->out);
+                continue;
+            }
+            if (*p != '%') {
+                fputc(*p, io->out);
+                continue;
+            }
+            if (p[1] == '%') {
+                fputc('%', io->out);
+                p++;
+                continue;
+            }
+            
+            // Conversion specification: %[flags][width][.precision]conv
+            char spec[64];
+            int len = 0;
+            int star[2] = {0, 0};
+            int nstar = 0;
+            spec[len++] = '%';
+            p++;
+            while (*p && strchr("-+ #0", *p) && len < 40) spec[len++] = *p++;
+            if (*p == '*') {
+                star[nstar++] = *args ? atoi(*args++) : 0;
+                spec[len++] = '*';
+                p++;
+            } else {
+                while (isdigit((unsigned char)*p) && len < 40) spec[len++] = *p++;
+            }
+            if (*p == '.') {
+                spec[len++] = *p++;
+                if (*p == '*') {
+                    star[nstar++] = *args ? atoi(*args++) : 0;
+                    spec[len++] = '*';
+                    p++;
+                } else {
+                    while (isdigit((unsigned char)*p) && len < 40) spec[len++] = *p++;
+                }
+            }
+            
+            char conv = *p;
+            const char *arg = *args ? *args++ : NULL;
+            long long sv;
+            unsigned long long uv;
+            double fv;
+            
+            switch (conv) {
+                case 's':
+                case 'c':
+                    spec[len++] = 's';
+                    spec[len] = '\0';
+                    if (conv == 'c') {
+                        char ch[2] = {arg ? arg[0] : '\0', '\0'};
+                        arg = ch;
+                        if (nstar == 2) fprintf(io->out, spec, star[0], star[1], arg);
+                        else if (nstar == 1) fprintf(io->out, spec, star[0], arg);
+                        else fprintf(io->out, spec, arg);
+                        break;
+                    }
+                    if (!arg) arg = "";
+                    if (nstar == 2) fprintf(io->out, spec, star[0], star[1], arg);
+                    else if (nstar == 1) fprintf(io->out, spec, star[0], arg);
+                    else fprintf(io->out, spec, arg);
+                    break;
+                case 'b':
+                    if (arg && print_escaped(arg, io->out)) {
+                        stop = 1;
+                    }
+                    break;
+                case 'd':
+                case 'i':
+                    status |= printf_number(arg, &sv, &uv, &fv, io->err);
+                    spec[len++] = 'l';
+                    spec[len++] = 'l';
+                    spec[len++] = 'd';
+                    spec[len] = '\0';
+                    if (nstar == 2) fprintf(io->out, spec, star[0], star[1], sv);
+                    else if (nstar == 1) fprintf(io->out, spec, star[0], sv);
+                    else fprintf(io->out, spec, sv);
+                    break;
+                case 'o':
+                case 'u':
+                case 'x':
+                case 'X':
+                    status |= printf_number(arg, &sv, &uv, &fv, io->err);
+                    spec[len++] = 'l';
+                    spec[len++] = 'l';
+                    spec[len++] = conv;
+                    spec[len] = '\0';
+                    if (nstar == 2) fprintf(io->out, spec, star[0], star[1], uv);
+                    else if (nstar == 1) fprintf(io->out, spec, star[0], uv);
+                    else fprintf(io->out, spec, uv);
+                    break;
+                case 'f':
+                case 'F':
+                case 'e':
+                case 'E':
+                case 'g':
+                case 'G':
+                case 'a':
+                case 'A':
+                    status |= printf_number(arg, &sv, &uv, &fv, io->err);
+                    spec[len++] = conv;
+                    spec[len] = '\0';
+                    if (nstar == 2) fprintf(io->out, spec, star[0], star[1], fv);
+                    else if (nstar == 1) fprintf(io->out, spec, star[0], fv);
+                    else fprintf(io->out, spec, fv);
+                    break;
+                default:
+                    fprintf(io->err, "myshell: printf: %%%c: invalid conversion\n", conv ? conv : '%');
+                    return 1;
+            }
+        }
+        
+        // Stop if this pass consumed nothing (or the format has no conversions)
+        if (args == pass_start) {
+            break;
+        }
+    } while (*args && !stop);
+    
+    return status;
+}
+
+/**
+ * Built-in: pwd - Print working directory
+ */
+int builtin_pwd(char **argv, builtin_io_t *io) {
+    char *cwd;
+    (void)argv; // Unused parameter
+    
+    cwd = getcwd(NULL, 0);
+    if (cwd == NULL) {
+        error_system("pwd");
+        return 1;
+    }
+    fprintf(io->out, "%s\n", cwd);
+    free(cwd);
+    return 0;
+}
+
+/*
+ * test / [ - recursive descent over the argument list
+ *   expr    := and ( -o and )*
+ *   and     := not ( -a not )*
+ *   not     := ! not | primary
+ *   primary := ( expr ) | unary-op arg | arg binary-op arg | arg
+ */
+
+typedef struct test_state {
+    char **argv;
+    int pos;
+    int argc;
+    int error;
+    FILE *err;
+} test_state_t;
+
+static int test_expr(test_state_t *t);
+
+static const char *test_peek(test_state_t *t, int offset) {
+    return (t->pos + offset < t->argc) ? t->argv[t->pos + offset] : NULL;
+}
+
+static int test_is_binary(const char *op) {
+    static const char *ops[] = {"=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le",
+                                "-gt", "-ge", "-nt", "-ot", "-ef", NULL};
+    for (int i = 0; op && ops[i]; i++) {
+        if (strcmp(op, ops[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+static int test_integer(test_state_t *t, const char *s, long long *value) {
+    char *end;
+    errno = 0;
+    *value = strtoll(s, &end, 10);
+    while (isspace((unsigned char)*end)) end++;
+    if (*s == '\0' || *end != '\0' || errno) {
+        fprintf(t->err, "myshell: test: %s: integer expression expected\n", s);
+        t->error = 1;
+        return 0;
+    }
+    return 1;
+}
+
+static int test_unary(test_state_t *t, char op, const char *arg) {
+    struct stat st;
+    
+    switch (op) {
+        case 'n': return arg[0] != '\0';
+        case 'z': return arg[0] == '\0';
+        case 't': return isatty(atoi(arg));
+        case 'e': return stat(arg, &st) == 0;
+        case 'f': return stat(arg, &st) == 0 && S_ISREG(st.st_mode);
+        case 'd': return stat(arg, &st) == 0 && S_ISDIR(st.st_mode);
+        case 's': return stat(arg, &st) == 0 && st.st_size > 0;
+        case 'r': return access(arg, R_OK) == 0;
+        case 'w': return access(arg, W_OK) == 0;
+        case 'x': return access(arg, X_OK) == 0;
+        #ifndef _WIN32
+        case 'h':
+        case 'L': return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+        case 'b': return stat(arg, &st) == 0 && S_ISBLK(st.st_mode);
+        case 'c': return stat(arg, &st) == 0 && S_ISCHR(st.st_mode);
+        case 'p': return stat(arg, &st) == 0 && S_ISFIFO(st.st_mode);
+        case 'S': return stat(arg, &st) == 0 && S_ISSOCK(st.st_mode);
+        #endif
+        default:
+            fprintf(t->err, "myshell: test: -%c: unary operator expected\n", op);
+            t->error = 1;
+            return 0;
+    }
+}
+
+static int test_binary(test_state_t *t, const char *left, const char *op, const char *right) {
+    long long a, b;
+    struct stat sa, sb;
+    
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return strcmp(left, right) == 0;
+    if (strcmp(op, "!=") == 0) return strcmp(left, right) != 0;
+    if (strcmp(op, "<") == 0) return strcmp(left, right) < 0;
+    if (strcmp(op, ">") == 0) return strcmp(left, right) > 0;
+    
+    if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0 || strcmp(op, "-ef") == 0) {
+        int la = stat(left, &sa) == 0, lb = stat(right, &sb) == 0;
+        if (op[1] == 'n') return la && (!lb || sa.st_mtime > sb.st_mtime);
+        if (op[1] == 'o') return lb && (!la || sa.st_mtime < sb.st_mtime);
+        return la && lb && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+    }
+    
+    if (!test_integer(t, left, &a) || !test_integer(t, right, &b)) {
+        return 0;
+    }
+    if (strcmp(op, "-eq") == 0) return a == b;
+    if (strcmp(op, "-ne") == 0) return a != b;
+    if (strcmp(op, "-lt") == 0) return a < b;
+    if (strcmp(op, "-le") == 0) return a <= b;
+    if (strcmp(op, "-gt") == 0) return a > b;
+    return a >= b;  // -ge
+}
+
+static int test_primary(test_state_t *t) {
+    const char *arg = test_peek(t, 0);
+    
+    if (arg == NULL) {
+        fprintf(t->err, "myshell: test: argument expected\n");
+        t->error = 1;
+        return 0;
+    }
+    
+    // Binary operator first, so "-n = x" compares strings
+    if (test_is_binary(test_peek(t, 1)) && test_peek(t, 2) != NULL) {
+        const char *op = test_peek(t, 1);
+        const char *right = test_peek(t, 2);
+        t->pos += 3;
+        return test_binary(t, arg, op, right);
+    }
+    
+    if (strcmp(arg, "(") == 0 && test_peek(t, 1) != NULL) {
+        t->pos++;
+        int result = test_expr(t);
+        if (test_peek(t, 0) == NULL || strcmp(test_peek(t, 0), ")") != 0) {
+            fprintf(t->err, "myshell: test: `)' expected\n");
+            t->error = 1;
+            return 0;
+        }
+        t->pos++;
+        return result;
+    }
+    
+    if (arg[0] == '-' && arg[1] != '\0' && arg[2] == '\0' && test_peek(t, 1) != NULL) {
+        t->pos += 2;
+        return test_unary(t, arg[1], test_peek(t, -1));
+    }
+    
+    // A lone string is true if non-empty
+    t->pos++;
+    return arg[0] != '\0';
+}
+
+static int test_not(test_state_t *t) {
+    const char *arg = test_peek(t, 0);
+    if (arg && strcmp(arg, "!") == 0 && test_peek(t, 1) != NULL) {
+        t->pos++;
+        return !test_not(t);
+    }
+    return test_primary(t);
+}
+
+static int test_and(test_state_t *t) {
+    int result = test_not(t);
+    while (!t->error && test_peek(t, 0) && strcmp(test_peek(t, 0), "-a") == 0) {
+        t->pos++;
+        int right = test_not(t);
+        result = result && right;
+    }
+    return result;
+}
+
+static int test_expr(test_state_t *t) {
+    int result = test_and(t);
+    while (!t->error && test_peek(t, 0) && strcmp(test_peek(t, 0), "-o") == 0) {
+        t->pos++;
+        int right = test_and(t);
+        result = result || right;
+    }
+    return result;
+}
+
+/**
+ * Built-in: test / [ - Evaluate a conditional expression
+ */
+int builtin_test(char **argv, builtin_io_t *io) {
+    test_state_t t = {argv + 1, 0, 0, 0, io->err};
+    
+    while (t.argv[t.argc] != NULL) {
+        t.argc++;
+    }
+    
+    // [ requires a closing ]
+    if (strcmp(argv[0], "[") == 0) {
+        if (t.argc == 0 || strcmp(t.argv[t.argc - 1], "]") != 0) {
+            fprintf(io->err, "myshell: [: missing `]'\n");
+            return 2;
+        }
+        t.argc--;
+    }
+    
+    // No arguments: false
+    if (t.argc == 0) {
+        return 1;
+    }
+    
+    int result = test_expr(&t);
+    if (!t.error && t.pos < t.argc) {
+        fprintf(t.err, "myshell: test: %s: unexpected argument\n", t.argv[t.pos]);
+        t.error = 1;
+    }
+    if (t.error) {
+        return 2;
+    }
+    return result ? 0 : 1;
+}
+
+/**
+ * Shell options settable with set -o name / set +o name
+ */
+static struct {
+    const char *name;
+    char letter;             // Short form (set -n), or 0
+    int *value;
+} shell_options[] = {
+    {"noexec", 'n', &shell.noexec},
+    {"pipefail", 0, &shell.pipefail},
+};
+
+#define NUM_SHELL_OPTIONS (int)(sizeof(shell_options) / sizeof(shell_options[0]))
+
+/**
+ * Built-in: set - Set or show shell options
+ */
+int builtin_set(char **argv, builtin_io_t *io) {
+    // set / set -o / set +o: show options
+    if (argv[1] == NULL || (argv[2] == NULL && (strcmp(argv[1], "-o") == 0 || strcmp(argv[1], "+o") == 0))) {
+        int as_commands = (argv[1] != NULL && argv[1][0] == '+');
+        for (int i = 0; i < NUM_SHELL_OPTIONS; i++) {
+            if (as_commands) {
+                fprintf(io->out, "set %co %s\n", *shell_options[i].value ? '-' : '+', shell_options[i].name);
+            } else {
+                fprintf(io->out, "%-15s %s\n", shell_options[i].name, *shell_options[i].value ? "on" : "off");
+            }
+        }
+        return 0;
+    }
+    
+    for (int i = 1; argv[i] != NULL; i++) {
+        const char *arg = argv[i];
+        int enable = (arg[0] == '-');
+        
+        if ((arg[0] != '-' && arg[0] != '+') || arg[1] == '\0') {
+            fprintf(io->err, "myshell: set: %s: invalid option\n", arg);
+            return 2;
+        }
+        
+        if (strcmp(arg + 1, "o") == 0) {
+            // -o name / +o name
+            const char *name = argv[++i];
+            int found = 0;
+            if (name == NULL) {
+                fprintf(io->err, "myshell: set: %s: option name required\n", arg);
+                return 2;
+            }
+            for (int j = 0; j < NUM_SHELL_OPTIONS; j++) {
+                if (strcmp(name, shell_options[j].name) == 0) {
+                    *shell_options[j].value = enable;
+                    found = 1;
+                }
+            }
+            if (!found) {
+                fprintf(io->err, "myshell: set: %s: invalid option name\n", name);
+                return 2;
+            }
+            continue;
+        }
+        
+        // Short options: -n, +n
+        for (const char *c = arg + 1; *c; c++) {
+            int found = 0;
+            for (int j = 0; j < NUM_SHELL_OPTIONS; j++) {
+                if (shell_options[j].letter == *c) {
+                    *shell_options[j].value = enable;
+                    found = 1;
+                }
+            }
+            if (!found) {
+                fprintf(io->err, "myshell: set: %c%c: invalid option\n", arg[0], *c);
+                return 2;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Built-in: export - Mark variables for export, optionally assigning them
+ */
+int builtin_export(char **argv, builtin_io_t *io) {
+    int exported = 1;
+    int status = 0;
+    int i;
+    
+    // -n unexports, -p (or no names) lists
+    for (i = 1; argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        for (const char *c = argv[i] + 1; *c; c++) {
+            if (*c == 'n') {
+                exported = 0;
+            } else if (*c != 'p') {
+                fprintf(io->err, "myshell: export: -%c: invalid option\n", *c);
+                fprintf(io->err, "myshell: export: usage: export [-n] [-p] [name[=value] ...]\n");
+                return 2;
+            }
+        }
+    }
+    if (argv[i] == NULL) {
+        vars_list_exported(io->out);
+        return 0;
+    }
+    
+    for (; argv[i] != NULL; i++) {
+        char *eq = strchr(argv[i], '=');
+        size_t len = eq ? (size_t)(eq - argv[i]) : strlen(argv[i]);
+        if (!vars_valid_name(argv[i], len)) {
+            fprintf(io->err, "myshell: export: `%s': not a valid identifier\n", argv[i]);
+            status = 1;
+            continue;
+        }
+        if (eq) {
+            vars_assign(argv[i], exported ? VAR_EXPORT : 0);
+            *eq = '\0';
+        }
+        vars_export(argv[i], exported);
+        if (eq) {
+            *eq = '=';
+        }
+    }
+    return status;
+}
+
+/**
+ * Built-in: unset - Remove variables
+ */
+int builtin_unset(char **argv, builtin_io_t *io) {
+    int status = 0;
+    int functions = 0;
+    int i = 1;
+    
+    if (argv[i] != NULL && strcmp(argv[i], "-f") == 0) {
+        functions = 1;
+        i++;
+    } else if (argv[i] != NULL && (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--") == 0)) {
+        i++;
+    } else if (argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0') {
+        fprintf(io->err, "myshell: unset: %s: invalid option\n", argv[i]);
+        fprintf(io->err, "myshell: unset: usage: unset [-f] [-v] name ...\n");
+        return 2;
+    }
+    
+    for (; argv[i] != NULL; i++) {
+        if (functions) {
+            vm_unset_function(argv[i]);
+            continue;
+        }
+        if (!vars_valid_name(argv[i], strlen(argv[i]))) {
+            fprintf(io->err, "myshell: unset: `%s': not a valid identifier\n", argv[i]);
+            status = 1;
+            continue;
+        }
+        vars_unset(argv[i]);
+    }
+    return status;
+}
+
+/**
+ * Built-in: exec - Replace the shell with a command
+ */
+int builtin_exec(char **argv, builtin_io_t *io) {
+    int i = 1;
+    
+    if (argv[i] != NULL && strcmp(argv[i], "--") == 0) {
+        i++;
+    }
+    if (argv[i] == NULL) {
+        // Redirections only; already applied for good by the caller
+        return 0;
+    }
+    
+    // Whatever the builtin's streams hold must not be lost with the process
+    fflush(io->out);
+    fflush(io->err);
+    #ifdef _WIN32
+    _execvpe(argv[i], (const char *const *)(argv + i), (const char *const *)vars_environ());
+    fprintf(io->err, "myshell: exec: %s: command not found\n", argv[i]);
+    return 127;
+    #else
+    // Prefix assignments are in the variable table for the builtin's duration
+    return launch_exec(argv + i, NULL);
+    #endif
+}
+
+/**
+ * Shared part of break and continue
+ * @param what: VM_BREAK or VM_CONTINUE
+ */
+static int loop_control(char **argv, builtin_io_t *io, int what) {
+    long count = 1;
+    int depth = vm_loop_depth();
+    
     if (argv[1] != NULL) {
-        if (argv[1][0] == '%') {
-            job_id = atoi(argv[1] + 1);
+        char *end;
+        count = strtol(argv[1], &end, 10);
+        if (argv[1][0] == '\0' || *end != '\0' || count < 1) {
+            fprintf(io->err, "myshell: %s: %s: loop count out of range\n", argv[0], argv[1]);
+            return 1;
+        }
+    }
+    if (depth == 0) {
+        fprintf(io->err, "myshell: %s: only meaningful in a `for', `while', or `until' loop\n", argv[0]);
+        return 0;
+    }
+    
+    // break 5 inside two loops leaves both
+    vm_control(what, (count < depth) ? (int)count : depth);
+    return 0;
+}
+
+/**
+ * Built-in: break - Leave the innermost (or Nth) enclosing loop
+ */
+int builtin_break(char **argv, builtin_io_t *io) {
+    return loop_control(argv, io, VM_BREAK);
+}
+
+/**
+ * Built-in: continue - Start the next iteration of the innermost (or Nth) loop
+ */
+int builtin_continue(char **argv, builtin_io_t *io) {
+    return loop_control(argv, io, VM_CONTINUE);
+}
+
+/**
+ * Built-in: return - Leave the running function
+ */
+int builtin_return(char **argv, builtin_io_t *io) {
+    int status = shell.last_status;
+    
+    if (vm_function_depth() == 0) {
+        fprintf(io->err, "myshell: return: can only `return' from a function\n");
+        return 1;
+    }
+    if (argv[1] != NULL) {
+        char *end;
+        long value = strtol(argv[1], &end, 10);
+        if (argv[1][0] == '\0' || *end != '\0') {
+            fprintf(io->err, "myshell: return: %s: numeric argument required\n", argv[1]);
+            status = 2;
         } else {
-            job_id = atoi(argv[1]);
+            status = (int)(value & 0xff);
         }
     }
+    vm_control(VM_RETURN, 0);
+    return status;
+}
+
+/**
+ * Built-in: let - Evaluate arithmetic expressions
+ */
+int builtin_let(char **argv, builtin_io_t *io) {
+    int64_t value = 0;
     
-    return bg_job(job_id);
+    if (argv[1] == NULL) {
+        fprintf(io->err, "myshell: let: expression expected\n");
+        return 1;
+    }
+    for (int i = 1; argv[i] != NULL; i++) {
+        if (arith_eval(argv[i], &value, io->err) < 0) {
+            return 1;
+        }
+    }
+    return value == 0;
 }
@@ -0,0 +1,333 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#define access _access
+#define X_OK 0
+#define PATH_SEP ';'
+#else
+#include <unistd.h>
+#define PATH_SEP ':'
+#endif
+
+#include "cmdhash.h"
+#include "error.h"
+#include "vars.h"
+#include "hashtable.h"
+
+#define CMDHASH_INITIAL_BUCKETS 64
+
+// One cached command; path == NULL records a miss
+typedef struct cmdhash_entry {
+    char *name;
+    char *path;
+    unsigned int hits;
+    unsigned int generation;   // PATH directory state a miss was found in
+    struct cmdhash_entry *next;
+} cmdhash_entry_t;
+
+// A PATH directory as last seen; a cached miss stands while none change
+typedef struct path_dir {
+    char *path;
+    int exists;                // -1 until first looked at
+    dev_t dev;
+    ino_t ino;
+    #ifdef _WIN32
+    time_t mtime;
+    #else
+    struct timespec mtime;
+    #endif
+} path_dir_t;
+
+static cmdhash_entry_t **buckets = NULL;
+static unsigned int bucket_count = 0;
+static unsigned int entry_count = 0;
+static char *cached_path_var = NULL;   // PATH the table was built against
+static path_dir_t *path_dirs = NULL;   // Its directories
+static int num_path_dirs = 0;
+static unsigned int dirs_generation = 0;
+
+static void free_entry(cmdhash_entry_t *e) {
+    free(e->name);
+    free(e->path);
+    free(e);
+}
+
+void cmdhash_clear(void) {
+    for (unsigned int i = 0; i < bucket_count; i++) {
+        cmdhash_entry_t *e = buckets[i];
+        while (e) {
+            cmdhash_entry_t *next = e->next;
+            free_entry(e);
+            e = next;
+        }
+        buckets[i] = NULL;
+    }
+    entry_count = 0;
+}
+
+static void free_path_dirs(void) {
+    for (int i = 0; i < num_path_dirs; i++) {
+        free(path_dirs[i].path);
+    }
+    free(path_dirs);
+    path_dirs = NULL;
+    num_path_dirs = 0;
+}
+
+/**
+ * Split cached_path_var into its directories, none of them looked at yet
+ */
+static void set_path_dirs(void) {
+    int count = 1;
+    for (const char *c = cached_path_var; *c; c++) {
+        if (*c == PATH_SEP) count++;
+    }
+    path_dirs = calloc(count, sizeof(path_dir_t));
+    if (!path_dirs) {
+        error_allocation("cmdhash");
+        exit(EXIT_FAILURE);
+    }
+
+    const char *p = cached_path_var;
+    for (int i = 0; i < count; i++) {
+        const char *sep = strchr(p, PATH_SEP);
+        size_t len = sep ? (size_t)(sep - p) : strlen(p);
+        // Empty PATH component means the current directory
+        path_dirs[i].path = (len == 0) ? strdup(".") : strndup(p, len);
+        if (!path_dirs[i].path) {
+            error_allocation("cmdhash");
+            exit(EXIT_FAILURE);
+        }
+        path_dirs[i].exists = -1;
+        p = sep ? sep + 1 : p + len;
+    }
+    num_path_dirs = count;
+}
+
+/**
+ * Invalidate the table if PATH differs from the one it was built for
+ */
+static void check_path_changed(void) {
+    const char *path = vars_get("PATH");
+    if (path == NULL) path = "";
+
+    if (cached_path_var && strcmp(cached_path_var, path) == 0) {
+        return;
+    }
+    cmdhash_clear();
+    free(cached_path_var);
+    free_path_dirs();
+    cached_path_var = strdup(path);
+    if (!cached_path_var) {
+        error_allocation("cmdhash");
+        exit(EXIT_FAILURE);
+    }
+    set_path_dirs();
+}
+
+/**
+ * Look at every PATH directory (one stat each) for files added or removed
+ * @return: Generation of the directories' state, bumped whenever one of
+ *          them changed since the last call
+ */
+static unsigned int path_dirs_generation(void) {
+    int changed = 0;
+
+    for (int i = 0; i < num_path_dirs; i++) {
+        path_dir_t *dir = &path_dirs[i];
+        struct stat st;
+        int exists = (stat(dir->path, &st) == 0 && S_ISDIR(st.st_mode));
+
+        #ifdef _WIN32
+        int same_mtime = (exists && st.st_mtime == dir->mtime);
+        #else
+        int same_mtime = (exists && st.st_mtim.tv_sec == dir->mtime.tv_sec &&
+                          st.st_mtim.tv_nsec == dir->mtime.tv_nsec);
+        #endif
+        // "." (or a replaced directory) can become another directory: compare identity too
+        if (exists == dir->exists &&
+            (!exists || (same_mtime && st.st_dev == dir->dev && st.st_ino == dir->ino))) {
+            continue;
+        }
+        dir->exists = exists;
+        if (exists) {
+            dir->dev = st.st_dev;
+            dir->ino = st.st_ino;
+            #ifdef _WIN32
+            dir->mtime = st.st_mtime;
+            #else
+            dir->mtime = st.st_mtim;
+            #endif
+        }
+        changed = 1;
+    }
+    if (changed) {
+        dirs_generation++;
+    }
+    return dirs_generation;
+}
+
+static void grow_table(void) {
+    unsigned int new_count = bucket_count ? bucket_count * 2 : CMDHASH_INITIAL_BUCKETS;
+    cmdhash_entry_t **new_buckets = calloc(new_count, sizeof(cmdhash_entry_t *));
+    if (!new_buckets) {
+        error_allocation("cmdhash");
+        return;
+    }
+    for (unsigned int i = 0; i < bucket_count; i++) {
+        cmdhash_entry_t *e = buckets[i];
+        while (e) {
+            cmdhash_entry_t *next = e->next;
+            unsigned int b = hash_fnv1a_str(e->name) & (new_count - 1);
+            e->next = new_buckets[b];
+            new_buckets[b] = e;
+            e = next;
+        }
+    }
+    free(buckets);
+    buckets = new_buckets;
+    bucket_count = new_count;
+}
+
+/**
+ * Walk PATH once looking for an executable regular file
+ * @return: Newly allocated path or NULL
+ */
+static char *search_path(const char *name) {
+    const char *p = cached_path_var;
+    size_t name_len = strlen(name);
+
+    while (p) {
+        const char *sep = strchr(p, PATH_SEP);
+        size_t dir_len = sep ? (size_t)(sep - p) : strlen(p);
+        char *candidate = malloc(dir_len + name_len + 3);
+        struct stat st;
+
+        if (!candidate) {
+            error_allocation("cmdhash");
+            return NULL;
+        }
+        if (dir_len == 0) {
+            // Empty PATH component means the current directory
+            candidate[0] = '.';
+            dir_len = 1;
+        } else {
+            memcpy(candidate, p, dir_len);
+        }
+        candidate[dir_len] = '/';
+        memcpy(candidate + dir_len + 1, name, name_len + 1);
+
+        if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode) && access(candidate, X_OK) == 0) {
+            return candidate;
+        }
+        free(candidate);
+        p = sep ? sep + 1 : NULL;
+    }
+    return NULL;
+}
+
+const char *cmdhash_lookup(const char *name) {
+    if (name == NULL || name[0] == '\0') {
+        return NULL;
+    }
+    if (strchr(name, '/')) {
+        return name;
+    }
+
+    check_path_changed();
+
+    if (bucket_count > 0) {
+        cmdhash_entry_t *e = buckets[hash_fnv1a_str(name) & (bucket_count - 1)];
+        for (; e; e = e->next) {
+            if (strcmp(e->name, name) == 0) {
+                e->hits++;
+                if (e->path == NULL) {
+                    // A miss stands until a PATH directory changes (a command was installed)
+                    unsigned int generation = path_dirs_generation();
+                    if (generation != e->generation) {
+                        e->generation = generation;
+                        e->path = search_path(name);
+                    }
+                }
+                return e->path;
+            }
+        }
+    }
+
+    // Miss: resolve once and remember the answer, found or not
+    if (entry_count >= bucket_count * 3 / 4) {
+        grow_table();
+        if (bucket_count == 0) {
+            return NULL;
+        }
+    }
+    cmdhash_entry_t *e = malloc(sizeof(cmdhash_entry_t));
+    if (!e || !(e->name = strdup(name))) {
+        free(e);
+        error_allocation("cmdhash");
+        return NULL;
+    }
+    // Directories first: a change during the search is seen by the next lookup
+    e->generation = path_dirs_generation();
+    e->path = search_path(name);
+    e->hits = 1;
+
+    unsigned int b = hash_fnv1a_str(name) & (bucket_count - 1);
+    e->next = buckets[b];
+    buckets[b] = e;
+    entry_count++;
+
+    return e->path;
+}
+
+void cmdhash_forget(const char *name) {
+    if (bucket_count == 0 || name == NULL) {
+        return;
+    }
+    cmdhash_entry_t **link = &buckets[hash_fnv1a_str(name) & (bucket_count - 1)];
+    while (*link) {
+        if (strcmp((*link)->name, name) == 0) {
+            cmdhash_entry_t *e = *link;
+            *link = e->next;
+            free_entry(e);
+            entry_count--;
+            return;
+        }
+        link = &(*link)->next;
+    }
+}
+
+void cmdhash_list(FILE *out) {
+    int found = 0;
+    for (unsigned int i = 0; i < bucket_count; i++) {
+        for (cmdhash_entry_t *e = buckets[i]; e; e = e->next) {
+            if (!found) {
+                fprintf(out, "hits\tcommand\n");
+                found = 1;
+            }
+            if (e->path) {
+                fprintf(out, "%4u\t%s\n", e->hits, e->path);
+            } else {
+                fprintf(out, "%4u\t%s (not found)\n", e->hits, e->name);
+            }
+        }
+    }
+
+    if (!found) {
+        fprintf(out, "hash: hash table empty\n");
+    }
+}
+
+void cmdhash_free(void) {
+    cmdhash_clear();
+    free(buckets);
+    buckets = NULL;
+    bucket_count = 0;
+    free(cached_path_var);
+    cached_path_var = NULL;
+    free_path_dirs();
+}
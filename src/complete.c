@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define PATH_SEP ';'
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#define PATH_SEP ':'
+#endif
+
+#include "complete.h"
+#include "builtins.h"
+#include "arena.h"
+#include "error.h"
+#include "vars.h"
+
+/**
+ * One PATH directory and the executables found in it at its last scan
+ */
+typedef struct path_dir {
+    char *path;
+    int scanned;              // Scanned at least once
+    int exists;               // Directory existed at the last scan
+#ifndef _WIN32
+    struct timespec mtime;    // Directory mtime at the last scan
+#endif
+    arena_t strings;          // Storage for the names
+    const char **names;
+    int count;
+    int cap;
+} path_dir_t;
+
+static path_dir_t *dirs = NULL;
+static int num_dirs = 0;
+static char *indexed_path_var = NULL;   // PATH the directory list was built from
+
+// Every name from every directory plus the built-ins, sorted and unique
+static const char **index_names = NULL;
+static int index_count = 0;
+static int index_cap = 0;
+static int index_built = 0;
+
+static void free_dirs(void) {
+    for (int i = 0; i < num_dirs; i++) {
+        free(dirs[i].path);
+        free(dirs[i].names);
+        arena_free(&dirs[i].strings);
+    }
+    free(dirs);
+    dirs = NULL;
+    num_dirs = 0;
+}
+
+/**
+ * Split PATH into directories (an empty entry means the current directory)
+ */
+static void set_path(const char *path) {
+    free_dirs();
+    free(indexed_path_var);
+    indexed_path_var = strdup(path);
+
+    int max_dirs = 1;
+    for (const char *p = path; *p; p++) {
+        if (*p == PATH_SEP) max_dirs++;
+    }
+    dirs = calloc(max_dirs, sizeof(path_dir_t));
+    if (dirs == NULL || indexed_path_var == NULL) {
+        error_allocation("completion index");
+        exit(EXIT_FAILURE);
+    }
+
+    const char *start = path;
+    while (1) {
+        const char *end = strchr(start, PATH_SEP);
+        size_t len = end ? (size_t)(end - start) : strlen(start);
+        path_dir_t *dir = &dirs[num_dirs++];
+        if (len == 0) {
+            start = ".";
+            len = 1;
+        }
+        dir->path = malloc(len + 1);
+        if (dir->path == NULL) {
+            error_allocation("completion index");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(dir->path, start, len);
+        dir->path[len] = '\0';
+        arena_init(&dir->strings);
+        if (!end) break;
+        start = end + 1;
+    }
+    index_built = 0;
+}
+
+#ifndef _WIN32
+/**
+ * Has the directory changed since it was scanned?
+ * Updates the recorded state, so a rescan follows a "yes".
+ */
+static int dir_changed(path_dir_t *dir) {
+    struct stat st;
+    int exists = (stat(dir->path, &st) == 0 && S_ISDIR(st.st_mode));
+
+    if (dir->scanned && exists == dir->exists &&
+        (!exists || (st.st_mtim.tv_sec == dir->mtime.tv_sec && st.st_mtim.tv_nsec == dir->mtime.tv_nsec))) {
+        return 0;
+    }
+    dir->scanned = 1;
+    dir->exists = exists;
+    if (exists) {
+        dir->mtime = st.st_mtim;
+    }
+    return 1;
+}
+
+/**
+ * Collect the regular files with an execute bit in one directory
+ */
+static void scan_dir(path_dir_t *dir) {
+    arena_reset(&dir->strings);
+    dir->count = 0;
+    if (!dir->exists) {
+        return;
+    }
+
+    DIR *d = opendir(dir->path);
+    if (d == NULL) {
+        return;
+    }
+
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (ent->d_name[0] == '.' && (ent->d_name[1] == '\0' || strcmp(ent->d_name, "..") == 0)) {
+            continue;
+        }
+        if (ent->d_type == DT_DIR) {
+            continue;
+        }
+
+        struct stat st;
+        if (fstatat(dirfd(d), ent->d_name, &st, 0) < 0 ||
+            !S_ISREG(st.st_mode) || (st.st_mode & 0111) == 0) {
+            continue;
+        }
+
+        if (dir->count == dir->cap) {
+            dir->cap = dir->cap ? dir->cap * 2 : 64;
+            dir->names = realloc(dir->names, dir->cap * sizeof(char *));
+            if (dir->names == NULL) {
+                error_allocation("completion index");
+                exit(EXIT_FAILURE);
+            }
+        }
+        dir->names[dir->count++] = arena_strdup(&dir->strings, ent->d_name);
+    }
+    closedir(d);
+}
+#endif
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/**
+ * Merge every directory's names and the built-ins into index_names
+ */
+static void build_index(void) {
+    int total = num_builtins();
+    for (int i = 0; i < num_dirs; i++) {
+        total += dirs[i].count;
+    }
+    if (total > index_cap) {
+        index_cap = total;
+        free(index_names);
+        index_names = malloc(index_cap * sizeof(char *));
+        if (index_names == NULL) {
+            error_allocation("completion index");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int n = 0;
+    for (int i = 0; i < num_builtins(); i++) {
+        index_names[n++] = builtin_names[i];
+    }
+    for (int i = 0; i < num_dirs; i++) {
+        // An empty or missing directory has no names array at all
+        if (dirs[i].count == 0) {
+            continue;
+        }
+        memcpy(index_names + n, dirs[i].names, dirs[i].count * sizeof(char *));
+        n += dirs[i].count;
+    }
+    qsort(index_names, n, sizeof(char *), compare_names);
+
+    // The same name in several directories (or as a built-in) once
+    index_count = 0;
+    for (int i = 0; i < n; i++) {
+        if (index_count == 0 || strcmp(index_names[index_count - 1], index_names[i]) != 0) {
+            index_names[index_count++] = index_names[i];
+        }
+    }
+    index_built = 1;
+}
+
+/**
+ * Bring the index up to date with PATH and its directories
+ */
+static void refresh_index(void) {
+    const char *path = vars_get("PATH");
+    if (path == NULL) path = "";
+
+    if (indexed_path_var == NULL || strcmp(indexed_path_var, path) != 0) {
+        set_path(path);
+    }
+
+#ifndef _WIN32
+    for (int i = 0; i < num_dirs; i++) {
+        if (dir_changed(&dirs[i])) {
+            scan_dir(&dirs[i]);
+            index_built = 0;
+        }
+    }
+#endif
+
+    if (!index_built) {
+        build_index();
+    }
+}
+
+/**
+ * First index whose name is not less than prefix, or (if past_prefix)
+ * the first one that is past every name starting with prefix
+ */
+static int search_index(const char *prefix, size_t prefix_len, int past_prefix) {
+    int lo = 0, hi = index_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        int cmp = past_prefix ? strncmp(index_names[mid], prefix, prefix_len)
+                              : strcmp(index_names[mid], prefix);
+        if (cmp < 0 || (past_prefix && cmp == 0)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+int complete_commands(const char *prefix, const char *const **names) {
+    size_t prefix_len = strlen(prefix);
+
+    refresh_index();
+
+    int first = search_index(prefix, prefix_len, 0);
+    int last = search_index(prefix, prefix_len, 1);
+    *names = index_names + first;
+    return last - first;
+}
+
+void complete_free(void) {
+    free_dirs();
+    free(indexed_path_var);
+    indexed_path_var = NULL;
+    free(index_names);
+    index_names = NULL;
+    index_count = 0;
+    index_cap = 0;
+    index_built = 0;
+}
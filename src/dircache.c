@@ -0,0 +1,358 @@
+#ifndef _WIN32
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+
+#include "dircache.h"
+#include "arena.h"
+#include "error.h"
+#include "launch.h"
+
+// Directories whose listings are kept (least recently used goes first)
+#define DIRCACHE_MAX_DIRS 8
+// Names read before they are handed to the editor
+#define DIRCACHE_BATCH 1024
+
+enum {
+    LISTING_EMPTY,
+    LISTING_QUEUED,         // Waiting for the scanner
+    LISTING_SCANNING,
+    LISTING_DONE
+};
+
+/**
+ * One directory's names
+ * While a listing is queued or scanning only the scanner touches its
+ * strings; names/count change under the lock, a batch at a time.
+ */
+typedef struct dir_listing {
+    int state;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;      // Directory mtime when the scan started
+    int fd;                     // Open directory for the scanner
+    unsigned long last_used;
+    arena_t strings;
+    const char **names;         // In directory order
+    size_t count;
+    size_t cap;
+    const char **sorted;        // Sorted copy, once the scan is done
+} dir_listing_t;
+
+static dir_listing_t listings[DIRCACHE_MAX_DIRS];
+static dir_listing_t *current = NULL;   // Listing of the lookup in progress
+static unsigned long use_clock = 0;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work = PTHREAD_COND_INITIALIZER;
+static pthread_t scanner;
+static int scanner_running = 0;
+static volatile int stopping = 0;
+static int notify_pipe[2] = {-1, -1};
+
+static void notify(void) {
+    if (notify_pipe[1] >= 0) {
+        // Non-blocking: a full pipe already means "more names"
+        ssize_t ignored = write(notify_pipe[1], "", 1);
+        (void)ignored;
+    }
+}
+
+/**
+ * Append a batch of names to a listing
+ */
+static void publish(dir_listing_t *listing, const char **batch, size_t n) {
+    if (n == 0) {
+        return;
+    }
+    pthread_mutex_lock(&lock);
+    if (listing->count + n > listing->cap) {
+        size_t cap = listing->cap ? listing->cap * 2 : DIRCACHE_BATCH;
+        while (cap < listing->count + n) cap *= 2;
+        const char **names = realloc(listing->names, cap * sizeof(char *));
+        if (names == NULL) {
+            error_allocation("directory listing");
+            exit(EXIT_FAILURE);
+        }
+        listing->names = names;
+        listing->cap = cap;
+    }
+    memcpy(listing->names + listing->count, batch, n * sizeof(char *));
+    listing->count += n;
+    pthread_mutex_unlock(&lock);
+    notify();
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/**
+ * Read a queued directory, publishing its names a batch at a time
+ */
+static void scan_listing(dir_listing_t *listing) {
+    const char *batch[DIRCACHE_BATCH];
+    size_t n = 0;
+
+    DIR *d = fdopendir(listing->fd);
+    if (d == NULL) {
+        close(listing->fd);
+    } else {
+        struct dirent *ent;
+        while (!stopping && (ent = readdir(d)) != NULL) {
+            const char *name = ent->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+
+            int is_dir = (ent->d_type == DT_DIR);
+            if (ent->d_type == DT_UNKNOWN || ent->d_type == DT_LNK) {
+                struct stat st;
+                is_dir = (fstatat(dirfd(d), name, &st, 0) == 0 && S_ISDIR(st.st_mode));
+            }
+
+            size_t len = strlen(name);
+            char *copy = arena_alloc(&listing->strings, len + 2);
+            memcpy(copy, name, len);
+            if (is_dir) copy[len++] = '/';
+            copy[len] = '\0';
+
+            batch[n++] = copy;
+            if (n == DIRCACHE_BATCH) {
+                publish(listing, batch, n);
+                n = 0;
+            }
+        }
+        closedir(d);
+    }
+    listing->fd = -1;
+    publish(listing, batch, n);
+
+    // Finished listings are searched by binary search
+    const char **sorted = malloc((listing->count ? listing->count : 1) * sizeof(char *));
+    if (sorted == NULL) {
+        error_allocation("directory listing");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(sorted, listing->names, listing->count * sizeof(char *));
+    qsort(sorted, listing->count, sizeof(char *), compare_names);
+
+    pthread_mutex_lock(&lock);
+    listing->sorted = sorted;
+    listing->state = LISTING_DONE;
+    pthread_mutex_unlock(&lock);
+    notify();
+}
+
+static void *scanner_main(void *arg) {
+    (void)arg;  // Unused parameter
+
+    pthread_mutex_lock(&lock);
+    while (!stopping) {
+        // The newest request first: that is the one being typed
+        dir_listing_t *next = NULL;
+        for (int i = 0; i < DIRCACHE_MAX_DIRS; i++) {
+            if (listings[i].state == LISTING_QUEUED &&
+                (next == NULL || listings[i].last_used > next->last_used)) {
+                next = &listings[i];
+            }
+        }
+        if (next == NULL) {
+            pthread_cond_wait(&work, &lock);
+            continue;
+        }
+        next->state = LISTING_SCANNING;
+        pthread_mutex_unlock(&lock);
+        scan_listing(next);
+        pthread_mutex_lock(&lock);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+/**
+ * Create the notification pipe and the scanner thread
+ * Signals stay with the main thread. If either cannot be created,
+ * directories are scanned synchronously instead.
+ */
+static void start_scanner(void) {
+    if (notify_pipe[0] < 0 && launch_private_pipe(notify_pipe, O_NONBLOCK) < 0) {
+        notify_pipe[0] = notify_pipe[1] = -1;
+        return;
+    }
+
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+    stopping = 0;
+    scanner_running = (pthread_create(&scanner, NULL, scanner_main, NULL) == 0);
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+}
+
+/**
+ * Find the listing for a directory, queueing a scan if it is missing
+ * or the directory changed since it was read
+ */
+static dir_listing_t *find_listing(const char *path) {
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&lock);
+    dir_listing_t *listing = NULL;
+    dir_listing_t *victim = NULL;
+    for (int i = 0; i < DIRCACHE_MAX_DIRS; i++) {
+        dir_listing_t *l = &listings[i];
+        if (l->state != LISTING_EMPTY && l->dev == st.st_dev && l->ino == st.st_ino) {
+            listing = l;
+        }
+        if (l->state == LISTING_EMPTY ||
+            (l->state == LISTING_DONE && (victim == NULL ||
+             (victim->state != LISTING_EMPTY && l->last_used < victim->last_used)))) {
+            victim = l;
+        }
+    }
+
+    if (listing && (listing->state != LISTING_DONE ||
+                    (listing->mtime.tv_sec == st.st_mtim.tv_sec && listing->mtime.tv_nsec == st.st_mtim.tv_nsec))) {
+        // Cached and unchanged, or being read right now
+        listing->last_used = ++use_clock;
+        pthread_mutex_unlock(&lock);
+        close(fd);
+        return listing;
+    }
+    if (listing) {
+        victim = listing;
+    }
+    if (victim == NULL) {
+        // Every slot is busy scanning
+        pthread_mutex_unlock(&lock);
+        close(fd);
+        return NULL;
+    }
+
+    arena_reset(&victim->strings);
+    free(victim->sorted);
+    victim->sorted = NULL;
+    victim->count = 0;
+    victim->state = LISTING_QUEUED;
+    victim->dev = st.st_dev;
+    victim->ino = st.st_ino;
+    victim->mtime = st.st_mtim;
+    victim->fd = fd;
+    victim->last_used = ++use_clock;
+    pthread_cond_signal(&work);
+    pthread_mutex_unlock(&lock);
+
+    if (!scanner_running) {
+        start_scanner();
+        if (!scanner_running) {
+            victim->state = LISTING_SCANNING;
+            scan_listing(victim);
+        }
+    }
+    return victim;
+}
+
+/**
+ * First sorted name not less than prefix
+ */
+static size_t lower_bound(const char **names, size_t count, const char *prefix) {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(names[mid], prefix) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+int dircache_match(const char *dir, const char *prefix, size_t *seen, dircache_fn fn, void *arg) {
+    size_t prefix_len = strlen(prefix);
+
+    // Notifications up to now are answered by this call
+    if (notify_pipe[0] >= 0) {
+        char buf[256];
+        while (read(notify_pipe[0], buf, sizeof(buf)) > 0) {
+        }
+    }
+
+    if (*seen == 0) {
+        current = find_listing(*dir ? dir : ".");
+    }
+    dir_listing_t *listing = current;
+    if (listing == NULL) {
+        return DIRCACHE_ERROR;
+    }
+
+    pthread_mutex_lock(&lock);
+    int state = (listing->state == LISTING_DONE) ? DIRCACHE_DONE : DIRCACHE_SCANNING;
+    if (state == DIRCACHE_DONE && *seen == 0) {
+        for (size_t i = lower_bound(listing->sorted, listing->count, prefix);
+             i < listing->count && strncmp(listing->sorted[i], prefix, prefix_len) == 0; i++) {
+            fn(listing->sorted[i], arg);
+        }
+    } else {
+        for (size_t i = *seen; i < listing->count; i++) {
+            if (strncmp(listing->names[i], prefix, prefix_len) == 0) {
+                fn(listing->names[i], arg);
+            }
+        }
+    }
+    *seen = listing->count;
+    pthread_mutex_unlock(&lock);
+
+    return state;
+}
+
+int dircache_fd(void) {
+    return notify_pipe[0];
+}
+
+void dircache_free(void) {
+    if (scanner_running) {
+        pthread_mutex_lock(&lock);
+        stopping = 1;
+        pthread_cond_signal(&work);
+        pthread_mutex_unlock(&lock);
+        pthread_join(scanner, NULL);
+        scanner_running = 0;
+    }
+
+    for (int i = 0; i < DIRCACHE_MAX_DIRS; i++) {
+        dir_listing_t *l = &listings[i];
+        if (l->state == LISTING_QUEUED) {
+            close(l->fd);
+        }
+        arena_free(&l->strings);
+        free(l->names);
+        free(l->sorted);
+        memset(l, 0, sizeof(*l));
+    }
+    current = NULL;
+
+    for (int i = 0; i < 2; i++) {
+        if (notify_pipe[i] >= 0) {
+            close(notify_pipe[i]);
+            notify_pipe[i] = -1;
+        }
+    }
+}
+#endif
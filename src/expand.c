@@ -0,0 +1,390 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "expand.h"
+#include "arith.h"
+#include "shell.h"
+#include "vars.h"
+
+/**
+ * Growable string built in an arena
+ */
+typedef struct strbuf {
+    arena_t *arena;
+    char *data;
+    size_t len;
+    size_t cap;
+} strbuf_t;
+
+static void sb_append(strbuf_t *sb, const char *bytes, size_t n) {
+    if (sb->len + n + 1 > sb->cap) {
+        size_t new_cap = (sb->cap * 2 > sb->len + n + 1) ? sb->cap * 2 : sb->len + n + 1;
+        sb->data = arena_realloc(sb->arena, sb->data, sb->cap, new_cap);
+        sb->cap = new_cap;
+    }
+    memcpy(sb->data + sb->len, bytes, n);
+    sb->len += n;
+}
+
+static void sb_putc(strbuf_t *sb, char c) {
+    sb_append(sb, &c, 1);
+}
+
+const char *lookup_variable(const char *name) {
+    static char number[32];
+
+    if (strcmp(name, "?") == 0) {
+        snprintf(number, sizeof(number), "%d", shell.last_status);
+        return number;
+    }
+    if (strcmp(name, "#") == 0) {
+        snprintf(number, sizeof(number), "%d", shell.argc);
+        return number;
+    }
+    if (strcmp(name, "$") == 0) {
+        snprintf(number, sizeof(number), "%d", (int)getpid());
+        return number;
+    }
+    if (isdigit((unsigned char)name[0])) {
+        int n = atoi(name);
+        if (n == 0) {
+            return shell.name;
+        }
+        return (n <= shell.argc) ? shell.argv[n - 1] : NULL;
+    }
+    if (strncmp(name, "PIPESTATUS", 10) == 0 && (name[10] == '\0' || name[10] == '[')) {
+        // $PIPESTATUS is its first element, like any array
+        int n = (name[10] == '[') ? atoi(name + 11) : 0;
+        if (n < 0 || n >= shell.num_pipestatus) {
+            return NULL;
+        }
+        snprintf(number, sizeof(number), "%d", shell.pipestatus[n]);
+        return number;
+    }
+
+    return vars_get(name);
+}
+
+// An expansion failed since the last expand_failed() call
+static int failed = 0;
+
+int expand_failed(void) {
+    int result = failed;
+    failed = 0;
+    return result;
+}
+
+/**
+ * Expand $(( expression )) whose `((` starts at s[i]
+ * The expression gets $ expansion and quote removal first, then is
+ * evaluated in the shell.
+ * @return: Index just past the `))`, or -1 if it is not closed
+ */
+static int expand_arith(strbuf_t *sb, const char *s, int i, int len) {
+    int depth = 0;
+    int end;
+
+    for (end = i + 2; end < len; end++) {
+        if (s[end] == '(') {
+            depth++;
+        } else if (s[end] == ')') {
+            if (depth == 0) {
+                break;
+            }
+            depth--;
+        }
+    }
+    if (end + 1 >= len || s[end + 1] != ')') {
+        return -1;
+    }
+
+    token_t inner = {TOK_WORD, WORD_QUOTED | WORD_DOLLAR, -1, (char *)s + i + 2, end - i - 2};
+    const char *expr = expand_word(sb->arena, &inner);
+    int64_t value;
+    if (arith_eval(expr, &value, stderr) < 0) {
+        failed = 1;
+    } else {
+        char number[24];
+        int digits = snprintf(number, sizeof(number), "%" PRId64, value);
+        sb_append(sb, number, digits);
+    }
+    return end + 2;
+}
+
+/**
+ * Find the `)` matching the `(` at s[i]; quotes inside are skipped, as
+ * the lexer does
+ * @return: Index of the `)`, or -1 if there is none
+ */
+static int match_paren(const char *s, int i, int len) {
+    int depth = 0;
+
+    for (; i < len; i++) {
+        char c = s[i];
+        if (c == '(') {
+            depth++;
+        } else if (c == ')') {
+            if (--depth == 0) {
+                return i;
+            }
+        } else if (c == '\\') {
+            i++;
+        } else if (c == '\'' || c == '"') {
+            for (i++; i < len && s[i] != c; i++) {
+                if (c == '"' && s[i] == '\\') {
+                    i++;
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+/**
+ * Run a command substitution and append its output
+ * @param command: Command text, NUL-terminated (in the arena)
+ */
+static void substitute(strbuf_t *sb, const char *command) {
+    const char *output = eval_substitution(sb->arena, command);
+    sb_append(sb, output, strlen(output));
+}
+
+/**
+ * Expand `command` whose opening backquote is s[i]
+ * Inside, a backslash quotes only $, ` and itself.
+ * @return: Index just past the closing backquote
+ */
+static int expand_backquotes(strbuf_t *sb, const char *s, int i, int len) {
+    char *command = arena_alloc(sb->arena, len - i);
+    int n = 0;
+
+    for (i++; i < len && s[i] != '`'; i++) {
+        if (s[i] == '\\' && i + 1 < len && strchr("$`\\", s[i + 1])) {
+            i++;
+        }
+        command[n++] = s[i];
+    }
+    command[n] = '\0';
+    substitute(sb, command);
+    return i + 1;
+}
+
+/**
+ * Expand the parameter reference at s[i] == '$'
+ * @return: Index just past the reference
+ */
+static int expand_dollar(strbuf_t *sb, const char *s, int i, int len) {
+    int start, end, next;
+
+    i++;  // Skip $
+    if (i + 1 < len && s[i] == '(' && s[i + 1] == '(') {
+        next = expand_arith(sb, s, i, len);
+        if (next >= 0) {
+            return next;
+        }
+    }
+    if (i < len && s[i] == '(') {
+        // $( command )
+        end = match_paren(s, i, len);
+        if (end >= 0) {
+            substitute(sb, arena_strndup(sb->arena, s + i + 1, end - i - 1));
+            return end + 1;
+        }
+    }
+    if (i < len && s[i] == '{') {
+        // ${VAR}
+        start = i + 1;
+        end = start;
+        while (end < len && s[end] != '}') end++;
+        if (end >= len) {
+            // No closing brace: keep the text literally
+            sb_putc(sb, '$');
+            return i;
+        }
+        next = end + 1;
+    } else if (i < len && (strchr("?#$@*", s[i]) || isdigit((unsigned char)s[i]))) {
+        // Special parameters are a single character
+        start = i;
+        end = next = i + 1;
+    } else if (i < len && (isalpha((unsigned char)s[i]) || s[i] == '_')) {
+        // Variable name: alphanumeric and underscore
+        start = i;
+        end = i + 1;
+        while (end < len && (isalnum((unsigned char)s[end]) || s[end] == '_')) end++;
+        next = end;
+    } else {
+        // A lone $ is literal
+        sb_putc(sb, '$');
+        return i;
+    }
+
+    // $@ and $*: every positional parameter, space separated
+    if (end - start == 1 && (s[start] == '@' || s[start] == '*')) {
+        for (int n = 0; n < shell.argc; n++) {
+            if (n > 0) {
+                sb_putc(sb, ' ');
+            }
+            sb_append(sb, shell.argv[n], strlen(shell.argv[n]));
+        }
+        return next;
+    }
+
+    // ${PIPESTATUS[@]}, ${PIPESTATUS[*]}: every element, space separated
+    if (end - start == 13 && strncmp(s + start, "PIPESTATUS[", 11) == 0 &&
+        (s[start + 11] == '@' || s[start + 11] == '*') && s[start + 12] == ']') {
+        char number[16];
+        for (int n = 0; n < shell.num_pipestatus; n++) {
+            int digits = snprintf(number, sizeof(number), n ? " %d" : "%d", shell.pipestatus[n]);
+            sb_append(sb, number, digits);
+        }
+        return next;
+    }
+    if (end - start == 14 && strncmp(s + start, "#PIPESTATUS[", 12) == 0 &&
+        (s[start + 12] == '@' || s[start + 12] == '*') && s[start + 13] == ']') {
+        char number[16];
+        int digits = snprintf(number, sizeof(number), "%d", shell.num_pipestatus);
+        sb_append(sb, number, digits);
+        return next;
+    }
+
+    const char *value = lookup_variable(arena_strndup(sb->arena, s + start, end - start));
+    if (value) {
+        sb_append(sb, value, strlen(value));
+    }
+    // If variable not found, just skip it (replace with empty string)
+    return next;
+}
+
+char *expand_word(arena_t *arena, const token_t *word) {
+    const char *s = word->start;
+    int len = word->len;
+    int in_double = 0;
+    int i = 0;
+
+    // Most words have nothing to expand: hand them back untouched
+    if (word->flags == 0) {
+        return word->start;
+    }
+
+    strbuf_t sb = {arena, NULL, 0, 0};
+    sb.cap = len + 1;
+    sb.data = arena_alloc(arena, sb.cap);
+
+    while (i < len) {
+        char c = s[i];
+
+        if (c == '\'' && !in_double) {
+            // Single quotes: everything literal up to the closing quote
+            int end = i + 1;
+            while (end < len && s[end] != '\'') end++;
+            sb_append(&sb, s + i + 1, end - i - 1);
+            i = end + 1;
+        } else if (c == '"') {
+            in_double = !in_double;
+            i++;
+        } else if (c == '\\') {
+            if (i + 1 >= len) {
+                sb_putc(&sb, '\\');
+                i++;
+            } else if (!in_double || strchr("$\"\\`\n", s[i + 1])) {
+                // Escaped character (backslash-newline is a continuation)
+                if (s[i + 1] != '\n') {
+                    sb_putc(&sb, s[i + 1]);
+                }
+                i += 2;
+            } else {
+                // Inside double quotes other backslashes are literal
+                sb_putc(&sb, '\\');
+                i++;
+            }
+        } else if (c == '$' && (word->flags & WORD_DOLLAR)) {
+            i = expand_dollar(&sb, s, i, len);
+        } else if (c == '`' && (word->flags & WORD_DOLLAR)) {
+            i = expand_backquotes(&sb, s, i, len);
+        } else {
+            sb_putc(&sb, c);
+            i++;
+        }
+    }
+
+    sb.data[sb.len] = '\0';
+    return sb.data;
+}
+
+char *expand_assignment(arena_t *arena, const token_t *word) {
+    // Expand just the value, then put the name back in front
+    int name_len = (int)(strchr(word->start, '=') - word->start) + 1;
+    token_t value = *word;
+    value.start += name_len;
+    value.len -= name_len;
+
+    const char *expanded = expand_word(arena, &value);
+    size_t len = strlen(expanded);
+    char *result = arena_alloc(arena, name_len + len + 1);
+    memcpy(result, word->start, name_len);
+    memcpy(result + name_len, expanded, len + 1);
+    return result;
+}
+
+char **expand_fields(arena_t *arena, const token_t *words, int count, int split, int *num_fields) {
+    int capacity = count + 1;
+    int n = 0;
+    char **fields = arena_alloc(arena, capacity * sizeof(char *));
+
+    for (int i = 0; i < count; i++) {
+        const token_t *word = &words[i];
+        int splits = split && word->flags == WORD_DOLLAR;
+        int extra;
+        char *text = NULL;
+
+        if (word->len == 4 && memcmp(word->start, "\"$@\"", 4) == 0) {
+            extra = shell.argc;
+        } else {
+            text = expand_word(arena, word);
+            extra = splits ? (int)strlen(text) / 2 + 1 : 1;
+        }
+        if (n + extra + 1 > capacity) {
+            int new_capacity = (capacity * 2 > n + extra + 1) ? capacity * 2 : n + extra + 1;
+            fields = arena_realloc(arena, fields, capacity * sizeof(char *),
+                                   new_capacity * sizeof(char *));
+            capacity = new_capacity;
+        }
+
+        if (text == NULL) {
+            // "$@": one field per parameter, even empty ones
+            for (int arg = 0; arg < shell.argc; arg++) {
+                fields[n++] = shell.argv[arg];
+            }
+        } else if (splits) {
+            // Unquoted expansion: split at blanks, dropping empty fields
+            char *p = text;
+            while (1) {
+                p += strspn(p, " \t\n");
+                if (*p == '\0') {
+                    break;
+                }
+                fields[n++] = p;
+                p += strcspn(p, " \t\n");
+                if (*p == '\0') {
+                    break;
+                }
+                *p++ = '\0';
+            }
+        } else {
+            fields[n++] = text;
+        }
+    }
+
+    fields[n] = NULL;
+    *num_fields = n;
+    return fields;
+}
@@ -0,0 +1,484 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#define open _open
+#define read _read
+#define write _write
+#define close _close
+#define O_CLOEXEC 0
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include "history.h"
+#include "histsearch.h"
+#include "error.h"
+#include "vars.h"
+
+#define HISTORY_CHUNK_SIZE (64 * 1024)
+#define HISTORY_MIN_SLOTS 64
+
+// Stands for a newline inside a multi-line command in $HISTFILE, which
+// holds one entry per line; the line editor never inserts it
+#define HISTORY_FILE_NEWLINE '\036'
+
+/**
+ * Block of packed, NUL-terminated lines
+ * Lines are appended in order and evicted in order, so chunks die
+ * oldest-first: a chunk is freed when its live count reaches zero.
+ */
+typedef struct history_chunk {
+    struct history_chunk *next;   // Newer chunk
+    size_t size;                  // Usable bytes in data[]
+    size_t used;                  // Bytes handed out
+    int live;                     // Held lines stored in this chunk
+    char data[];
+} history_chunk_t;
+
+typedef struct history_slot {
+    history_entry_t entry;
+    history_chunk_t *chunk;
+} history_slot_t;
+
+static history_slot_t *ring = NULL;
+static int ring_cap = 0;            // Slots allocated (grows up to max_size)
+static int ring_head = 0;           // Slot of the oldest line
+static int count = 0;               // Lines held
+static int max_size = HISTSIZE_DEFAULT;
+static int base = 1;                // History number of the oldest line
+
+static history_chunk_t *oldest_chunk = NULL;
+static history_chunk_t *newest_chunk = NULL;
+
+// $HISTFILE: appended to after every command, read back on first use
+static int hist_fd = -1;
+static const char *file_data = NULL;   // Contents at startup (mmap'd)
+static size_t file_size = 0;
+static int loaded = 1;                  // File contents merged into the ring
+static int pending = 0;                 // Newest line still to be logged
+
+/**
+ * Parse $HISTSIZE
+ * @return: The requested capacity, or HISTSIZE_DEFAULT if unset/invalid
+ */
+static int histsize_from_env(void) {
+    const char *value = vars_get("HISTSIZE");
+    if (!value || !*value) return HISTSIZE_DEFAULT;
+
+    char *end;
+    long size = strtol(value, &end, 10);
+    if (*end != '\0' || size < 0) return HISTSIZE_DEFAULT;
+    if (size > INT_MAX / 2) size = INT_MAX / 2;
+    return (int)size;
+}
+
+/**
+ * Copy a line into the newest chunk, starting a new chunk if it is full
+ * Lines longer than a chunk get a chunk of their own.
+ */
+static const char *store_text(const char *line, size_t len, history_chunk_t **chunk_out) {
+    history_chunk_t *chunk = newest_chunk;
+
+    if (chunk == NULL || chunk->size - chunk->used < len + 1) {
+        size_t size = (len + 1 > HISTORY_CHUNK_SIZE) ? len + 1 : HISTORY_CHUNK_SIZE;
+        chunk = malloc(sizeof(history_chunk_t) + size);
+        if (!chunk) {
+            error_allocation("history");
+            exit(EXIT_FAILURE);
+        }
+        chunk->next = NULL;
+        chunk->size = size;
+        chunk->used = 0;
+        chunk->live = 0;
+        if (newest_chunk) {
+            newest_chunk->next = chunk;
+        } else {
+            oldest_chunk = chunk;
+        }
+        newest_chunk = chunk;
+    }
+
+    char *text = chunk->data + chunk->used;
+    memcpy(text, line, len);
+    text[len] = '\0';
+    chunk->used += len + 1;
+    chunk->live++;
+    *chunk_out = chunk;
+    return text;
+}
+
+/**
+ * Drop one line's claim on its chunk, freeing the chunk when unused
+ * The newest regular-sized chunk is kept and rewound instead.
+ */
+static void release_text(history_chunk_t *chunk) {
+    if (--chunk->live > 0) return;
+
+    if (chunk == newest_chunk && chunk->size == HISTORY_CHUNK_SIZE) {
+        chunk->used = 0;
+        return;
+    }
+
+    // Eviction is FIFO, so this is the oldest chunk in practice
+    history_chunk_t **link = &oldest_chunk;
+    history_chunk_t *prev = NULL;
+    while (*link != chunk) {
+        prev = *link;
+        link = &(*link)->next;
+    }
+    *link = chunk->next;
+    if (newest_chunk == chunk) {
+        newest_chunk = prev;
+    }
+    free(chunk);
+}
+
+/**
+ * Move the held lines into a ring of new_cap slots, oldest at slot 0
+ */
+static void resize_ring(int new_cap) {
+    if (new_cap == 0) {
+        free(ring);
+        ring = NULL;
+        ring_cap = 0;
+        ring_head = 0;
+        return;
+    }
+
+    history_slot_t *new_ring = malloc(sizeof(history_slot_t) * new_cap);
+    if (!new_ring) {
+        error_allocation("history");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < count; i++) {
+        new_ring[i] = ring[(ring_head + i) % ring_cap];
+    }
+    free(ring);
+    ring = new_ring;
+    ring_cap = new_cap;
+    ring_head = 0;
+}
+
+static void evict_oldest(void) {
+    histsearch_remove(base, ring[ring_head].entry.text);
+    release_text(ring[ring_head].chunk);
+    ring_head = (ring_head + 1) % ring_cap;
+    count--;
+    base++;
+}
+
+/**
+ * Append a line to the ring, evicting the oldest one when full
+ */
+static void push_entry(const char *text, size_t len, time_t when, int status) {
+    if (count == max_size) {
+        evict_oldest();
+    } else if (count == ring_cap) {
+        int new_cap = (ring_cap < HISTORY_MIN_SLOTS / 2) ? HISTORY_MIN_SLOTS : ring_cap * 2;
+        resize_ring(new_cap < max_size ? new_cap : max_size);
+    }
+
+    history_slot_t *slot = &ring[(ring_head + count) % ring_cap];
+    slot->entry.text = store_text(text, len, &slot->chunk);
+    slot->entry.when = when;
+    slot->entry.status = status;
+    histsearch_add(base + count, slot->entry.text);
+    count++;
+}
+
+/**
+ * Split one history file line into its fields
+ * Lines look like ": <time>:<status>;<command>"; anything else is taken
+ * as a bare command with no time or status.
+ */
+static void parse_file_line(const char *line, size_t len, const char **text, size_t *text_len,
+                            time_t *when, int *status) {
+    *text = line;
+    *text_len = len;
+    *when = 0;
+    *status = -1;
+
+    if (len < 2 || line[0] != ':' || line[1] != ' ') return;
+
+    size_t i = 2;
+    long long t = 0;
+    int s = 0, negative = 0;
+    while (i < len && line[i] >= '0' && line[i] <= '9') t = t * 10 + (line[i++] - '0');
+    if (i >= len || line[i++] != ':') return;
+    if (i < len && line[i] == '-') {
+        negative = 1;
+        i++;
+    }
+    while (i < len && line[i] >= '0' && line[i] <= '9') s = s * 10 + (line[i++] - '0');
+    if (i >= len || line[i++] != ';') return;
+
+    *text = line + i;
+    *text_len = len - i;
+    *when = (time_t)t;
+    *status = negative ? -s : s;
+}
+
+static const char *last_newline(const char *data, size_t len) {
+    while (len > 0) {
+        if (data[--len] == '\n') return data + len;
+    }
+    return NULL;
+}
+
+static void unmap_file(void) {
+    if (file_data) {
+#ifdef _WIN32
+        free((void *)file_data);
+#else
+        munmap((void *)file_data, file_size);
+#endif
+    }
+    file_data = NULL;
+    file_size = 0;
+}
+
+/**
+ * Merge the history file (as it was at startup) in front of the lines
+ * entered so far. Only the last max_size lines of the file are parsed.
+ */
+static void load_file(void) {
+    if (loaded) return;
+    loaded = 1;
+    if (!file_data) return;
+
+    const char *data = file_data;
+    size_t size = file_size;
+    if (size > 0 && data[size - 1] == '\n') size--;
+
+    // Walk back to the first line that will survive in the ring
+    size_t start = size;
+    int kept = 0;
+    while (start > 0 && kept < max_size) {
+        const char *nl = last_newline(data, start);
+        start = nl ? (size_t)(nl - data) : 0;
+        kept++;
+        if (nl && kept == max_size) start++;
+    }
+    int skipped = 0;
+    for (const char *p = data; p < data + start && (p = memchr(p, '\n', start - (p - data))); p++) {
+        skipped++;
+    }
+
+    // Set the session's lines aside, fill in the file, then put them back
+    history_slot_t *session = ring;
+    int session_cap = ring_cap, session_head = ring_head, session_count = count;
+    ring = NULL;
+    ring_cap = ring_head = count = 0;
+    base = skipped + 1;
+    histsearch_clear();
+
+    size_t pos = start;
+    while (pos < size && size > 0) {
+        const char *line = data + pos;
+        const char *nl = memchr(line, '\n', size - pos);
+        size_t len = nl ? (size_t)(nl - line) : size - pos;
+        const char *text;
+        size_t text_len;
+        time_t when;
+        int status;
+        parse_file_line(line, len, &text, &text_len, &when, &status);
+        if (text_len > 0 && memchr(text, HISTORY_FILE_NEWLINE, text_len)) {
+            char *joined = malloc(text_len);
+            if (joined == NULL) {
+                error_allocation("history");
+                exit(EXIT_FAILURE);
+            }
+            for (size_t i = 0; i < text_len; i++) {
+                joined[i] = (text[i] == HISTORY_FILE_NEWLINE) ? '\n' : text[i];
+            }
+            push_entry(joined, text_len, when, status);
+            free(joined);
+        } else if (text_len > 0) {
+            push_entry(text, text_len, when, status);
+        }
+        pos += len + 1;
+    }
+
+    for (int i = 0; i < session_count; i++) {
+        history_slot_t *slot = &session[(session_head + i) % session_cap];
+        push_entry(slot->entry.text, strlen(slot->entry.text), slot->entry.when, slot->entry.status);
+        release_text(slot->chunk);
+    }
+    free(session);
+    unmap_file();
+}
+
+/**
+ * Open $HISTFILE for appending and map its current contents
+ * Defaults to ~/.myshell_history; an empty HISTFILE disables it.
+ */
+static void open_history_file(void) {
+    const char *path = vars_get("HISTFILE");
+    char buf[4096];
+    
+    if (path == NULL) {
+        const char *home = vars_get("HOME");
+        if (home == NULL || *home == '\0') return;
+        snprintf(buf, sizeof(buf), "%s/.myshell_history", home);
+        path = buf;
+    }
+    if (*path == '\0') return;
+
+    int fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) return;
+#ifndef _WIN32
+    // Keep it clear of the descriptors commands redirect
+    int high = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+    if (high >= 0) {
+        close(fd);
+        fd = high;
+    }
+#endif
+    hist_fd = fd;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size <= 0) return;
+    file_size = (size_t)st.st_size;
+#ifdef _WIN32
+    char *copy = malloc(file_size);
+    if (copy && read(fd, copy, (unsigned)file_size) == (int)file_size) {
+        file_data = copy;
+    } else {
+        free(copy);
+    }
+#else
+    void *map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+        file_data = map;
+    }
+#endif
+    if (!file_data) {
+        file_size = 0;
+        return;
+    }
+    loaded = 0;
+}
+
+void init_history(void) {
+    free_history();
+    max_size = histsize_from_env();
+    base = 1;
+    open_history_file();
+}
+
+void add_history(const char *line) {
+    pending = 0;
+    if (!line || *line == '\0' || max_size == 0) return;
+
+    // Don't add duplicates of the last command
+    if (count > 0 && strcmp(ring[(ring_head + count - 1) % ring_cap].entry.text, line) == 0) {
+        return;
+    }
+
+    push_entry(line, strlen(line), time(NULL), -1);
+    pending = 1;
+}
+
+void history_record_status(int status) {
+    if (!pending) return;
+    pending = 0;
+
+    history_entry_t *entry = &ring[(ring_head + count - 1) % ring_cap].entry;
+    entry->status = status;
+
+    if (hist_fd < 0) return;
+
+    // One write(2) per entry: O_APPEND keeps concurrent shells' lines whole
+    char header[64];
+    size_t text_len = strlen(entry->text);
+    int header_len = snprintf(header, sizeof(header), ": %lld:%d;", (long long)entry->when, status);
+    char stack_buf[1024];
+    size_t total = header_len + text_len + 1;
+    char *buf = (total <= sizeof(stack_buf)) ? stack_buf : malloc(total);
+    if (!buf) return;
+    memcpy(buf, header, header_len);
+    memcpy(buf + header_len, entry->text, text_len);
+    for (char *p = buf + header_len; (p = memchr(p, '\n', buf + total - 1 - p)); p++) {
+        *p = HISTORY_FILE_NEWLINE;
+    }
+    buf[total - 1] = '\n';
+    if (write(hist_fd, buf, total) < 0) {
+        // Stop logging rather than complain after every command
+        close(hist_fd);
+        hist_fd = -1;
+    }
+    if (buf != stack_buf) {
+        free(buf);
+    }
+}
+
+int history_length(void) {
+    load_file();
+    return count;
+}
+
+int history_base(void) {
+    load_file();
+    return base;
+}
+
+const history_entry_t *history_entry(int index) {
+    load_file();
+    if (index < 0 || index >= count) return NULL;
+    return &ring[(ring_head + index) % ring_cap].entry;
+}
+
+const char *history_get(int index) {
+    const history_entry_t *entry = history_entry(index);
+    return entry ? entry->text : NULL;
+}
+
+void history_set_size(int size) {
+    if (size < 0) size = 0;
+    while (count > size) {
+        evict_oldest();
+    }
+    max_size = size;
+    if (ring_cap > size) {
+        resize_ring(size);
+    }
+}
+
+void history_update_size(void) {
+    history_set_size(histsize_from_env());
+}
+
+int history_size(void) {
+    return max_size;
+}
+
+void clear_history(void) {
+    // The file's lines are dropped too, without ever being parsed
+    loaded = 1;
+    unmap_file();
+    pending = 0;
+    while (count > 0) {
+        evict_oldest();
+    }
+}
+
+void free_history(void) {
+    clear_history();
+    if (hist_fd >= 0) {
+        close(hist_fd);
+        hist_fd = -1;
+    }
+    while (oldest_chunk) {
+        history_chunk_t *next = oldest_chunk->next;
+        free(oldest_chunk);
+        oldest_chunk = next;
+    }
+    newest_chunk = NULL;
+    resize_ring(0);
+    histsearch_clear();
+}
@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "histsearch.h"
+#include "history.h"
+#include "error.h"
+#include "hashtable.h"
+
+// Initial slot count of the index tables (power of two)
+#define HISTSEARCH_INITIAL_CAPACITY 1024
+
+/**
+ * History numbers containing one n-gram, oldest first
+ * Evictions advance head; the array is compacted once half of it is dead.
+ */
+typedef struct posting_list {
+    uint32_t key;       // From gram_key(); 0 marks an empty slot
+    int head;           // First live entry in ids[]
+    int len;            // One past the newest entry
+    int cap;
+    int *ids;
+} posting_list_t;
+
+/**
+ * How many held lines have a given text (keyed by a hash of it)
+ */
+typedef struct freq_slot {
+    uint64_t hash;      // 0 marks an empty slot
+    int count;
+} freq_slot_t;
+
+/**
+ * A distinct matching line while a query is ranked
+ */
+typedef struct search_match {
+    int index;          // History index of its newest occurrence
+    uint64_t hash;
+    long score;
+} search_match_t;
+
+static hashtable_t grams;         // Of posting_list_t
+static hashtable_t frequencies;   // Of freq_slot_t
+
+static uint64_t text_hash(const char *text) {
+    // 0 is reserved for empty slots
+    uint64_t hash = hash_fnv1a64(text);
+    return hash ? hash : 1;
+}
+
+/**
+ * Pack the n (1-3) bytes at p into a key, tagged with n so that keys of
+ * different lengths never collide (and are never 0)
+ */
+static uint32_t gram_key(const char *p, size_t n) {
+    const unsigned char *u = (const unsigned char *)p;
+    uint32_t key = (uint32_t)n << 24;
+    for (size_t i = 0; i < n; i++) {
+        key |= (uint32_t)u[i] << (8 * (n - 1 - i));
+    }
+    return key;
+}
+
+static int gram_is_empty(const void *slot) {
+    return ((const posting_list_t *)slot)->key == 0;
+}
+
+static uint64_t gram_hash(const void *slot) {
+    return ((const posting_list_t *)slot)->key;
+}
+
+static int gram_matches(const void *slot, const void *key) {
+    return ((const posting_list_t *)slot)->key == *(const uint32_t *)key;
+}
+
+static const hashtable_type_t gram_type = {
+    sizeof(posting_list_t), HISTSEARCH_INITIAL_CAPACITY, "history index", gram_is_empty, gram_hash
+};
+
+static int freq_is_empty(const void *slot) {
+    return ((const freq_slot_t *)slot)->hash == 0;
+}
+
+static uint64_t freq_hash(const void *slot) {
+    return ((const freq_slot_t *)slot)->hash;
+}
+
+static int freq_matches(const void *slot, const void *key) {
+    return ((const freq_slot_t *)slot)->hash == *(const uint64_t *)key;
+}
+
+static const hashtable_type_t freq_type = {
+    sizeof(freq_slot_t), HISTSEARCH_INITIAL_CAPACITY, "history index", freq_is_empty, freq_hash
+};
+
+static posting_list_t *gram_get(uint32_t key) {
+    posting_list_t *list = hashtable_find(&grams, &gram_type, key, gram_matches, &key);
+    return (list != NULL && list->key != 0) ? list : NULL;
+}
+
+/**
+ * Find or create the list for an n-gram
+ */
+static posting_list_t *gram_put(uint32_t key) {
+    posting_list_t *list = hashtable_put(&grams, &gram_type, key, gram_matches, &key, NULL);
+    list->key = key;
+    return list;
+}
+
+static void gram_list_remove(posting_list_t *list) {
+    free(list->ids);
+    hashtable_remove(&grams, &gram_type, list);
+}
+
+static freq_slot_t *freq_find(uint64_t hash, int create) {
+    if (!create) {
+        freq_slot_t *slot = hashtable_find(&frequencies, &freq_type, hash, freq_matches, &hash);
+        return (slot != NULL && slot->hash != 0) ? slot : NULL;
+    }
+    int created;
+    freq_slot_t *slot = hashtable_put(&frequencies, &freq_type, hash, freq_matches, &hash, &created);
+    if (created) {
+        slot->hash = hash;
+        slot->count = 0;
+    }
+    return slot;
+}
+
+/**
+ * Append id to the list of one n-gram
+ */
+static void gram_add(uint32_t key, int id) {
+    posting_list_t *list = gram_put(key);
+
+    // A gram repeated within the line is listed once
+    if (list->len > list->head && list->ids[list->len - 1] == id) {
+        return;
+    }
+    if (list->len == list->cap) {
+        list->cap = list->cap ? list->cap * 2 : 4;
+        list->ids = realloc(list->ids, list->cap * sizeof(int));
+        if (list->ids == NULL) {
+            error_allocation("history index");
+            exit(EXIT_FAILURE);
+        }
+    }
+    list->ids[list->len++] = id;
+}
+
+/**
+ * Pop id from the front of the list of one n-gram
+ */
+static void gram_remove(uint32_t key, int id) {
+    posting_list_t *list = gram_get(key);
+
+    // Lines leave in the order they came, so id is at the front
+    if (list == NULL || list->head == list->len || list->ids[list->head] != id) {
+        return;
+    }
+    list->head++;
+    if (list->head == list->len) {
+        gram_list_remove(list);
+    } else if (list->head >= 16 && list->head * 2 >= list->len) {
+        memmove(list->ids, list->ids + list->head, (list->len - list->head) * sizeof(int));
+        list->len -= list->head;
+        list->head = 0;
+    }
+}
+
+void histsearch_add(int id, const char *text) {
+    size_t len = strlen(text);
+
+    for (size_t i = 0; i < len; i++) {
+        for (size_t n = 1; n <= 3 && i + n <= len; n++) {
+            gram_add(gram_key(text + i, n), id);
+        }
+    }
+
+    freq_find(text_hash(text), 1)->count++;
+}
+
+void histsearch_remove(int id, const char *text) {
+    size_t len = strlen(text);
+
+    for (size_t i = 0; i < len; i++) {
+        for (size_t n = 1; n <= 3 && i + n <= len; n++) {
+            gram_remove(gram_key(text + i, n), id);
+        }
+    }
+
+    freq_slot_t *slot = freq_find(text_hash(text), 0);
+    if (slot != NULL && --slot->count <= 0) {
+        hashtable_remove(&frequencies, &freq_type, slot);
+    }
+}
+
+void histsearch_clear(void) {
+    posting_list_t *lists = grams.slots;
+    for (size_t i = 0; i < grams.capacity; i++) {
+        free(lists[i].ids);
+    }
+    hashtable_free(&grams);
+    hashtable_free(&frequencies);
+}
+
+/**
+ * Rank weight for a line run `age` commands ago
+ */
+static int recency_weight(int age) {
+    if (age < 100) return 8;
+    if (age < 1000) return 4;
+    if (age < 10000) return 2;
+    return 1;
+}
+
+int history_search(const char *query, int *matches, int max) {
+    search_match_t found[HISTSEARCH_MAX_MATCHES];
+    int num_found = 0;
+    int length = history_length();
+    int base = history_base();
+    size_t qlen = strlen(query);
+
+    if (qlen == 0 || length == 0) {
+        return 0;
+    }
+
+    // Candidates: the shortest posting list among the query's trigrams
+    // (shorter queries are looked up whole, so every candidate matches)
+    size_t n = (qlen < 3) ? qlen : 3;
+    const posting_list_t *best = NULL;
+    for (size_t i = 0; i + n <= qlen; i++) {
+        const posting_list_t *list = gram_get(gram_key(query + i, n));
+        if (list == NULL) {
+            return 0;
+        }
+        if (best == NULL || list->len - list->head < best->len - best->head) {
+            best = list;
+        }
+    }
+
+    for (int c = best->len - 1; c >= best->head && num_found < HISTSEARCH_MAX_MATCHES; c--) {
+        int index = best->ids[c] - base;
+        const char *text = history_get(index);
+        if (text == NULL || strstr(text, query) == NULL) {
+            continue;
+        }
+
+        uint64_t hash = text_hash(text);
+        int seen = 0;
+        for (int i = 0; i < num_found && !seen; i++) {
+            seen = found[i].hash == hash && strcmp(history_get(found[i].index), text) == 0;
+        }
+        if (seen) {
+            continue;
+        }
+
+        freq_slot_t *freq = freq_find(hash, 0);
+        found[num_found].index = index;
+        found[num_found].hash = hash;
+        found[num_found].score = (long)(freq ? freq->count : 1) * recency_weight(length - 1 - index);
+        num_found++;
+    }
+
+    // Insertion sort by score; found[] is newest first, so ties stay in that order
+    for (int i = 1; i < num_found; i++) {
+        int j = i;
+        while (j > 0 && found[j - 1].score < found[i].score) {
+            j--;
+        }
+        if (j < i) {
+            search_match_t moved = found[i];
+            memmove(&found[j + 1], &found[j], (i - j) * sizeof(search_match_t));
+            found[j] = moved;
+        }
+    }
+
+    int num_matches = (num_found < max) ? num_found : max;
+    for (int i = 0; i < num_matches; i++) {
+        matches[i] = found[i].index;
+    }
+    return num_matches;
+}
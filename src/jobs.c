@@ -1,3 +1,5 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,145 +10,441 @@
 #include <process.h>
 #else
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #endif
 
 #include "jobs.h"
 #include "error.h"
+#include "shell.h"
+#include "launch.h"
+#include "hashtable.h"
+
+// Initial slot count of the job indexes (power of two)
+#define JOB_MAP_INITIAL_CAPACITY 64
+
+/**
+ * Slot of a map from a positive integer key (job id or pid) to a job
+ */
+typedef struct job_slot {
+    int key;              // 0 marks an empty slot
+    job_t *job;
+} job_slot_t;
+
+static int job_slot_empty(const void *slot) {
+    return ((const job_slot_t *)slot)->key == 0;
+}
+
+static uint64_t job_slot_hash(const void *slot) {
+    return (unsigned int)((const job_slot_t *)slot)->key;
+}
+
+static int job_slot_matches(const void *slot, const void *key) {
+    return ((const job_slot_t *)slot)->key == *(const int *)key;
+}
+
+static const hashtable_type_t job_map_type = {
+    sizeof(job_slot_t), JOB_MAP_INITIAL_CAPACITY, "job table", job_slot_empty, job_slot_hash
+};
+
+static hashtable_t jobs_by_id;
+static hashtable_t jobs_by_pid;
+static job_t *job_head = NULL;       // Oldest job; the list is in job id order
+static job_t *job_tail = NULL;       // Newest job
+static job_t *current_job = NULL;    // %+
+static job_t *previous_job = NULL;   // %-
+
+static void job_map_put(hashtable_t *map, int key, job_t *job) {
+    job_slot_t *slot = hashtable_put(map, &job_map_type, (unsigned int)key, job_slot_matches, &key, NULL);
+    slot->key = key;
+    slot->job = job;
+}
+
+static job_t *job_map_get(const hashtable_t *map, int key) {
+    if (key <= 0) {
+        return NULL;
+    }
+    job_slot_t *slot = hashtable_find(map, &job_map_type, (unsigned int)key, job_slot_matches, &key);
+    return (slot != NULL && slot->key != 0) ? slot->job : NULL;
+}
+
+static void job_map_remove(hashtable_t *map, int key) {
+    if (key <= 0) {
+        return;
+    }
+    job_slot_t *slot = hashtable_find(map, &job_map_type, (unsigned int)key, job_slot_matches, &key);
+    if (slot != NULL && slot->key != 0) {
+        hashtable_remove(map, &job_map_type, slot);
+    }
+}
 
-#define MAX_JOBS 100
+/**
+ * Make job the current job (%+); the old current becomes previous (%-)
+ */
+static void set_current_job(job_t *job) {
+    if (job == current_job) {
+        return;
+    }
+    previous_job = current_job;
+    current_job = job;
+}
+#ifndef _WIN32
+// SIGCHLD self-pipe: the handler only records that some child changed state
+static int sigchld_pipe[2] = {-1, -1};
+static volatile sig_atomic_t sigchld_pending = 0;
 
-static job_t jobs[MAX_JOBS];
-static int job_count = 0;
-static int next_job_id = 1;
+static void sigchld_handler(int sig) {
+    int saved_errno = errno;
+    (void)sig;  // Unused parameter
+    sigchld_pending = 1;
+    if (sigchld_pipe[1] >= 0) {
+        // Non-blocking: a full pipe already means "wake up"
+        ssize_t ignored = write(sigchld_pipe[1], "", 1);
+        (void)ignored;
+    }
+    errno = saved_errno;
+}
+#endif
 
 void init_jobs(void) {
-    job_count = 0;
-    next_job_id = 1;
-    for (int i = 0; i < MAX_JOBS; i++) {
-        jobs[i].job_id = 0;
-        jobs[i].pid = 0;
-        jobs[i].command = NULL;
-        jobs[i].state = JOB_DONE;
-        jobs[i].background = 0;
+    job_head = job_tail = NULL;
+    current_job = previous_job = NULL;
+    
+    #ifndef _WIN32
+    if (sigchld_pipe[0] < 0 && launch_private_pipe(sigchld_pipe, O_NONBLOCK) == 0) {
+        struct sigaction sa;
+        sa.sa_handler = sigchld_handler;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESTART;  // Blocking waits and reads just resume
+        sigaction(SIGCHLD, &sa, NULL);
     }
+    #endif
+}
+
+int jobs_event_fd(void) {
+    #ifndef _WIN32
+    return sigchld_pipe[0];
+    #else
+    return -1;
+    #endif
 }
 
-int add_job(pid_t pid, const char *command, int background) {
-    if (job_count >= MAX_JOBS) {
-        fprintf(stderr, "myshell: job table full\n");
+int add_job(pid_t pgid, const pid_t *pids, int num_pids, const char *command, int background) {
+    job_t *job = malloc(sizeof(job_t));
+    if (job == NULL) {
+        error_allocation("add_job");
+        return -1;
+    }
+    job->stages = malloc(num_pids * sizeof(job_stage_t));
+    if (job->stages == NULL && num_pids > 0) {
+        error_allocation("add_job");
+        free(job);
         return -1;
     }
     
-    // Find empty slot
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].job_id == 0) {
-            jobs[i].job_id = next_job_id++;
-            jobs[i].pid = pid;
-            jobs[i].command = strdup(command);
-            jobs[i].state = JOB_RUNNING;
-            jobs[i].background = background;
-            job_count++;
-            
-            if (background) {
-                printf("[%d] %d\n", jobs[i].job_id, (int)pid);
-            }
-            
-            return jobs[i].job_id;
+    // Keep only stages that have a process (threads and failed launches don't)
+    job->num_stages = 0;
+    for (int i = 0; i < num_pids; i++) {
+        if (pids[i] > 0) {
+            job->stages[job->num_stages].pid = pids[i];
+            job->stages[job->num_stages].running = 1;
+            job->stages[job->num_stages].status = 0;
+            #ifndef _WIN32
+            memset(&job->stages[job->num_stages].usage, 0, sizeof(struct rusage));
+            #endif
+            job->num_stages++;
         }
     }
+    if (job->num_stages == 0) {
+        free(job->stages);
+        free(job);
+        return -1;
+    }
     
-    return -1;
+    // Ids are never reused while a job lives; numbering restarts once all
+    // jobs are gone, like other shells
+    job->job_id = job_tail ? job_tail->job_id + 1 : 1;
+    job->pid = job->stages[job->num_stages - 1].pid;
+    job->pgid = pgid;
+    job->num_running = job->num_stages;
+    job->command = strdup(command);
+    job->state = JOB_RUNNING;
+    job->background = background;
+    
+    // Append to the list (kept in job id order)
+    job->prev = job_tail;
+    job->next = NULL;
+    if (job_tail) {
+        job_tail->next = job;
+    } else {
+        job_head = job;
+    }
+    job_tail = job;
+    
+    job_map_put(&jobs_by_id, job->job_id, job);
+    for (int i = 0; i < job->num_stages; i++) {
+        job_map_put(&jobs_by_pid, (int)job->stages[i].pid, job);
+    }
+    set_current_job(job);
+    
+    if (background && shell.interactive) {
+        printf("[%d] %d\n", job->job_id, (int)job->pid);
+    }
+    
+    return job->job_id;
 }
 
 void remove_job(int job_id) {
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].job_id == job_id) {
-            free(jobs[i].command);
-            jobs[i].job_id = 0;
-            jobs[i].pid = 0;
-            jobs[i].command = NULL;
-            jobs[i].state = JOB_DONE;
-            job_count--;
-            return;
+    job_t *job = job_map_get(&jobs_by_id, job_id);
+    if (job == NULL) {
+        return;
+    }
+    
+    job_map_remove(&jobs_by_id, job->job_id);
+    for (int i = 0; i < job->num_stages; i++) {
+        job_map_remove(&jobs_by_pid, (int)job->stages[i].pid);
+    }
+    
+    if (job->prev) {
+        job->prev->next = job->next;
+    } else {
+        job_head = job->next;
+    }
+    if (job->next) {
+        job->next->prev = job->prev;
+    } else {
+        job_tail = job->prev;
+    }
+    
+    // Keep %+ and %- pointing at live jobs: fall back to the newest others
+    if (job == current_job) {
+        current_job = previous_job;
+        previous_job = NULL;
+    } else if (job == previous_job) {
+        previous_job = NULL;
+    }
+    if (current_job == NULL) {
+        current_job = job_tail;
+    }
+    if (previous_job == NULL) {
+        for (job_t *j = job_tail; j != NULL; j = j->prev) {
+            if (j != current_job) {
+                previous_job = j;
+                break;
+            }
         }
     }
+    
+    free(job->stages);
+    free(job->command);
+    free(job);
 }
 
 job_t *get_job(int job_id) {
-    // If job_id is 0, return most recent job
+    // If job_id is 0, return the current job (%+)
     if (job_id == 0) {
-        int max_id = 0;
-        job_t *recent = NULL;
-        for (int i = 0; i < MAX_JOBS; i++) {
-            if (jobs[i].job_id > 0 && jobs[i].job_id > max_id) {
-                max_id = jobs[i].job_id;
-                recent = &jobs[i];
-            }
-        }
-        return recent;
-    }
-    
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].job_id == job_id) {
-            return &jobs[i];
-        }
+        return current_job;
     }
-    return NULL;
+    return job_map_get(&jobs_by_id, job_id);
 }
 
 job_t *get_job_by_pid(pid_t pid) {
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].pid == pid && jobs[i].job_id > 0) {
-            return &jobs[i];
+    return job_map_get(&jobs_by_pid, (int)pid);
+}
+
+int find_job_spec(const char *spec) {
+    const char *p = spec;
+    job_t *job = NULL;
+    
+    if (*p == '%') {
+        p++;
+    }
+    
+    if (*p == '\0' || strcmp(p, "+") == 0 || strcmp(p, "%") == 0) {
+        job = current_job;
+    } else if (strcmp(p, "-") == 0) {
+        job = previous_job;
+    } else if (*p >= '0' && *p <= '9') {
+        job = job_map_get(&jobs_by_id, atoi(p));
+    } else if (spec[0] == '%') {
+        // %name: newest job whose command starts with name
+        size_t len = strlen(p);
+        for (job = job_tail; job != NULL; job = job->prev) {
+            if (strncmp(job->command, p, len) == 0) {
+                break;
+            }
         }
     }
-    return NULL;
+    
+    return job ? job->job_id : -1;
 }
 
 void update_job_state(int job_id, job_state_t state) {
     job_t *job = get_job(job_id);
     if (job) {
         job->state = state;
+        // A job that just stopped is the one fg/bg should pick up
+        if (state == JOB_STOPPED) {
+            set_current_job(job);
+        }
     }
 }
 
-void list_jobs(void) {
-    int found = 0;
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].job_id > 0) {
-            const char *state_str;
-            switch (jobs[i].state) {
-                case JOB_RUNNING:
-                    state_str = "Running";
-                    break;
-                case JOB_STOPPED:
-                    state_str = "Stopped";
-                    break;
-                case JOB_DONE:
-                    state_str = "Done";
-                    break;
-                default:
-                    state_str = "Unknown";
+void list_jobs(FILE *out, int verbose) {
+    if (job_head == NULL) {
+        fprintf(out, "No jobs\n");
+        return;
+    }
+    
+    for (job_t *job = job_head; job != NULL; job = job->next) {
+        const char *state_str;
+        switch (job->state) {
+            case JOB_RUNNING:
+                state_str = "Running";
+                break;
+            case JOB_STOPPED:
+                state_str = "Stopped";
+                break;
+            case JOB_DONE:
+                state_str = "Done";
+                break;
+            default:
+                state_str = "Unknown";
+        }
+        
+        fprintf(out, "[%d]%c %s\t\t%s\n",
+               job->job_id,
+               job == current_job ? '+' : (job == previous_job ? '-' : ' '),
+               state_str,
+               job->command);
+        
+        if (!verbose) {
+            continue;
+        }
+        
+        // One line per process; CPU totals cover the stages reaped so far
+        double total_cpu = 0;
+        for (int i = 0; i < job->num_stages; i++) {
+            job_stage_t *stage = &job->stages[i];
+            if (stage->running) {
+                fprintf(out, "      %-7d %s\n", (int)stage->pid,
+                        job->state == JOB_STOPPED ? "Stopped" : "Running");
+                continue;
             }
-            
-            printf("[%d]%c %s\t\t%s\n",
-                   jobs[i].job_id,
-                   (i == 0) ? '+' : ' ',  // Mark current job
-                   state_str,
-                   jobs[i].command);
-            found = 1;
+            #ifndef _WIN32
+            double user = stage->usage.ru_utime.tv_sec + stage->usage.ru_utime.tv_usec / 1e6;
+            double sys = stage->usage.ru_stime.tv_sec + stage->usage.ru_stime.tv_usec / 1e6;
+            total_cpu += user + sys;
+            fprintf(out, "      %-7d Done    user %.3fs sys %.3fs maxrss %ld KB\n",
+                    (int)stage->pid, user, sys, stage->usage.ru_maxrss);
+            #else
+            fprintf(out, "      %-7d Done\n", (int)stage->pid);
+            #endif
         }
+        fprintf(out, "      cpu %.3fs\n", total_cpu);
+    }
+}
+
+#ifndef _WIN32
+// POSIX implementation of job control and fg/bg
+
+// The shell's own process group; 0 while job control is off
+static pid_t shell_pgid = 0;
+
+void init_job_control(void) {
+    if (!isatty(STDIN_FILENO)) {
+        return;
+    }
+    
+    // Started in the background: wait until we are brought to the foreground
+    while (tcgetpgrp(STDIN_FILENO) != getpgrp()) {
+        kill(-getpgrp(), SIGTTIN);
     }
     
-    if (!found) {
-        printf("No jobs\n");
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);
+    
+    shell_pgid = getpid();
+    if (getpgrp() != shell_pgid && setpgid(0, shell_pgid) < 0) {
+        // Session leader or similar: keep the group we have
+        shell_pgid = getpgrp();
     }
+    tcsetpgrp(STDIN_FILENO, shell_pgid);
 }
 
-#ifndef _WIN32
-// POSIX implementation of fg/bg
+int job_control_enabled(void) {
+    return shell_pgid > 0;
+}
+
+void give_terminal(pid_t pgid) {
+    if (shell_pgid > 0 && pgid > 0) {
+        tcsetpgrp(STDIN_FILENO, pgid);
+    }
+}
+
+void reclaim_terminal(void) {
+    if (shell_pgid > 0) {
+        tcsetpgrp(STDIN_FILENO, shell_pgid);
+    }
+}
+
+void jobs_enter_subshell(void) {
+    // The parent's jobs are not ours to wait for or signal
+    free_jobs();
+    shell_pgid = 0;
+}
+
+/**
+ * Send a signal to every process of a job
+ */
+static void signal_job(job_t *job, int sig) {
+    if (job->pgid > 0) {
+        killpg(job->pgid, sig);
+        return;
+    }
+    for (int i = 0; i < job->num_stages; i++) {
+        if (job->stages[i].running) {
+            kill(job->stages[i].pid, sig);
+        }
+    }
+}
+
+/**
+ * Record a wait status and resource usage for one process of a job
+ * @return: 1 if the process is finished, 0 if it only stopped
+ */
+static int job_stage_update(job_t *job, pid_t pid, int status, const struct rusage *usage) {
+    if (WIFSTOPPED(status)) {
+        update_job_state(job->job_id, JOB_STOPPED);
+        return 0;
+    }
+    for (int i = 0; i < job->num_stages; i++) {
+        if (job->stages[i].pid == pid && job->stages[i].running) {
+            job->stages[i].running = 0;
+            job->stages[i].status = status;
+            job->stages[i].usage = *usage;
+            job->num_running--;
+            break;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Convert a raw wait status into a shell exit status
+ */
+static int wait_status_code(int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return 0;
+}
 
 int fg_job(int job_id) {
     job_t *job = get_job(job_id);
@@ -157,31 +455,50 @@ int fg_job(int job_id) {
     }
     
     printf("%s\n", job->command);
+    fflush(stdout);
     
-    // Continue the process if stopped
+    give_terminal(job->pgid);
+    
+    // Continue the whole pipeline if stopped
     if (job->state == JOB_STOPPED) {
-        kill(job->pid, SIGCONT);
+        signal_job(job, SIGCONT);
     }
     
     job->state = JOB_RUNNING;
     job->background = 0;
+    set_current_job(job);
     
-    // Wait for the job to complete
-    int status;
-    pid_t result = waitpid(job->pid, &status, WUNTRACED);
-    
-    if (result > 0) {
-        if (WIFEXITED(status) || WIFSIGNALED(status)) {
-            // Job completed
-            remove_job(job->job_id);
-        } else if (WIFSTOPPED(status)) {
+    // Wait for every stage, not just the last one
+    for (int i = 0; i < job->num_stages; i++) {
+        int status;
+        struct rusage usage;
+        pid_t pid = job->stages[i].pid;
+        
+        if (!job->stages[i].running) {
+            continue;
+        }
+        if (wait4(pid, &status, WUNTRACED, &usage) < 0) {
+            // Already gone (reaped elsewhere); don't wait on it again
+            job->stages[i].running = 0;
+            job->num_running--;
+            continue;
+        }
+        if (!job_stage_update(job, pid, status, &usage)) {
             // Job stopped (Ctrl+Z)
-            job->state = JOB_STOPPED;
+            reclaim_terminal();
             printf("\n[%d]+  Stopped\t\t%s\n", job->job_id, job->command);
+            return 128 + WSTOPSIG(status);
         }
     }
     
-    return 0;
+    reclaim_terminal();
+    int last = job->stages[job->num_stages - 1].status;
+    if (WIFSIGNALED(last) && WTERMSIG(last) == SIGINT && shell.interactive) {
+        printf("\n");  // Ctrl+C: start the prompt on a fresh line
+    }
+    int result = wait_status_code(last);
+    remove_job(job->job_id);
+    return result;
 }
 
 int bg_job(int job_id) {
@@ -197,38 +514,82 @@ int bg_job(int job_id) {
         return -1;
     }
     
-    // Continue the process in background
-    kill(job->pid, SIGCONT);
+    // Continue the whole pipeline in background
+    signal_job(job, SIGCONT);
     job->state = JOB_RUNNING;
     job->background = 1;
+    set_current_job(job);
     
     printf("[%d]+ %s &\n", job->job_id, job->command);
     
     return 0;
 }
 
-void check_jobs(void) {
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].job_id > 0 && jobs[i].state == JOB_RUNNING) {
-            int status;
-            pid_t result = waitpid(jobs[i].pid, &status, WNOHANG | WUNTRACED);
-            
-            if (result > 0) {
-                if (WIFEXITED(status) || WIFSIGNALED(status)) {
-                    printf("\n[%d]+  Done\t\t%s\n", jobs[i].job_id, jobs[i].command);
-                    remove_job(jobs[i].job_id);
-                } else if (WIFSTOPPED(status)) {
-                    jobs[i].state = JOB_STOPPED;
-                    printf("\n[%d]+  Stopped\t\t%s\n", jobs[i].job_id, jobs[i].command);
+int check_jobs(void) {
+    char drain[64];
+    int status;
+    int reported = 0;
+    struct rusage usage;
+    pid_t pid;
+    
+    // Nothing has changed since the last call: no syscalls at all
+    if (!sigchld_pending) {
+        return 0;
+    }
+    sigchld_pending = 0;
+    while (read(sigchld_pipe[0], drain, sizeof(drain)) > 0) {
+        // Empty the self-pipe so the next poll blocks again
+    }
+    
+    // One pass reaps every child that changed; foreground children were
+    // already waited for, so anything found here is background work
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED, &usage)) > 0) {
+        job_t *job = get_job_by_pid(pid);
+        if (job == NULL) {
+            continue;  // Not part of any job
+        }
+        int was_stopped = (job->state == JOB_STOPPED);
+        if (!job_stage_update(job, pid, status, &usage)) {
+            // Report a stopped pipeline once, not once per stage
+            if (!was_stopped) {
+                if (shell.interactive) {
+                    printf("\n[%d]+  Stopped\t\t%s\n", job->job_id, job->command);
                 }
+                reported++;
             }
+        } else if (job->num_running == 0) {
+            // The job is done only when its last process is; scripts
+            // drop it silently
+            if (shell.interactive) {
+                printf("\n[%d]+  Done\t\t%s\n", job->job_id, job->command);
+            }
+            remove_job(job->job_id);
+            reported++;
         }
     }
+    if (reported && shell.interactive) {
+        fflush(stdout);
+    }
+    return reported;
 }
 
 #else
 // Windows stubs (limited support)
 
+void init_job_control(void) {
+}
+
+int job_control_enabled(void) {
+    return 0;
+}
+
+void give_terminal(pid_t pgid) {
+    (void)pgid;
+}
+
+void reclaim_terminal(void) {
+}
+
 int fg_job(int job_id) {
     fprintf(stderr, "myshell: fg: job control not supported on Windows\n");
     return -1;
@@ -239,33 +600,43 @@ int bg_job(int job_id) {
     return -1;
 }
 
-void check_jobs(void) {
+int check_jobs(void) {
+    int reported = 0;
+    
     // Windows: Check if processes are still running
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].job_id > 0 && jobs[i].state == JOB_RUNNING) {
-            HANDLE hProcess = OpenProcess(PROCESS_QUERY_INFORMATION, FALSE, jobs[i].pid);
+    for (job_t *job = job_head, *next; job != NULL; job = next) {
+        next = job->next;
+        if (job->state == JOB_RUNNING) {
+            HANDLE hProcess = OpenProcess(PROCESS_QUERY_INFORMATION, FALSE, job->pid);
             if (hProcess) {
                 DWORD exitCode;
                 if (GetExitCodeProcess(hProcess, &exitCode)) {
                     if (exitCode != STILL_ACTIVE) {
-                        printf("\n[%d]+  Done\t\t%s\n", jobs[i].job_id, jobs[i].command);
-                        remove_job(jobs[i].job_id);
+                        printf("\n[%d]+  Done\t\t%s\n", job->job_id, job->command);
+                        remove_job(job->job_id);
+                        reported++;
                     }
                 }
                 CloseHandle(hProcess);
             }
         }
     }
+    return reported;
 }
 
 #endif
 
 void free_jobs(void) {
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].command) {
-            free(jobs[i].command);
-            jobs[i].command = NULL;
-        }
+    job_t *job = job_head;
+    while (job != NULL) {
+        job_t *next = job->next;
+        free(job->stages);
+        free(job->command);
+        free(job);
+        job = next;
     }
-    job_count = 0;
+    job_head = job_tail = NULL;
+    current_job = previous_job = NULL;
+    hashtable_free(&jobs_by_id);
+    hashtable_free(&jobs_by_pid);
 }
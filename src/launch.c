@@ -0,0 +1,449 @@
+#ifndef _WIN32
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "launch.h"
+#include "error.h"
+#include "cmdhash.h"
+#include "vars.h"
+
+// glibc can hand the terminal to the child's group before exec
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 35))
+#define HAVE_SPAWN_TCSETPGRP 1
+#endif
+
+/**
+ * Reset the dispositions the shell changes for itself to SIG_DFL
+ */
+static void reset_signals(void) {
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGTTIN, SIG_DFL);
+    signal(SIGTTOU, SIG_DFL);
+}
+
+void launch_opts_init(launch_opts_t *opts) {
+    opts->in_fd = -1;
+    opts->out_fd = -1;
+    opts->redirs = NULL;
+    opts->num_redirs = 0;
+    opts->envp = NULL;
+    opts->pgid = -1;
+    opts->foreground = 0;
+}
+
+int launch_pipe(int fds[2]) {
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        error_pipe();
+        return -1;
+    }
+    return 0;
+}
+
+int launch_private_fd(int fd) {
+    if (fd >= 0 && fd < LAUNCH_USER_FDS) {
+        int high = fcntl(fd, F_DUPFD_CLOEXEC, LAUNCH_USER_FDS);
+        if (high >= 0) {
+            close(fd);
+            return high;
+        }
+    }
+    return fd;
+}
+
+int launch_private_pipe(int fds[2], int flags) {
+    if (pipe2(fds, O_CLOEXEC | flags) < 0) {
+        return -1;
+    }
+    fds[0] = launch_private_fd(fds[0]);
+    fds[1] = launch_private_fd(fds[1]);
+    return 0;
+}
+
+/**
+ * open() flags for a file redirection
+ */
+static int redirect_flags(redir_op_t op) {
+    switch (op) {
+        case REDIR_INPUT:     return O_RDONLY;
+        case REDIR_OUTPUT:    return O_WRONLY | O_CREAT | O_TRUNC;
+        case REDIR_APPEND:    return O_WRONLY | O_CREAT | O_APPEND;
+        default:              return O_RDWR | O_CREAT;
+    }
+}
+
+/**
+ * Open a redirection target in the shell, close-on-exec
+ * The fd is moved above the user range so that no earlier redirection in
+ * the same list can land on it before it is used.
+ * @return: File descriptor or -1 (message already printed)
+ */
+static int open_redirect(const redirection_t *r) {
+    int fd = open(r->path, redirect_flags(r->op) | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            error_file_not_found(r->path, (r->op == REDIR_INPUT) ? "input" : "output");
+        } else {
+            error_system(r->path);
+        }
+        return -1;
+    }
+    if (fd < LAUNCH_USER_FDS) {
+        int high = fcntl(fd, F_DUPFD_CLOEXEC, LAUNCH_USER_FDS);
+        close(fd);
+        if (high < 0) {
+            error_system("redirection");
+        }
+        fd = high;
+    }
+    return fd;
+}
+
+/**
+ * Report a n>&m whose m is not an open descriptor
+ */
+static void error_bad_fd(const redirection_t *r) {
+    errno = EBADF;
+    error_system(r->path);
+}
+
+/**
+ * Will the source of a REDIR_DUP be open when the child reaches it?
+ * Earlier redirections in the list and the pipes count as well as the
+ * shell's own descriptors.
+ */
+static int dup_source_open(const launch_opts_t *opts, int index) {
+    int source = opts->redirs[index].source;
+
+    if (source < 0) {
+        return 0;
+    }
+    for (int i = index - 1; i >= 0; i--) {
+        if (opts->redirs[i].fd == source) {
+            return opts->redirs[i].op != REDIR_CLOSE;
+        }
+    }
+    if ((source == STDIN_FILENO && opts->in_fd >= 0) ||
+        (source == STDOUT_FILENO && opts->out_fd >= 0)) {
+        return 1;
+    }
+    return fcntl(source, F_GETFD) >= 0;
+}
+
+pid_t launch_process(char **argv, const launch_opts_t *opts) {
+    launch_opts_t defaults;
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t sigdefault, sigmask;
+    const char *path;
+    pid_t pid = -1;
+    int err;
+    int i;
+
+    if (argv == NULL || argv[0] == NULL) {
+        return -1;
+    }
+
+    // Resolve through the command hash; a cached miss only stats the PATH directories
+    path = cmdhash_lookup(argv[0]);
+    if (path == NULL) {
+        error_command_not_found(argv[0]);
+        return -127;
+    }
+    if (opts == NULL) {
+        launch_opts_init(&defaults);
+        opts = &defaults;
+    }
+
+    // Open every file target up front so failures are reported before spawning
+    int opened[opts->num_redirs + 1];
+    for (i = 0; i < opts->num_redirs; i++) {
+        const redirection_t *r = &opts->redirs[i];
+        opened[i] = -1;
+        if (r->op == REDIR_DUP && !dup_source_open(opts, i)) {
+            error_bad_fd(r);
+            break;
+        }
+        if (r->op != REDIR_DUP && r->op != REDIR_CLOSE) {
+            opened[i] = open_redirect(r);
+            if (opened[i] < 0) {
+                break;
+            }
+        }
+    }
+    if (i < opts->num_redirs) {
+        while (--i >= 0) {
+            if (opened[i] >= 0) close(opened[i]);
+        }
+        return -1;
+    }
+
+    posix_spawn_file_actions_init(&actions);
+    #ifdef HAVE_SPAWN_TCSETPGRP
+    // Runs after the child joins its group and while fd 0 is still the terminal
+    if (opts->foreground && opts->pgid >= 0) {
+        posix_spawn_file_actions_addtcsetpgrp_np(&actions, STDIN_FILENO);
+    }
+    #endif
+    // Pipes first, then the redirections in command-line order (2>&1 >f differs from >f 2>&1)
+    if (opts->in_fd >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, opts->in_fd, STDIN_FILENO);
+    }
+    if (opts->out_fd >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, opts->out_fd, STDOUT_FILENO);
+    }
+    for (i = 0; i < opts->num_redirs; i++) {
+        const redirection_t *r = &opts->redirs[i];
+        if (r->op == REDIR_CLOSE) {
+            posix_spawn_file_actions_addclose(&actions, r->fd);
+        } else {
+            posix_spawn_file_actions_adddup2(&actions, (r->op == REDIR_DUP) ? r->source : opened[i], r->fd);
+        }
+    }
+
+    // Children get default dispositions for the signals the shell handles
+    posix_spawnattr_init(&attr);
+    sigemptyset(&sigdefault);
+    sigaddset(&sigdefault, SIGINT);
+    sigaddset(&sigdefault, SIGQUIT);
+    sigaddset(&sigdefault, SIGPIPE);
+    sigaddset(&sigdefault, SIGTSTP);
+    sigaddset(&sigdefault, SIGTTIN);
+    sigaddset(&sigdefault, SIGTTOU);
+    sigemptyset(&sigmask);
+    posix_spawnattr_setsigdefault(&attr, &sigdefault);
+    posix_spawnattr_setsigmask(&attr, &sigmask);
+    if (opts->pgid >= 0) {
+        posix_spawnattr_setpgroup(&attr, opts->pgid);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK |
+                                        POSIX_SPAWN_SETPGROUP);
+    } else {
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+    }
+
+    // glibc implements posix_spawn with clone(CLONE_VM | CLONE_VFORK):
+    // no page tables are copied, so launch cost is independent of shell RSS
+    char **envp = opts->envp ? opts->envp : vars_environ();
+    err = posix_spawn(&pid, path, &actions, &attr, argv, envp);
+    if (err == ENOENT && path != argv[0]) {
+        // Cached location went away; look it up again once
+        cmdhash_forget(argv[0]);
+        path = cmdhash_lookup(argv[0]);
+        if (path) {
+            err = posix_spawn(&pid, path, &actions, &attr, argv, envp);
+        }
+    }
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    for (i = 0; i < opts->num_redirs; i++) {
+        if (opened[i] >= 0) close(opened[i]);
+    }
+
+    if (err != 0) {
+        errno = err;
+        // Same statuses as launch_exec(): 127 not found, 126 found but not runnable
+        if (err == ENOENT) {
+            error_command_not_found(argv[0]);
+            return -127;
+        }
+        error_exec(argv[0]);
+        return -126;
+    }
+
+    return pid;
+}
+
+int launch_exec(char **argv, const launch_opts_t *opts) {
+    const char *path;
+
+    if (argv == NULL || argv[0] == NULL) {
+        return 0;
+    }
+
+    path = cmdhash_lookup(argv[0]);
+    if (path == NULL) {
+        error_command_not_found(argv[0]);
+        return 127;
+    }
+
+    // Nothing to go back to: the redirections are made for good
+    if (opts && launch_redirect(opts, NULL) < 0) {
+        return 1;
+    }
+
+    reset_signals();
+    fflush(stdout);
+
+    execve(path, argv, (opts && opts->envp) ? opts->envp : vars_environ());
+
+    if (errno == ENOENT) {
+        error_command_not_found(argv[0]);
+        return 127;
+    }
+    error_exec(argv[0]);
+    return 126;
+}
+
+pid_t launch_fork(const launch_opts_t *opts) {
+    pid_t pid;
+
+    // Don't let the child flush a copy of our pending output
+    fflush(stdout);
+    fflush(stderr);
+
+    pid = fork();
+    if (pid < 0) {
+        error_fork();
+        return -1;
+    }
+    if (pid == 0) {
+        if (opts && opts->pgid >= 0) {
+            setpgid(0, opts->pgid);
+            if (opts->foreground) {
+                tcsetpgrp(STDIN_FILENO, getpgrp());
+            }
+        }
+        reset_signals();
+        // The child never restores, so nothing is parked
+        if (opts && launch_redirect(opts, NULL) < 0) {
+            _exit(1);
+        }
+        return 0;
+    }
+
+    // Set the group from both sides so neither races the other
+    if (opts && opts->pgid >= 0) {
+        setpgid(pid, opts->pgid ? opts->pgid : pid);
+    }
+    return pid;
+}
+
+/**
+ * Park the original of a user fd the first time it is changed
+ * @param target: Descriptor about to be changed
+ * @param saved: Parked originals, or NULL for a permanent change
+ * @return: 0 on success, -1 on failure
+ */
+static int save_fd(int target, int *saved) {
+    if (saved == NULL || saved[target] != -1) {
+        return 0;
+    }
+    // Park it above the user-visible range; EBADF means it was closed
+    saved[target] = fcntl(target, F_DUPFD_CLOEXEC, LAUNCH_USER_FDS);
+    if (saved[target] < 0) {
+        if (errno != EBADF) {
+            error_system("redirection");
+            saved[target] = -1;
+            return -1;
+        }
+        saved[target] = -2;
+    }
+    return 0;
+}
+
+/**
+ * Point one of the shell's fds at fd, remembering the original
+ * @return: 0 on success, -1 on failure
+ */
+static int redirect_saved(int fd, int target, int *saved) {
+    if (save_fd(target, saved) < 0) {
+        return -1;
+    }
+    if (dup2(fd, target) < 0) {
+        error_system("redirection");
+        return -1;
+    }
+    return 0;
+}
+
+int launch_redirect(const launch_opts_t *opts, int saved[LAUNCH_USER_FDS]) {
+    int fd, status;
+
+    if (saved) {
+        for (int i = 0; i < LAUNCH_USER_FDS; i++) {
+            saved[i] = -1;
+        }
+    }
+
+    if (opts->in_fd >= 0 && redirect_saved(opts->in_fd, STDIN_FILENO, saved) < 0) {
+        goto fail;
+    }
+    if (opts->out_fd >= 0 && redirect_saved(opts->out_fd, STDOUT_FILENO, saved) < 0) {
+        goto fail;
+    }
+    for (int i = 0; i < opts->num_redirs; i++) {
+        const redirection_t *r = &opts->redirs[i];
+        switch (r->op) {
+            case REDIR_CLOSE:
+                if (save_fd(r->fd, saved) < 0) {
+                    goto fail;
+                }
+                close(r->fd);
+                break;
+            case REDIR_DUP:
+                if (r->source < 0 || fcntl(r->source, F_GETFD) < 0) {
+                    error_bad_fd(r);
+                    goto fail;
+                }
+                if (r->source != r->fd && redirect_saved(r->source, r->fd, saved) < 0) {
+                    goto fail;
+                }
+                break;
+            default:
+                fd = open_redirect(r);
+                if (fd < 0) {
+                    goto fail;
+                }
+                status = redirect_saved(fd, r->fd, saved);
+                close(fd);
+                if (status < 0) {
+                    goto fail;
+                }
+                break;
+        }
+    }
+    return 0;
+
+fail:
+    if (saved) {
+        launch_restore(saved);
+    }
+    return -1;
+}
+
+void launch_restore(int saved[LAUNCH_USER_FDS]) {
+    for (int target = 0; target < LAUNCH_USER_FDS; target++) {
+        if (saved[target] >= 0) {
+            dup2(saved[target], target);
+            close(saved[target]);
+        } else if (saved[target] == -2) {
+            close(target);
+        }
+        saved[target] = -1;
+    }
+}
+
+int launch_exit_status(int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return 0;
+}
+
+#endif // _WIN32
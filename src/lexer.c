@@ -0,0 +1,357 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "lexer.h"
+
+#define TOKEN_INITIAL_CAPACITY 8
+
+/**
+ * Characters that end an unquoted word
+ */
+static int is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\a';
+}
+
+static int is_operator_char(char c) {
+    return c == '|' || c == '&' || c == ';' || c == '<' || c == '>' || c == '(' || c == ')';
+}
+
+const char *token_name(token_type_t type) {
+    switch (type) {
+        case TOK_PIPE:   return "|";
+        case TOK_LESS:   return "<";
+        case TOK_GREAT:  return ">";
+        case TOK_DGREAT: return ">>";
+        case TOK_LESSGREAT: return "<>";
+        case TOK_LESSAND:   return "<&";
+        case TOK_GREATAND:  return ">&";
+        case TOK_AMPGREAT:  return "&>";
+        case TOK_AMPDGREAT: return "&>>";
+        case TOK_AMP:    return "&";
+        case TOK_SEMI:   return ";";
+        case TOK_AND_IF: return "&&";
+        case TOK_OR_IF:  return "||";
+        case TOK_LPAREN: return "(";
+        case TOK_RPAREN: return ")";
+        case TOK_DSEMI:  return ";;";
+        case TOK_ARITH:  return "((";
+        case TOK_NEWLINE:
+        case TOK_EOF:    return "newline";
+        default:         return "word";
+    }
+}
+
+// Bytes that need a closer look inside a word (everything else is skipped)
+static const unsigned char word_special[256] = {
+    ['\0'] = 1, [' '] = 1, ['\t'] = 1, ['\r'] = 1, ['\n'] = 1, ['\a'] = 1,
+    ['|'] = 1, ['&'] = 1, [';'] = 1, ['<'] = 1, ['>'] = 1, ['('] = 1, [')'] = 1,
+    ['\\'] = 1, ['\''] = 1, ['"'] = 1, ['$'] = 1, ['`'] = 1
+};
+
+/**
+ * Skip a parenthesized span starting at its `(`, as in $( ... )
+ * Parentheses nest, and quotes inside are honoured, so blanks and
+ * operators in the span do not end the word around it.
+ * @return: Pointer just past the matching `)`, or NULL if the input ends
+ *          first
+ */
+static char *skip_parens(char *p) {
+    int depth = 0;
+
+    for (; *p != '\0'; p++) {
+        switch (*p) {
+            case '(':
+                depth++;
+                break;
+            case ')':
+                if (--depth == 0) {
+                    return p + 1;
+                }
+                break;
+            case '\\':
+                if (p[1] == '\0') {
+                    return NULL;
+                }
+                p++;
+                break;
+            case '\'':
+                p = strchr(p + 1, '\'');
+                if (!p) {
+                    return NULL;
+                }
+                break;
+            case '"':
+                for (p++; *p != '"'; p++) {
+                    if (*p == '\0') {
+                        return NULL;
+                    }
+                    if (*p == '\\' && p[1]) {
+                        p++;
+                    }
+                }
+                break;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Skip a `command` substitution starting at its opening backquote
+ * @return: Pointer just past the closing backquote, or NULL if the input
+ *          ends first
+ */
+static char *skip_backquotes(char *p) {
+    for (p++; *p != '`'; p++) {
+        if (*p == '\0') {
+            return NULL;
+        }
+        if (*p == '\\' && p[1]) {
+            p++;
+        }
+    }
+    return p + 1;
+}
+
+/**
+ * Find the `))` closing an arithmetic command opened by `((`
+ * @param p: First character after `((`
+ * @param flags: Output WORD_* flags of the expression
+ * @param end: Output pointer just past the `))`
+ * @return: 1 if found, 0 if a `)` closes something else first (nested
+ *          subshells, as in ((cd d; make) | tee log)), or LEX_INCOMPLETE
+ */
+static int scan_arith(char *p, int *flags, char **end) {
+    int depth = 0;
+
+    for (; *p != '\0'; p++) {
+        if (*p == '(') {
+            depth++;
+        } else if (*p == ')') {
+            if (depth == 0) {
+                if (p[1] != ')') {
+                    return 0;
+                }
+                *end = p + 2;
+                return 1;
+            }
+            depth--;
+        } else if (*p == '$') {
+            *flags |= WORD_DOLLAR;
+        } else if (*p == '\\' || *p == '\'' || *p == '"') {
+            *flags |= WORD_QUOTED;
+        }
+    }
+    return LEX_INCOMPLETE;
+}
+
+/**
+ * Scan one word starting at p, recording quoting in *flags
+ * Quotes and substitutions may span lines; the input just has to
+ * contain all of them.
+ * @return: Pointer just past the word, or NULL if the input ends inside
+ *          quotes or right after a backslash
+ */
+static char *scan_word(char *p, int *flags) {
+    while (1) {
+        while (!word_special[(unsigned char)*p]) p++;
+        if (*p == '\0' || *p == '\n' || is_blank(*p) || is_operator_char(*p)) {
+            break;
+        }
+        switch (*p) {
+            case '\\':
+                *flags |= WORD_QUOTED;
+                if (p[1] == '\0') {
+                    return NULL;
+                }
+                p += 2;
+                break;
+            case '\'':
+                *flags |= WORD_QUOTED;
+                p = strchr(p + 1, '\'');
+                if (!p) {
+                    return NULL;
+                }
+                p++;
+                break;
+            case '"':
+                *flags |= WORD_QUOTED;
+                for (p++; *p != '"'; p++) {
+                    if (*p == '\0') {
+                        return NULL;
+                    }
+                    if (*p == '\\' && p[1]) {
+                        p++;
+                    } else if (*p == '$') {
+                        *flags |= WORD_DOLLAR;
+                        if (p[1] == '(') {
+                            p = skip_parens(p + 1);
+                            if (!p) {
+                                return NULL;
+                            }
+                            p--;
+                        }
+                    } else if (*p == '`') {
+                        *flags |= WORD_DOLLAR;
+                        p = skip_backquotes(p);
+                        if (!p) {
+                            return NULL;
+                        }
+                        p--;
+                    }
+                }
+                p++;
+                break;
+            case '$':
+                *flags |= WORD_DOLLAR;
+                p++;
+                if (*p == '(') {
+                    p = skip_parens(p);
+                    if (!p) {
+                        return NULL;
+                    }
+                }
+                break;
+            case '`':
+                *flags |= WORD_DOLLAR;
+                p = skip_backquotes(p);
+                if (!p) {
+                    return NULL;
+                }
+                break;
+        }
+    }
+    return p;
+}
+
+int lex_line(arena_t *arena, char *line, token_t **out) {
+    size_t capacity = TOKEN_INITIAL_CAPACITY;
+    token_t *tokens = arena_alloc(arena, capacity * sizeof(token_t));
+    int count = 0;
+    int io_number = -1;
+    char *p = line;
+
+    while (1) {
+        // Blanks, and backslash-newline joining two lines
+        while (is_blank(*p) || (p[0] == '\\' && p[1] == '\n')) {
+            p += is_blank(*p) ? 1 : 2;
+        }
+
+        // A comment runs to the end of its line
+        if (*p == '#') {
+            while (*p != '\0' && *p != '\n') p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+
+        // Keep room for this token and the TOK_EOF terminator
+        if ((size_t)count + 2 > capacity) {
+            tokens = arena_realloc(arena, tokens, capacity * sizeof(token_t),
+                                   capacity * 2 * sizeof(token_t));
+            capacity *= 2;
+        }
+
+        token_t *t = &tokens[count];
+        t->start = p;
+        t->flags = 0;
+        t->io_number = -1;
+        t->len = 1;
+
+        switch (*p) {
+            case '|':
+                t->type = (p[1] == '|') ? TOK_OR_IF : TOK_PIPE;
+                break;
+            case '&':
+                if (p[1] == '>') {
+                    t->type = (p[2] == '>') ? TOK_AMPDGREAT : TOK_AMPGREAT;
+                } else {
+                    t->type = (p[1] == '&') ? TOK_AND_IF : TOK_AMP;
+                }
+                break;
+            case ';':
+                t->type = (p[1] == ';') ? TOK_DSEMI : TOK_SEMI;
+                break;
+            case '\n':
+                t->type = TOK_NEWLINE;
+                break;
+            case '(':
+                t->type = TOK_LPAREN;
+                if (p[1] == '(') {
+                    // (( expression )): one token, unless a `)` first
+                    // closes a nested subshell
+                    char *end;
+                    int found = scan_arith(p + 2, &t->flags, &end);
+                    if (found == LEX_INCOMPLETE) {
+                        return LEX_INCOMPLETE;
+                    }
+                    if (found) {
+                        t->type = TOK_ARITH;
+                        t->len = (int)(end - p);
+                        p = end;
+                        count++;
+                        continue;
+                    }
+                    t->flags = 0;
+                }
+                break;
+            case ')':
+                t->type = TOK_RPAREN;
+                break;
+            case '<':
+                t->type = (p[1] == '>') ? TOK_LESSGREAT :
+                          (p[1] == '&') ? TOK_LESSAND : TOK_LESS;
+                break;
+            case '>':
+                t->type = (p[1] == '>') ? TOK_DGREAT :
+                          (p[1] == '&') ? TOK_GREATAND : TOK_GREAT;
+                break;
+            default: {
+                char *end = scan_word(p, &t->flags);
+                if (!end) {
+                    return LEX_INCOMPLETE;
+                }
+                t->type = TOK_WORD;
+                t->len = (int)(end - p);
+
+                // Single digit glued to a redirection: 2>file. Only fds
+                // 0-9 belong to commands; the shell keeps its own above.
+                if (t->flags == 0 && end == p + 1 && isdigit((unsigned char)*p) &&
+                    (*end == '<' || *end == '>')) {
+                    io_number = *p - '0';
+                    p = end;
+                    continue;
+                }
+                p = end;
+                count++;
+                continue;
+            }
+        }
+
+        // Operator tokens: the spelling gives the length
+        t->len = (t->type == TOK_NEWLINE) ? 1 : (int)strlen(token_name(t->type));
+        if (TOK_IS_REDIRECT(t->type) && t->type != TOK_AMPGREAT && t->type != TOK_AMPDGREAT) {
+            t->io_number = io_number;
+        }
+        io_number = -1;
+        p += t->len;
+        count++;
+    }
+
+    tokens[count].type = TOK_EOF;
+    tokens[count].flags = 0;
+    tokens[count].io_number = -1;
+    tokens[count].start = p;
+    tokens[count].len = 0;
+
+    // Plain words are used in place: terminate them now that every token
+    // has been recognized (the byte after a word is a blank or an operator)
+    for (int i = 0; i < count; i++) {
+        if (tokens[i].type == TOK_WORD && tokens[i].flags == 0) {
+            tokens[i].start[tokens[i].len] = '\0';
+        }
+    }
+
+    *out = tokens;
+    return count;
+}
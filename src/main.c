@@ -3,46 +3,82 @@
 #include <string.h>
 #include <signal.h>
 #include <ctype.h>
+#include <errno.h>
 
 #ifdef _WIN32
 // Windows headers
 #include <process.h>
 #include <io.h>
 #include <fcntl.h>
+#include <time.h>
 #else
 // POSIX headers
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
 #include <fcntl.h>
+#include <pthread.h>
 #endif
 
 #include "builtins.h"
 #include "error.h"
 #include "readline.h"
+#include "history.h"
 #include "jobs.h"
-
-
-
-
-
-
-
-#define TOKEN_DELIMITERS " \t\r\n\a"
-#define TOKEN_BUFFER_SIZE 64
+#include "launch.h"
+#include "cmdhash.h"
+#include "complete.h"
+#include "dircache.h"
+#include "shell.h"
+#include "arena.h"
+#include "lexer.h"
+#include "expand.h"
+#include "parser.h"
+#include "parsecache.h"
+#include "vars.h"
+#include "vm.h"
 
 /**
- * Structure to represent a parsed command
+ * Structure to represent an expanded, ready-to-run command
  */
 struct command {
-    char **argv;           // Command arguments (NULL-terminated)
-    char *input_file;      // Input redirection file (or NULL)
-    char *output_file;     // Output redirection file (or NULL)
+    int kind;              // CMD_SIMPLE, CMD_GROUP or CMD_SUBSHELL
+    const struct code *code;  // Groups and subshells: the compiled body
+    const char *text;      // Groups and subshells: source text
+    char **argv;           // Command arguments (NULL-terminated; empty for groups)
+    char **assigns;        // Prefix assignments, NAME=value (NULL if none)
+    char **envp;           // Environment with the assignments applied (NULL if none)
+    redirection_t *redirs; // Redirections in command-line order
+    int num_redirs;        // Number of redirections
     int background;        // 1 if background (&), 0 otherwise
 };
 
+// eval_line result for a command that goes on on the next line
+#define EVAL_INCOMPLETE -2
+
+// Shell-wide state
+shell_state_t shell = {.name = "myshell"};
+
+// Expanded words of the line being evaluated; reset after each line
+static arena_t eval_arena;
+
+// Command substitutions run so far (NAME=$(cmd) takes the last one's status)
+static unsigned long substitutions = 0;
+
+// In-shell last stages running while earlier stages are still unwaited
+static int pipeline_depth = 0;
+
 // Forward declarations
+int execute_builtin_redirected(struct command *cmd, int in_fd);
+int execute_timed_pipeline(struct command **commands, int num_cmds);
+#ifdef _WIN32
+struct rusage;  // No resource accounting on Windows; always NULL there
 int execute_external(struct command *cmd);
+#endif
+int execute_pipeline(struct command **commands, int num_cmds, struct rusage *usage);
 
 /**
  * Signal handler for SIGINT (Ctrl+C)
@@ -71,495 +107,826 @@ void setup_signal_handlers(void) {
 }
 
 /**
- * Expand environment variables in a string
- * Supports $VAR and ${VAR} syntax
- * @param input: String with potential variables
- * @return: New string with variables expanded (must be freed by caller)
+ * Expand a parsed redirection into the launch engine's form
+ * &>file (and a bare >&file) becomes two entries: >file 2>&1.
+ * @param arena: Arena for the target word
+ * @param parsed: Parsed redirection
+ * @param out: Room for two entries
+ * @return: Number of entries written
  */
-char *expand_variables(const char *input) {
-    if (!input) return NULL;
-    
-    char *result = malloc(4096);  // Large buffer for expansion
-    if (!result) {
-        error_allocation("expand_variables");
-        return strdup(input);
-    }
+static int expand_redirect(arena_t *arena, const struct parsed_redirect *parsed, redirection_t *out) {
+    char *word = expand_word(arena, parsed->target);
+    int both = 0;
     
-    int result_pos = 0;
-    int i = 0;
-    int len = strlen(input);
-    
-    while (i < len && result_pos < 4095) {
-        if (input[i] == '$') {
-            // Found a variable
-            i++;  // Skip $
-            
-            char var_name[256] = "";
-            int var_pos = 0;
-            int use_braces = 0;
-            
-            // Check for ${VAR} syntax
-            if (i < len && input[i] == '{') {
-                use_braces = 1;
-                i++;  // Skip {
-            }
-            
-            // Extract variable name
-            while (i < len && var_pos < 255) {
-                char c = input[i];
-                
-                if (use_braces) {
-                    if (c == '}') {
-                        i++;  // Skip }
-                        break;
-                    }
-                    var_name[var_pos++] = c;
-                    i++;
-                } else {
-                    // Variable name: alphanumeric and underscore
-                    if (isalnum(c) || c == '_') {
-                        var_name[var_pos++] = c;
-                        i++;
-                    } else {
-                        break;
-                    }
-                }
-            }
-            
-            var_name[var_pos] = '\0';
-            
-            // Get environment variable value
-            char *value = getenv(var_name);
-            if (value) {
-                // Copy value to result
-                int value_len = strlen(value);
-                if (result_pos + value_len < 4095) {
-                    strcpy(result + result_pos, value);
-                    result_pos += value_len;
-                }
+    out->path = word;
+    out->source = -1;
+    switch (parsed->type) {
+        case TOK_LESS:      out->op = REDIR_INPUT; break;
+        case TOK_GREAT:     out->op = REDIR_OUTPUT; break;
+        case TOK_DGREAT:    out->op = REDIR_APPEND; break;
+        case TOK_LESSGREAT: out->op = REDIR_READWRITE; break;
+        case TOK_AMPGREAT:  out->op = REDIR_OUTPUT; both = 1; break;
+        case TOK_AMPDGREAT: out->op = REDIR_APPEND; both = 1; break;
+        default: {
+            // n>&m and n<&m copy a descriptor, n>&- closes one
+            size_t digits = strspn(word, "0123456789");
+            if (strcmp(word, "-") == 0) {
+                out->op = REDIR_CLOSE;
+            } else if (digits > 0 && word[digits] == '\0') {
+                out->op = REDIR_DUP;
+                out->source = (digits == 1) ? word[0] - '0' : -1;
+            } else if (parsed->type == TOK_GREATAND && parsed->fd < 0) {
+                out->op = REDIR_OUTPUT;
+                both = 1;
+            } else {
+                out->op = REDIR_DUP;   // Reported as a bad descriptor
             }
-            // If variable not found, just skip it (replace with empty string)
-            
-        } else if (input[i] == '\\' && i + 1 < len && input[i + 1] == '$') {
-            // Escaped dollar sign
-            result[result_pos++] = '$';
-            i += 2;
-        } else {
-            // Regular character
-            result[result_pos++] = input[i++];
+            break;
         }
     }
+    if (parsed->fd >= 0) {
+        out->fd = parsed->fd;
+    } else {
+        out->fd = (parsed->type == TOK_LESS || parsed->type == TOK_LESSGREAT ||
+                   parsed->type == TOK_LESSAND) ? 0 : 1;
+    }
     
-    result[result_pos] = '\0';
-    return result;
+    if (both) {
+        out[1].op = REDIR_DUP;
+        out[1].fd = 2;
+        out[1].source = 1;
+        out[1].path = "1";
+        return 2;
+    }
+    return 1;
 }
 
 /**
- * Initialize a command structure
+ * Check whether a command redirects a descriptor
+ * @param cmd: Expanded command
+ * @param fd: Descriptor
+ * @return: 1 if some redirection targets fd, 0 otherwise
  */
-struct command *init_command(void) {
-    struct command *cmd = malloc(sizeof(struct command));
-    if (!cmd) {
-        error_allocation("init_command");
-        exit(EXIT_FAILURE);
+static int redirects_fd(const struct command *cmd, int fd) {
+    for (int i = 0; i < cmd->num_redirs; i++) {
+        if (cmd->redirs[i].fd == fd) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Expand a parsed command into an executable one
+ * Runs every time the command executes; the parsed form is not modified.
+ * @param arena: Arena for the expanded command
+ * @param parsed: Parsed (pre-expansion) command
+ * @return: Command with argv and redirection targets expanded
+ */
+struct command *expand_command(arena_t *arena, const struct parsed_command *parsed) {
+    struct command *cmd = arena_alloc(arena, sizeof(struct command));
+    int argc;
+    
+    cmd->kind = parsed->kind;
+    cmd->code = parsed->code;
+    cmd->text = parsed->text;
+    cmd->argv = expand_fields(arena, parsed->words, parsed->num_words, 0, &argc);  // "$@" may add words
+    
+    // VAR=x cmd: the command gets its own environment
+    cmd->assigns = NULL;
+    cmd->envp = NULL;
+    if (parsed->num_assigns > 0) {
+        cmd->assigns = arena_alloc(arena, (parsed->num_assigns + 1) * sizeof(char*));
+        for (int i = 0; i < parsed->num_assigns; i++) {
+            cmd->assigns[i] = expand_assignment(arena, &parsed->assigns[i]);
+        }
+        cmd->assigns[parsed->num_assigns] = NULL;
+        cmd->envp = vars_environ_with(arena, cmd->assigns);
+    }
+    
+    // Redirections keep their order: 2>&1 >f and >f 2>&1 differ
+    cmd->redirs = NULL;
+    cmd->num_redirs = 0;
+    if (parsed->num_redirs > 0) {
+        cmd->redirs = arena_alloc(arena, 2 * parsed->num_redirs * sizeof(redirection_t));
+        for (int i = 0; i < parsed->num_redirs; i++) {
+            cmd->num_redirs += expand_redirect(arena, &parsed->redirs[i], cmd->redirs + cmd->num_redirs);
+        }
     }
-    cmd->argv = NULL;
-    cmd->input_file = NULL;
-    cmd->output_file = NULL;
     cmd->background = 0;
     return cmd;
 }
 
 /**
- * Free a command structure
+ * Set the variables of an assignment-only command, in order, so each
+ * value can use the ones before it (A=1 B=$A)
+ * @param arena: Arena for the expanded values
+ * @param parsed: Command with assignments and no words
+ * @return: 0
  */
-void free_command(struct command *cmd) {
-    if (cmd) {
-        free(cmd->argv);
-        free(cmd);
+static int assign_variables(arena_t *arena, const struct parsed_command *parsed) {
+    for (int i = 0; i < parsed->num_assigns; i++) {
+        vars_assign(expand_assignment(arena, &parsed->assigns[i]), 0);
     }
+    return 0;
 }
 
 /**
- * Parse tokens into a command structure
- * Handles: redirection (<, >), background (&)
+ * Perform the redirections of a command with nothing to run (> file)
+ * Files are opened, created or truncated as for any command; the shell's
+ * descriptors are put back right after.
+ * @param redirs: Expanded redirections
+ * @param num_redirs: Number of redirections
+ * @return: 0, or 1 if a redirection failed (message printed)
  */
-struct command *parse_command(char **tokens) {
-    if (tokens == NULL || tokens[0] == NULL) {
-        return NULL;
-    }
+static int redirect_only(const redirection_t *redirs, int num_redirs) {
+    #ifdef _WIN32
+    // Like a builtin's, the redirections are not applied on Windows
+    (void)redirs;
+    (void)num_redirs;
+    return 0;
+    #else
+    launch_opts_t opts;
+    int saved[LAUNCH_USER_FDS];
     
-    struct command *cmd = init_command();
+    launch_opts_init(&opts);
+    opts.redirs = redirs;
+    opts.num_redirs = num_redirs;
+    if (launch_redirect(&opts, saved) < 0) {
+        return 1;
+    }
+    launch_restore(saved);
+    return 0;
+    #endif
+}
+
+/**
+ * Is a command run by the shell itself (a function or a builtin)?
+ * Functions come first, so one can wrap a builtin of the same name.
+ */
+static int runs_in_shell(char *name) {
+    return vm_function(name) != NULL || is_builtin(name);
+}
+
+/**
+ * Call a shell function
+ * The arguments are $1, $2, ... while the body runs; the body is a
+ * compound command like any other, run in the shell ({ }) or forked (( )).
+ * @param body: Function body
+ * @param argv: Command words, argv[0] being the function name
+ * @return: Status of the body (or of `return`), or -1 if the shell should exit
+ */
+static int call_function(const struct parsed_command *body, char **argv) {
+    int saved_argc = shell.argc;
+    char **saved_argv = shell.argv;
     int argc = 0;
-    int argv_size = TOKEN_BUFFER_SIZE;
     
-    // Allocate argv array
-    cmd->argv = malloc(argv_size * sizeof(char*));
-    if (!cmd->argv) {
-        error_allocation("parse_command argv");
-        exit(EXIT_FAILURE);
+    if (vm_function_begin() < 0) {
+        return 1;
     }
-    
-    // Parse tokens
-    for (int i = 0; tokens[i] != NULL; i++) {
-        if (strcmp(tokens[i], "<") == 0) {
-            // Input redirection
-            if (tokens[i + 1] != NULL) {
-                cmd->input_file = tokens[i + 1];
-                i++; // Skip the filename
-            }
-        } else if (strcmp(tokens[i], ">") == 0) {
-            // Output redirection
-            if (tokens[i + 1] != NULL) {
-                cmd->output_file = tokens[i + 1];
-                i++; // Skip the filename
-            }
-        } else if (strcmp(tokens[i], "&") == 0) {
-            // Background execution
-            cmd->background = 1;
-        } else {
-            // Regular argument
-            cmd->argv[argc] = tokens[i];
-            argc++;
-            
-            // Reallocate if needed
-            if (argc >= argv_size) {
-                argv_size += TOKEN_BUFFER_SIZE;
-                cmd->argv = realloc(cmd->argv, argv_size * sizeof(char*));
-                if (!cmd->argv) {
-                    error_allocation("parse_command realloc");
-                    exit(EXIT_FAILURE);
-                }
-            }
-        }
+    while (argv[argc + 1] != NULL) {
+        argc++;
     }
+    shell.argc = argc;
+    shell.argv = argv + 1;
     
-    // NULL-terminate argv
-    cmd->argv[argc] = NULL;
+    struct command *cmd = expand_command(&eval_arena, body);
+    int status = execute_pipeline(&cmd, 1, NULL);
     
-    return cmd;
+    vm_function_end();
+    shell.argc = saved_argc;
+    shell.argv = saved_argv;
+    return status;
 }
 
+/**
+ * Run a builtin or function with its prefix assignments (VAR=x builtin)
+ * in effect
+ * @param cmd: Command whose argv[0] is a builtin or function
+ * @param io: Streams to use (builtins only)
+ * @return: Exit status, or -1 if the shell should exit
+ */
+static int run_builtin(struct command *cmd, builtin_io_t *io) {
+    const struct parsed_command *function = vm_function(cmd->argv[0]);
+    vars_saved_t *saved = NULL;
+    int status;
+    
+    if (cmd->assigns != NULL) {
+        saved = vars_save(cmd->assigns);
+    }
+    if (function) {
+        status = call_function(function, cmd->argv);
+    } else {
+        status = execute_builtin(cmd->argv, io);
+    }
+    if (saved != NULL) {
+        vars_restore(saved);
+    }
+    return status;
+}
 
 /**
- * Tokenize input string by whitespace
- * @param line: Input string to tokenize
- * @return: NULL-terminated array of tokens (char**)
+ * Run a builtin or function in the shell process, honoring its redirections
+ * The shell's own fds are redirected around the call and restored after,
+ * so no child process is needed. `exec` without a command is the
+ * exception: its redirections stay, opening fds for the rest of the shell.
+ * @param cmd: Command whose argv[0] is a builtin or function
+ * @param in_fd: Pipe the command reads from (closed here), or -1
+ * @return: Builtin exit status, or -1 if the shell should exit
  */
-char **tokenize(char *line) {
-    int bufsize = TOKEN_BUFFER_SIZE;
-    int position = 0;
-    char **tokens = malloc(bufsize * sizeof(char*));
-    char *token;
+int execute_builtin_redirected(struct command *cmd, int in_fd) {
+    builtin_io_t io;
+    builtin_io_init(&io);
     
-    if (!tokens) {
-        fprintf(stderr, "myshell: allocation error\n");
-        exit(EXIT_FAILURE);
+    #ifdef _WIN32
+    (void)in_fd;
+    return run_builtin(cmd, &io);
+    #else
+    launch_opts_t opts;
+    int saved[LAUNCH_USER_FDS];
+    int permanent = (strcmp(cmd->argv[0], "exec") == 0 &&
+                     (cmd->argv[1] == NULL || (strcmp(cmd->argv[1], "--") == 0 && cmd->argv[2] == NULL)));
+    int function = (vm_function(cmd->argv[0]) != NULL);
+    int status;
+    
+    // A redirected stdin wins over the pipe
+    if (in_fd >= 0 && redirects_fd(cmd, 0)) {
+        close(in_fd);
+        in_fd = -1;
     }
     
-    // Use strtok to split by whitespace
-    token = strtok(line, TOKEN_DELIMITERS);
-    while (token != NULL) {
-        // Expand environment variables in the token
-        char *expanded = expand_variables(token);
-        tokens[position] = expanded;
-        position++;
-        
-        // Reallocate if we exceed buffer
-        if (position >= bufsize) {
-            bufsize += TOKEN_BUFFER_SIZE;
-            tokens = realloc(tokens, bufsize * sizeof(char*));
-            if (!tokens) {
-                fprintf(stderr, "myshell: allocation error\n");
-                exit(EXIT_FAILURE);
+    launch_opts_init(&opts);
+    opts.redirs = cmd->redirs;
+    opts.num_redirs = cmd->num_redirs;
+    if (function) {
+        // The commands of a function read fd 0 themselves
+        opts.in_fd = in_fd;
+    } else if (in_fd >= 0) {
+        // Input comes in as a stream; the shell's own stdin is left alone
+        io.in = fdopen(in_fd, "r");
+        if (io.in == NULL) {
+            close(in_fd);
+            error_system("fdopen");
+            return 1;
+        }
+    }
+    
+    if (opts.num_redirs == 0 && opts.in_fd < 0) {
+        status = run_builtin(cmd, &io);
+    } else {
+        // Buffered output belongs to the old stdout
+        fflush(stdout);
+        if (launch_redirect(&opts, permanent ? NULL : saved) < 0) {
+            status = 1;
+        } else {
+            status = run_builtin(cmd, &io);
+            fflush(stdout);
+            fflush(stderr);
+            if (!permanent) {
+                launch_restore(saved);
             }
         }
-        
-        token = strtok(NULL, TOKEN_DELIMITERS);
     }
     
-    // NULL-terminate the array
-    tokens[position] = NULL;
-    return tokens;
+    // Closing the read end lets the upstream stages finish
+    if (io.in != stdin) {
+        fclose(io.in);
+    } else if (opts.in_fd >= 0) {
+        close(opts.in_fd);
+    }
+    return status;
+    #endif
 }
 
 /**
- * Free tokens array (including expanded strings)
- * @param tokens: Array of tokens to free
+ * Run a compound command ({ list; }, if, while, ...) in the shell
+ * process, honoring its redirections
+ * Like a builtin, the redirections wrap the whole command and are
+ * restored afterwards; variables and cd inside it affect the shell.
+ * @param cmd: Group command
+ * @return: Status of the list, or -1 if the shell should exit
  */
-void free_tokens(char **tokens) {
-    if (!tokens) return;
+static int execute_group(struct command *cmd) {
+    #ifdef _WIN32
+    return vm_run(cmd->code, &eval_arena, 0);
+    #else
+    launch_opts_t opts;
+    int saved[LAUNCH_USER_FDS];
+    int status;
     
-    // Free each expanded token string
-    for (int i = 0; tokens[i] != NULL; i++) {
-        free(tokens[i]);
+    if (cmd->num_redirs == 0) {
+        return vm_run(cmd->code, &eval_arena, 0);
     }
+    launch_opts_init(&opts);
+    opts.redirs = cmd->redirs;
+    opts.num_redirs = cmd->num_redirs;
     
-    // Free the array itself
-    free(tokens);
+    fflush(stdout);
+    if (launch_redirect(&opts, saved) < 0) {
+        return 1;
+    }
+    status = vm_run(cmd->code, &eval_arena, 0);
+    fflush(stdout);
+    fflush(stderr);
+    launch_restore(saved);
+    return status;
+    #endif
 }
 
+#ifndef _WIN32
 /**
- * Split tokens into pipeline commands (separated by |)
- * @param tokens: Array of tokens
- * @param commands: Output array of command structures
- * @return: Number of commands in pipeline
+ * Turn a forked child into a subshell: no jobs of its own, no prompt
  */
-int split_pipeline(char **tokens, struct command ***commands) {
-    int num_cmds = 0;
-    int cmd_capacity = 4;
-    int token_start = 0;
-    int i;
-    
-    *commands = malloc(cmd_capacity * sizeof(struct command*));
-    if (!*commands) {
-        fprintf(stderr, "myshell: allocation error\n");
-        exit(EXIT_FAILURE);
+static void enter_subshell(void) {
+    jobs_enter_subshell();
+    shell.interactive = 0;
+    // Builtin stages must get EPIPE rather than die, as in the parent
+    signal(SIGPIPE, SIG_IGN);
+}
+
+/**
+ * Run a list in a forked copy of the shell: ( list ), a compound command
+ * used as a pipeline stage, or a list run in the background
+ * The last command is exec'd in place of the subshell when it can be.
+ * @param code: Compiled list to run
+ * @return: Exit status for _exit()
+ */
+static int run_subshell(const struct code *code) {
+    enter_subshell();
+    int status = vm_run(code, &eval_arena, EVAL_TAIL_EXEC);
+    fflush(stdout);
+    fflush(stderr);
+    return (status < 0) ? shell.last_status : status;
+}
+#endif
+
+#ifndef _WIN32
+/**
+ * Accumulate one process's resource usage into a total
+ * Times, context switches and block I/O add up; max RSS is the largest.
+ */
+static void rusage_add(struct rusage *total, const struct rusage *ru) {
+    timeradd(&total->ru_utime, &ru->ru_utime, &total->ru_utime);
+    timeradd(&total->ru_stime, &ru->ru_stime, &total->ru_stime);
+    if (ru->ru_maxrss > total->ru_maxrss) {
+        total->ru_maxrss = ru->ru_maxrss;
     }
+    total->ru_nvcsw += ru->ru_nvcsw;
+    total->ru_nivcsw += ru->ru_nivcsw;
+    total->ru_inblock += ru->ru_inblock;
+    total->ru_oublock += ru->ru_oublock;
+}
+
+/**
+ * Describe a pipeline for the job table ("producer -x | filter")
+ * @param commands: Pipeline stages
+ * @param num_cmds: Number of stages
+ * @param buf: Output buffer (truncated if too small)
+ * @param size: Size of buf
+ */
+static void pipeline_text(struct command **commands, int num_cmds, char *buf, size_t size) {
+    size_t len = 0;
     
-    // Find pipe symbols and create commands
-    for (i = 0; tokens[i] != NULL; i++) {
-        if (strcmp(tokens[i], "|") == 0) {
-            // Create a temporary array for this command's tokens
-            int token_count = i - token_start;
-            char **cmd_tokens = malloc((token_count + 1) * sizeof(char*));
-            for (int j = 0; j < token_count; j++) {
-                cmd_tokens[j] = tokens[token_start + j];
-            }
-            cmd_tokens[token_count] = NULL;
-            
-            // Parse this command
-            (*commands)[num_cmds] = parse_command(cmd_tokens);
-            free(cmd_tokens);
-            num_cmds++;
-            
-            // Expand array if needed
-            if (num_cmds >= cmd_capacity) {
-                cmd_capacity *= 2;
-                *commands = realloc(*commands, cmd_capacity * sizeof(struct command*));
-                if (!*commands) {
-                    fprintf(stderr, "myshell: allocation error\n");
-                    exit(EXIT_FAILURE);
-                }
-            }
-            
-            token_start = i + 1;
+    buf[0] = '\0';
+    for (int i = 0; i < num_cmds && len < size; i++) {
+        if (i > 0) {
+            len += snprintf(buf + len, size - len, " | ");
+        }
+        if (commands[i]->kind != CMD_SIMPLE) {
+            len += snprintf(buf + len, size - len, "%s", commands[i]->text);
+        }
+        for (int j = 0; commands[i]->argv[j] != NULL && len < size; j++) {
+            len += snprintf(buf + len, size - len, j ? " %s" : "%s", commands[i]->argv[j]);
         }
     }
+}
+
+/**
+ * A builtin pipeline stage running on a thread
+ */
+typedef struct builtin_thread {
+    pthread_t thread;
+    char **argv;       // Stage arguments (live until the pipeline is waited)
+    int out_fd;        // Pipe write end, owned by the thread
+    int status;        // Exit status once joined
+} builtin_thread_t;
+
+/**
+ * Thread body: run the builtin into its pipe, then close it for EOF
+ */
+static void *builtin_thread_main(void *arg) {
+    builtin_thread_t *stage = arg;
+    builtin_io_t io;
     
-    // Handle the last command (or only command if no pipes)
-    if (token_start <= i) {
-        int token_count = i - token_start;
-        char **cmd_tokens = malloc((token_count + 1) * sizeof(char*));
-        for (int j = 0; j < token_count; j++) {
-            cmd_tokens[j] = tokens[token_start + j];
-        }
-        cmd_tokens[token_count] = NULL;
-        
-        (*commands)[num_cmds] = parse_command(cmd_tokens);
-        free(cmd_tokens);
-        num_cmds++;
+    builtin_io_init(&io);
+    io.in = NULL;  // Pure builtins never read input
+    io.out = fdopen(stage->out_fd, "w");
+    if (io.out == NULL) {
+        close(stage->out_fd);
+        stage->status = 1;
+        return NULL;
     }
+    stage->status = execute_builtin(stage->argv, &io);
+    fclose(io.out);
+    return NULL;
+}
+#endif
+
+/**
+ * Record the exit status of every stage of the last pipeline (PIPESTATUS)
+ * @param statuses: Stage statuses in pipeline order
+ * @param count: Number of stages
+ */
+static void set_pipestatus(const int *statuses, int count) {
+    static int capacity = 0;
     
-    return num_cmds;
+    if (count > capacity) {
+        int *grown = realloc(shell.pipestatus, count * sizeof(int));
+        if (grown == NULL) {
+            error_allocation("PIPESTATUS");
+            return;
+        }
+        shell.pipestatus = grown;
+        capacity = count;
+    }
+    memcpy(shell.pipestatus, statuses, count * sizeof(int));
+    shell.num_pipestatus = count;
+}
+
+/**
+ * Status of a whole pipeline: the last stage's, or with pipefail the
+ * rightmost non-zero one
+ */
+static int pipeline_status(const int *statuses, int count) {
+    if (shell.pipefail) {
+        for (int i = count - 1; i >= 0; i--) {
+            if (statuses[i] != 0) {
+                return statuses[i];
+            }
+        }
+        return 0;
+    }
+    return statuses[count - 1];
 }
 
 /**
  * Execute a pipeline of commands
  * @param commands: Array of command structures
  * @param num_cmds: Number of commands in pipeline
- * @return: 0 on success, 1 on failure
+ * @param usage: If non-NULL, resource usage of the reaped stages is added to it
+ * @return: Exit status of the last command, or -1 if the shell should exit
  * 
  * Note: Full pipeline support requires fork/exec which is not available on Windows.
  * On Windows, this provides limited functionality.
  */
-int execute_pipeline(struct command **commands, int num_cmds) {
+int execute_pipeline(struct command **commands, int num_cmds, struct rusage *usage) {
     if (num_cmds == 0) {
         return 1;
     }
     
-    // Single command - no pipes needed
+    // Single built-in, function or compound command runs in the shell itself
     if (num_cmds == 1) {
-        if (commands[0]->argv[0] && is_builtin(commands[0]->argv[0])) {
-            return execute_builtin(commands[0]->argv);
+        if (commands[0]->kind == CMD_GROUP && !commands[0]->background) {
+            return execute_group(commands[0]);
+        }
+        if (commands[0]->argv[0] && runs_in_shell(commands[0]->argv[0])) {
+            int status = execute_builtin_redirected(commands[0], -1);
+            int recorded = (status < 0) ? 0 : status;
+            set_pipestatus(&recorded, 1);
+            return status;
+        }
+        #ifdef _WIN32
+        if (commands[0]->kind != CMD_SIMPLE) {
+            // No fork: a subshell runs in the shell too
+            return execute_group(commands[0]);
         }
-        return execute_external(commands[0]);
+        int status = execute_external(commands[0]);
+        set_pipestatus(&status, 1);
+        return status;
+        #endif
     }
     
-    // Multiple commands with pipes
     #ifdef _WIN32
+    (void)usage;
+    
+    // Multiple commands with pipes
     // Windows: Limited pipe support
     fprintf(stderr, "myshell: piping not fully supported on Windows\n");
     fprintf(stderr, "myshell: executing commands sequentially instead\n");
     
     // Execute commands sequentially as a fallback
+    int stage_status[num_cmds];
     for (int i = 0; i < num_cmds; i++) {
-        if (commands[i]->argv[0]) {
-            if (is_builtin(commands[i]->argv[0])) {
-                execute_builtin(commands[i]->argv);
+        stage_status[i] = 0;
+        if (commands[i]->kind != CMD_SIMPLE) {
+            stage_status[i] = execute_group(commands[i]);
+            if (stage_status[i] < 0) stage_status[i] = 0;
+        } else if (commands[i]->argv[0]) {
+            if (runs_in_shell(commands[i]->argv[0])) {
+                stage_status[i] = execute_builtin_redirected(commands[i], -1);
+                if (stage_status[i] < 0) stage_status[i] = 0;
             } else {
-                execute_external(commands[i]);
+                stage_status[i] = execute_external(commands[i]);
             }
         }
     }
-    return 0;
+    set_pipestatus(stage_status, num_cmds);
+    return pipeline_status(stage_status, num_cmds);
     
     #else
-    // POSIX: Full pipe support with fork/exec
+    // POSIX: external stages go through the launch engine. Builtin stages
+    // never fork the shell unless they have to: the last one runs in the
+    // shell, pure ones run on a thread, and only state-touching builtins
+    // (whose effects must not leak into the shell) get a forked child, as
+    // do groups and subshells.
     int i;
-    int pipefds[2 * (num_cmds - 1)];
-    pid_t pid;
+    
+    // Children write straight to the fds; get our buffered output out first
+    fflush(stdout);
+    int prev_read = -1;
+    pid_t pids[num_cmds];
+    builtin_thread_t threads[num_cmds];
+    pid_t pid = -1;
     int status;
+    int last_status = 0;
+    int in_shell = 0;
+    int is_background = commands[num_cmds - 1]->background;
+    char job_text[1024];
     
-    // Create all pipes
-    for (i = 0; i < num_cmds - 1; i++) {
-        if (pipe(pipefds + i * 2) < 0) {
-            error_pipe();
-            return 1;
-        }
-    }
+    // With job control the pipeline gets its own process group, led by
+    // the first process; a foreground group also gets the terminal
+    int job_control = job_control_enabled();
+    pid_t pgid = 0;
     
-    // Execute each command in the pipeline
     for (i = 0; i < num_cmds; i++) {
-        pid = fork();
+        int pipefd[2] = {-1, -1};
+        launch_opts_t opts;
+        char **argv = commands[i]->argv;
         
-        if (pid < 0) {
-            error_fork();
-            return 1;
-        } else if (pid == 0) {
-            // Child process
-            
-            // Restore default signal handlers in child
-            signal(SIGINT, SIG_DFL);
-            #ifndef _WIN32
-            signal(SIGQUIT, SIG_DFL);
-            #endif
-            
-            // If not the first command, get input from previous pipe
-            if (i > 0) {
-                if (dup2(pipefds[(i - 1) * 2], STDIN_FILENO) < 0) {
-                    perror("myshell: dup2");
-                    exit(EXIT_FAILURE);
-                }
-            }
-            
-            // If not the last command, send output to next pipe
-            if (i < num_cmds - 1) {
-                if (dup2(pipefds[i * 2 + 1], STDOUT_FILENO) < 0) {
-                    perror("myshell: dup2");
-                    exit(EXIT_FAILURE);
-                }
-            }
-            
-            // Close all pipe file descriptors
-            for (int j = 0; j < 2 * (num_cmds - 1); j++) {
-                close(pipefds[j]);
+        pids[i] = -1;
+        threads[i].argv = NULL;
+        
+        // Foreground last-stage builtin or function: run by the shell once
+        // the rest is started
+        if (i == num_cmds - 1 && !is_background && runs_in_shell(argv[0])) {
+            in_shell = 1;
+            break;
+        }
+        
+        // Pipe to the next stage; both ends are close-on-exec
+        if (i < num_cmds - 1 && launch_pipe(pipefd) < 0) {
+            if (prev_read >= 0) close(prev_read);
+            num_cmds = i;
+            break;
+        }
+        
+        launch_opts_init(&opts);
+        opts.in_fd = prev_read;
+        opts.out_fd = pipefd[1];
+        
+        // Every stage's redirections apply on top of its pipes
+        opts.redirs = commands[i]->redirs;
+        opts.num_redirs = commands[i]->num_redirs;
+        opts.envp = commands[i]->envp;
+        if (job_control) {
+            opts.pgid = pgid;
+            opts.foreground = !is_background;
+        }
+        
+        if (commands[i]->kind == CMD_SIMPLE && !runs_in_shell(argv[0])) {
+            pids[i] = launch_process(argv, &opts);
+        } else if (!is_background && is_builtin_pure(argv[0]) && !vm_function(argv[0]) &&
+                   commands[i]->num_redirs == 0 && !commands[i]->assigns) {
+            // Thread takes ownership of the pipe's write end
+            threads[i].argv = argv;
+            threads[i].out_fd = pipefd[1];
+            threads[i].status = 0;
+            if (pthread_create(&threads[i].thread, NULL, builtin_thread_main, &threads[i]) == 0) {
+                pipefd[1] = -1;
+            } else {
+                error_system("pthread_create");
+                threads[i].argv = NULL;
             }
-            
-            // Handle I/O redirection for first/last commands
-            if (i == 0 && commands[i]->input_file) {
-                int fd_in = open(commands[i]->input_file, O_RDONLY);
-                if (fd_in < 0) {
-                    perror("myshell: input redirection");
-                    exit(EXIT_FAILURE);
+        } else {
+            pids[i] = launch_fork(&opts);
+            if (pids[i] == 0) {
+                // Child: stdio is now the stage's; the next stage owns the read end
+                builtin_io_t io;
+                if (pipefd[0] >= 0) close(pipefd[0]);
+                if (prev_read >= 0) close(prev_read);
+                if (commands[i]->kind != CMD_SIMPLE) {
+                    _exit(run_subshell(commands[i]->code));
                 }
-                dup2(fd_in, STDIN_FILENO);
-                close(fd_in);
+                builtin_io_init(&io);
+                status = run_builtin(commands[i], &io);
+                fflush(stdout);
+                fflush(stderr);
+                _exit(status < 0 ? shell.last_status : status);
             }
-            
-            if (i == num_cmds - 1 && commands[i]->output_file) {
-                int fd_out = open(commands[i]->output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-                if (fd_out < 0) {
-                    perror("myshell: output redirection");
-                    exit(EXIT_FAILURE);
+        }
+        if (pids[i] > 0) {
+            pid = pids[i];
+            if (job_control && pgid == 0) {
+                pgid = pid;
+                if (!is_background) {
+                    give_terminal(pgid);
                 }
-                dup2(fd_out, STDOUT_FILENO);
-                close(fd_out);
-            }
-            
-            // Execute the command
-            if (execvp(commands[i]->argv[0], commands[i]->argv) < 0) {
-                error_command_not_found(commands[i]->argv[0]);
-                exit(EXIT_FAILURE);
             }
         }
+        
+        // Parent keeps only the read end for the next stage
+        if (prev_read >= 0) close(prev_read);
+        if (pipefd[1] >= 0) close(pipefd[1]);
+        prev_read = pipefd[0];
     }
     
-    // Parent: Close all pipe file descriptors
-    for (i = 0; i < 2 * (num_cmds - 1); i++) {
-        close(pipefds[i]);
+    if (in_shell) {
+        // -1 (exit) is passed through once the other stages are waited for;
+        // until then nothing may reap them from under us
+        pipeline_depth++;
+        last_status = execute_builtin_redirected(commands[num_cmds - 1], prev_read);
+        pipeline_depth--;
+        prev_read = -1;
+    } else if (prev_read >= 0) {
+        close(prev_read);
     }
     
-    // Check if this is a background job (last command has background flag)
-    int is_background = (num_cmds > 0 && commands[num_cmds - 1]->background);
-    
     if (is_background) {
-        // Add to job list - use the last command's PID
-        // For pipelines, we track the last process
-        char cmd_str[1024] = "";
-        for (int j = 0; j < num_cmds; j++) {
-            if (j > 0) strcat(cmd_str, " | ");
-            strcat(cmd_str, commands[j]->argv[0]);
-        }
-        // Note: pid variable holds the last forked PID
-        add_job(pid, cmd_str, 1);
+        // Every stage is tracked, so the job ends when its last process does
+        if (pid > 0) {
+            pipeline_text(commands, num_cmds, job_text, sizeof(job_text));
+            add_job(pgid, pids, num_cmds, job_text, 1);
+        }
+        last_status = (pid > 0) ? 0 : 127;
+        set_pipestatus(&last_status, 1);
     } else {
-        // Wait for all children (foreground)
+        // Wait for exactly the children and threads we started (foreground),
+        // collecting every stage's status in pipeline order
+        int stage_status[num_cmds];
+        int stopped_at = num_cmds;  // First stage of a Ctrl+Z'd pipeline
+        for (i = 0; i < num_cmds - in_shell; i++) {
+            if (pids[i] > 0) {
+                struct rusage stage_usage;
+                wait4(pids[i], &status, job_control ? WUNTRACED : 0, &stage_usage);
+                if (WIFSTOPPED(status)) {
+                    // Ctrl+Z: the unfinished stages become a stopped job
+                    pipeline_text(commands, num_cmds, job_text, sizeof(job_text));
+                    int job_id = add_job(pgid, pids + i, num_cmds - in_shell - i, job_text, 0);
+                    update_job_state(job_id, JOB_STOPPED);
+                    printf("\n[%d]+  Stopped\t\t%s\n", job_id, job_text);
+                    stopped_at = i;
+                    for (; i < num_cmds; i++) {
+                        stage_status[i] = 128 + WSTOPSIG(status);
+                    }
+                    break;
+                }
+                if (usage) {
+                    rusage_add(usage, &stage_usage);
+                }
+                stage_status[i] = launch_exit_status(status);
+                if (i == num_cmds - 1 && stage_status[i] == 128 + SIGINT && shell.interactive) {
+                    printf("\n");  // Ctrl+C: start the prompt on a fresh line
+                }
+            } else if (!threads[i].argv) {
+                // Launch failed: launch_process() gives the negated status
+                // (127, 126 or 1), a failed fork or thread -1
+                stage_status[i] = -pids[i];
+            }
+        }
         for (i = 0; i < num_cmds; i++) {
-            wait(&status);
+            if (threads[i].argv) {
+                pthread_join(threads[i].thread, NULL);
+                if (i < stopped_at) {
+                    stage_status[i] = threads[i].status;
+                }
+            }
+        }
+        if (pgid > 0) {
+            reclaim_terminal();
+        }
+        
+        if (in_shell && stopped_at == num_cmds) {
+            stage_status[num_cmds - 1] = (last_status < 0) ? 0 : last_status;
+        }
+        set_pipestatus(stage_status, num_cmds);
+        if (!(in_shell && last_status < 0) || stopped_at < num_cmds) {
+            last_status = pipeline_status(stage_status, num_cmds);
         }
     }
     
-    return 0;
+    return last_status;
+    #endif
+}
+
+/**
+ * Execute a pipeline under the `time` reserved word
+ * Reports wall-clock time plus the resources of every stage (reaped with
+ * wait4) and of the shell itself (builtins and their threads) to stderr.
+ * @param commands: Array of command structures
+ * @param num_cmds: Number of commands in pipeline
+ * @return: Exit status of the pipeline, or -1 if the shell should exit
+ */
+int execute_timed_pipeline(struct command **commands, int num_cmds) {
+    #ifdef _WIN32
+    clock_t start = clock();
+    int status = execute_pipeline(commands, num_cmds, NULL);
+    double real = (double)(clock() - start) / CLOCKS_PER_SEC;
+    fprintf(stderr, "\nreal\t%dm%.3fs\n", (int)(real / 60), real - 60 * (int)(real / 60));
+    return status;
+    #else
+    struct timespec start, end;
+    struct rusage self_before, self_after, total;
+    int status;
+    
+    memset(&total, 0, sizeof(total));
+    getrusage(RUSAGE_SELF, &self_before);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    status = execute_pipeline(commands, num_cmds, &total);
+    
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_SELF, &self_after);
+    
+    // Work done inside the shell counts too; its RSS only if nothing was spawned
+    struct rusage self;
+    memset(&self, 0, sizeof(self));
+    timersub(&self_after.ru_utime, &self_before.ru_utime, &self.ru_utime);
+    timersub(&self_after.ru_stime, &self_before.ru_stime, &self.ru_stime);
+    self.ru_maxrss = total.ru_maxrss ? 0 : self_after.ru_maxrss;
+    self.ru_nvcsw = self_after.ru_nvcsw - self_before.ru_nvcsw;
+    self.ru_nivcsw = self_after.ru_nivcsw - self_before.ru_nivcsw;
+    self.ru_inblock = self_after.ru_inblock - self_before.ru_inblock;
+    self.ru_oublock = self_after.ru_oublock - self_before.ru_oublock;
+    rusage_add(&total, &self);
+    
+    double real = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fflush(stdout);
+    fprintf(stderr, "\nreal\t%dm%.3fs\n", (int)(real / 60), real - 60 * (int)(real / 60));
+    fprintf(stderr, "user\t%dm%ld.%03lds\n", (int)(total.ru_utime.tv_sec / 60),
+            (long)(total.ru_utime.tv_sec % 60), (long)(total.ru_utime.tv_usec / 1000));
+    fprintf(stderr, "sys\t%dm%ld.%03lds\n", (int)(total.ru_stime.tv_sec / 60),
+            (long)(total.ru_stime.tv_sec % 60), (long)(total.ru_stime.tv_usec / 1000));
+    fprintf(stderr, "maxrss\t%ld KB\n", total.ru_maxrss);
+    fprintf(stderr, "ctxsw\t%ld voluntary, %ld involuntary\n", total.ru_nvcsw, total.ru_nivcsw);
+    fprintf(stderr, "blockio\t%ld in, %ld out\n", total.ru_inblock, total.ru_oublock);
+    return status;
     #endif
 }
 
+#ifdef _WIN32
 /**
- * Execute an external command using _spawnvp (Windows-compatible)
+ * Execute an external command using _spawnvpe (Windows-compatible)
  * @param cmd: Command structure with argv, redirection, and background info
  * @return: 0 on success, 1 on failure
  */
 int execute_external(struct command *cmd) {
-    int status;
-    int saved_stdin = -1, saved_stdout = -1;
-    int fd_in = -1, fd_out = -1;
+    int status = -1;
+    int saved[LAUNCH_USER_FDS];
+    int ok = 1;
     
     if (cmd == NULL || cmd->argv == NULL || cmd->argv[0] == NULL) {
         return 1;
     }
     
-    // Handle input redirection
-    if (cmd->input_file != NULL) {
-        saved_stdin = _dup(0);  // Save stdin
-        fd_in = _open(cmd->input_file, _O_RDONLY);
-        if (fd_in < 0) {
-            perror("myshell: input redirection");
-            return 1;
-        }
-        _dup2(fd_in, 0);  // Redirect stdin
-        _close(fd_in);
+    // Apply the redirections in order, saving each fd the first time it changes
+    for (int i = 0; i < LAUNCH_USER_FDS; i++) {
+        saved[i] = -2;
     }
-    
-    // Handle output redirection
-    if (cmd->output_file != NULL) {
-        saved_stdout = _dup(1);  // Save stdout
-        fd_out = _open(cmd->output_file, _O_WRONLY | _O_CREAT | _O_TRUNC, 0644);
-        if (fd_out < 0) {
-            perror("myshell: output redirection");
-            if (saved_stdin >= 0) {
-                _dup2(saved_stdin, 0);
-                _close(saved_stdin);
+    for (int i = 0; i < cmd->num_redirs && ok; i++) {
+        const redirection_t *r = &cmd->redirs[i];
+        if (saved[r->fd] == -2) {
+            saved[r->fd] = _dup(r->fd);
+        }
+        if (r->op == REDIR_CLOSE) {
+            _close(r->fd);
+        } else if (r->op == REDIR_DUP) {
+            if (r->source < 0 || _dup2(r->source, r->fd) < 0) {
+                fprintf(stderr, "myshell: %s: Bad file descriptor\n", r->path);
+                ok = 0;
+            }
+        } else {
+            int flags = (r->op == REDIR_INPUT) ? _O_RDONLY :
+                        (r->op == REDIR_OUTPUT) ? _O_WRONLY | _O_CREAT | _O_TRUNC :
+                        (r->op == REDIR_APPEND) ? _O_WRONLY | _O_CREAT | _O_APPEND :
+                        _O_RDWR | _O_CREAT;
+            int fd = _open(r->path, flags, 0644);
+            if (fd < 0) {
+                perror("myshell: redirection");
+                ok = 0;
+            } else {
+                _dup2(fd, r->fd);
+                _close(fd);
             }
-            return 1;
         }
-        _dup2(fd_out, 1);  // Redirect stdout
-        _close(fd_out);
     }
     
-    // Spawn the process
-    if (cmd->background) {
+    // Spawn the process with the shell's exported variables
+    char **envp = cmd->envp ? cmd->envp : vars_environ();
+    if (!ok) {
+        // Redirection failed (already reported)
+    } else if (cmd->background) {
         // Background process - don't wait
-        status = _spawnvp(_P_NOWAIT, cmd->argv[0], (const char* const*)cmd->argv);
+        status = _spawnvpe(_P_NOWAIT, cmd->argv[0], (const char* const*)cmd->argv, (const char* const*)envp);
         if (status == -1) {
             fprintf(stderr, "myshell: %s: command not found\n", cmd->argv[0]);
         } else {
@@ -567,189 +934,774 @@ int execute_external(struct command *cmd) {
         }
     } else {
         // Foreground process - wait for completion
-        status = _spawnvp(_P_WAIT, cmd->argv[0], (const char* const*)cmd->argv);
+        status = _spawnvpe(_P_WAIT, cmd->argv[0], (const char* const*)cmd->argv, (const char* const*)envp);
         if (status == -1) {
             fprintf(stderr, "myshell: %s: command not found\n", cmd->argv[0]);
         }
     }
     
-    // Restore stdin/stdout
-    if (saved_stdin >= 0) {
-        _dup2(saved_stdin, 0);
-        _close(saved_stdin);
-    }
-    if (saved_stdout >= 0) {
-        _dup2(saved_stdout, 1);
-        _close(saved_stdout);
+    // Restore the redirected fds (-1: it was closed before)
+    for (int i = 0; i < LAUNCH_USER_FDS; i++) {
+        if (saved[i] >= 0) {
+            _dup2(saved[i], i);
+            _close(saved[i]);
+        } else if (saved[i] == -1) {
+            _close(i);
+        }
     }
     
     return (status == -1) ? 1 : 0;
 }
+#endif
 
 /**
- * Load and execute commands from ~/.myshellrc
+ * Expand and run one pipeline of a command list
+ * Its expansions are given back as soon as it finishes, so a loop
+ * running it many times does not grow the arena.
+ * @param pipeline: Parsed pipeline
+ * @param flags: EVAL_* flags
+ * @param background: 1 to run it as a background job (&)
+ * @return: Exit status, or -1 if the shell should exit
  */
-void load_rc_file(void) {
-    char rc_path[1024];
-    char *home;
-    FILE *rc_file;
-    char *line = NULL;
-    size_t len = 0;
-    ssize_t nread;
-    int line_num = 0;
+int eval_pipeline(const struct pipeline *pipeline, int flags, int background) {
+    arena_mark_t mark = arena_mark(&eval_arena);
+    int status = 0;
     
-    // Get home directory
-    home = getenv("HOME");
-    if (home == NULL) {
-        #ifdef _WIN32
-        home = getenv("USERPROFILE");
+    // Scripts and -c have no prompt to reap finished jobs at: do it between
+    // commands, so `cmd &` in a loop leaves no zombies behind
+    if (!shell.interactive && pipeline_depth == 0) {
+        check_jobs();
+    }
+    
+    if (pipeline->num_cmds == 0) {
+        // Bare `time`
+    } else if (pipeline->commands[0].kind == CMD_SIMPLE && pipeline->commands[0].num_words == 0) {
+        // NAME=value alone sets shell variables and "> file" alone opens
+        // its files (the parser allows both only as a whole pipeline)
+        const struct parsed_command *parsed = &pipeline->commands[0];
+        unsigned long before = substitutions;
+        status = assign_variables(&eval_arena, parsed);
+        if (parsed->num_redirs > 0) {
+            redirection_t *redirs = arena_alloc(&eval_arena, 2 * parsed->num_redirs * sizeof(redirection_t));
+            int num_redirs = 0;
+            for (int i = 0; i < parsed->num_redirs; i++) {
+                num_redirs += expand_redirect(&eval_arena, &parsed->redirs[i], redirs + num_redirs);
+            }
+            if (!expand_failed()) {
+                status = redirect_only(redirs, num_redirs);
+            }
+        }
+        if (expand_failed()) {
+            status = 1;
+        } else if (status == 0 && substitutions != before) {
+            // dir=$(pwd): the status of the substitution
+            status = shell.last_status;
+        }
+    } else {
+        // Expand each stage for this run
+        int num_cmds = pipeline->num_cmds;
+        struct command **commands = arena_alloc(&eval_arena, num_cmds * sizeof(struct command*));
+        for (int i = 0; i < num_cmds; i++) {
+            commands[i] = expand_command(&eval_arena, &pipeline->commands[i]);
+        }
+        commands[num_cmds - 1]->background = background;
+        
+        if (expand_failed()) {
+            // A bad $(( )): the pipeline does not run
+            status = 1;
+        } else if (num_cmds == 1 && commands[0]->kind == CMD_SIMPLE && commands[0]->argv[0] == NULL) {
+            // "$@" with no parameters: nothing to run but the redirections
+            status = redirect_only(commands[0]->redirs, commands[0]->num_redirs);
+        } else
+        #ifndef _WIN32
+        // Tail position of `-c`: become the command instead of waiting for it
+        if ((flags & EVAL_TAIL_EXEC) && num_cmds == 1 && !pipeline->timed &&
+            commands[0]->argv[0] != NULL && !commands[0]->background &&
+            !runs_in_shell(commands[0]->argv[0])) {
+            launch_opts_t opts;
+            launch_opts_init(&opts);
+            opts.redirs = commands[0]->redirs;
+            opts.num_redirs = commands[0]->num_redirs;
+            opts.envp = commands[0]->envp;
+            status = launch_exec(commands[0]->argv, &opts);
+        } else
+        #else
+        (void)flags;
         #endif
+        {
+            // Execute the pipeline
+            if (pipeline->timed) {
+                status = execute_timed_pipeline(commands, num_cmds);
+            } else {
+                status = execute_pipeline(commands, num_cmds, NULL);
+            }
+        }
     }
     
-    if (home == NULL) {
-        // No home directory, skip rc file
-        return;
+    arena_rewind(&eval_arena, mark);
+    
+    // $? is current for the next pipeline of the same line
+    if (status >= 0) {
+        shell.last_status = status;
+    }
+    return status;
+}
+
+/**
+ * Run an and-or list in the background (list &)
+ * A plain pipeline becomes a job directly; anything larger (a && b &)
+ * runs in a forked subshell that is the job.
+ * @param node: NODE_ASYNC node
+ * @return: 0, or 1 if the subshell could not be started
+ */
+int eval_async(const struct node *node) {
+    const struct node *job = node->left;
+    
+    if (job->type == NODE_PIPELINE && job->pipeline->num_cmds > 0 &&
+        (job->pipeline->commands[0].kind != CMD_SIMPLE || job->pipeline->commands[0].num_words > 0)) {
+        return eval_pipeline(job->pipeline, 0, 1);
     }
     
-    // Construct rc file path
-    snprintf(rc_path, sizeof(rc_path), "%s/.myshellrc", home);
+    #ifdef _WIN32
+    // No fork: the list runs in the foreground
+    int status = vm_run(node->code, &eval_arena, 0);
+    return (status < 0) ? status : 0;
+    #else
+    launch_opts_t opts;
+    int job_control = job_control_enabled();
     
-    // Try to open rc file
-    rc_file = fopen(rc_path, "r");
-    if (rc_file == NULL) {
-        // RC file doesn't exist, that's okay
-        return;
+    launch_opts_init(&opts);
+    if (job_control) {
+        opts.pgid = 0;
+    }
+    pid_t pid = launch_fork(&opts);
+    if (pid == 0) {
+        _exit(run_subshell(node->code));
     }
     
-    printf("Loading %s...\n", rc_path);
+    int status = 1;
+    if (pid > 0) {
+        add_job(job_control ? pid : 0, &pid, 1, node->text, 1);
+        status = 0;
+    }
+    set_pipestatus(&status, 1);
+    shell.last_status = status;
+    return status;
+    #endif
+}
+
+#ifndef _WIN32
+/**
+ * Read a pipe to its end
+ * @param fd: Read end (closed here)
+ * @param len: Output number of bytes read
+ * @return: The bytes (malloc'd), however many there are
+ */
+static char *read_pipe(int fd, size_t *len) {
+    size_t capacity = 4096;
+    size_t used = 0;
+    char *data = malloc(capacity);
     
-    // Read and execute each line
-    while ((nread = getline(&line, &len, rc_file)) != -1) {
-        line_num++;
+    if (!data) {
+        error_allocation("command substitution");
+        exit(EXIT_FAILURE);
+    }
+    while (1) {
+        if (used == capacity) {
+            capacity *= 2;
+            data = realloc(data, capacity);
+            if (!data) {
+                error_allocation("command substitution");
+                exit(EXIT_FAILURE);
+            }
+        }
+        ssize_t n = read(fd, data + used, capacity - used);
+        if (n > 0) {
+            used += n;
+        } else if (n == 0 || errno != EINTR) {
+            break;
+        }
+    }
+    close(fd);
+    *len = used;
+    return data;
+}
+
+/**
+ * Wait for one child
+ * @return: Its exit status
+ */
+static int wait_child(pid_t pid) {
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return 1;
+        }
+    }
+    return launch_exit_status(status);
+}
+#endif
+
+/**
+ * Run the code of a command substitution with its output captured
+ * A lone pure builtin (echo, printf, pwd, ...) runs in the shell and
+ * writes into memory, and a lone external command is spawned with its
+ * output on a pipe. Everything else (functions, builtins that change the
+ * shell, lists, pipelines) runs in a forked subshell, so it cannot change
+ * the shell's variables or directory.
+ * @param code: Compiled command
+ * @param len: Output length of the captured output
+ * @return: The output (malloc'd), or NULL if nothing ran; $? is set
+ */
+static char *capture_output(const struct code *code, size_t *len) {
+    const struct pipeline *pipeline = vm_single_pipeline(code);
+    arena_mark_t mark = arena_mark(&eval_arena);
+    struct command *cmd = NULL;
+    char *output = NULL;
+    int status = 1;
+    
+    *len = 0;
+    if (pipeline != NULL && pipeline->num_cmds == 1 && !pipeline->timed && !pipeline->negated &&
+        pipeline->commands[0].kind == CMD_SIMPLE && pipeline->commands[0].num_words > 0) {
+        // A lone command is expanded here, once, to see what it is
+        cmd = expand_command(&eval_arena, &pipeline->commands[0]);
+        if (expand_failed() || cmd->argv[0] == NULL) {
+            arena_rewind(&eval_arena, mark);
+            shell.last_status = (cmd->argv[0] == NULL) ? 0 : 1;
+            return NULL;
+        }
+    }
+    
+    #ifdef _WIN32
+    // No fork: run it here with stdout sent to a temporary file
+    FILE *tmp = tmpfile();
+    if (tmp != NULL) {
+        fflush(stdout);
+        int saved = _dup(1);
+        _dup2(_fileno(tmp), 1);
+        status = cmd ? execute_pipeline(&cmd, 1, NULL) : vm_run(code, &eval_arena, 0);
+        fflush(stdout);
+        _dup2(saved, 1);
+        _close(saved);
         
+        long size = ftell(tmp);
+        output = malloc(size > 0 ? size : 1);
+        if (!output) {
+            error_allocation("command substitution");
+            exit(EXIT_FAILURE);
+        }
+        rewind(tmp);
+        *len = fread(output, 1, size > 0 ? size : 0, tmp);
+        fclose(tmp);
+    }
+    #else
+    if (cmd != NULL && is_builtin_pure(cmd->argv[0]) && !vm_function(cmd->argv[0]) &&
+        cmd->num_redirs == 0 && !cmd->assigns) {
+        // Pure builtin: no process, no pipe
+        builtin_io_t io;
+        size_t size = 0;
+        builtin_io_init(&io);
+        io.out = open_memstream(&output, &size);
+        if (io.out != NULL) {
+            status = execute_builtin(cmd->argv, &io);
+            fclose(io.out);
+            *len = size;
+        }
+    } else {
+        int fds[2];
+        launch_opts_t opts;
+        pid_t pid;
+        int external = (cmd != NULL && !runs_in_shell(cmd->argv[0]));
+        
+        if (launch_pipe(fds) < 0) {
+            arena_rewind(&eval_arena, mark);
+            shell.last_status = 1;
+            return NULL;
+        }
+        launch_opts_init(&opts);
+        opts.out_fd = fds[1];
+        if (external) {
+            // Spawned directly: no copy of the shell in between
+            opts.redirs = cmd->redirs;
+            opts.num_redirs = cmd->num_redirs;
+            opts.envp = cmd->envp;
+            pid = launch_process(cmd->argv, &opts);
+        } else {
+            pid = launch_fork(&opts);
+            if (pid == 0) {
+                close(fds[0]);
+                enter_subshell();
+                int child_status = cmd ? execute_pipeline(&cmd, 1, NULL)
+                                       : vm_run(code, &eval_arena, EVAL_TAIL_EXEC);
+                fflush(stdout);
+                fflush(stderr);
+                _exit((child_status < 0) ? shell.last_status : child_status);
+            }
+        }
+        close(fds[1]);
+        
+        // Read everything before waiting: the child may write more than a pipe holds
+        output = read_pipe(fds[0], len);
+        status = (pid > 0) ? wait_child(pid) : -pid;
+    }
+    #endif
+    
+    arena_rewind(&eval_arena, mark);
+    shell.last_status = status;
+    return output;
+}
+
+char *eval_substitution(arena_t *arena, const char *command) {
+    parsecache_entry_t *entry = NULL;
+    const struct code *code;
+    char *output = NULL;
+    size_t len = 0;
+    
+    // Compiled once: a substitution in a loop is not parsed again
+    substitutions++;
+    int result = parsecache_acquire(command, &code, &entry);
+    if (result == PARSE_INCOMPLETE) {
+        error_syntax("unexpected end of file");
+    }
+    if (result < 0) {
+        shell.last_status = 2;
+    } else if (code == NULL) {
+        // $( ) or a comment
+        shell.last_status = 0;
+    } else {
+        output = capture_output(code, &len);
+    }
+    parsecache_release(entry);
+    
+    // Trailing newlines are dropped: dir=$(pwd)
+    while (len > 0 && output[len - 1] == '\n') {
+        len--;
+    }
+    char *text = arena_strndup(arena, output ? output : "", len);
+    free(output);
+    return text;
+}
+
+/**
+ * Tokenize, parse and execute one command
+ * @param line: Command text; several lines if the command spans them
+ * @param flags: EVAL_* flags
+ * @return: Exit status of the command, -1 if the shell should exit, or
+ *          EVAL_INCOMPLETE if it goes on (nothing was run; call again
+ *          with the next line appended)
+ */
+int eval_line(char *line, int flags) {
+    parsecache_entry_t *entry = NULL;
+    const struct code *code;
+    int status = 0;
+    
+    // Parse and compile, or reuse the code of an identical earlier line
+    int result = parsecache_acquire(line, &code, &entry);
+    if (result == PARSE_INCOMPLETE) {
+        return EVAL_INCOMPLETE;
+    }
+    
+    // A command typed over several lines is one entry, with its newlines
+    if (flags & EVAL_HISTORY) {
+        add_history(line);
+        flags &= ~EVAL_HISTORY;
+    }
+    
+    if (result < 0) {
+        // Syntax error (already reported)
+        status = 2;
+    } else if (shell.noexec || code == NULL) {
+        // -n: parse only
+    } else {
+        status = vm_run(code, &eval_arena, flags);
+    }
+    
+    // Everything the line allocated goes away at once
+    parsecache_release(entry);
+    arena_reset(&eval_arena);
+    
+    if (status >= 0) {
+        shell.last_status = status;
+    }
+    return status;
+}
+
+/**
+ * Add a line to a command that spans several
+ * @param command: Lines so far (malloc'd), or NULL
+ * @param line: Next line, without its newline
+ * @return: The joined text (malloc'd)
+ */
+static char *append_line(char *command, const char *line) {
+    size_t old_len = command ? strlen(command) : 0;
+    size_t line_len = strlen(line);
+    char *joined = realloc(command, old_len + line_len + 2);
+    
+    if (joined == NULL) {
+        error_allocation("command");
+        exit(EXIT_FAILURE);
+    }
+    if (old_len > 0) {
+        joined[old_len++] = '\n';
+    }
+    memcpy(joined + old_len, line, line_len + 1);
+    return joined;
+}
+
+/**
+ * Run the next line of input, as a command of its own or as part of one
+ * that started on an earlier line (if ... fi, a trailing |)
+ * @param command: Unfinished command, updated (NULL when there is none)
+ * @param line: Line just read
+ * @param flags: EVAL_* flags
+ * @return: As eval_line; EVAL_INCOMPLETE leaves the lines in *command
+ */
+static int eval_next_line(char **command, char *line, int flags) {
+    if (*command == NULL) {
+        // Usual case: a whole command on one line, run without copying
+        int status = eval_line(line, flags);
+        if (status == EVAL_INCOMPLETE) {
+            *command = append_line(NULL, line);
+        }
+        return status;
+    }
+    
+    *command = append_line(*command, line);
+    int status = eval_line(*command, flags);
+    if (status != EVAL_INCOMPLETE) {
+        free(*command);
+        *command = NULL;
+    }
+    return status;
+}
+
+/**
+ * Report input that ended in the middle of a command
+ * @param command: Unfinished command (freed here), or NULL
+ */
+static void end_of_input(char *command) {
+    if (command != NULL) {
+        error_syntax("unexpected end of file");
+        shell.last_status = 2;
+        free(command);
+    }
+}
+
+/**
+ * Open a script for reading
+ * Its descriptor is kept clear of the ones commands redirect, so that
+ * `exec 3>log` inside the script cannot replace the script itself.
+ * @param path: Script path
+ * @return: Open stream, or NULL (errno set)
+ */
+static FILE *open_script(const char *path) {
+    #ifdef _WIN32
+    return fopen(path, "r");
+    #else
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    fd = launch_private_fd(fd);
+    FILE *file = fdopen(fd, "r");
+    if (file == NULL) {
+        close(fd);
+    }
+    return file;
+    #endif
+}
+
+/**
+ * Execute every line of a script
+ * @param file: Open script file
+ * @return: -1 if the script ran `exit`, 0 otherwise
+ */
+int run_file(FILE *file) {
+    char *line = NULL;
+    char *command = NULL;
+    size_t len = 0;
+    ssize_t nread;
+    int status = 0;
+    
+    // Read and execute each line
+    while ((nread = getline(&line, &len, file)) != -1) {
         // Remove trailing newline
-        if (line[nread - 1] == '\n') {
+        if (nread > 0 && line[nread - 1] == '\n') {
             line[nread - 1] = '\0';
         }
         
-        // Skip empty lines and comments
-        if (strlen(line) == 0 || line[0] == '#') {
+        // Skip empty lines and comments (including a #! line) between commands
+        if (command == NULL && (strlen(line) == 0 || line[0] == '#')) {
             continue;
         }
         
-        // Tokenize the input
-        char **tokens = tokenize(line);
-        
-        // Split into pipeline commands
-        struct command **commands = NULL;
-        int num_cmds = split_pipeline(tokens, &commands);
+        status = eval_next_line(&command, line, 0);
+        if (status == -1) {
+            break;
+        }
+    }
+    
+    end_of_input(command);
+    free(line);
+    return (status == -1) ? -1 : 0;
+}
+
+/**
+ * Execute a `-c` command string, one command at a time
+ * @param commands: Command string
+ * @return: -1 if the string ran `exit`, 0 otherwise
+ */
+int run_string(const char *commands) {
+    char *copy = strdup(commands);
+    char *line = copy;
+    char *command = NULL;
+    int status = 0;
+    
+    if (!copy) {
+        error_allocation("run_string");
+        return 0;
+    }
+    
+    while (line && status != -1) {
+        char *next = strchr(line, '\n');
+        if (next) {
+            *next++ = '\0';
+        }
         
-        // Execute the pipeline
-        if (num_cmds > 0) {
-            execute_pipeline(commands, num_cmds);
-            
-            // Free all commands
-            for (int i = 0; i < num_cmds; i++) {
-                free_command(commands[i]);
+        // Skip blank and comment lines between commands
+        char *p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (command != NULL || (*p != '\0' && *p != '#')) {
+            // The final line is in tail position unless only blanks follow
+            int flags = EVAL_TAIL_EXEC;
+            for (char *rest = next; rest && *rest; rest++) {
+                if (!isspace((unsigned char)*rest)) {
+                    flags = 0;
+                    break;
+                }
             }
-            free(commands);
+            status = eval_next_line(&command, line, flags);
         }
         
-        // Free tokens array
-        free_tokens(tokens);
+        line = next;
     }
     
-    // Cleanup
-    free(line);
+    end_of_input(command);
+    free(copy);
+    return (status == -1) ? -1 : 0;
+}
+
+/**
+ * Load and execute commands from ~/.myshellrc
+ * @return: -1 if the rc file ran `exit`, 0 otherwise
+ */
+int load_rc_file(void) {
+    char rc_path[1024];
+    const char *home;
+    FILE *rc_file;
+    int result;
+    
+    // Get home directory
+    home = vars_get("HOME");
+    if (home == NULL) {
+        #ifdef _WIN32
+        home = vars_get("USERPROFILE");
+        #endif
+    }
+    
+    if (home == NULL) {
+        // No home directory, skip rc file
+        return 0;
+    }
+    
+    // Construct rc file path
+    snprintf(rc_path, sizeof(rc_path), "%s/.myshellrc", home);
+    
+    // Try to open rc file
+    rc_file = open_script(rc_path);
+    if (rc_file == NULL) {
+        // RC file doesn't exist, that's okay
+        return 0;
+    }
+    
+    if (shell.interactive) {
+        printf("Loading %s...\n", rc_path);
+    }
+    
+    result = run_file(rc_file);
     fclose(rc_file);
     
-    printf("RC file loaded.\n\n");
+    if (shell.interactive) {
+        printf("RC file loaded.\n\n");
+    }
+    return result;
 }
 
-int main(void) {
+/**
+ * Print command-line usage
+ */
+static void usage(void) {
+    fprintf(stderr,
+            "usage: myshell [-in] [--rc | --norc] [-c command [name [arg...]]]\n"
+            "       myshell [-in] [--rc | --norc] [script [arg...]]\n");
+}
+
+int main(int argc, char **argv) {
     char *line = NULL;
+    const char *command_string = NULL;
+    const char *script = NULL;
+    FILE *script_file = NULL;
+    int force_interactive = 0;
+    int rc_mode = -1;   // -1: default (interactive only), 0: --norc, 1: --rc
+    int argi;
     
-    // Setup signal handlers
-    setup_signal_handlers();
+    // Parse options
+    for (argi = 1; argi < argc && argv[argi][0] == '-'; argi++) {
+        if (strcmp(argv[argi], "-c") == 0) {
+            if (argi + 1 >= argc) {
+                error_missing_arg("-c");
+                return 2;
+            }
+            command_string = argv[++argi];
+        } else if (strcmp(argv[argi], "-i") == 0) {
+            force_interactive = 1;
+        } else if (strcmp(argv[argi], "-n") == 0) {
+            shell.noexec = 1;
+        } else if (strcmp(argv[argi], "-s") == 0) {
+            // Read commands from stdin (the default without a script)
+        } else if (strcmp(argv[argi], "--rc") == 0) {
+            rc_mode = 1;
+        } else if (strcmp(argv[argi], "--norc") == 0) {
+            rc_mode = 0;
+        } else if (strcmp(argv[argi], "--") == 0) {
+            argi++;
+            break;
+        } else {
+            fprintf(stderr, "myshell: %s: invalid option\n", argv[argi]);
+            usage();
+            return 2;
+        }
+    }
     
-    // Load and execute RC file
-    load_rc_file();
+    // Remaining arguments: `-c` takes $0 then $1...; otherwise a script path
+    if (command_string) {
+        if (argi < argc) {
+            shell.name = argv[argi++];
+        }
+    } else if (argi < argc) {
+        script = argv[argi++];
+        shell.name = (char *)script;
+    }
+    shell.argc = argc - argi;
+    shell.argv = argv + argi;
     
-    // Initialize history
-    init_history();
+    shell.interactive = force_interactive ||
+        (command_string == NULL && script == NULL && isatty(STDIN_FILENO));
+    if (shell.interactive) {
+        // -n only makes sense for scripts
+        shell.noexec = 0;
+    }
+    
+    if (script) {
+        script_file = open_script(script);
+        if (script_file == NULL) {
+            error_system(script);
+            return 127;
+        }
+    }
+    
+    // Setup signal handlers
+    if (shell.interactive) {
+        setup_signal_handlers();
+    }
+    
+    #ifndef _WIN32
+    // Builtin stages write to pipes from inside the shell: a closed reader
+    // must give them EPIPE, not kill the shell (children get SIG_DFL back)
+    signal(SIGPIPE, SIG_IGN);
+    #endif
     
     // Initialize job control
     init_jobs();
+    if (shell.interactive) {
+        init_job_control();
+    }
     
-    // REPL: Read-Eval-Print Loop
-    while (1) {
-        // Check for completed jobs
-        check_jobs();
-        
-        // Read user input using custom readline (handles prompt and history)
-        if (line) {
-            free(line);
-            line = NULL;
-        }
-        
-        line = read_line("myshell> ");
-        
-        // Handle EOF or error
-        if (line == NULL) {
-            printf("\n");
-            break;
+    // Load and execute RC file
+    if (rc_mode == 1 || (rc_mode == -1 && shell.interactive)) {
+        if (load_rc_file() < 0) {
+            free_jobs();
+            cmdhash_free();
+            return shell.last_status;
         }
+    }
+    
+    if (command_string) {
+        run_string(command_string);
+    } else if (script_file) {
+        run_file(script_file);
+        fclose(script_file);
+    } else if (!shell.interactive) {
+        run_file(stdin);
+    } else {
+        // Initialize history
+        init_history();
         
-        // Add to history if not empty
-        if (strlen(line) > 0) {
-            add_history(line);
-        }
+        // Report background jobs as soon as they finish, even at an idle prompt
+        set_read_line_event(jobs_event_fd(), check_jobs);
         
-        // Process the command
-        if (strlen(line) > 0) {
-            // Tokenize the input
-            char **tokens = tokenize(line);
+        // REPL: Read-Eval-Print Loop
+        char *command = NULL;   // Command continued on the next line
+        while (1) {
+            // Check for completed jobs
+            check_jobs();
+            
+            // Read user input using custom readline (handles prompt and history)
+            if (line) {
+                free(line);
+                line = NULL;
+            }
             
-            // Split into pipeline commands
-            struct command **commands = NULL;
-            int num_cmds = split_pipeline(tokens, &commands);
+            line = read_line(command ? "> " : "myshell> ");
             
-            // Check for exit in first command
-            if (num_cmds > 0 && commands[0]->argv[0] != NULL) {
-                if (strcmp(commands[0]->argv[0], "exit") == 0) {
-                    int result = execute_builtin(commands[0]->argv);
-                    if (result == -1) {
-                        // Cleanup and exit
-                        for (int i = 0; i < num_cmds; i++) {
-                            free_command(commands[i]);
-                        }
-                        free(commands);
-                        free_tokens(tokens);
-                        break;
-                    }
+            // Handle EOF or error; Ctrl+D drops an unfinished command
+            if (line == NULL) {
+                printf("\n");
+                if (command) {
+                    end_of_input(command);
+                    command = NULL;
+                    continue;
                 }
+                break;
             }
             
-            // Execute the pipeline
-            if (num_cmds > 0) {
-                execute_pipeline(commands, num_cmds);
-                
-                // Free all commands
-                for (int i = 0; i < num_cmds; i++) {
-                    free_command(commands[i]);
+            // Process the command, then log it with its exit status
+            if (strlen(line) > 0 || command) {
+                int result = eval_next_line(&command, line, EVAL_HISTORY);
+                if (result == EVAL_INCOMPLETE) {
+                    continue;
+                }
+                history_record_status(shell.last_status);
+                if (result < 0) {
+                    break;
                 }
-                free(commands);
             }
-            
-            // Free tokens array
-            free_tokens(tokens);
         }
+        
+        // Free allocated memory
+        free(line);
+        free_history();
     }
     
-    // Free allocated memory
-    free(line);
-    free_history();
     free_jobs();
+    cmdhash_free();
+    complete_free();
+#ifndef _WIN32
+    dircache_free();
+#endif
+    vm_free();
+    parsecache_free();
+    vars_free();
     
-    return 0;
+    return shell.last_status;
 }
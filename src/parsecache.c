@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "parsecache.h"
+#include "arena.h"
+#include "vm.h"
+#include "hashtable.h"
+
+#define PARSECACHE_CAPACITY 256
+#define PARSECACHE_BUCKETS 512          // Power of two, 2x capacity
+#define PARSECACHE_BYTES_PER_CHAR 16    // Arena sizing: one block per entry
+
+struct parsecache_entry {
+    char *text;                         // Key: exact line text
+    unsigned int hash;
+    arena_t arena;                      // Holds the entry itself, the key,
+                                        // the lexed copy, the parse and its code
+    const struct code *code;            // Compiled list, NULL for an empty line
+    int pins;                           // Users currently executing it
+    struct parsecache_entry *hash_next;
+    struct parsecache_entry *lru_prev;  // Towards most recently used
+    struct parsecache_entry *lru_next;  // Towards least recently used
+};
+
+static parsecache_entry_t *buckets[PARSECACHE_BUCKETS];
+static parsecache_entry_t *lru_head = NULL;   // Most recently used
+static parsecache_entry_t *lru_tail = NULL;   // Least recently used
+static int entry_count = 0;
+static unsigned long hits = 0, misses = 0, evictions = 0;
+
+static void lru_unlink(parsecache_entry_t *e) {
+    if (e->lru_prev) e->lru_prev->lru_next = e->lru_next;
+    else lru_head = e->lru_next;
+    if (e->lru_next) e->lru_next->lru_prev = e->lru_prev;
+    else lru_tail = e->lru_prev;
+    e->lru_prev = e->lru_next = NULL;
+}
+
+static void lru_push_front(parsecache_entry_t *e) {
+    e->lru_prev = NULL;
+    e->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = e;
+    lru_head = e;
+    if (!lru_tail) lru_tail = e;
+}
+
+/**
+ * Remove an entry from the table and free it
+ */
+static void destroy_entry(parsecache_entry_t *e) {
+    parsecache_entry_t **link = &buckets[e->hash & (PARSECACHE_BUCKETS - 1)];
+    while (*link != e) {
+        link = &(*link)->hash_next;
+    }
+    *link = e->hash_next;
+    lru_unlink(e);
+    entry_count--;
+
+    // The entry lives in its own arena: copy the handle before freeing
+    arena_t arena = e->arena;
+    arena_free(&arena);
+}
+
+/**
+ * Evict least recently used entries that nobody is executing
+ */
+static void evict(void) {
+    parsecache_entry_t *e = lru_tail;
+    while (e && entry_count >= PARSECACHE_CAPACITY) {
+        parsecache_entry_t *prev = e->lru_prev;
+        if (e->pins == 0) {
+            destroy_entry(e);
+            evictions++;
+        }
+        e = prev;
+    }
+}
+
+int parsecache_acquire(const char *line, const struct code **code, parsecache_entry_t **entry) {
+    unsigned int h = hash_fnv1a_str(line);
+    parsecache_entry_t *e;
+
+    for (e = buckets[h & (PARSECACHE_BUCKETS - 1)]; e; e = e->hash_next) {
+        if (e->hash == h && strcmp(e->text, line) == 0) {
+            hits++;
+            lru_unlink(e);
+            lru_push_front(e);
+            e->pins++;
+            *entry = e;
+            *code = e->code;
+            return 0;
+        }
+    }
+
+    // Miss: parse a private copy of the text into a fresh arena sized so
+    // that the entry, its key and the parse normally take one malloc
+    misses++;
+    size_t len = strlen(line);
+    arena_t arena;
+    arena_init_size(&arena, sizeof(parsecache_entry_t) + 512 + len * PARSECACHE_BYTES_PER_CHAR);
+    e = arena_alloc(&arena, sizeof(parsecache_entry_t));
+    memset(e, 0, sizeof(*e));
+    e->text = arena_strndup(&arena, line, len);
+    e->hash = h;
+    char *work = arena_strndup(&arena, line, len);
+    struct node *tree;
+
+    int result = parse_line(&arena, work, &tree);
+    if (result < 0) {
+        // Syntax errors are reported every time, so never cache them; nor
+        // unfinished commands, which come back with another line appended
+        arena_free(&arena);
+        *entry = NULL;
+        *code = NULL;
+        return result;
+    }
+    e->code = tree ? vm_compile(&arena, tree, e) : NULL;
+    e->arena = arena;
+
+    if (entry_count >= PARSECACHE_CAPACITY) {
+        evict();
+    }
+    e->hash_next = buckets[h & (PARSECACHE_BUCKETS - 1)];
+    buckets[h & (PARSECACHE_BUCKETS - 1)] = e;
+    lru_push_front(e);
+    entry_count++;
+
+    e->pins = 1;
+    *entry = e;
+    *code = e->code;
+    return 0;
+}
+
+void parsecache_retain(parsecache_entry_t *entry) {
+    if (entry) {
+        entry->pins++;
+    }
+}
+
+void parsecache_release(parsecache_entry_t *entry) {
+    if (entry && entry->pins > 0) {
+        entry->pins--;
+    }
+}
+
+void parsecache_stats(FILE *out) {
+    unsigned long lookups = hits + misses;
+    fprintf(out, "entries:   %d/%d\n", entry_count, PARSECACHE_CAPACITY);
+    fprintf(out, "hits:      %lu\n", hits);
+    fprintf(out, "misses:    %lu\n", misses);
+    fprintf(out, "evictions: %lu\n", evictions);
+    fprintf(out, "hit rate:  %.1f%%\n", lookups ? 100.0 * hits / lookups : 0.0);
+}
+
+void parsecache_clear(void) {
+    parsecache_entry_t *e = lru_head;
+    while (e) {
+        parsecache_entry_t *next = e->lru_next;
+        if (e->pins == 0) {
+            destroy_entry(e);
+        }
+        e = next;
+    }
+    hits = misses = evictions = 0;
+}
+
+void parsecache_free(void) {
+    while (lru_head) {
+        destroy_entry(lru_head);
+    }
+}
@@ -0,0 +1,751 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "parser.h"
+#include "error.h"
+#include "vars.h"
+
+/**
+ * Recursive-descent parser state
+ */
+typedef struct parser {
+    arena_t *arena;
+    token_t *tokens;         // Token stream, ending in TOK_EOF
+    int pos;                 // Next token to look at
+    int incomplete;          // Ran out of input where more was expected
+} parser_t;
+
+/**
+ * Report an unexpected token
+ */
+static void syntax_error_near(const token_t *tok) {
+    char message[128];
+    if (tok->type == TOK_WORD) {
+        snprintf(message, sizeof(message), "near unexpected token `%.*s'", tok->len, tok->start);
+    } else {
+        snprintf(message, sizeof(message), "near unexpected token `%s'", token_name(tok->type));
+    }
+    error_syntax(message);
+}
+
+/**
+ * Reject the current token
+ * Running out of input is not an error yet: the command may go on on the
+ * next line, so nothing is printed and the parse reports PARSE_INCOMPLETE.
+ */
+static void unexpected(parser_t *p) {
+    if (p->tokens[p->pos].type == TOK_EOF) {
+        p->incomplete = 1;
+    } else {
+        syntax_error_near(&p->tokens[p->pos]);
+    }
+}
+
+/**
+ * Is a token the given unquoted word (a reserved word such as `{` or `fi`)?
+ */
+static int is_word(const token_t *tok, const char *word) {
+    size_t len = strlen(word);
+    return tok->type == TOK_WORD && tok->flags == 0 && (size_t)tok->len == len &&
+           memcmp(tok->start, word, len) == 0;
+}
+
+/**
+ * Is a token a reserved word (only meaningful in command position)?
+ */
+static int is_reserved(const token_t *tok) {
+    static const char *reserved[] = {"!", "{", "}", "case", "do", "done", "elif", "else",
+                                     "esac", "fi", "for", "function", "if", "in", "then",
+                                     "until", "while", NULL};
+    if (tok->type != TOK_WORD || tok->flags != 0) {
+        return 0;
+    }
+    for (int i = 0; reserved[i] != NULL; i++) {
+        if (is_word(tok, reserved[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Does the current token end a list (end of input, `)`, `;;`, `}`, or a
+ * reserved word such as `then` or `done`)?
+ * Only called in command position, where those words are reserved.
+ */
+static int at_list_end(const parser_t *p) {
+    static const char *closers[] = {"}", "then", "elif", "else", "fi", "do", "done", "esac", NULL};
+    const token_t *tok = &p->tokens[p->pos];
+    if (tok->type == TOK_EOF || tok->type == TOK_RPAREN || tok->type == TOK_DSEMI) {
+        return 1;
+    }
+    if (tok->type != TOK_WORD || tok->flags != 0) {
+        return 0;
+    }
+    for (int i = 0; closers[i] != NULL; i++) {
+        if (is_word(tok, closers[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void skip_newlines(parser_t *p) {
+    while (p->tokens[p->pos].type == TOK_NEWLINE) {
+        p->pos++;
+    }
+}
+
+/**
+ * Consume a reserved word that must come next (then, do, fi, ...)
+ * @return: 0 if it was there, -1 otherwise
+ */
+static int expect(parser_t *p, const char *word) {
+    if (!is_word(&p->tokens[p->pos], word)) {
+        unexpected(p);
+        return -1;
+    }
+    p->pos++;
+    return 0;
+}
+
+/**
+ * Can a newline after this token be left out of a one-line rendering?
+ */
+static int opens_list(const token_t *tok) {
+    return tok->type == TOK_NEWLINE || tok->type == TOK_SEMI || tok->type == TOK_AMP ||
+           tok->type == TOK_PIPE || tok->type == TOK_AND_IF || tok->type == TOK_OR_IF ||
+           tok->type == TOK_LPAREN || tok->type == TOK_DSEMI ||
+           is_word(tok, "{") || is_word(tok, "do") || is_word(tok, "then") ||
+           is_word(tok, "else") || is_word(tok, "in");
+}
+
+/**
+ * Spelling of a token in a one-line rendering
+ */
+static const char *token_spelling(const token_t *tok, size_t *len) {
+    const char *text;
+    if (tok->type == TOK_WORD || tok->type == TOK_ARITH) {
+        *len = tok->len;
+        return tok->start;
+    }
+    text = (tok->type == TOK_NEWLINE) ? ";" : token_name(tok->type);
+    *len = strlen(text);
+    return text;
+}
+
+/**
+ * Source text of tokens [from, to), one space between tokens
+ * Used to show jobs and compound commands; quoting is kept as typed and
+ * line breaks become `;` where one is needed.
+ */
+static const char *tokens_text(parser_t *p, int from, int to) {
+    size_t len = 0, n;
+    for (int i = from; i < to; i++) {
+        token_spelling(&p->tokens[i], &n);
+        len += n + 1;
+    }
+
+    char *text = arena_alloc(p->arena, len + 1);
+    char *out = text;
+    for (int i = from; i < to; i++) {
+        const token_t *tok = &p->tokens[i];
+        if (tok->type == TOK_NEWLINE && (i == from || opens_list(&p->tokens[i - 1]))) {
+            continue;
+        }
+        const char *spelling = token_spelling(tok, &n);
+        if (out > text) {
+            *out++ = ' ';
+        }
+        memcpy(out, spelling, n);
+        out += n;
+    }
+    *out = '\0';
+    return text;
+}
+
+static struct node *new_node(parser_t *p, node_type_t type, struct node *left, struct node *right) {
+    struct node *node = arena_alloc(p->arena, sizeof(struct node));
+    memset(node, 0, sizeof(*node));
+    node->type = type;
+    node->left = left;
+    node->right = right;
+    return node;
+}
+
+/**
+ * Is a word an assignment (an unquoted valid name followed by '=')?
+ */
+static int is_assignment(const token_t *tok) {
+    const char *eq = memchr(tok->start, '=', tok->len);
+    return eq != NULL && vars_valid_name(tok->start, (size_t)(eq - tok->start));
+}
+
+/**
+ * Record one redirection of a command
+ * @param arena: Arena for the redirection list
+ * @param cmd: Command being parsed
+ * @param tok: Operator token, followed by its target
+ * @param capacity: Most redirections the command can have
+ * @return: 0 on success, -1 if the target is missing
+ */
+static int add_redirect(arena_t *arena, struct parsed_command *cmd, token_t *tok, int capacity) {
+    if (tok[1].type != TOK_WORD) {
+        syntax_error_near(&tok[1]);
+        return -1;
+    }
+    if (cmd->redirs == NULL) {
+        cmd->redirs = arena_alloc(arena, capacity * sizeof(struct parsed_redirect));
+    }
+    cmd->redirs[cmd->num_redirs].type = tok->type;
+    cmd->redirs[cmd->num_redirs].fd = tok->io_number;
+    cmd->redirs[cmd->num_redirs].target = &tok[1];
+    cmd->num_redirs++;
+    return 0;
+}
+
+/**
+ * Parse tokens into a simple command
+ * Handles: NAME=value prefixes and redirections (n<, n>, n>>, n<>, n<&,
+ * n>&, &>, &>>) anywhere in the command
+ * @param arena: Arena for the command
+ * @param cmd: Command to fill in
+ * @param tokens: First token of this command
+ * @param count: Number of tokens belonging to it (words and redirections)
+ * @return: 0 on success, -1 on a syntax error
+ */
+static int parse_command(arena_t *arena, struct parsed_command *cmd,
+                         token_t *tokens, int count) {
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->kind = CMD_SIMPLE;
+
+    // The word list can never be longer than the token list
+    cmd->words = arena_alloc(arena, (count + 1) * sizeof(token_t));
+
+    // Parse tokens
+    for (int i = 0; i < count; i++) {
+        token_t *tok = &tokens[i];
+
+        if (tok->type == TOK_WORD) {
+            // Assignments count only before the command name
+            if (cmd->num_words == 0 && is_assignment(tok)) {
+                if (cmd->assigns == NULL) {
+                    cmd->assigns = arena_alloc(arena, count * sizeof(token_t));
+                }
+                cmd->assigns[cmd->num_assigns++] = *tok;
+                continue;
+            }
+            // Regular argument, expanded when the command runs
+            cmd->words[cmd->num_words++] = *tok;
+        } else {
+            // Redirection: the next token must be the target
+            if (add_redirect(arena, cmd, tok, count / 2) < 0) {
+                return -1;
+            }
+            i++;
+        }
+    }
+
+    // "> file" with nothing to run is valid: it only opens the file
+    return 0;
+}
+
+/**
+ * Turn (( expression )) into the simple command `let "expression"`
+ * @param arena: Arena for the command
+ * @param cmd: Command to fill in
+ * @param tok: TOK_ARITH token
+ */
+static void parse_arith_command(arena_t *arena, struct parsed_command *cmd, const token_t *tok) {
+    static char let[] = "let";
+    token_t *words = arena_alloc(arena, 2 * sizeof(token_t));
+
+    words[0].type = TOK_WORD;
+    words[0].flags = 0;
+    words[0].io_number = -1;
+    words[0].start = let;
+    words[0].len = 3;
+
+    // The expression between the parentheses; plain text must end in a NUL
+    words[1] = *tok;
+    words[1].type = TOK_WORD;
+    words[1].start += 2;
+    words[1].len -= 4;
+    if (words[1].flags == 0) {
+        words[1].start = arena_strndup(arena, words[1].start, words[1].len);
+    }
+
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->kind = CMD_SIMPLE;
+    cmd->words = words;
+    cmd->num_words = 2;
+}
+
+static int parse_list(parser_t *p, struct node **list);
+static int parse_stage(parser_t *p, struct parsed_command *cmd);
+
+/**
+ * Parse a list that must not be empty (the body of if, while, { }, ...)
+ * @return: Root of the list, or NULL on a syntax error
+ */
+static struct node *parse_body(parser_t *p) {
+    struct node *list;
+    if (parse_list(p, &list) < 0) {
+        return NULL;
+    }
+    if (list == NULL) {
+        unexpected(p);
+    }
+    return list;
+}
+
+/**
+ * Parse `do list done`, the body of every loop
+ */
+static struct node *parse_do_group(parser_t *p) {
+    struct node *body;
+    if (expect(p, "do") < 0 || (body = parse_body(p)) == NULL || expect(p, "done") < 0) {
+        return NULL;
+    }
+    return body;
+}
+
+/**
+ * Parse if list; then list; [elif list; then list;]... [else list;] fi
+ * An elif chain nests in the else part and shares the final `fi`.
+ * @return: NODE_IF node, or NULL on a syntax error
+ */
+static struct node *parse_if(parser_t *p) {
+    struct node *node = new_node(p, NODE_IF, NULL, NULL);
+
+    p->pos++;  // if or elif
+    if ((node->left = parse_body(p)) == NULL || expect(p, "then") < 0 ||
+        (node->right = parse_body(p)) == NULL) {
+        return NULL;
+    }
+    if (is_word(&p->tokens[p->pos], "elif")) {
+        node->alt = parse_if(p);
+        return node->alt ? node : NULL;
+    }
+    if (is_word(&p->tokens[p->pos], "else")) {
+        p->pos++;
+        if ((node->alt = parse_body(p)) == NULL) {
+            return NULL;
+        }
+    }
+    return (expect(p, "fi") < 0) ? NULL : node;
+}
+
+/**
+ * Parse while/until list; do list; done
+ */
+static struct node *parse_while(parser_t *p) {
+    node_type_t type = is_word(&p->tokens[p->pos], "while") ? NODE_WHILE : NODE_UNTIL;
+    struct node *node = new_node(p, type, NULL, NULL);
+
+    p->pos++;
+    if ((node->left = parse_body(p)) == NULL || (node->right = parse_do_group(p)) == NULL) {
+        return NULL;
+    }
+    return node;
+}
+
+/**
+ * Parse for name [in word...]; do list; done
+ */
+static struct node *parse_for(parser_t *p) {
+    struct node *node = new_node(p, NODE_FOR, NULL, NULL);
+    token_t *tok = &p->tokens[++p->pos];
+
+    if (tok->type != TOK_WORD || tok->flags != 0 || !vars_valid_name(tok->start, tok->len)) {
+        unexpected(p);
+        return NULL;
+    }
+    node->name = tok;
+    p->pos++;
+    skip_newlines(p);
+
+    node->num_words = -1;
+    if (is_word(&p->tokens[p->pos], "in")) {
+        // The words are the tokens up to the separator
+        p->pos++;
+        node->words = &p->tokens[p->pos];
+        node->num_words = 0;
+        while (p->tokens[p->pos].type == TOK_WORD) {
+            node->num_words++;
+            p->pos++;
+        }
+        if (p->tokens[p->pos].type != TOK_SEMI && p->tokens[p->pos].type != TOK_NEWLINE) {
+            unexpected(p);
+            return NULL;
+        }
+        p->pos++;
+    } else if (p->tokens[p->pos].type == TOK_SEMI) {
+        p->pos++;
+    }
+    skip_newlines(p);
+
+    node->right = parse_do_group(p);
+    return node->right ? node : NULL;
+}
+
+/**
+ * Parse case word in [(]pattern[|pattern]...) list ;; ... esac
+ */
+static struct node *parse_case(parser_t *p) {
+    struct node *node = new_node(p, NODE_CASE, NULL, NULL);
+    int capacity = 4;
+
+    if (p->tokens[++p->pos].type != TOK_WORD) {
+        unexpected(p);
+        return NULL;
+    }
+    node->words = &p->tokens[p->pos++];
+    node->num_words = 1;
+    skip_newlines(p);
+    if (expect(p, "in") < 0) {
+        return NULL;
+    }
+    skip_newlines(p);
+
+    node->items = arena_alloc(p->arena, capacity * sizeof(struct case_item));
+    while (!is_word(&p->tokens[p->pos], "esac")) {
+        if (node->num_items == capacity) {
+            node->items = arena_realloc(p->arena, node->items,
+                                        capacity * sizeof(struct case_item),
+                                        capacity * 2 * sizeof(struct case_item));
+            capacity *= 2;
+        }
+        struct case_item *item = &node->items[node->num_items];
+
+        // Patterns: [(] word [| word]... )
+        if (p->tokens[p->pos].type == TOK_LPAREN) {
+            p->pos++;
+        }
+        int first = p->pos;
+        item->num_patterns = 0;
+        while (p->tokens[p->pos].type == TOK_WORD) {
+            item->num_patterns++;
+            if (p->tokens[++p->pos].type != TOK_PIPE) {
+                break;
+            }
+            p->pos++;
+        }
+        if (item->num_patterns == 0 || p->tokens[p->pos].type != TOK_RPAREN) {
+            unexpected(p);
+            return NULL;
+        }
+        item->patterns = arena_alloc(p->arena, item->num_patterns * sizeof(token_t));
+        for (int i = 0; i < item->num_patterns; i++) {
+            item->patterns[i] = p->tokens[first + 2 * i];
+        }
+        p->pos++;
+
+        // The arm's list may be empty, and the last arm needs no ;;
+        if (parse_list(p, &item->body) < 0) {
+            return NULL;
+        }
+        node->num_items++;
+        if (p->tokens[p->pos].type == TOK_DSEMI) {
+            p->pos++;
+            skip_newlines(p);
+        } else if (!is_word(&p->tokens[p->pos], "esac")) {
+            unexpected(p);
+            return NULL;
+        }
+    }
+    p->pos++;
+    return node;
+}
+
+/**
+ * Is the parser at a function definition: name () or function name?
+ */
+static int at_function(const parser_t *p) {
+    const token_t *tok = &p->tokens[p->pos];
+    if (is_word(tok, "function")) {
+        return 1;
+    }
+    return tok->type == TOK_WORD && tok->flags == 0 && !is_reserved(tok) &&
+           memchr(tok->start, '=', tok->len) == NULL &&
+           tok[1].type == TOK_LPAREN && tok[2].type == TOK_RPAREN;
+}
+
+/**
+ * Parse a function definition: name () body or function name [()] body,
+ * where the body is a compound command with optional redirections
+ */
+static struct node *parse_function(parser_t *p) {
+    struct node *node = new_node(p, NODE_FUNCTION, NULL, NULL);
+    token_t *tok = &p->tokens[p->pos];
+
+    if (is_word(tok, "function")) {
+        tok++;
+        p->pos++;
+        if (tok->type != TOK_WORD || tok->flags != 0 || is_reserved(tok)) {
+            unexpected(p);
+            return NULL;
+        }
+        p->pos++;
+        if (tok[1].type == TOK_LPAREN) {
+            if (tok[2].type != TOK_RPAREN) {
+                p->pos++;
+                unexpected(p);
+                return NULL;
+            }
+            p->pos += 2;
+        }
+    } else {
+        p->pos += 3;
+    }
+    node->name = tok;
+    skip_newlines(p);
+
+    node->pipeline = arena_alloc(p->arena, sizeof(struct pipeline));
+    memset(node->pipeline, 0, sizeof(struct pipeline));
+    node->pipeline->commands = arena_alloc(p->arena, sizeof(struct parsed_command));
+    node->pipeline->num_cmds = 1;
+
+    int body = p->pos;
+    if (parse_stage(p, node->pipeline->commands) < 0) {
+        return NULL;
+    }
+    if (node->pipeline->commands[0].kind == CMD_SIMPLE) {
+        // f() echo hi
+        syntax_error_near(&p->tokens[body]);
+        return NULL;
+    }
+    return node;
+}
+
+/**
+ * Parse one pipeline stage: a simple command, or a compound command
+ * ({ list; }, ( list ), if, while, until, for, case, (( ))) optionally
+ * followed by redirections
+ * @return: 0 on success, -1 on a syntax error
+ */
+static int parse_stage(parser_t *p, struct parsed_command *cmd) {
+    token_t *tokens = p->tokens;
+    int start = p->pos;
+    token_t *tok = &tokens[start];
+    struct node *body;
+
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->kind = CMD_GROUP;
+    if (tok->type == TOK_LPAREN || is_word(tok, "{")) {
+        int subshell = (tok->type == TOK_LPAREN);
+        p->pos++;
+        body = parse_body(p);
+        if (body == NULL) {
+            return -1;
+        }
+        if (subshell ? tokens[p->pos].type != TOK_RPAREN : !is_word(&tokens[p->pos], "}")) {
+            unexpected(p);
+            return -1;
+        }
+        p->pos++;
+        if (subshell) {
+            cmd->kind = CMD_SUBSHELL;
+        }
+    } else if (is_word(tok, "if")) {
+        body = parse_if(p);
+    } else if (is_word(tok, "while") || is_word(tok, "until")) {
+        body = parse_while(p);
+    } else if (is_word(tok, "for")) {
+        body = parse_for(p);
+    } else if (is_word(tok, "case")) {
+        body = parse_case(p);
+    } else if (tok->type == TOK_ARITH) {
+        parse_arith_command(p->arena, cmd, tok);
+        p->pos++;
+        body = NULL;
+    } else {
+        // Simple command: every word and redirection up to the next operator
+        int end = start;
+        if (!at_list_end(p)) {
+            while (tokens[end].type == TOK_WORD || TOK_IS_REDIRECT(tokens[end].type)) {
+                end++;
+            }
+        }
+        if (end == start) {
+            // "| cmd", "&& cmd", "; cmd", a stray `}` or `fi`, or the end
+            // of a line that has to go on
+            unexpected(p);
+            return -1;
+        }
+        p->pos = end;
+        return parse_command(p->arena, cmd, tokens + start, end - start);
+    }
+    if (cmd->kind != CMD_SIMPLE) {
+        if (body == NULL) {
+            return -1;
+        }
+        cmd->body = body;
+        cmd->text = tokens_text(p, start, p->pos);
+    }
+
+    // Redirections apply to the whole command: { a; b; } > log
+    int count = 0;
+    while (TOK_IS_REDIRECT(tokens[p->pos + 2 * count].type)) {
+        count++;
+    }
+    for (int i = 0; i < count; i++) {
+        if (add_redirect(p->arena, cmd, &tokens[p->pos], count) < 0) {
+            return -1;
+        }
+        p->pos += 2;
+    }
+    if ((tokens[p->pos].type == TOK_WORD && !at_list_end(p)) || tokens[p->pos].type == TOK_LPAREN) {
+        syntax_error_near(&tokens[p->pos]);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Parse a pipeline: [!] [time] stage (| stage)*, or a function definition
+ */
+static struct node *parse_pipeline(parser_t *p) {
+    if (at_function(p)) {
+        return parse_function(p);
+    }
+
+    struct node *node = new_node(p, NODE_PIPELINE, NULL, NULL);
+    struct pipeline *pipeline = arena_alloc(p->arena, sizeof(struct pipeline));
+    int capacity = 4;
+
+    node->pipeline = pipeline;
+    pipeline->num_cmds = 0;
+    pipeline->timed = 0;
+    pipeline->negated = 0;
+    pipeline->commands = arena_alloc(p->arena, capacity * sizeof(struct parsed_command));
+
+    // `!` and `time` are reserved words only when unquoted and first
+    while (1) {
+        token_t *tok = &p->tokens[p->pos];
+        if (is_word(tok, "!")) {
+            pipeline->negated = !pipeline->negated;
+            p->pos++;
+        } else if (!pipeline->timed && is_word(tok, "time")) {
+            pipeline->timed = 1;
+            p->pos++;
+            tok++;
+            if (at_list_end(p) || tok->type == TOK_SEMI || tok->type == TOK_AMP ||
+                tok->type == TOK_NEWLINE || tok->type == TOK_AND_IF || tok->type == TOK_OR_IF) {
+                return node;
+            }
+        } else {
+            break;
+        }
+    }
+
+    while (1) {
+        if (pipeline->num_cmds == capacity) {
+            pipeline->commands = arena_realloc(p->arena, pipeline->commands,
+                                               capacity * sizeof(struct parsed_command),
+                                               capacity * 2 * sizeof(struct parsed_command));
+            capacity *= 2;
+        }
+        struct parsed_command *cmd = &pipeline->commands[pipeline->num_cmds];
+        if (parse_stage(p, cmd) < 0) {
+            return NULL;
+        }
+        pipeline->num_cmds++;
+
+        // Assignments or redirections alone are only a whole pipeline: "A=1 | cmd", "cmd | >f"
+        int more = (p->tokens[p->pos].type == TOK_PIPE);
+        if (cmd->kind == CMD_SIMPLE && cmd->num_words == 0 && (more || pipeline->num_cmds > 1)) {
+            syntax_error_near(&p->tokens[p->pos]);
+            return NULL;
+        }
+        if (!more) {
+            return node;
+        }
+        p->pos++;
+        skip_newlines(p);
+    }
+}
+
+/**
+ * Parse an and-or list: pipeline ((&& | ||) linebreak pipeline)*
+ */
+static struct node *parse_and_or(parser_t *p) {
+    struct node *left = parse_pipeline(p);
+
+    while (left != NULL && (p->tokens[p->pos].type == TOK_AND_IF ||
+                            p->tokens[p->pos].type == TOK_OR_IF)) {
+        node_type_t type = (p->tokens[p->pos].type == TOK_AND_IF) ? NODE_AND : NODE_OR;
+        p->pos++;
+        skip_newlines(p);
+        struct node *right = parse_pipeline(p);
+        left = right ? new_node(p, type, left, right) : NULL;
+    }
+    return left;
+}
+
+/**
+ * Parse a list: and-or lists separated (or ended) by ;, & and newlines,
+ * up to the end of the input or a token that closes the enclosing
+ * command (`)`, `}`, `fi`, `done`, `;;` ...)
+ * @param list: Output root, NULL for an empty list
+ * @return: 0 on success, -1 on a syntax error
+ */
+static int parse_list(parser_t *p, struct node **list) {
+    struct node **tail = list;
+
+    *list = NULL;
+    skip_newlines(p);
+    while (!at_list_end(p)) {
+        int start = p->pos;
+        struct node *item = parse_and_or(p);
+        if (item == NULL) {
+            return -1;
+        }
+
+        token_t *tok = &p->tokens[p->pos];
+        if (tok->type == TOK_AMP) {
+            item = new_node(p, NODE_ASYNC, item, NULL);
+            item->text = tokens_text(p, start, p->pos);
+            p->pos++;
+        } else if (tok->type == TOK_SEMI || tok->type == TOK_NEWLINE) {
+            p->pos++;
+        } else if (!at_list_end(p)) {
+            syntax_error_near(tok);
+            return -1;
+        }
+        skip_newlines(p);
+
+        // Sequences nest to the right: a; b; c is SEQ(a, SEQ(b, c))
+        if (*list == NULL) {
+            *list = item;
+        } else {
+            *tail = new_node(p, NODE_SEQ, *tail, item);
+            tail = &(*tail)->right;
+        }
+    }
+    return 0;
+}
+
+int parse_line(arena_t *arena, char *line, struct node **tree) {
+    parser_t p;
+    struct node *list;
+
+    *tree = NULL;
+    if (lex_line(arena, line, &p.tokens) < 0) {
+        return PARSE_INCOMPLETE;
+    }
+    p.arena = arena;
+    p.pos = 0;
+    p.incomplete = 0;
+
+    if (parse_list(&p, &list) < 0) {
+        return p.incomplete ? PARSE_INCOMPLETE : -1;
+    }
+    if (p.tokens[p.pos].type != TOK_EOF) {
+        // A `)`, `}` or `fi` with nothing open
+        syntax_error_near(&p.tokens[p.pos]);
+        return -1;
+    }
+    *tree = list;
+    return 0;
+}
@@ -12,54 +12,115 @@
 #define KEY_BACKSPACE 8
 #define KEY_ENTER 13
 #define KEY_CTRL_C 3
+#define KEY_CTRL_G 7
+#define KEY_CTRL_R 18
+#define KEY_ESC 27
 #else
-// Simple fallback for POSIX if compiled there (though we target Windows)
 #include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <dirent.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
 #endif
 
 #include "readline.h"
+#include "history.h"
+#include "histsearch.h"
+#include "complete.h"
+#include "arena.h"
+#include "error.h"
+#include "vars.h"
+#ifndef _WIN32
+#include "dircache.h"
+#endif
 
-#define HISTORY_MAX 100
 #define BUFFER_SIZE 1024
 
-static char *history[HISTORY_MAX];
-static int history_count = 0;
+// Extra fd watched while waiting for input, and what to do when it fires
+static int event_fd = -1;
+static int (*event_callback)(void) = NULL;
 
-void init_history(void) {
-    history_count = 0;
-    for (int i = 0; i < HISTORY_MAX; i++) {
-        history[i] = NULL;
-    }
+void set_read_line_event(int fd, int (*callback)(void)) {
+    event_fd = fd;
+    event_callback = callback;
 }
 
-void add_history(const char *line) {
-    if (!line || strlen(line) == 0) return;
+// Tab completion support
+
+/**
+ * Completion candidates, stored in an arena (no limit on their number
+ * or length)
+ */
+typedef struct match_list {
+    char **items;
+    int count;
+    int cap;
+    size_t common_len;      // Length of the prefix every item shares
+    arena_t strings;
+} match_list_t;
+
+/**
+ * Add a candidate: dir followed by name
+ */
+static void match_list_add(match_list_t *list, const char *dir, const char *name) {
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    char *item = arena_alloc(&list->strings, dir_len + name_len + 1);
+    memcpy(item, dir, dir_len);
+    memcpy(item + dir_len, name, name_len + 1);
     
-    // Don't add duplicates of the last command
-    if (history_count > 0 && strcmp(history[history_count - 1], line) == 0) {
-        return;
+    if (list->count == list->cap) {
+        list->cap = list->cap ? list->cap * 2 : 64;
+        list->items = realloc(list->items, list->cap * sizeof(char *));
+        if (list->items == NULL) {
+            error_allocation("completion");
+            exit(EXIT_FAILURE);
+        }
     }
-
-    // If full, shift everything down (simple implementation)
-    if (history_count >= HISTORY_MAX) {
-        free(history[0]);
-        for (int i = 1; i < HISTORY_MAX; i++) {
-            history[i - 1] = history[i];
+    
+    // Keep the shared prefix up to date as candidates arrive
+    if (list->count == 0) {
+        list->common_len = dir_len + name_len;
+    } else {
+        size_t j = 0;
+        while (j < list->common_len && item[j] == list->items[0][j]) {
+            j++;
         }
-        history_count--;
+        list->common_len = j;
     }
+    list->items[list->count++] = item;
+}
 
-    history[history_count++] = strdup(line);
+static void match_list_clear(match_list_t *list) {
+    list->count = 0;
+    list->common_len = 0;
+    arena_reset(&list->strings);
 }
 
-void free_history(void) {
-    for (int i = 0; i < history_count; i++) {
-        free(history[i]);
+static void match_list_free(match_list_t *list) {
+    free(list->items);
+    arena_free(&list->strings);
+    memset(list, 0, sizeof(*list));
+}
+
+static int compare_matches(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/**
+ * Get list of commands matching prefix (built-ins and PATH executables)
+ */
+static void get_command_matches(const char *prefix, match_list_t *matches) {
+    const char *const *names;
+    int count = complete_commands(prefix, &names);
+    
+    for (int i = 0; i < count; i++) {
+        match_list_add(matches, "", names[i]);
     }
-    history_count = 0;
 }
 
-// Tab completion support
 #ifdef _WIN32
 #include <windows.h>
 #include <direct.h>
@@ -67,18 +128,17 @@ void free_history(void) {
 /**
  * Get list of files/directories matching prefix
  */
-static int get_file_matches(const char *prefix, char matches[][256], int max_matches) {
+static void get_file_matches(const char *prefix, match_list_t *matches) {
     WIN32_FIND_DATA findData;
     HANDLE hFind;
-    char search_path[512];
-    int count = 0;
+    char search_path[MAX_PATH];
     
     // Build search pattern
     snprintf(search_path, sizeof(search_path), "%s*", prefix);
     
     hFind = FindFirstFile(search_path, &findData);
     if (hFind == INVALID_HANDLE_VALUE) {
-        return 0;
+        return;
     }
     
     do {
@@ -88,48 +148,22 @@ static int get_file_matches(const char *prefix, char matches[][256], int max_mat
         }
         
         // Add to matches
-        if (count < max_matches) {
-            strncpy(matches[count], findData.cFileName, 255);
-            matches[count][255] = '\0';
-            count++;
-        }
-    } while (FindNextFile(hFind, &findData) && count < max_matches);
+        match_list_add(matches, "", findData.cFileName);
+    } while (FindNextFile(hFind, &findData));
     
     FindClose(hFind);
-    return count;
-}
-
-/**
- * Get list of commands matching prefix (built-ins and PATH executables)
- */
-static int get_command_matches(const char *prefix, char matches[][256], int max_matches) {
-    int count = 0;
-    const char *builtins[] = {"cd", "exit", "jobs", "fg", "bg", NULL};
-    
-    // Check built-in commands
-    for (int i = 0; builtins[i] != NULL && count < max_matches; i++) {
-        if (strncmp(builtins[i], prefix, strlen(prefix)) == 0) {
-            strncpy(matches[count], builtins[i], 255);
-            matches[count][255] = '\0';
-            count++;
-        }
-    }
-    
-    // TODO: Could also search PATH for executables
-    // For now, just return built-ins
-    
-    return count;
 }
 
 /**
  * Complete the current input
  */
 int complete_input(char *buffer, int pos) {
-    char matches[50][256];
-    int match_count = 0;
-    char prefix[256] = "";
+    match_list_t matches;
+    char prefix[BUFFER_SIZE] = "";
     int prefix_start = 0;
     
+    memset(&matches, 0, sizeof(matches));
+    
     // Find the word to complete (from last space to cursor)
     for (int i = pos - 1; i >= 0; i--) {
         if (buffer[i] == ' ' || buffer[i] == '\t') {
@@ -150,29 +184,27 @@ int complete_input(char *buffer, int pos) {
     
     if (is_first_word) {
         // Complete command
-        match_count = get_command_matches(prefix, matches, 50);
+        get_command_matches(prefix, &matches);
         
         // If no command matches, try files
-        if (match_count == 0) {
-            match_count = get_file_matches(prefix, matches, 50);
+        if (matches.count == 0) {
+            get_file_matches(prefix, &matches);
         }
     } else {
         // Complete file/directory
-        match_count = get_file_matches(prefix, matches, 50);
+        get_file_matches(prefix, &matches);
     }
     
-    if (match_count == 0) {
+    if (matches.count == 0) {
         // No matches, beep
         printf("\a");
-        return pos;
-    } else if (match_count == 1) {
+    } else if (matches.count == 1) {
         // Single match - complete it
-        int completion_len = strlen(matches[0]);
-        int chars_to_add = completion_len - prefix_len;
+        int completion_len = strlen(matches.items[0]);
         
-        if (pos + chars_to_add < BUFFER_SIZE - 1) {
+        if (prefix_start + completion_len < BUFFER_SIZE - 1) {
             // Add the completion
-            strcpy(buffer + prefix_start, matches[0]);
+            strcpy(buffer + prefix_start, matches.items[0]);
             pos = prefix_start + completion_len;
             buffer[pos] = '\0';
             
@@ -181,26 +213,18 @@ int complete_input(char *buffer, int pos) {
         }
     } else {
         // Multiple matches - show them
+        qsort(matches.items, matches.count, sizeof(char *), compare_matches);
         printf("\n");
-        for (int i = 0; i < match_count; i++) {
-            printf("%s  ", matches[i]);
+        for (int i = 0; i < matches.count; i++) {
+            printf("%s  ", matches.items[i]);
             if ((i + 1) % 5 == 0) printf("\n");
         }
-        if (match_count % 5 != 0) printf("\n");
-        
-        // Find common prefix
-        int common_len = strlen(matches[0]);
-        for (int i = 1; i < match_count; i++) {
-            int j = 0;
-            while (j < common_len && matches[i][j] == matches[0][j]) {
-                j++;
-            }
-            common_len = j;
-        }
+        if (matches.count % 5 != 0) printf("\n");
         
         // Complete to common prefix
-        if (common_len > prefix_len) {
-            strncpy(buffer + prefix_start, matches[0], common_len);
+        int common_len = (int)matches.common_len;
+        if (common_len > prefix_len && prefix_start + common_len < BUFFER_SIZE - 1) {
+            strncpy(buffer + prefix_start, matches.items[0], common_len);
             pos = prefix_start + common_len;
             buffer[pos] = '\0';
         }
@@ -209,15 +233,128 @@ int complete_input(char *buffer, int pos) {
         printf("myshell> %s", buffer);
     }
     
+    match_list_free(&matches);
     return pos;
 }
 
 #else
-// POSIX stub
+/**
+ * A completion in progress
+ * File names come from the directory cache, which may still be reading
+ * the directory: continue_completions() picks up the names found since.
+ */
+typedef struct completion {
+    match_list_t matches;
+    int word_start;         // Start of the word being completed
+    char *dir;              // Directory part of the word, up to its last '/'
+    char *base;             // The rest: start of the file name
+    size_t seen;            // Cursor into the directory listing
+} completion_t;
+
+static void add_file_match(const char *name, void *arg) {
+    completion_t *comp = arg;
+    
+    // Hidden files only when asked for
+    if (name[0] == '.' && comp->base[0] != '.') {
+        return;
+    }
+    match_list_add(&comp->matches, comp->dir, name);
+}
+
+/**
+ * Collect the file names published since the last call
+ * @return: DIRCACHE_DONE, DIRCACHE_SCANNING or DIRCACHE_ERROR
+ */
+static int continue_completions(completion_t *comp) {
+    return dircache_match(comp->dir, comp->base, &comp->seen, add_file_match, comp);
+}
+
+/**
+ * Collect completions for the word ending at pos
+ * The first word completes to commands, falling back to files.
+ * @param comp: Receives the word and its candidates
+ * @param buffer: Line being edited
+ * @param pos: Cursor position
+ * @return: DIRCACHE_SCANNING if more file names may follow, otherwise
+ *          DIRCACHE_DONE (or DIRCACHE_ERROR, with no candidates)
+ */
+static int find_completions(completion_t *comp, const char *buffer, int pos) {
+    int start = pos;
+    
+    while (start > 0 && buffer[start - 1] != ' ' && buffer[start - 1] != '\t') {
+        start--;
+    }
+    comp->word_start = start;
+    comp->seen = 0;
+    match_list_clear(&comp->matches);
+    
+    // Split the word at its last '/'
+    const char *word = buffer + start;
+    int dir_len = pos - start;
+    while (dir_len > 0 && word[dir_len - 1] != '/') {
+        dir_len--;
+    }
+    free(comp->dir);
+    free(comp->base);
+    comp->dir = strndup(word, dir_len);
+    comp->base = strndup(word + dir_len, pos - start - dir_len);
+    if (comp->dir == NULL || comp->base == NULL) {
+        error_allocation("completion");
+        exit(EXIT_FAILURE);
+    }
+    
+    int is_first_word = 1;
+    for (int i = 0; i < start; i++) {
+        if (buffer[i] != ' ' && buffer[i] != '\t') {
+            is_first_word = 0;
+            break;
+        }
+    }
+    if (is_first_word && dir_len == 0) {
+        get_command_matches(comp->base, &comp->matches);
+        if (comp->matches.count > 0) {
+            return DIRCACHE_DONE;
+        }
+    }
+    return continue_completions(comp);
+}
+
+static void free_completion(completion_t *comp) {
+    match_list_free(&comp->matches);
+    free(comp->dir);
+    free(comp->base);
+    comp->dir = comp->base = NULL;
+}
+
+/**
+ * Complete the current input in place, as far as all matches agree
+ * (the editor lists ambiguous matches itself); waits for the directory
+ * scan when there is one
+ */
 int complete_input(char *buffer, int pos) {
-    (void)buffer;
-    (void)pos;
-    printf("\a");  // Beep - not implemented
+    completion_t comp;
+    
+    memset(&comp, 0, sizeof(comp));
+    int state = find_completions(&comp, buffer, pos);
+    while (state == DIRCACHE_SCANNING) {
+        struct pollfd pfd = {dircache_fd(), POLLIN, 0};
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+            break;
+        }
+        state = continue_completions(&comp);
+    }
+    
+    int start = comp.word_start;
+    int common_len = (int)comp.matches.common_len;
+    size_t tail = strlen(buffer + pos);
+    if (comp.matches.count > 0 && common_len > pos - start &&
+        start + common_len + tail < BUFFER_SIZE) {
+        // Keep whatever follows the cursor
+        memmove(buffer + start + common_len, buffer + pos, tail + 1);
+        memcpy(buffer + start, comp.matches.items[0], common_len);
+        pos = start + common_len;
+    }
+    free_completion(&comp);
     return pos;
 }
 #endif
@@ -225,10 +362,74 @@ int complete_input(char *buffer, int pos) {
 #ifdef _WIN32
 // Windows implementation using _getch()
 
+/**
+ * Ctrl-R: incremental reverse search through the history
+ * Typing narrows the search and Ctrl-R steps to the next match. Enter
+ * runs the match, Esc keeps it for editing, Ctrl-G/Ctrl-C restore the line.
+ * @param prompt: The normal prompt
+ * @param buffer: Line being edited; receives the match
+ * @param pos: Cursor position, updated
+ * @return: 1 if the line should be run now, 0 to keep editing
+ */
+static int reverse_search(const char *prompt, char *buffer, int *pos) {
+    char query[BUFFER_SIZE] = "";
+    int qlen = 0;
+    int matches[HISTSEARCH_MAX_MATCHES];
+    int num_matches = 0, current = 0;
+    int drawn = 0;
+    const char *shown = "";
+    
+    while (1) {
+        // Redraw "(reverse-i-search)`query': match" over the old line
+        int len = printf("\r(reverse-i-search)`%s': %s", query, shown);
+        for (int i = len; i < drawn; i++) printf(" ");
+        for (int i = len; i < drawn; i++) printf("\b");
+        drawn = len;
+        
+        int ch = _getch();
+        if (ch == 0 || ch == 0xE0) {
+            _getch(); // Arrow keys: stop searching and edit the match
+            ch = KEY_ESC;
+        }
+        
+        if (ch == KEY_CTRL_R) {
+            if (current + 1 < num_matches) {
+                current++;
+            }
+        } else if (ch == KEY_BACKSPACE || isprint(ch)) {
+            if (ch == KEY_BACKSPACE) {
+                if (qlen == 0) continue;
+                query[--qlen] = '\0';
+            } else if (qlen < BUFFER_SIZE - 1) {
+                // A longer query cannot match if the shorter one did not
+                int hopeless = (qlen > 0 && num_matches == 0);
+                query[qlen++] = (char)ch;
+                query[qlen] = '\0';
+                if (hopeless) continue;
+            }
+            num_matches = history_search(query, matches, HISTSEARCH_MAX_MATCHES);
+            current = 0;
+        } else {
+            // Leave search mode
+            int accept = (num_matches > 0 && ch != KEY_CTRL_G && ch != KEY_CTRL_C);
+            if (accept) {
+                strncpy(buffer, shown, BUFFER_SIZE - 1);
+                buffer[BUFFER_SIZE - 1] = '\0';
+                *pos = strlen(buffer);
+            }
+            printf("\r%s%s", prompt, buffer);
+            for (int i = (int)(strlen(prompt) + strlen(buffer)); i < drawn; i++) printf(" ");
+            printf("\r%s%s", prompt, buffer);
+            return accept && ch == KEY_ENTER;
+        }
+        shown = (num_matches > 0) ? history_get(matches[current]) : "";
+    }
+}
+
 char *read_line(const char *prompt) {
     char buffer[BUFFER_SIZE];
     int pos = 0;
-    int history_index = history_count; // Points to "new" line (after last history)
+    int history_index = -1; // "New" line; becomes history_length() once history is browsed
     int ch;
     
     // Display prompt
@@ -244,6 +445,10 @@ char *read_line(const char *prompt) {
             // Special key
             ch = _getch(); // Get the actual code
             
+            if ((ch == KEY_UP || ch == KEY_DOWN) && history_index < 0) {
+                // First look at the history: only now is the file read
+                history_index = history_length();
+            }
             if (ch == KEY_UP) {
                 // History Up
                 if (history_index > 0) {
@@ -255,13 +460,13 @@ char *read_line(const char *prompt) {
                     printf(" \r%s", prompt); // Return to start
                     
                     // Copy history to buffer
-                    strncpy(buffer, history[history_index], BUFFER_SIZE - 1);
+                    strncpy(buffer, history_get(history_index), BUFFER_SIZE - 1);
                     pos = strlen(buffer);
                     printf("%s", buffer);
                 }
             } else if (ch == KEY_DOWN) {
                 // History Down
-                if (history_index < history_count) {
+                if (history_index < history_length()) {
                     history_index++;
                     
                     // Clear current line
@@ -269,8 +474,8 @@ char *read_line(const char *prompt) {
                     for (int i = 0; i < pos; i++) printf(" ");
                     printf(" \r%s", prompt);
                     
-                    if (history_index < history_count) {
-                        strncpy(buffer, history[history_index], BUFFER_SIZE - 1);
+                    if (history_index < history_length()) {
+                        strncpy(buffer, history_get(history_index), BUFFER_SIZE - 1);
                     } else {
                         buffer[0] = '\0'; // New empty line
                     }
@@ -297,6 +502,12 @@ char *read_line(const char *prompt) {
             printf("^C\n");
             buffer[0] = '\0';
             return strdup(buffer);
+        } else if (ch == KEY_CTRL_R) {
+            // Ctrl+R - search the history
+            if (reverse_search(prompt, buffer, &pos)) {
+                printf("\n");
+                return strdup(buffer);
+            }
         } else if (ch == 9) {
             // Tab - auto-completion
             pos = complete_input(buffer, pos);
@@ -312,23 +523,875 @@ char *read_line(const char *prompt) {
 }
 
 #else
-// POSIX fallback (simple fgets, no history navigation without raw mode)
-char *read_line(const char *prompt) {
+// POSIX: a raw-mode editor on terminals, plain line reads otherwise.
+// Input is read with read(2), not stdio, so poll() sees exactly what is
+// pending; bytes past the first newline are kept for the next call.
+static char input_buf[BUFFER_SIZE];
+static size_t input_len = 0;
+
+// Editor key codes beyond single bytes
+enum {
+    EDIT_KEY_COMPLETION = -3,   // More completion candidates arrived
+    EDIT_KEY_TIMEOUT = -2,
+    EDIT_KEY_EOF = -1,
+    EDIT_KEY_LEFT = 256,
+    EDIT_KEY_RIGHT,
+    EDIT_KEY_UP,
+    EDIT_KEY_DOWN,
+    EDIT_KEY_HOME,
+    EDIT_KEY_END,
+    EDIT_KEY_DELETE,
+    EDIT_KEY_WORD_LEFT,
+    EDIT_KEY_WORD_RIGHT,
+    EDIT_KEY_KILL_WORD,
+    EDIT_KEY_KILL_WORD_LEFT,
+    EDIT_KEY_IGNORED
+};
+
+#define EDIT_CTRL(c) ((c) & 0x1f)
+#define EDIT_KEY_ESC 27
+#define EDIT_KEY_BACKSPACE 127
+#define EDIT_ESC_TIMEOUT_MS 50
+// Ask before listing more completion candidates than this
+#define COMPLETION_QUERY_ITEMS 100
+
+/**
+ * Terminal output collected while handling input
+ * Flushed with a single write(2) when the editor is about to wait for
+ * the next key, so a keystroke (or a whole paste) costs one write.
+ */
+typedef struct out_buf {
+    char *data;
+    size_t len;
+    size_t cap;
+    size_t mark;            // Output before this is not part of the edited line
+} out_buf_t;
+
+typedef struct editor {
+    const char *prompt;
+    size_t prompt_len;
+    char *buf;              // Line being edited (NUL-terminated)
+    size_t len;
+    size_t cap;
+    size_t pos;             // Cursor position in buf
+    size_t offset;          // First byte shown when the line is wider than the screen
+    size_t cols;            // Terminal width
+    int history_index;      // history_length() while on the new line (-1 until browsed)
+    char *saved;            // The new line, while browsing history
+    int tab_count;          // Consecutive Tab presses
+    completion_t comp;      // Candidates of the last Tab
+    int comp_pending;       // Waiting for a directory scan to finish them
+    out_buf_t out;
+} editor_t;
+
+// Last killed text; Ctrl-Y yanks it (kept across lines)
+static char *kill_text = NULL;
+static size_t kill_len = 0;
+
+static struct termios saved_termios;
+
+static void out_append(out_buf_t *ob, const char *s, size_t n) {
+    if (ob->len + n > ob->cap) {
+        size_t cap = ob->cap ? ob->cap * 2 : 256;
+        while (cap < ob->len + n) cap *= 2;
+        char *data = realloc(ob->data, cap);
+        if (data == NULL) return;
+        ob->data = data;
+        ob->cap = cap;
+    }
+    memcpy(ob->data + ob->len, s, n);
+    ob->len += n;
+}
+
+/**
+ * Append part of the edited line
+ * A recalled multi-line command holds newlines; each is drawn as a space
+ * so every byte still takes one column.
+ */
+static void out_append_text(out_buf_t *ob, const char *s, size_t n) {
+    size_t start = ob->len;
+    out_append(ob, s, n);
+    for (size_t i = start; i < ob->len; i++) {
+        if (ob->data[i] == '\n') ob->data[i] = ' ';
+    }
+}
+
+static void out_puts(out_buf_t *ob, const char *s) {
+    out_append(ob, s, strlen(s));
+}
+
+static void out_flush(out_buf_t *ob) {
+    size_t done = 0;
+    while (done < ob->len) {
+        ssize_t n = write(STDOUT_FILENO, ob->data + done, ob->len - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        done += (size_t)n;
+    }
+    ob->len = 0;
+    ob->mark = 0;
+}
+
+/**
+ * Keep everything queued so far (listings, bells) when the line is
+ * redrawn; see refresh_line()
+ */
+static void out_barrier(out_buf_t *ob) {
+    ob->mark = ob->len;
+}
+
+static void refresh_line(editor_t *ed);
+
+/**
+ * Wait until stdin is readable, running the event callback meanwhile
+ * @param prompt: Prompt to show again after the callback printed something
+ * @param ed: Editor to redraw instead, or NULL when reading plain lines
+ * @return: 1 when stdin is readable, 2 when a pending completion has
+ *          new candidates, 0 on error
+ */
+static int wait_for_input(const char *prompt, editor_t *ed) {
+    struct pollfd fds[3];
+    int completion = (ed != NULL && ed->comp_pending);
+    
+    if ((event_fd < 0 || event_callback == NULL) && !completion) {
+        return 1;
+    }
+    
+    // poll() skips negative descriptors
+    fds[0].fd = STDIN_FILENO;
+    fds[0].events = POLLIN;
+    fds[1].fd = (event_callback != NULL) ? event_fd : -1;
+    fds[1].events = POLLIN;
+    fds[2].fd = completion ? dircache_fd() : -1;
+    fds[2].events = POLLIN;
+    
+    while (1) {
+        fds[0].revents = fds[1].revents = fds[2].revents = 0;
+        if (poll(fds, 3, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        if (fds[1].revents & POLLIN) {
+            if (ed) {
+                // Notices start on a new line; redraw the line below them
+                out_flush(&ed->out);
+                if (event_callback() > 0) {
+                    fflush(stdout);
+                    refresh_line(ed);
+                    out_flush(&ed->out);
+                }
+            } else if (event_callback() > 0) {
+                // Something was reported: give the user a fresh prompt
+                printf("%s", prompt);
+                fflush(stdout);
+            }
+        }
+        if (fds[0].revents) {
+            return 1;
+        }
+        if (fds[2].revents & POLLIN) {
+            return 2;
+        }
+    }
+}
+
+/**
+ * Read a line without editing (stdin is not a terminal)
+ */
+static char *read_line_plain(const char *prompt) {
     char *line = NULL;
-    size_t len = 0;
+    size_t line_len = 0;
     
     printf("%s", prompt);
-    if (getline(&line, &len, stdin) == -1) {
-        free(line);
-        return NULL;
+    fflush(stdout);
+    
+    while (1) {
+        // Complete line already buffered?
+        char *newline = memchr(input_buf, '\n', input_len);
+        size_t take = newline ? (size_t)(newline - input_buf) + 1 : input_len;
+        
+        if (take > 0) {
+            char *grown = realloc(line, line_len + take + 1);
+            if (grown == NULL) {
+                free(line);
+                return NULL;
+            }
+            line = grown;
+            memcpy(line + line_len, input_buf, take);
+            line_len += take;
+            line[line_len] = '\0';
+            memmove(input_buf, input_buf + take, input_len - take);
+            input_len -= take;
+        }
+        if (newline) {
+            break;
+        }
+        
+        if (!wait_for_input(prompt, NULL)) {
+            break;
+        }
+        ssize_t n = read(STDIN_FILENO, input_buf, sizeof(input_buf));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            // EOF: return a final unterminated line, if any
+            if (line_len == 0) {
+                free(line);
+                return NULL;
+            }
+            break;
+        }
+        input_len = (size_t)n;
     }
     
     // Remove newline
-    size_t line_len = strlen(line);
     if (line_len > 0 && line[line_len - 1] == '\n') {
         line[line_len - 1] = '\0';
     }
     
     return line;
 }
+
+static int enable_raw_mode(void) {
+    struct termios raw;
+    
+    if (tcgetattr(STDIN_FILENO, &saved_termios) < 0) {
+        return 0;
+    }
+    raw = saved_termios;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_cflag |= CS8;
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    // TCSADRAIN, not TCSAFLUSH: keep anything typed ahead
+    return tcsetattr(STDIN_FILENO, TCSADRAIN, &raw) == 0;
+}
+
+static void disable_raw_mode(void) {
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &saved_termios);
+}
+
+static size_t terminal_columns(void) {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) < 0 || ws.ws_col == 0) {
+        return 80;
+    }
+    return ws.ws_col;
+}
+
+/**
+ * Next input byte, flushing pending output before blocking
+ * @param timeout_ms: How long to wait, or -1 to wait for input
+ * @return: The byte, EDIT_KEY_EOF, EDIT_KEY_TIMEOUT, or (when waiting
+ *          for input) EDIT_KEY_COMPLETION
+ */
+static int read_byte(editor_t *ed, int timeout_ms) {
+    while (input_len == 0) {
+        out_flush(&ed->out);
+        
+        if (timeout_ms >= 0) {
+            struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+            int ready = poll(&pfd, 1, timeout_ms);
+            if (ready == 0) return EDIT_KEY_TIMEOUT;
+            if (ready < 0 && errno != EINTR) return EDIT_KEY_EOF;
+        } else {
+            int ready = wait_for_input(ed->prompt, ed);
+            if (ready == 0) return EDIT_KEY_EOF;
+            if (ready == 2) return EDIT_KEY_COMPLETION;
+        }
+        
+        ssize_t n = read(STDIN_FILENO, input_buf, sizeof(input_buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return EDIT_KEY_EOF;
+        input_len = (size_t)n;
+    }
+    
+    int c = (unsigned char)input_buf[0];
+    memmove(input_buf, input_buf + 1, --input_len);
+    return c;
+}
+
+/**
+ * Read one key, decoding ESC sequences (arrows, Home/End, Delete, Alt-x)
+ */
+static int read_key(editor_t *ed) {
+    int c = read_byte(ed, -1);
+    if (c != EDIT_KEY_ESC) {
+        return c;
+    }
+    
+    // A lone ESC: nothing follows promptly
+    int c1 = read_byte(ed, EDIT_ESC_TIMEOUT_MS);
+    if (c1 < 0) return EDIT_KEY_ESC;
+    
+    switch (c1) {
+    case 'b': return EDIT_KEY_WORD_LEFT;
+    case 'f': return EDIT_KEY_WORD_RIGHT;
+    case 'd': return EDIT_KEY_KILL_WORD;
+    case EDIT_KEY_BACKSPACE: return EDIT_KEY_KILL_WORD_LEFT;
+    case '[':
+    case 'O':
+        break;
+    default:
+        return EDIT_KEY_IGNORED;
+    }
+    
+    // CSI/SS3: numeric parameters separated by ';', then a final byte
+    int params[2] = {0, 0}, num_params = 0;
+    int c2;
+    while ((c2 = read_byte(ed, EDIT_ESC_TIMEOUT_MS)) >= 0) {
+        if (c2 >= '0' && c2 <= '9') {
+            if (num_params == 0) num_params = 1;
+            params[num_params - 1] = params[num_params - 1] * 10 + (c2 - '0');
+        } else if (c2 == ';') {
+            if (num_params < 2) num_params++;
+        } else {
+            break;
+        }
+    }
+    
+    // A modifier (e.g. 1;5C for Ctrl-Right) turns arrows into word moves
+    int modified = (num_params == 2 && params[1] > 1);
+    switch (c2) {
+    case 'A': return EDIT_KEY_UP;
+    case 'B': return EDIT_KEY_DOWN;
+    case 'C': return modified ? EDIT_KEY_WORD_RIGHT : EDIT_KEY_RIGHT;
+    case 'D': return modified ? EDIT_KEY_WORD_LEFT : EDIT_KEY_LEFT;
+    case 'H': return EDIT_KEY_HOME;
+    case 'F': return EDIT_KEY_END;
+    case '~':
+        switch (params[0]) {
+        case 1: case 7: return EDIT_KEY_HOME;
+        case 4: case 8: return EDIT_KEY_END;
+        case 3: return EDIT_KEY_DELETE;
+        }
+        break;
+    }
+    return EDIT_KEY_IGNORED;
+}
+
+/**
+ * Columns available for the line after the prompt (one is kept free so
+ * the cursor never wraps)
+ */
+static size_t line_width(const editor_t *ed) {
+    return (ed->cols > ed->prompt_len + 1) ? ed->cols - ed->prompt_len - 1 : 1;
+}
+
+/**
+ * Is the cursor at pos visible without scrolling?
+ */
+static int in_view(const editor_t *ed, size_t pos) {
+    return pos >= ed->offset && pos - ed->offset <= line_width(ed);
+}
+
+/**
+ * Queue a full redraw: prompt, the visible part of the line, clear to
+ * end of line, then put the cursor back
+ */
+static void refresh_line(editor_t *ed) {
+    size_t width = line_width(ed);
+    char seq[32];
+    
+    if (ed->pos < ed->offset) {
+        ed->offset = ed->pos;
+    } else if (ed->pos - ed->offset > width) {
+        ed->offset = ed->pos - width;
+    }
+    size_t shown = ed->len - ed->offset;
+    if (shown > width) shown = width;
+    
+    // Edits queued since the last barrier only touched this line, which
+    // is about to be redrawn whole: drop them (a paste redraws once)
+    ed->out.len = ed->out.mark;
+    out_puts(&ed->out, "\r");
+    out_append(&ed->out, ed->prompt, ed->prompt_len);
+    out_append_text(&ed->out, ed->buf + ed->offset, shown);
+    out_puts(&ed->out, "\x1b[K");
+    if (ed->pos - ed->offset < shown) {
+        snprintf(seq, sizeof(seq), "\x1b[%zuD", shown - (ed->pos - ed->offset));
+        out_puts(&ed->out, seq);
+    }
+}
+
+/**
+ * Move the cursor, with a relative cursor motion when no scrolling is needed
+ */
+static void move_cursor(editor_t *ed, size_t pos) {
+    char seq[32];
+    
+    if (pos == ed->pos) return;
+    if (!in_view(ed, pos)) {
+        ed->pos = pos;
+        refresh_line(ed);
+        return;
+    }
+    if (pos + 1 == ed->pos) {
+        out_puts(&ed->out, "\b");
+    } else if (pos == ed->pos + 1) {
+        out_puts(&ed->out, "\x1b[C");
+    } else if (pos < ed->pos) {
+        snprintf(seq, sizeof(seq), "\x1b[%zuD", ed->pos - pos);
+        out_puts(&ed->out, seq);
+    } else {
+        snprintf(seq, sizeof(seq), "\x1b[%zuC", pos - ed->pos);
+        out_puts(&ed->out, seq);
+    }
+    ed->pos = pos;
+}
+
+static void insert_text(editor_t *ed, const char *s, size_t n) {
+    if (ed->len + n + 1 > ed->cap) {
+        size_t cap = ed->cap * 2;
+        while (cap < ed->len + n + 1) cap *= 2;
+        char *buf = realloc(ed->buf, cap);
+        if (buf == NULL) return;
+        ed->buf = buf;
+        ed->cap = cap;
+    }
+    size_t tail = ed->len - ed->pos;
+    memmove(ed->buf + ed->pos + n, ed->buf + ed->pos, tail + 1);
+    memcpy(ed->buf + ed->pos, s, n);
+    ed->len += n;
+    ed->pos += n;
+    
+    // If the whole line still fits, echo the text and rewrite what follows
+    if (ed->len - ed->offset <= line_width(ed)) {
+        out_append_text(&ed->out, ed->buf + ed->pos - n, n + tail);
+        if (tail > 0) {
+            char seq[32];
+            snprintf(seq, sizeof(seq), "\x1b[%zuD", tail);
+            out_puts(&ed->out, seq);
+        }
+    } else {
+        refresh_line(ed);
+    }
+}
+
+/**
+ * Remove buf[from, to) and leave the cursor at from
+ */
+static void delete_text(editor_t *ed, size_t from, size_t to) {
+    if (from >= to) return;
+    size_t tail = ed->len - to;
+    memmove(ed->buf + from, ed->buf + to, tail + 1);
+    ed->len -= to - from;
+    
+    // No scrolling involved: step back, rewrite what follows and clear
+    if (ed->offset == 0 && in_view(ed, from) && in_view(ed, ed->pos) && ed->len <= line_width(ed)) {
+        move_cursor(ed, from);
+        out_append_text(&ed->out, ed->buf + from, tail);
+        out_puts(&ed->out, "\x1b[K");
+        if (tail > 0) {
+            char seq[32];
+            snprintf(seq, sizeof(seq), "\x1b[%zuD", tail);
+            out_puts(&ed->out, seq);
+        }
+    } else {
+        ed->pos = from;
+        refresh_line(ed);
+    }
+}
+
+static void kill_text_range(editor_t *ed, size_t from, size_t to) {
+    if (from >= to) return;
+    char *copy = malloc(to - from);
+    if (copy) {
+        memcpy(copy, ed->buf + from, to - from);
+        free(kill_text);
+        kill_text = copy;
+        kill_len = to - from;
+    }
+    delete_text(ed, from, to);
+}
+
+static void set_line(editor_t *ed, const char *text) {
+    size_t n = strlen(text);
+    ed->len = ed->pos = 0;
+    ed->buf[0] = '\0';
+    ed->offset = 0;
+    if (n + 1 > ed->cap) {
+        char *buf = realloc(ed->buf, n + 1);
+        if (buf == NULL) return;
+        ed->buf = buf;
+        ed->cap = n + 1;
+    }
+    memcpy(ed->buf, text, n + 1);
+    ed->len = ed->pos = n;
+    refresh_line(ed);
+}
+
+static size_t word_left(const editor_t *ed) {
+    size_t i = ed->pos;
+    while (i > 0 && ed->buf[i - 1] == ' ') i--;
+    while (i > 0 && ed->buf[i - 1] != ' ') i--;
+    return i;
+}
+
+static size_t word_right(const editor_t *ed) {
+    size_t i = ed->pos;
+    while (i < ed->len && ed->buf[i] == ' ') i++;
+    while (i < ed->len && ed->buf[i] != ' ') i++;
+    return i;
+}
+
+/**
+ * Up/Down: step through the history, keeping the new line aside
+ */
+static void history_step(editor_t *ed, int delta) {
+    if (ed->history_index < 0 && delta > 0) {
+        // Down on a fresh line: nothing below, no need to read the file
+        return;
+    }
+    int length = history_length();
+    if (ed->history_index < 0) {
+        ed->history_index = length;
+    }
+    int index = ed->history_index + delta;
+    
+    if (index < 0 || index > length) {
+        return;
+    }
+    if (ed->history_index == length) {
+        free(ed->saved);
+        ed->saved = strdup(ed->buf);
+    }
+    ed->history_index = index;
+    set_line(ed, (index == length) ? (ed->saved ? ed->saved : "") : history_get(index));
+}
+
+/**
+ * List the candidates in columns below the line, asking first when
+ * there are many
+ */
+static void list_matches(editor_t *ed) {
+    match_list_t *m = &ed->comp.matches;
+    
+    out_puts(&ed->out, "\n");
+    if (m->count > COMPLETION_QUERY_ITEMS) {
+        char question[64];
+        snprintf(question, sizeof(question), "Display all %d possibilities? (y or n)", m->count);
+        out_puts(&ed->out, question);
+        int key = read_key(ed);
+        out_puts(&ed->out, "\n");
+        if (key != 'y' && key != 'Y' && key != ' ') {
+            out_barrier(&ed->out);
+            refresh_line(ed);
+            return;
+        }
+    }
+    
+    qsort(m->items, m->count, sizeof(char *), compare_matches);
+    size_t widest = 0;
+    for (int i = 0; i < m->count; i++) {
+        size_t n = strlen(m->items[i]);
+        if (n > widest) widest = n;
+    }
+    size_t per_row = ed->cols / (widest + 2);
+    if (per_row == 0) per_row = 1;
+    
+    for (int i = 0; i < m->count; i++) {
+        size_t n = strlen(m->items[i]);
+        out_append(&ed->out, m->items[i], n);
+        if ((i + 1) % per_row == 0 || i == m->count - 1) {
+            out_puts(&ed->out, "\n");
+        } else {
+            for (size_t pad = n; pad < widest + 2; pad++) out_puts(&ed->out, " ");
+        }
+    }
+    out_barrier(&ed->out);
+    refresh_line(ed);
+}
+
+/**
+ * Act on the candidates found so far
+ * While the directory is still being read the editor keeps taking keys
+ * and comes back here as names arrive (any key but Tab drops the
+ * completion); it stops early once the outcome cannot change.
+ */
+static void update_completion(editor_t *ed, int state) {
+    match_list_t *m = &ed->comp.matches;
+    size_t word_len = ed->pos - ed->comp.word_start;
+    int listing = (ed->tab_count >= 2);
+    
+    if (state == DIRCACHE_SCANNING) {
+        // More names only shorten the shared prefix: two candidates
+        // that already stop at the typed word leave nothing to insert
+        if (listing || m->count < 2 || m->common_len > word_len) {
+            ed->comp_pending = 1;
+            return;
+        }
+    }
+    ed->comp_pending = 0;
+    
+    if (m->count > 0 && m->common_len > word_len) {
+        insert_text(ed, m->items[0] + word_len, m->common_len - word_len);
+        if (m->count == 1 && m->items[0][m->common_len - 1] != '/') {
+            insert_text(ed, " ", 1);
+        }
+        ed->tab_count = 0;
+        return;
+    }
+    if (m->count < 2 || !listing) {
+        out_puts(&ed->out, "\a");
+        out_barrier(&ed->out);
+        return;
+    }
+    list_matches(ed);
+}
+
+/**
+ * Tab: complete as far as the matches agree; a second Tab lists them
+ */
+static void complete_line(editor_t *ed) {
+    ed->tab_count++;
+    
+    // Completion only looks at the text before the cursor
+    char saved = ed->buf[ed->pos];
+    ed->buf[ed->pos] = '\0';
+    int state = find_completions(&ed->comp, ed->buf, (int)ed->pos);
+    ed->buf[ed->pos] = saved;
+    
+    update_completion(ed, state);
+}
+
+/**
+ * Ctrl-R: incremental reverse search through the history
+ * Typing narrows the search and Ctrl-R steps to the next match. Enter
+ * runs the match, other editing keys keep it for editing, Ctrl-G/Ctrl-C
+ * restore the line.
+ * @return: 1 if the line should be run now, 0 to keep editing
+ */
+static int reverse_search(editor_t *ed) {
+    char query[256] = "";
+    size_t qlen = 0;
+    int matches[HISTSEARCH_MAX_MATCHES];
+    int num_matches = 0, current = 0;
+    const char *shown = "";
+    
+    while (1) {
+        // Redraw "(reverse-i-search)`query': match", cut to the screen width
+        char line[1024];
+        int n = snprintf(line, sizeof(line), "(reverse-i-search)`%s': %s", query, shown);
+        size_t visible = (n < 0) ? 0 : (size_t)n;
+        if (visible >= sizeof(line)) visible = sizeof(line) - 1;
+        if (visible >= ed->cols) visible = ed->cols - 1;
+        ed->out.len = ed->out.mark;
+        out_puts(&ed->out, "\r");
+        out_append(&ed->out, line, visible);
+        out_puts(&ed->out, "\x1b[K");
+        
+        int key = read_key(ed);
+        if (key == EDIT_CTRL('r')) {
+            if (current + 1 < num_matches) {
+                current++;
+            }
+        } else if (key == EDIT_KEY_BACKSPACE || key == EDIT_CTRL('h')) {
+            if (qlen == 0) continue;
+            query[--qlen] = '\0';
+            num_matches = history_search(query, matches, HISTSEARCH_MAX_MATCHES);
+            current = 0;
+        } else if (key >= 32 && key < 127) {
+            if (qlen >= sizeof(query) - 1) continue;
+            // A longer query cannot match if the shorter one did not
+            int hopeless = (qlen > 0 && num_matches == 0);
+            query[qlen++] = (char)key;
+            query[qlen] = '\0';
+            if (!hopeless) {
+                num_matches = history_search(query, matches, HISTSEARCH_MAX_MATCHES);
+                current = 0;
+            }
+        } else {
+            // Leave search mode
+            int accept = (num_matches > 0 && key != EDIT_CTRL('g') && key != EDIT_CTRL('c') && key != EDIT_KEY_EOF);
+            if (accept) {
+                set_line(ed, shown);
+            } else {
+                refresh_line(ed);
+            }
+            return accept && (key == '\r' || key == '\n');
+        }
+        shown = (num_matches > 0) ? history_get(matches[current]) : "";
+    }
+}
+
+/**
+ * Edit a line in raw mode
+ * @return: The line, or NULL on EOF
+ */
+static char *edit_line(const char *prompt) {
+    editor_t ed;
+    
+    memset(&ed, 0, sizeof(ed));
+    ed.prompt = prompt;
+    ed.prompt_len = strlen(prompt);
+    ed.cols = terminal_columns();
+    ed.cap = 128;
+    ed.buf = malloc(ed.cap);
+    if (ed.buf == NULL) {
+        return NULL;
+    }
+    ed.buf[0] = '\0';
+    // The history file is parsed on the first Up, Ctrl-P or Ctrl-R, not per prompt
+    ed.history_index = -1;
+    
+    refresh_line(&ed);
+    
+    int eof = 0;
+    int done = 0;
+    while (!done) {
+        int key = read_key(&ed);
+        if (key == EDIT_KEY_COMPLETION) {
+            if (ed.comp_pending) {
+                update_completion(&ed, continue_completions(&ed.comp));
+            }
+            continue;
+        }
+        if (key != '\t') {
+            ed.tab_count = 0;
+            ed.comp_pending = 0;
+        }
+        
+        switch (key) {
+        case EDIT_KEY_EOF:
+            eof = (ed.len == 0);
+            done = 1;
+            break;
+        case '\r':
+        case '\n':
+            done = 1;
+            break;
+        case EDIT_CTRL('c'):
+            // Abandon the line
+            move_cursor(&ed, ed.len);
+            out_puts(&ed.out, "^C");
+            ed.len = ed.pos = 0;
+            ed.buf[0] = '\0';
+            done = 1;
+            break;
+        case EDIT_CTRL('d'):
+            if (ed.len == 0) {
+                eof = 1;
+                done = 1;
+            } else {
+                delete_text(&ed, ed.pos, ed.pos < ed.len ? ed.pos + 1 : ed.pos);
+            }
+            break;
+        case EDIT_KEY_DELETE:
+            delete_text(&ed, ed.pos, ed.pos < ed.len ? ed.pos + 1 : ed.pos);
+            break;
+        case EDIT_KEY_BACKSPACE:
+        case EDIT_CTRL('h'):
+            if (ed.pos > 0) {
+                delete_text(&ed, ed.pos - 1, ed.pos);
+            }
+            break;
+        case EDIT_CTRL('a'):
+        case EDIT_KEY_HOME:
+            move_cursor(&ed, 0);
+            break;
+        case EDIT_CTRL('e'):
+        case EDIT_KEY_END:
+            move_cursor(&ed, ed.len);
+            break;
+        case EDIT_CTRL('b'):
+        case EDIT_KEY_LEFT:
+            if (ed.pos > 0) move_cursor(&ed, ed.pos - 1);
+            break;
+        case EDIT_CTRL('f'):
+        case EDIT_KEY_RIGHT:
+            if (ed.pos < ed.len) move_cursor(&ed, ed.pos + 1);
+            break;
+        case EDIT_KEY_WORD_LEFT:
+            move_cursor(&ed, word_left(&ed));
+            break;
+        case EDIT_KEY_WORD_RIGHT:
+            move_cursor(&ed, word_right(&ed));
+            break;
+        case EDIT_CTRL('k'):
+            kill_text_range(&ed, ed.pos, ed.len);
+            break;
+        case EDIT_CTRL('u'):
+            kill_text_range(&ed, 0, ed.pos);
+            break;
+        case EDIT_CTRL('w'):
+        case EDIT_KEY_KILL_WORD_LEFT:
+            kill_text_range(&ed, word_left(&ed), ed.pos);
+            break;
+        case EDIT_KEY_KILL_WORD:
+            kill_text_range(&ed, ed.pos, word_right(&ed));
+            break;
+        case EDIT_CTRL('y'):
+            if (kill_text) insert_text(&ed, kill_text, kill_len);
+            break;
+        case EDIT_CTRL('p'):
+        case EDIT_KEY_UP:
+            history_step(&ed, -1);
+            break;
+        case EDIT_CTRL('n'):
+        case EDIT_KEY_DOWN:
+            history_step(&ed, 1);
+            break;
+        case EDIT_CTRL('l'):
+            out_puts(&ed.out, "\x1b[H\x1b[2J");
+            out_barrier(&ed.out);
+            ed.cols = terminal_columns();
+            refresh_line(&ed);
+            break;
+        case EDIT_CTRL('r'):
+            done = reverse_search(&ed);
+            break;
+        case '\t':
+            complete_line(&ed);
+            break;
+        default:
+            if (key >= 32 && key < 256 && key != EDIT_KEY_BACKSPACE) {
+                char c = (char)key;
+                insert_text(&ed, &c, 1);
+            }
+            break;
+        }
+    }
+    
+    // Leave the cursor below the whole line (output post-processing
+    // is left on, so "\n" is a full newline); main prints it on EOF
+    if (!eof) {
+        move_cursor(&ed, ed.len);
+        out_puts(&ed.out, "\n");
+    }
+    out_flush(&ed.out);
+    free(ed.out.data);
+    free(ed.saved);
+    free_completion(&ed.comp);
+    
+    if (eof) {
+        free(ed.buf);
+        return NULL;
+    }
+    return ed.buf;
+}
+
+char *read_line(const char *prompt) {
+    const char *term = vars_get("TERM");
+    
+    if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO) ||
+        (term && (strcmp(term, "dumb") == 0 || *term == '\0'))) {
+        return read_line_plain(prompt);
+    }
+    
+    fflush(stdout);
+    if (!enable_raw_mode()) {
+        return read_line_plain(prompt);
+    }
+    char *line = edit_line(prompt);
+    disable_raw_mode();
+    return line;
+}
 #endif
+
@@ -0,0 +1,429 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#include "vars.h"
+#include "history.h"
+#include "error.h"
+#include "hashtable.h"
+
+#ifdef _WIN32
+#define ENVIRON _environ
+#else
+extern char **environ;
+#define ENVIRON environ
+#endif
+
+// Initial slot count of the variable table (power of two)
+#define VARS_INITIAL_CAPACITY 128
+
+/**
+ * One variable, stored as a single string so envp can point at it
+ */
+typedef struct var {
+    char *entry;          // "NAME=value", or "NAME" without a value; NULL marks an empty slot
+    size_t name_len;
+    uint32_t hash;
+    int flags;            // VAR_* flags
+} var_t;
+
+static hashtable_t table;
+static int imported = 0;          // The environment has been read in
+
+// Environment for spawned commands, rebuilt after exported variables change
+static char **envp = NULL;
+static size_t envp_len = 0;
+static size_t envp_cap = 0;
+static int envp_valid = 0;
+
+/**
+ * A variable replaced by vars_save()
+ */
+typedef struct saved_var {
+    char *name;
+    int existed;
+    var_t old;            // Its slot contents, entry still owned
+} saved_var_t;
+
+struct vars_saved {
+    int count;
+    saved_var_t vars[];
+};
+
+static int var_is_empty(const void *slot) {
+    return ((const var_t *)slot)->entry == NULL;
+}
+
+static uint64_t var_hash(const void *slot) {
+    return ((const var_t *)slot)->hash;
+}
+
+static const hashtable_type_t var_table_type = {
+    sizeof(var_t), VARS_INITIAL_CAPACITY, "variables", var_is_empty, var_hash
+};
+
+/**
+ * A name being looked up
+ */
+typedef struct var_key {
+    const char *name;
+    size_t len;
+    uint32_t hash;
+} var_key_t;
+
+static int var_matches(const void *slot, const void *key) {
+    const var_t *var = slot;
+    const var_key_t *k = key;
+    return var->hash == k->hash && var->name_len == k->len && memcmp(var->entry, k->name, k->len) == 0;
+}
+
+/**
+ * Slot holding a name, or the empty slot where it would go
+ */
+static var_t *find_var(const char *name, size_t len, uint32_t hash) {
+    var_key_t key = {name, len, hash};
+    return hashtable_find(&table, &var_table_type, hash, var_matches, &key);
+}
+
+/**
+ * Put a variable into its slot (the name must not be present)
+ */
+static void insert_var(const var_t *var) {
+    var_key_t key = {var->entry, var->name_len, var->hash};
+    *(var_t *)hashtable_put(&table, &var_table_type, var->hash, var_matches, &key, NULL) = *var;
+}
+
+/**
+ * Read the process environment into the table (once)
+ */
+static void import_environ(void) {
+    if (imported) {
+        return;
+    }
+    imported = 1;
+    hashtable_reserve(&table, &var_table_type);
+
+    for (char **e = ENVIRON; e && *e; e++) {
+        const char *eq = strchr(*e, '=');
+        if (eq == NULL || eq == *e) {
+            continue;
+        }
+        var_t var;
+        var.name_len = (size_t)(eq - *e);
+        var.hash = hash_fnv1a(*e, var.name_len);
+        if (find_var(*e, var.name_len, var.hash)->entry != NULL) {
+            continue;  // First definition wins, as with getenv()
+        }
+        var.entry = strdup(*e);
+        if (var.entry == NULL) {
+            error_allocation("variables");
+            exit(EXIT_FAILURE);
+        }
+        var.flags = VAR_EXPORT;
+        insert_var(&var);
+    }
+}
+
+/**
+ * React to a change of a variable the shell itself uses
+ */
+static void variable_changed(const char *name, size_t len, int flags) {
+    if (flags & VAR_EXPORT) {
+        envp_valid = 0;
+    }
+    if (len == 8 && memcmp(name, "HISTSIZE", 8) == 0) {
+        history_update_size();
+    }
+    // PATH users (cmdhash, completion) compare it on every lookup
+}
+
+/**
+ * Store a new string for a name, replacing any previous one
+ * @param entry: "NAME=value" or "NAME" (ownership passes to the table)
+ * @param len: Length of the name
+ * @param flags: Flags to add
+ * @param keep_value: Keep an existing value (entry has none)
+ */
+static void store(char *entry, size_t len, int flags, int keep_value) {
+    uint32_t hash = hash_fnv1a(entry, len);
+    var_t *old = find_var(entry, len, hash);
+
+    if (old->entry != NULL) {
+        old->flags |= flags;
+        if (keep_value) {
+            free(entry);
+        } else {
+            free(old->entry);
+            old->entry = entry;
+        }
+        variable_changed(old->entry, len, old->flags);
+        return;
+    }
+
+    var_t var = {entry, len, hash, flags};
+    insert_var(&var);
+    variable_changed(entry, len, flags);
+}
+
+int vars_valid_name(const char *name, size_t len) {
+    if (len == 0 || !(isalpha((unsigned char)name[0]) || name[0] == '_')) {
+        return 0;
+    }
+    for (size_t i = 1; i < len; i++) {
+        if (!(isalnum((unsigned char)name[i]) || name[i] == '_')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+const char *vars_get(const char *name) {
+    import_environ();
+
+    size_t len = strlen(name);
+    const var_t *var = find_var(name, len, hash_fnv1a(name, len));
+    if (var->entry == NULL || var->entry[len] != '=') {
+        return NULL;
+    }
+    return var->entry + len + 1;
+}
+
+int vars_set(const char *name, const char *value, int flags) {
+    size_t len = strlen(name);
+    if (!vars_valid_name(name, len)) {
+        return -1;
+    }
+    import_environ();
+
+    size_t value_len = value ? strlen(value) : 0;
+    char *entry = malloc(len + value_len + 2);
+    if (entry == NULL) {
+        error_allocation("variables");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(entry, name, len);
+    entry[len] = '\0';
+    if (value) {
+        entry[len] = '=';
+        memcpy(entry + len + 1, value, value_len + 1);
+    }
+    store(entry, len, flags, value == NULL);
+    return 0;
+}
+
+int vars_assign(const char *assignment, int flags) {
+    const char *eq = strchr(assignment, '=');
+    if (eq == NULL || !vars_valid_name(assignment, (size_t)(eq - assignment))) {
+        return -1;
+    }
+    import_environ();
+
+    char *entry = strdup(assignment);
+    if (entry == NULL) {
+        error_allocation("variables");
+        exit(EXIT_FAILURE);
+    }
+    store(entry, (size_t)(eq - assignment), flags, 0);
+    return 0;
+}
+
+void vars_unset(const char *name) {
+    import_environ();
+
+    size_t len = strlen(name);
+    var_t *var = find_var(name, len, hash_fnv1a(name, len));
+    if (var->entry == NULL) {
+        return;
+    }
+    char *entry = var->entry;
+    int flags = var->flags;
+    hashtable_remove(&table, &var_table_type, var);
+    variable_changed(name, len, flags);
+    free(entry);
+}
+
+int vars_export(const char *name, int exported) {
+    size_t len = strlen(name);
+    if (!vars_valid_name(name, len)) {
+        return -1;
+    }
+    import_environ();
+
+    var_t *var = find_var(name, len, hash_fnv1a(name, len));
+    if (var->entry == NULL) {
+        return exported ? vars_set(name, NULL, VAR_EXPORT) : 0;
+    }
+    if (exported) {
+        var->flags |= VAR_EXPORT;
+    } else {
+        var->flags &= ~VAR_EXPORT;
+    }
+    envp_valid = 0;
+    return 0;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const var_t *x = *(const var_t *const *)a;
+    const var_t *y = *(const var_t *const *)b;
+    size_t len = (x->name_len < y->name_len) ? x->name_len : y->name_len;
+    int cmp = memcmp(x->entry, y->entry, len);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (x->name_len > y->name_len) - (x->name_len < y->name_len);
+}
+
+void vars_list_exported(FILE *out) {
+    import_environ();
+
+    const var_t *slots = table.slots;
+    const var_t **list = malloc((table.count ? table.count : 1) * sizeof(var_t *));
+    if (list == NULL) {
+        error_allocation("variables");
+        return;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < table.capacity; i++) {
+        if (slots[i].entry != NULL && (slots[i].flags & VAR_EXPORT)) {
+            list[n++] = &slots[i];
+        }
+    }
+    qsort(list, n, sizeof(var_t *), compare_entries);
+
+    for (size_t i = 0; i < n; i++) {
+        const var_t *var = list[i];
+        fprintf(out, "export %.*s", (int)var->name_len, var->entry);
+        if (var->entry[var->name_len] == '=') {
+            // Single-quoted, so the output can be read back in
+            fputs("='", out);
+            for (const char *p = var->entry + var->name_len + 1; *p; p++) {
+                if (*p == '\'') {
+                    fputs("'\\''", out);
+                } else {
+                    fputc(*p, out);
+                }
+            }
+            fputc('\'', out);
+        }
+        fputc('\n', out);
+    }
+    free(list);
+}
+
+char **vars_environ(void) {
+    import_environ();
+    if (envp_valid) {
+        return envp;
+    }
+
+    if (table.count + 1 > envp_cap) {
+        envp_cap = table.count + 1;
+        free(envp);
+        envp = malloc(envp_cap * sizeof(char *));
+        if (envp == NULL) {
+            error_allocation("variables");
+            exit(EXIT_FAILURE);
+        }
+    }
+    const var_t *slots = table.slots;
+    envp_len = 0;
+    for (size_t i = 0; i < table.capacity; i++) {
+        // Declared-only names ("export NAME") are not in the environment
+        if (slots[i].entry != NULL && (slots[i].flags & VAR_EXPORT) &&
+            slots[i].entry[slots[i].name_len] == '=') {
+            envp[envp_len++] = slots[i].entry;
+        }
+    }
+    envp[envp_len] = NULL;
+    envp_valid = 1;
+    return envp;
+}
+
+char **vars_environ_with(arena_t *arena, char *const *assigns) {
+    char **base = vars_environ();
+    size_t num_assigns = 0;
+    while (assigns[num_assigns]) num_assigns++;
+
+    char **result = arena_alloc(arena, (envp_len + num_assigns + 1) * sizeof(char *));
+    size_t n = 0;
+    for (size_t i = 0; i < envp_len; i++) {
+        size_t len = strchr(base[i], '=') - base[i] + 1;
+        int overridden = 0;
+        for (size_t j = 0; j < num_assigns && !overridden; j++) {
+            overridden = (strncmp(base[i], assigns[j], len) == 0);
+        }
+        if (!overridden) {
+            result[n++] = base[i];
+        }
+    }
+    for (size_t j = 0; j < num_assigns; j++) {
+        result[n++] = assigns[j];
+    }
+    result[n] = NULL;
+    return result;
+}
+
+vars_saved_t *vars_save(char *const *assigns) {
+    int num_assigns = 0;
+    while (assigns[num_assigns]) num_assigns++;
+
+    import_environ();
+    vars_saved_t *saved = malloc(sizeof(vars_saved_t) + num_assigns * sizeof(saved_var_t));
+    if (saved == NULL) {
+        error_allocation("variables");
+        exit(EXIT_FAILURE);
+    }
+    saved->count = 0;
+
+    for (int i = 0; i < num_assigns; i++) {
+        size_t len = strchr(assigns[i], '=') - assigns[i];
+        saved_var_t *s = &saved->vars[saved->count++];
+        s->name = malloc(len + 1);
+        if (s->name == NULL) {
+            error_allocation("variables");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(s->name, assigns[i], len);
+        s->name[len] = '\0';
+
+        // Park the current definition, untouched, for vars_restore()
+        var_t *var = find_var(assigns[i], len, hash_fnv1a(assigns[i], len));
+        s->existed = (var->entry != NULL);
+        if (s->existed) {
+            s->old = *var;
+            hashtable_remove(&table, &var_table_type, var);
+        }
+        vars_assign(assigns[i], VAR_EXPORT);
+    }
+    return saved;
+}
+
+void vars_restore(vars_saved_t *saved) {
+    // Newest first, so a name assigned twice ends up with its original
+    for (int i = saved->count - 1; i >= 0; i--) {
+        saved_var_t *s = &saved->vars[i];
+        vars_unset(s->name);
+        if (s->existed) {
+            insert_var(&s->old);
+            variable_changed(s->old.entry, s->old.name_len, s->old.flags);
+        }
+        free(s->name);
+    }
+    free(saved);
+}
+
+void vars_free(void) {
+    var_t *slots = table.slots;
+    for (size_t i = 0; i < table.capacity; i++) {
+        free(slots[i].entry);
+    }
+    hashtable_free(&table);
+    imported = 0;
+    free(envp);
+    envp = NULL;
+    envp_len = 0;
+    envp_cap = 0;
+    envp_valid = 0;
+}
@@ -0,0 +1,719 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vm.h"
+#include "error.h"
+#include "expand.h"
+#include "shell.h"
+#include "vars.h"
+#include "hashtable.h"
+
+// Instructions: an opcode and one integer operand
+typedef enum {
+    OP_RUN,         // Run pipeline consts[arg]
+    OP_RUN_TAIL,    // Same, with nothing after it: gets the caller's flags
+    OP_ASYNC,       // Start NODE_ASYNC consts[arg] in the background
+    OP_JUMP,        // Go to arg
+    OP_JUMP_FAIL,   // Go to arg if the status is non-zero
+    OP_JUMP_OK,     // Go to arg if the status is zero
+    OP_NOT,         // Negate the status (! pipeline)
+    OP_STATUS,      // Set the status to arg
+    OP_LOOP,        // Enter a loop ending at arg; `continue` goes to the next instruction
+    OP_FOR,         // Expand the words of NODE_FOR consts[arg]; `continue` goes to the next instruction
+    OP_NEXT,        // Set the loop variable to the next word, or go to arg if none is left
+    OP_SAVE,        // Keep the status of a finished iteration
+    OP_POP,         // Leave the loop with the status of its last iteration
+    OP_CASE,        // Skip the jump table that follows to the matching arm of NODE_CASE consts[arg]
+    OP_DEFUN,       // Define NODE_FUNCTION consts[arg]
+    OP_END          // Return the status
+} opcode_t;
+
+typedef struct instr {
+    int op;
+    int arg;
+} instr_t;
+
+/**
+ * Compiled code for one list
+ */
+struct code {
+    const instr_t *ops;          // Instructions, ending with OP_END
+    const void **consts;         // Pipelines and nodes named by operands
+    int max_loops;               // Deepest loop nesting, sizes the frame stack
+    parsecache_entry_t *owner;   // Cache entry holding the code and the tree
+};
+
+/**
+ * Compiler state for one code block
+ * Instructions are collected in malloc'd arrays and copied into the
+ * arena once complete, so nested blocks can be compiled in between.
+ */
+typedef struct compiler {
+    arena_t *arena;
+    parsecache_entry_t *owner;
+    instr_t *ops;
+    int len;
+    int capacity;
+    const void **consts;
+    int num_consts;
+    int consts_capacity;
+    int loops;                   // Loops open at this point
+    int max_loops;
+} compiler_t;
+
+/**
+ * One running loop
+ */
+typedef struct frame {
+    int brk;                     // Instruction after the loop
+    int cont;                    // Where `continue` resumes
+    int status;                  // Status of the last finished iteration
+    const char *name;            // for: loop variable
+    char **words;                // for: expanded word list
+    int num_words;
+    int next;                    // for: index of the next word
+    arena_mark_t mark;           // Arena before the loop's own allocations
+} frame_t;
+
+/**
+ * A shell function
+ */
+typedef struct function {
+    char *name;
+    const struct parsed_command *body;   // One compound stage
+    parsecache_entry_t *owner;           // Cache entry holding the body, kept pinned
+    struct function *next;               // Hash chain
+} function_t;
+
+#define FUNCTION_BUCKETS 64             // Power of two
+
+static function_t *functions[FUNCTION_BUCKETS];
+static int num_functions = 0;
+
+static int pending = 0;         // VM_BREAK, VM_CONTINUE or VM_RETURN under way
+static int pending_count = 0;   // Loops still to leave for break/continue N
+static int loop_depth = 0;      // Loops running, over every active vm_run
+static int function_depth = 0;  // Function calls running
+
+static const struct code *compile_code(arena_t *arena, struct node *tree, parsecache_entry_t *owner);
+static void compile_node(compiler_t *c, struct node *node);
+
+/**
+ * Append an instruction
+ * @return: Its index, for patching the operand later
+ */
+static int emit(compiler_t *c, int op, int arg) {
+    if (c->len == c->capacity) {
+        c->capacity = c->capacity ? c->capacity * 2 : 16;
+        c->ops = realloc(c->ops, c->capacity * sizeof(instr_t));
+        if (!c->ops) {
+            error_allocation("compiler");
+            exit(EXIT_FAILURE);
+        }
+    }
+    c->ops[c->len].op = op;
+    c->ops[c->len].arg = arg;
+    return c->len++;
+}
+
+/**
+ * Add a constant operand
+ * @return: Its index
+ */
+static int add_const(compiler_t *c, const void *value) {
+    if (c->num_consts == c->consts_capacity) {
+        c->consts_capacity = c->consts_capacity ? c->consts_capacity * 2 : 8;
+        c->consts = realloc(c->consts, c->consts_capacity * sizeof(void *));
+        if (!c->consts) {
+            error_allocation("compiler");
+            exit(EXIT_FAILURE);
+        }
+    }
+    c->consts[c->num_consts] = value;
+    return c->num_consts++;
+}
+
+/**
+ * Point a jump emitted earlier at the next instruction
+ */
+static void patch_here(compiler_t *c, int at) {
+    c->ops[at].arg = c->len;
+}
+
+/**
+ * Compile the compound stages of a pipeline into code of their own
+ */
+static void compile_stages(compiler_t *c, struct pipeline *pipeline) {
+    for (int i = 0; i < pipeline->num_cmds; i++) {
+        struct parsed_command *cmd = &pipeline->commands[i];
+        if (cmd->kind != CMD_SIMPLE) {
+            cmd->code = compile_code(c->arena, cmd->body, c->owner);
+        }
+    }
+}
+
+static void compile_pipeline(compiler_t *c, struct pipeline *pipeline) {
+    struct parsed_command *first = &pipeline->commands[0];
+
+    if (pipeline->num_cmds == 1 && first->kind == CMD_GROUP &&
+        first->num_redirs == 0 && !pipeline->timed) {
+        // A compound command on its own runs inline: no call, no new code
+        compile_node(c, first->body);
+    } else {
+        compile_stages(c, pipeline);
+        emit(c, OP_RUN, add_const(c, pipeline));
+    }
+    if (pipeline->negated) {
+        emit(c, OP_NOT, 0);
+    }
+}
+
+/**
+ * while/until: test, body, jump back
+ *     LOOP end; top: cond; JUMP_FAIL exit; body; SAVE; JUMP top; exit: POP; end:
+ */
+static void compile_while(compiler_t *c, struct node *node) {
+    int loop = emit(c, OP_LOOP, 0);
+    int top = c->len;
+
+    compile_node(c, node->left);
+    int exit = emit(c, (node->type == NODE_WHILE) ? OP_JUMP_FAIL : OP_JUMP_OK, 0);
+    compile_node(c, node->right);
+    emit(c, OP_SAVE, 0);
+    emit(c, OP_JUMP, top);
+    patch_here(c, exit);
+    emit(c, OP_POP, 0);
+    patch_here(c, loop);
+}
+
+/**
+ * for: words expanded once, one NEXT per iteration
+ *     LOOP end; FOR; next: NEXT exit; body; SAVE; JUMP next; exit: POP; end:
+ */
+static void compile_for(compiler_t *c, struct node *node) {
+    int loop = emit(c, OP_LOOP, 0);
+    emit(c, OP_FOR, add_const(c, node));
+    int next = emit(c, OP_NEXT, 0);
+
+    compile_node(c, node->right);
+    emit(c, OP_SAVE, 0);
+    emit(c, OP_JUMP, next);
+    patch_here(c, next);
+    emit(c, OP_POP, 0);
+    patch_here(c, loop);
+}
+
+/**
+ * case: a jump table indexed by the matching arm, then the arms
+ *     CASE; JUMP arm0; ... JUMP armN-1; STATUS 0; JUMP end; arm0: list; JUMP end; ...
+ */
+static void compile_case(compiler_t *c, struct node *node) {
+    int n = node->num_items;
+    int ends[n + 1];
+
+    emit(c, OP_CASE, add_const(c, node));
+    int table = c->len;
+    for (int i = 0; i < n; i++) {
+        emit(c, OP_JUMP, 0);
+    }
+    emit(c, OP_STATUS, 0);
+    ends[n] = emit(c, OP_JUMP, 0);
+
+    for (int i = 0; i < n; i++) {
+        patch_here(c, table + i);
+        if (node->items[i].body) {
+            compile_node(c, node->items[i].body);
+        } else {
+            emit(c, OP_STATUS, 0);
+        }
+        ends[i] = emit(c, OP_JUMP, 0);
+    }
+    for (int i = 0; i <= n; i++) {
+        patch_here(c, ends[i]);
+    }
+}
+
+static void compile_node(compiler_t *c, struct node *node) {
+    int jump, end;
+
+    switch (node->type) {
+        case NODE_PIPELINE:
+            compile_pipeline(c, node->pipeline);
+            break;
+
+        case NODE_AND:
+        case NODE_OR:
+            // The right side runs only if the left one succeeded (&&) or failed (||)
+            compile_node(c, node->left);
+            jump = emit(c, (node->type == NODE_AND) ? OP_JUMP_FAIL : OP_JUMP_OK, 0);
+            compile_node(c, node->right);
+            patch_here(c, jump);
+            break;
+
+        case NODE_SEQ:
+            compile_node(c, node->left);
+            compile_node(c, node->right);
+            break;
+
+        case NODE_ASYNC:
+            // The job may run as a plain pipeline or in a subshell
+            if (node->left->type == NODE_PIPELINE) {
+                compile_stages(c, node->left->pipeline);
+            }
+            node->code = compile_code(c->arena, node->left, c->owner);
+            emit(c, OP_ASYNC, add_const(c, node));
+            break;
+
+        case NODE_IF:
+            // An if without else and a false condition has status 0
+            compile_node(c, node->left);
+            jump = emit(c, OP_JUMP_FAIL, 0);
+            compile_node(c, node->right);
+            end = emit(c, OP_JUMP, 0);
+            patch_here(c, jump);
+            if (node->alt) {
+                compile_node(c, node->alt);
+            } else {
+                emit(c, OP_STATUS, 0);
+            }
+            patch_here(c, end);
+            break;
+
+        case NODE_WHILE:
+        case NODE_UNTIL:
+        case NODE_FOR:
+            if (++c->loops > c->max_loops) {
+                c->max_loops = c->loops;
+            }
+            if (node->type == NODE_FOR) {
+                compile_for(c, node);
+            } else {
+                compile_while(c, node);
+            }
+            c->loops--;
+            break;
+
+        case NODE_CASE:
+            compile_case(c, node);
+            break;
+
+        case NODE_FUNCTION:
+            compile_stages(c, node->pipeline);
+            emit(c, OP_DEFUN, add_const(c, node));
+            break;
+    }
+}
+
+/**
+ * Compile a list into a code block of its own
+ */
+static const struct code *compile_code(arena_t *arena, struct node *tree, parsecache_entry_t *owner) {
+    compiler_t c;
+
+    memset(&c, 0, sizeof(c));
+    c.arena = arena;
+    c.owner = owner;
+    compile_node(&c, tree);
+    emit(&c, OP_END, 0);
+
+    // A pipeline followed (through jumps) by the end is in tail position
+    for (int i = 0; i < c.len; i++) {
+        if (c.ops[i].op == OP_RUN) {
+            int next = i + 1;
+            for (int hops = 0; c.ops[next].op == OP_JUMP && hops < c.len; hops++) {
+                next = c.ops[next].arg;
+            }
+            if (c.ops[next].op == OP_END) {
+                c.ops[i].op = OP_RUN_TAIL;
+            }
+        }
+    }
+
+    struct code *code = arena_alloc(arena, sizeof(struct code));
+    instr_t *ops = arena_alloc(arena, c.len * sizeof(instr_t));
+    memcpy(ops, c.ops, c.len * sizeof(instr_t));
+    code->ops = ops;
+    code->consts = NULL;
+    if (c.num_consts > 0) {
+        code->consts = arena_alloc(arena, c.num_consts * sizeof(void *));
+        memcpy(code->consts, c.consts, c.num_consts * sizeof(void *));
+    }
+    code->max_loops = c.max_loops;
+    code->owner = owner;
+
+    free(c.ops);
+    free(c.consts);
+    return code;
+}
+
+const struct code *vm_compile(arena_t *arena, struct node *tree, parsecache_entry_t *owner) {
+    return compile_code(arena, tree, owner);
+}
+
+/**
+ * Match one character against the pattern element at p: ?, [set],
+ * \c or a literal character
+ * @return: Length of the element if it matches, 0 if not
+ */
+static int match_char(const char *p, unsigned char c) {
+    if (*p == '?') {
+        return 1;
+    }
+    if (*p == '\\' && p[1] != '\0') {
+        return ((unsigned char)p[1] == c) ? 2 : 0;
+    }
+    if (*p == '[') {
+        const char *q = p + 1;
+        int negate = (*q == '!' || *q == '^');
+        int found = 0;
+        if (negate) {
+            q++;
+        }
+        // A ] right after the opening [ (or [!) is part of the set
+        const char *first = q;
+        while (*q != '\0' && (*q != ']' || q == first)) {
+            if (q[1] == '-' && q[2] != '\0' && q[2] != ']') {
+                if ((unsigned char)q[0] <= c && c <= (unsigned char)q[2]) {
+                    found = 1;
+                }
+                q += 3;
+            } else {
+                if ((unsigned char)*q == c) {
+                    found = 1;
+                }
+                q++;
+            }
+        }
+        if (*q != ']') {
+            // No closing bracket: a literal [
+            return (c == '[') ? 1 : 0;
+        }
+        return (found != negate) ? (int)(q + 1 - p) : 0;
+    }
+    return (*p != '\0' && (unsigned char)*p == c) ? 1 : 0;
+}
+
+/**
+ * Match a string against a case pattern (*, ?, [set] and \ escapes)
+ * A failed match after a * retries from one character further, which
+ * needs no recursion since only the last * can ever have to move.
+ * @return: 1 on a match, 0 otherwise
+ */
+static int pattern_match(const char *p, const char *s) {
+    const char *star_p = NULL;
+    const char *star_s = NULL;
+
+    while (*s != '\0') {
+        if (*p == '*') {
+            star_p = ++p;
+            star_s = s;
+            continue;
+        }
+        int n = match_char(p, (unsigned char)*s);
+        if (n > 0) {
+            p += n;
+            s++;
+        } else if (star_p) {
+            p = star_p;
+            s = ++star_s;
+        } else {
+            return 0;
+        }
+    }
+    while (*p == '*') {
+        p++;
+    }
+    return *p == '\0';
+}
+
+/**
+ * Find the first arm of a case command whose pattern matches
+ * A quoted pattern matches its text literally ("*" is a star).
+ * @return: Index of the arm, or num_items if none matches
+ */
+static int case_arm(arena_t *arena, const struct node *node) {
+    arena_mark_t mark = arena_mark(arena);
+    const char *subject = expand_word(arena, node->words);
+    int arm = node->num_items;
+
+    for (int i = 0; i < node->num_items && arm == node->num_items; i++) {
+        const struct case_item *item = &node->items[i];
+        for (int j = 0; j < item->num_patterns; j++) {
+            const token_t *pattern = &item->patterns[j];
+            const char *text = expand_word(arena, pattern);
+            if ((pattern->flags & WORD_QUOTED) ? strcmp(text, subject) == 0
+                                               : pattern_match(text, subject)) {
+                arm = i;
+                break;
+            }
+        }
+    }
+
+    arena_rewind(arena, mark);
+    return arm;
+}
+
+static function_t **function_slot(const char *name) {
+    function_t **link = &functions[hash_fnv1a_str(name) & (FUNCTION_BUCKETS - 1)];
+    while (*link && strcmp((*link)->name, name) != 0) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+/**
+ * Define (or redefine) a function from a NODE_FUNCTION node
+ * @param node: Definition
+ * @param owner: Cache entry holding it, pinned for as long as it is used
+ */
+static void define_function(const struct node *node, parsecache_entry_t *owner) {
+    const char *name = node->name->start;
+    function_t **link = function_slot(name);
+    function_t *f = *link;
+
+    parsecache_retain(owner);
+    if (f) {
+        parsecache_release(f->owner);
+    } else {
+        f = malloc(sizeof(function_t));
+        if (f == NULL || (f->name = strdup(name)) == NULL) {
+            error_allocation("function");
+            exit(EXIT_FAILURE);
+        }
+        f->next = NULL;
+        *link = f;
+        num_functions++;
+    }
+    f->body = &node->pipeline->commands[0];
+    f->owner = owner;
+}
+
+const struct parsed_command *vm_function(const char *name) {
+    // Scripts without functions pay one comparison per command
+    if (num_functions == 0 || name == NULL) {
+        return NULL;
+    }
+    function_t *f = *function_slot(name);
+    return f ? f->body : NULL;
+}
+
+void vm_unset_function(const char *name) {
+    function_t **link = function_slot(name);
+    function_t *f = *link;
+
+    if (f) {
+        *link = f->next;
+        parsecache_release(f->owner);
+        free(f->name);
+        free(f);
+        num_functions--;
+    }
+}
+
+int vm_function_begin(void) {
+    if (function_depth >= VM_MAX_FUNCTION_DEPTH) {
+        fprintf(stderr, "myshell: maximum function nesting level exceeded (%d)\n",
+                VM_MAX_FUNCTION_DEPTH);
+        return -1;
+    }
+    function_depth++;
+    return 0;
+}
+
+void vm_function_end(void) {
+    function_depth--;
+    if (pending == VM_RETURN) {
+        pending = 0;
+    }
+}
+
+int vm_loop_depth(void) {
+    return loop_depth;
+}
+
+int vm_function_depth(void) {
+    return function_depth;
+}
+
+void vm_control(int what, int count) {
+    pending = what;
+    pending_count = count;
+}
+
+void vm_free(void) {
+    for (int i = 0; i < FUNCTION_BUCKETS; i++) {
+        while (functions[i]) {
+            function_t *f = functions[i];
+            functions[i] = f->next;
+            parsecache_release(f->owner);
+            free(f->name);
+            free(f);
+        }
+    }
+    num_functions = 0;
+}
+
+/**
+ * Leave the innermost loop, giving back what it allocated
+ */
+static void pop_frame(frame_t *frames, int *depth, arena_t *arena) {
+    (*depth)--;
+    loop_depth--;
+    arena_rewind(arena, frames[*depth].mark);
+}
+
+/**
+ * Carry out a pending break, continue or return
+ * @return: 0 if it ended in this code (pc updated), -1 if it has to go on
+ *          in the caller: a return, or loops outside this code
+ */
+static int unwind(frame_t *frames, int *depth, int *pc, arena_t *arena) {
+    while (*depth > 0 && pending != VM_RETURN) {
+        frame_t *f = &frames[*depth - 1];
+        if (pending_count > 1) {
+            pending_count--;
+            pop_frame(frames, depth, arena);
+            continue;
+        }
+        if (pending == VM_BREAK) {
+            *pc = f->brk;
+            pop_frame(frames, depth, arena);
+        } else {
+            *pc = f->cont;
+        }
+        pending = 0;
+        return 0;
+    }
+    while (*depth > 0) {
+        pop_frame(frames, depth, arena);
+    }
+    return -1;
+}
+
+const struct pipeline *vm_single_pipeline(const struct code *code) {
+    if ((code->ops[0].op == OP_RUN || code->ops[0].op == OP_RUN_TAIL) && code->ops[1].op == OP_END) {
+        return code->consts[code->ops[0].arg];
+    }
+    return NULL;
+}
+
+int vm_run(const struct code *code, arena_t *arena, int flags) {
+    frame_t frames[code->max_loops > 0 ? code->max_loops : 1];
+    frame_t *f;
+    const struct node *node;
+    int depth = 0;
+    int pc = 0;
+    int status = shell.last_status;
+
+    while (1) {
+        const instr_t *in = &code->ops[pc++];
+        switch (in->op) {
+            case OP_RUN:
+            case OP_RUN_TAIL:
+                status = eval_pipeline(code->consts[in->arg], (in->op == OP_RUN_TAIL) ? flags : 0, 0);
+                if (status < 0) {
+                    loop_depth -= depth;
+                    return status;
+                }
+                if (pending && unwind(frames, &depth, &pc, arena) < 0) {
+                    return status;
+                }
+                break;
+
+            case OP_ASYNC:
+                status = eval_async(code->consts[in->arg]);
+                if (status < 0) {
+                    loop_depth -= depth;
+                    return status;
+                }
+                break;
+
+            case OP_JUMP:
+                pc = in->arg;
+                break;
+
+            case OP_JUMP_FAIL:
+                if (status != 0) {
+                    pc = in->arg;
+                }
+                break;
+
+            case OP_JUMP_OK:
+                if (status == 0) {
+                    pc = in->arg;
+                }
+                break;
+
+            case OP_NOT:
+                status = !status;
+                shell.last_status = status;
+                break;
+
+            case OP_STATUS:
+                status = in->arg;
+                shell.last_status = status;
+                break;
+
+            case OP_LOOP:
+                f = &frames[depth++];
+                loop_depth++;
+                f->brk = in->arg;
+                f->cont = pc;
+                f->status = 0;
+                f->words = NULL;
+                f->mark = arena_mark(arena);
+                break;
+
+            case OP_FOR:
+                // The list is expanded once, before the first iteration
+                node = code->consts[in->arg];
+                f = &frames[depth - 1];
+                f->name = node->name->start;
+                if (node->num_words < 0) {
+                    f->words = shell.argv;
+                    f->num_words = shell.argc;
+                } else {
+                    f->words = expand_fields(arena, node->words, node->num_words, 1, &f->num_words);
+                    if (expand_failed()) {
+                        f->num_words = 0;
+                        f->status = 1;
+                    }
+                }
+                f->next = 0;
+                f->cont = pc;
+                break;
+
+            case OP_NEXT:
+                f = &frames[depth - 1];
+                if (f->next < f->num_words) {
+                    vars_set(f->name, f->words[f->next++], 0);
+                } else {
+                    pc = in->arg;
+                }
+                break;
+
+            case OP_SAVE:
+                frames[depth - 1].status = status;
+                break;
+
+            case OP_POP:
+                status = frames[depth - 1].status;
+                shell.last_status = status;
+                pop_frame(frames, &depth, arena);
+                break;
+
+            case OP_CASE:
+                pc += case_arm(arena, code->consts[in->arg]);
+                break;
+
+            case OP_DEFUN:
+                define_function(code->consts[in->arg], code->owner);
+                status = 0;
+                shell.last_status = 0;
+                break;
+
+            case OP_END:
+                return status;
+        }
+    }
+}